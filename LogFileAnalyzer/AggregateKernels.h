@@ -0,0 +1,231 @@
+/**
+ * @file AggregateKernels.h
+ * @brief Batch kernels for the aggregates of the query engine.
+ *
+ * @details Queries (QueryEngine.h) run over their rows in batches of
+ * kBatchRows. The predicates leave a selection vector of the batch's matching
+ * rows, and each kernel below then reduces the selected values in one tight
+ * loop:
+ *  - gatherSelected() copies the selected values of a column into a dense
+ *    buffer. If every row of the batch matched, the column is used in place.
+ *  - summarizeValues() finds count, sum, min and max. With SSE2 it works on
+ *    four values at a time: min and max are built from compares and masks
+ *    (SSE2 has no 32-bit min/max), and sums are widened to 64 bits so they
+ *    cannot overflow.
+ *  - CodeCounter counts dictionary codes. For small dictionaries every code
+ *    has four counters, used in turn by consecutive rows, so runs of the same
+ *    code do not wait on each other's increments.
+ *  - CodeSummarizer finds count, sum, min and max per code, with four lanes
+ *    of its own in the same way.
+ *  - bucketValues() computes histogram buckets. With SSE2 it divides four
+ *    values at a time through a float reciprocal and corrects each quotient
+ *    exactly.
+ *
+ * A batch is small enough that its selection, gathered values and per-batch
+ * counters stay in the L1 cache between one kernel and the next.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <vector>
+
+#include "BitOps.h"
+
+constexpr std::size_t kBatchRows = 4096;
+
+// --- Group Statistics ---
+struct GroupStats {
+    long long count = 0;
+    long long latencySum = 0;
+    int latencyMin = INT_MAX;
+    int latencyMax = INT_MIN;
+
+    void add(int latency) {
+        ++count;
+        latencySum += latency;
+        latencyMin = std::min(latencyMin, latency);
+        latencyMax = std::max(latencyMax, latency);
+    }
+
+    void merge(const GroupStats& other) {
+        count += other.count;
+        latencySum += other.latencySum;
+        latencyMin = std::min(latencyMin, other.latencyMin);
+        latencyMax = std::max(latencyMax, other.latencyMax);
+    }
+};
+
+// --- Gathering ---
+// out[i] = column[selection[i]] for the first 'count' selected rows.
+template<typename T>
+void gatherSelected(const T* column, const std::uint32_t* selection, std::size_t count, T* out) {
+    for (std::size_t i = 0; i < count; ++i) {
+        out[i] = column[selection[i]];
+    }
+}
+
+// --- Summaries ---
+#ifdef LFA_SSE2
+namespace kernel_sse2 {
+inline __m128i select(__m128i mask, __m128i ifSet, __m128i ifClear) {
+    return _mm_or_si128(_mm_and_si128(mask, ifSet), _mm_andnot_si128(mask, ifClear));
+}
+inline __m128i min32(__m128i a, __m128i b) { return select(_mm_cmpgt_epi32(a, b), b, a); }
+inline __m128i max32(__m128i a, __m128i b) { return select(_mm_cmpgt_epi32(a, b), a, b); }
+} // namespace kernel_sse2
+#endif
+
+// Adds 'count' dense values to 'stats'.
+inline void summarizeValues(const std::int32_t* values, std::size_t count, GroupStats& stats) {
+    std::size_t i = 0;
+#ifdef LFA_SSE2
+    if (count >= 8) {
+        using namespace kernel_sse2;
+        __m128i low = _mm_set1_epi32(INT_MAX);
+        __m128i high = _mm_set1_epi32(INT_MIN);
+        __m128i sum = _mm_setzero_si128();
+        for (; i + 4 <= count; i += 4) {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+            low = min32(low, v);
+            high = max32(high, v);
+            const __m128i sign = _mm_srai_epi32(v, 31);
+            sum = _mm_add_epi64(sum, _mm_unpacklo_epi32(v, sign));
+            sum = _mm_add_epi64(sum, _mm_unpackhi_epi32(v, sign));
+        }
+        alignas(16) std::int32_t lows[4];
+        alignas(16) std::int32_t highs[4];
+        alignas(16) std::int64_t sums[2];
+        _mm_store_si128(reinterpret_cast<__m128i*>(lows), low);
+        _mm_store_si128(reinterpret_cast<__m128i*>(highs), high);
+        _mm_store_si128(reinterpret_cast<__m128i*>(sums), sum);
+        stats.count += static_cast<long long>(i);
+        stats.latencySum += sums[0] + sums[1];
+        stats.latencyMin = std::min({ stats.latencyMin, lows[0], lows[1], lows[2], lows[3] });
+        stats.latencyMax = std::max({ stats.latencyMax, highs[0], highs[1], highs[2], highs[3] });
+    }
+#endif
+    for (; i < count; ++i) {
+        stats.add(values[i]);
+    }
+}
+
+// --- Per-Code Aggregates ---
+// Dictionaries of up to kMaxLaneCodes codes get four lanes of counters per
+// code; larger ones one, to keep them small.
+constexpr std::size_t kMaxLaneCodes = 4096;
+
+// Count, sum, min and max of the values of each code.
+class CodeSummarizer {
+public:
+    explicit CodeSummarizer(std::size_t codes)
+        : lanes_(codes <= kMaxLaneCodes ? 4 : 1), stats_(codes * lanes_) {}
+
+    // groups[codes[i]].add(values[i]) for every i.
+    void add(const std::uint32_t* codes, const std::int32_t* values, std::size_t count) {
+        std::size_t i = 0;
+        if (lanes_ == 4) {
+            GroupStats* stats = stats_.data();
+            for (; i + 4 <= count; i += 4) {
+                stats[4 * codes[i]].add(values[i]);
+                stats[4 * codes[i + 1] + 1].add(values[i + 1]);
+                stats[4 * codes[i + 2] + 2].add(values[i + 2]);
+                stats[4 * codes[i + 3] + 3].add(values[i + 3]);
+            }
+        }
+        for (; i < count; ++i) {
+            stats_[lanes_ * codes[i]].add(values[i]);
+        }
+    }
+
+    GroupStats stats(std::uint32_t code) const {
+        GroupStats total;
+        for (std::size_t lane = 0; lane < lanes_; ++lane) {
+            total.merge(stats_[lanes_ * code + lane]);
+        }
+        return total;
+    }
+
+private:
+    std::size_t lanes_;
+    std::vector<GroupStats> stats_;
+};
+
+// Counts of each code.
+class CodeCounter {
+public:
+    explicit CodeCounter(std::size_t codes)
+        : lanes_(codes <= kMaxLaneCodes ? 4 : 1), counts_(codes * lanes_, 0) {}
+
+    void add(const std::uint32_t* codes, std::size_t count) {
+        std::size_t i = 0;
+        if (lanes_ == 4) {
+            long long* counts = counts_.data();
+            for (; i + 4 <= count; i += 4) {
+                ++counts[4 * codes[i]];
+                ++counts[4 * codes[i + 1] + 1];
+                ++counts[4 * codes[i + 2] + 2];
+                ++counts[4 * codes[i + 3] + 3];
+            }
+        }
+        for (; i < count; ++i) {
+            ++counts_[lanes_ * codes[i]];
+        }
+    }
+
+    long long count(std::uint32_t code) const {
+        long long total = 0;
+        for (std::size_t lane = 0; lane < lanes_; ++lane) {
+            total += counts_[lanes_ * code + lane];
+        }
+        return total;
+    }
+
+private:
+    std::size_t lanes_;
+    std::vector<long long> counts_;
+};
+
+// --- Histogram Buckets ---
+inline long long floorDivide(long long value, long long divisor) {
+    const long long quotient = value / divisor;
+    return quotient - ((value % divisor != 0 && (value < 0) != (divisor < 0)) ? 1 : 0);
+}
+
+// Writes floor(values[i] / width) - firstBucket to buckets[i]. 'firstBucket'
+// must be floor(min / width) of the values, and the last bucket no more than
+// UINT32_MAX past it.
+inline void bucketValues(const std::int32_t* values, std::size_t count, int width, long long firstBucket,
+                         std::uint32_t* buckets) {
+    std::size_t i = 0;
+#ifdef LFA_SSE2
+    const long long origin = firstBucket * width;
+    // Offsets from 'origin' below 2^23 and widths below 2^23 keep every float
+    // below exact, so one correction step each way makes the quotient exact.
+    constexpr long long kExact = 1 << 23;
+    if (width < kExact && origin >= INT_MIN) {
+        const __m128i base = _mm_set1_epi32(static_cast<int>(origin));
+        const __m128 divisor = _mm_set1_ps(static_cast<float>(width));
+        const __m128 reciprocal = _mm_set1_ps(1.0f / static_cast<float>(width));
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128i limit = _mm_set1_epi32(static_cast<int>(kExact));
+        for (; i + 4 <= count; i += 4) {
+            const __m128i offset = _mm_sub_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i)), base);
+            const __m128i inRange = _mm_andnot_si128(_mm_srai_epi32(offset, 31), _mm_cmplt_epi32(offset, limit)); // 0 <= offset < 2^23
+            if (_mm_movemask_epi8(inRange) != 0xFFFF) {
+                break; // Leave the rest of the batch to the exact integer loop.
+            }
+            const __m128 x = _mm_cvtepi32_ps(offset);
+            __m128 q = _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_mul_ps(x, reciprocal)));
+            q = _mm_sub_ps(q, _mm_and_ps(_mm_cmpgt_ps(_mm_mul_ps(q, divisor), x), one));
+            q = _mm_add_ps(q, _mm_and_ps(_mm_cmple_ps(_mm_mul_ps(_mm_add_ps(q, one), divisor), x), one));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(buckets + i), _mm_cvttps_epi32(q));
+        }
+    }
+#endif
+    for (; i < count; ++i) {
+        buckets[i] = static_cast<std::uint32_t>(floorDivide(values[i], width) - firstBucket);
+    }
+}
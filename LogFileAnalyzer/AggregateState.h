@@ -0,0 +1,198 @@
+/**
+ * @file AggregateState.h
+ * @brief Saving a LogSummary to a small binary file and merging such files.
+ *
+ * @details Each log host can run the analyzer locally with --emit-state and ship
+ * only the resulting state file (usually well under a kilobyte). The `merge`
+ * subcommand then combines any number of state files into one fleet-wide
+ * report. Merging is just LogSummary::merge, which is associative and
+ * commutative, so merging state files in any grouping gives the same result as
+ * analyzing the concatenated logs. (With --dedup, duplicates are only detected
+ * within each host's own log.)
+ *
+ * File layout, version 1:
+ *
+ *     "LFAS" | u16 version (LE) | section* | tag 0 | fixed64 checksum
+ *     section = u8 tag | varint byteLength | payload
+ *
+ * Readers skip sections with tags they do not know, so new kinds of aggregate
+ * can be added without breaking older readers. The checksum is hashLine() of
+ * every byte before it.
+ */
+
+#pragma once
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+#include "Aggregates.h"
+#include "BinaryIO.h"
+#include "Hash.h"
+
+constexpr std::string_view kStateMagic = "LFAS";
+constexpr std::uint16_t kStateVersion = 1;
+
+// Section tags. Never reuse a number for a different meaning.
+enum StateSection : std::uint8_t {
+    kSectionEnd = 0,
+    kSectionLineCounters = 1,  // totalLines, malformedLines, duplicateLines
+    kSectionLatency = 2,       // count, sum, min, max
+    kSectionActionStatus = 3,  // nested action -> status -> count
+};
+
+// --- Writing ---
+inline std::string serializeSummary(const LogSummary& summary) {
+    std::string out;
+    ByteWriter writer(out);
+    writer.bytes(kStateMagic);
+    writer.u8(kStateVersion & 0xFF);
+    writer.u8(kStateVersion >> 8);
+
+    const auto section = [&](StateSection tag, const std::string& payload) {
+        writer.u8(tag);
+        writer.string(payload);
+    };
+
+    std::string payload;
+    ByteWriter body(payload);
+    body.varint(static_cast<std::uint64_t>(summary.totalLines));
+    body.varint(static_cast<std::uint64_t>(summary.malformedLines));
+    body.varint(static_cast<std::uint64_t>(summary.duplicateLines));
+    section(kSectionLineCounters, payload);
+
+    payload.clear();
+    body.varint(static_cast<std::uint64_t>(summary.latency.count));
+    body.svarint(summary.latency.sumMs);
+    body.svarint(summary.latency.minMs);
+    body.svarint(summary.latency.maxMs);
+    section(kSectionLatency, payload);
+
+    payload.clear();
+    body.varint(summary.actionStatusCounts.size());
+    for (const auto& action : summary.actionStatusCounts) {
+        body.string(action.first);
+        body.varint(action.second.size());
+        for (const auto& status : action.second) {
+            body.string(status.first);
+            body.varint(static_cast<std::uint64_t>(status.second));
+        }
+    }
+    section(kSectionActionStatus, payload);
+
+    writer.u8(kSectionEnd);
+    writer.fixed64(hashLine(out));
+    return out;
+}
+
+// --- Reading ---
+// Parses a state blob into 'summary' (replacing its contents). On failure,
+// 'error' explains what was wrong and 'summary' should not be used.
+inline bool deserializeSummary(std::string_view data, LogSummary& summary, std::string& error) {
+    summary = LogSummary();
+    if (data.size() < kStateMagic.size() + 2 + 1 + 8 || data.substr(0, kStateMagic.size()) != kStateMagic) {
+        error = "not an analyzer state file";
+        return false;
+    }
+    const std::string_view body = data.substr(0, data.size() - 8);
+    ByteReader trailer(data.substr(data.size() - 8));
+    std::uint64_t checksum = 0;
+    if (!trailer.fixed64(checksum) || checksum != hashLine(body)) {
+        error = "checksum mismatch (file is truncated or corrupt)";
+        return false;
+    }
+
+    ByteReader reader(body.substr(kStateMagic.size()));
+    std::uint8_t versionLow = 0;
+    std::uint8_t versionHigh = 0;
+    reader.u8(versionLow);
+    reader.u8(versionHigh);
+    const std::uint16_t version = static_cast<std::uint16_t>(versionLow | (versionHigh << 8));
+    if (version != kStateVersion) {
+        error = "unsupported state version " + std::to_string(version);
+        return false;
+    }
+
+    for (;;) {
+        std::uint8_t tag = 0;
+        std::string_view payload;
+        if (!reader.u8(tag)) {
+            error = "missing end marker";
+            return false;
+        }
+        if (tag == kSectionEnd) {
+            return true;
+        }
+        if (!reader.string(payload)) {
+            error = "truncated section";
+            return false;
+        }
+
+        ByteReader in(payload);
+        bool ok = true;
+        std::uint64_t a = 0, b = 0, c = 0;
+        switch (tag) {
+        case kSectionLineCounters:
+            ok = in.varint(a) && in.varint(b) && in.varint(c);
+            summary.totalLines = static_cast<long long>(a);
+            summary.malformedLines = static_cast<long long>(b);
+            summary.duplicateLines = static_cast<long long>(c);
+            break;
+        case kSectionLatency: {
+            std::int64_t sum = 0, minimum = 0, maximum = 0;
+            ok = in.varint(a) && in.svarint(sum) && in.svarint(minimum) && in.svarint(maximum);
+            summary.latency.count = static_cast<long long>(a);
+            summary.latency.sumMs = sum;
+            summary.latency.minMs = static_cast<int>(minimum);
+            summary.latency.maxMs = static_cast<int>(maximum);
+            break;
+        }
+        case kSectionActionStatus: {
+            std::uint64_t actions = 0;
+            ok = in.varint(actions);
+            for (std::uint64_t i = 0; ok && i < actions; ++i) {
+                std::string_view action;
+                std::uint64_t statuses = 0;
+                ok = in.string(action) && in.varint(statuses);
+                CountMap& counts = summary.actionStatusCounts[std::string(action)];
+                for (std::uint64_t j = 0; ok && j < statuses; ++j) {
+                    std::string_view status;
+                    ok = in.string(status) && in.varint(a);
+                    incrementCount(counts, status, static_cast<long long>(a));
+                }
+            }
+            break;
+        }
+        default:
+            break; // A section from a newer writer; skipping it is safe.
+        }
+        if (!ok) {
+            error = "malformed section " + std::to_string(tag);
+            return false;
+        }
+    }
+}
+
+// --- Files ---
+inline bool writeStateFile(const std::string& path, const LogSummary& summary) {
+    const std::string data = serializeSummary(summary);
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(data.data(), static_cast<std::streamsize>(data.size()));
+    return static_cast<bool>(file);
+}
+
+inline bool readStateFile(const std::string& path, LogSummary& summary, std::string& error) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        error = "cannot open " + path;
+        return false;
+    }
+    std::ostringstream contents;
+    contents << file.rdbuf();
+    if (!deserializeSummary(contents.str(), summary, error)) {
+        error = path + ": " + error;
+        return false;
+    }
+    return true;
+}
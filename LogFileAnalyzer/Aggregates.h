@@ -0,0 +1,89 @@
+/**
+ * @file Aggregates.h
+ * @brief The summary metrics accumulated while scanning a log.
+ *
+ * @details A LogSummary is cheap to update per record and can be merged with
+ * another summary, so independent scans (for example one per worker thread) can
+ * each build their own and combine them at the end.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <climits>
+#include <map>
+#include <string>
+#include <string_view>
+
+#include "LogRecord.h"
+
+// --- Latency Statistics ---
+struct LatencyStats {
+    long long count = 0;
+    long long sumMs = 0;
+    int minMs = INT_MAX;
+    int maxMs = INT_MIN;
+
+    void add(int latencyMs) {
+        ++count;
+        sumMs += latencyMs;
+        minMs = std::min(minMs, latencyMs);
+        maxMs = std::max(maxMs, latencyMs);
+    }
+
+    void merge(const LatencyStats& other) {
+        count += other.count;
+        sumMs += other.sumMs;
+        minMs = std::min(minMs, other.minMs);
+        maxMs = std::max(maxMs, other.maxMs);
+    }
+
+    double meanMs() const { return count == 0 ? 0.0 : static_cast<double>(sumMs) / count; }
+};
+
+// Counts keyed by a string. std::less<> allows lookups with a std::string_view
+// straight from the line buffer, so counting an existing key never allocates.
+using CountMap = std::map<std::string, long long, std::less<>>;
+
+inline void incrementCount(CountMap& counts, std::string_view key, long long by = 1) {
+    auto found = counts.find(key);
+    if (found == counts.end()) {
+        found = counts.emplace(std::string(key), 0).first;
+    }
+    found->second += by;
+}
+
+// --- The Whole Report ---
+struct LogSummary {
+    long long totalLines = 0;      // Every line read, before any filtering.
+    long long malformedLines = 0;  // Lines that did not parse.
+    long long duplicateLines = 0;  // Lines dropped by the --dedup stage.
+
+    // Action -> Status -> count, e.g. counts["LOGIN"]["FAILURE"].
+    std::map<std::string, CountMap, std::less<>> actionStatusCounts;
+    LatencyStats latency;
+
+    long long recordCount() const { return totalLines - malformedLines - duplicateLines; }
+
+    void add(const LogRecord& record) {
+        auto action = actionStatusCounts.find(record.action);
+        if (action == actionStatusCounts.end()) {
+            action = actionStatusCounts.emplace(std::string(record.action), CountMap()).first;
+        }
+        incrementCount(action->second, record.status);
+        latency.add(record.latencyMs);
+    }
+
+    void merge(const LogSummary& other) {
+        totalLines += other.totalLines;
+        malformedLines += other.malformedLines;
+        duplicateLines += other.duplicateLines;
+        for (const auto& action : other.actionStatusCounts) {
+            CountMap& mine = actionStatusCounts[action.first];
+            for (const auto& status : action.second) {
+                incrementCount(mine, status.first, status.second);
+            }
+        }
+        latency.merge(other.latency);
+    }
+};
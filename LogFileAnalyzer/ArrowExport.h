@@ -0,0 +1,396 @@
+/**
+ * @file ArrowExport.h
+ * @brief Writing parsed log rows as Apache Arrow IPC (file or stream format).
+ *
+ * @details The output can be opened directly by pyarrow, pandas, polars, DuckDB
+ * and other Arrow readers, which can memory-map the file without copying it.
+ * It is written against the Arrow columnar format specification (metadata
+ * version V5) with a small built-in FlatBuffers encoder, so there is no
+ * dependency on the Arrow C++ library.
+ *
+ * Schema (no column is nullable):
+ *     timestamp   timestamp[s, tz=UTC]
+ *     ip          uint32 (IPv4 address, most significant octet first)
+ *     user_id     dictionary<int32, utf8>
+ *     action      dictionary<int32, utf8>
+ *     status      dictionary<int32, utf8>
+ *     latency_ms  int32
+ *     details     utf8
+ *
+ * Rows are written in record batches while the log is still being parsed. Each
+ * batch is preceded by a dictionary batch per dictionary column holding only
+ * the values first seen since the previous batch (a "delta"), so the
+ * dictionaries never have to be known in advance.
+ *
+ * Buffers are written straight from memory, so the byte order of the data is
+ * that of the host; every platform this project builds for is little-endian,
+ * which is what the schema declares.
+ */
+
+#pragma once
+
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "BinaryIO.h"
+#include "ColumnarTable.h"
+#include "FileChunks.h"
+#include "FlatBufferBuilder.h"
+
+enum class ArrowLayout { File, Stream };
+
+inline bool parseArrowLayout(std::string_view text, ArrowLayout& out) {
+    if (text == "file") { out = ArrowLayout::File; return true; }
+    if (text == "stream") { out = ArrowLayout::Stream; return true; }
+    return false;
+}
+
+// --- Constants From the Arrow Format ---
+namespace arrow_format {
+constexpr std::int16_t kMetadataV5 = 4;
+constexpr std::uint8_t kHeaderSchema = 1;
+constexpr std::uint8_t kHeaderDictionaryBatch = 2;
+constexpr std::uint8_t kHeaderRecordBatch = 3;
+constexpr std::uint8_t kTypeInt = 2;
+constexpr std::uint8_t kTypeUtf8 = 5;
+constexpr std::uint8_t kTypeTimestamp = 10;
+constexpr std::int16_t kTimeUnitSecond = 0;
+constexpr std::uint32_t kContinuation = 0xFFFFFFFFu;
+constexpr std::string_view kFileMagic = "ARROW1";
+}
+
+// --- Writer ---
+class ArrowIpcWriter {
+public:
+    bool open(const std::string& path, ArrowLayout layout) {
+        layout_ = layout;
+        out_.open(path, std::ios::binary | std::ios::trunc);
+        if (!out_.is_open()) {
+            return false;
+        }
+        if (layout_ == ArrowLayout::File) {
+            write(std::string(arrow_format::kFileMagic) + std::string(2, '\0')); // Padded to 8 bytes.
+        }
+        FlatBufferBuilder builder;
+        const FlatBufferBuilder::Ref schema = buildSchema(builder);
+        writeMessage(builder, arrow_format::kHeaderSchema, schema, std::string());
+        return static_cast<bool>(out_);
+    }
+
+    // Writes every row currently in 'table' as one record batch, preceded by
+    // the dictionary values it uses that have not been written yet.
+    bool writeBatch(const ColumnarTable& table) {
+        const Dictionary* dictionaries[3] = { &table.users, &table.actions, &table.statuses };
+        for (std::int64_t id = 0; id < 3; ++id) {
+            const std::size_t from = dictionarySent_[id];
+            const std::size_t to = dictionaries[id]->size();
+            if (from == to && batches_ > 0) {
+                continue;
+            }
+            writeDictionary(id, *dictionaries[id], from, to, batches_ > 0);
+            dictionarySent_[id] = to;
+        }
+        writeRecordBatch(table);
+        ++batches_;
+        rows_ += table.rows();
+        return static_cast<bool>(out_);
+    }
+
+    // Ends the stream, and for the file format writes the footer.
+    bool close() {
+        ByteWriter end(scratch_);
+        scratch_.clear();
+        end.fixed32(arrow_format::kContinuation);
+        end.fixed32(0);
+        write(scratch_);
+        if (layout_ == ArrowLayout::File) {
+            FlatBufferBuilder builder;
+            const std::string footer = buildFooter(builder);
+            scratch_.clear();
+            end.bytes(footer);
+            end.fixed32(static_cast<std::uint32_t>(footer.size()));
+            end.bytes(arrow_format::kFileMagic);
+            write(scratch_);
+        }
+        out_.close();
+        return !out_.fail();
+    }
+
+    std::size_t batches() const { return batches_; }
+    std::size_t rows() const { return rows_; }
+
+private:
+    using Ref = FlatBufferBuilder::Ref;
+
+    // Where a message sits in the file, for the footer.
+    struct Block {
+        std::int64_t offset;
+        std::int32_t metadataLength;
+        std::int64_t bodyLength;
+    };
+
+    // The body of a message: buffers back to back, each padded to 8 bytes,
+    // plus the Buffer and FieldNode descriptors that point into it.
+    struct Body {
+        std::string bytes;
+        std::string buffers;
+        std::string nodes;
+
+        void buffer(const void* data, std::size_t size) {
+            ByteWriter descriptor(buffers);
+            descriptor.fixed64(bytes.size());
+            descriptor.fixed64(size);
+            bytes.append(static_cast<const char*>(data), size);
+            bytes.append((8 - bytes.size() % 8) % 8, '\0');
+        }
+        void node(std::size_t length) {
+            ByteWriter descriptor(nodes);
+            descriptor.fixed64(length);
+            descriptor.fixed64(0); // Null count; nothing is nullable.
+        }
+        // A non-nullable column still has a validity buffer slot; it is empty.
+        void noValidity() { buffer(nullptr, 0); }
+    };
+
+    // --- Schema ---
+    static Ref intType(FlatBufferBuilder& builder, int bitWidth, bool isSigned) {
+        builder.startTable();
+        builder.addInt32(0, bitWidth);
+        builder.addBool(1, isSigned);
+        return builder.endTable();
+    }
+
+    static Ref field(FlatBufferBuilder& builder, std::string_view name, std::uint8_t typeType, Ref type, Ref dictionary) {
+        const Ref nameRef = builder.createString(name);
+        const Ref children = builder.createTableVector({});
+        builder.startTable();
+        builder.addOffset(0, nameRef);
+        builder.addBool(1, false);
+        builder.addUint8(2, typeType);
+        builder.addOffset(3, type);
+        if (dictionary != 0) {
+            builder.addOffset(4, dictionary);
+        }
+        builder.addOffset(5, children);
+        return builder.endTable();
+    }
+
+    static Ref dictionaryField(FlatBufferBuilder& builder, std::string_view name, std::int64_t id) {
+        const Ref indexType = intType(builder, 32, true);
+        builder.startTable();
+        builder.addInt64(0, id);
+        builder.addOffset(1, indexType);
+        builder.addBool(2, false);
+        const Ref encoding = builder.endTable();
+        builder.startTable();
+        const Ref utf8 = builder.endTable();
+        return field(builder, name, arrow_format::kTypeUtf8, utf8, encoding);
+    }
+
+    static Ref buildSchema(FlatBufferBuilder& builder) {
+        std::vector<Ref> fields;
+        const Ref timezoneName = builder.createString("UTC");
+        builder.startTable();
+        builder.addInt16(0, arrow_format::kTimeUnitSecond);
+        builder.addOffset(1, timezoneName);
+        fields.push_back(field(builder, "timestamp", arrow_format::kTypeTimestamp, builder.endTable(), 0));
+        fields.push_back(field(builder, "ip", arrow_format::kTypeInt, intType(builder, 32, false), 0));
+        fields.push_back(dictionaryField(builder, "user_id", 0));
+        fields.push_back(dictionaryField(builder, "action", 1));
+        fields.push_back(dictionaryField(builder, "status", 2));
+        fields.push_back(field(builder, "latency_ms", arrow_format::kTypeInt, intType(builder, 32, true), 0));
+        builder.startTable();
+        const Ref utf8 = builder.endTable();
+        fields.push_back(field(builder, "details", arrow_format::kTypeUtf8, utf8, 0));
+
+        const Ref fieldVector = builder.createTableVector(fields);
+        builder.startTable();
+        builder.addInt16(0, 0); // Little-endian.
+        builder.addOffset(1, fieldVector);
+        return builder.endTable();
+    }
+
+    // --- Messages ---
+    static Ref recordBatchHeader(FlatBufferBuilder& builder, std::size_t length, const Body& body) {
+        const Ref nodes = builder.createStructVector(body.nodes, 16, 8);
+        const Ref buffers = builder.createStructVector(body.buffers, 16, 8);
+        builder.startTable();
+        builder.addInt64(0, static_cast<std::int64_t>(length));
+        builder.addOffset(1, nodes);
+        builder.addOffset(2, buffers);
+        return builder.endTable();
+    }
+
+    void writeDictionary(std::int64_t id, const Dictionary& dictionary, std::size_t from, std::size_t to, bool isDelta) {
+        std::vector<std::int32_t> offsets(1, 0);
+        std::string data;
+        for (std::size_t code = from; code < to; ++code) {
+            data += dictionary.value(static_cast<std::uint32_t>(code));
+            offsets.push_back(static_cast<std::int32_t>(data.size()));
+        }
+        Body body;
+        body.node(to - from);
+        body.noValidity();
+        body.buffer(offsets.data(), offsets.size() * sizeof(std::int32_t));
+        body.buffer(data.data(), data.size());
+
+        FlatBufferBuilder builder;
+        const Ref batch = recordBatchHeader(builder, to - from, body);
+        builder.startTable();
+        builder.addInt64(0, id);
+        builder.addOffset(1, batch);
+        builder.addBool(2, isDelta);
+        const Ref header = builder.endTable();
+        dictionaryBlocks_.push_back(writeMessage(builder, arrow_format::kHeaderDictionaryBatch, header, body.bytes));
+    }
+
+    void writeRecordBatch(const ColumnarTable& table) {
+        const std::size_t rows = table.rows();
+        Body body;
+        const auto column = [&](const void* data, std::size_t bytes) {
+            body.node(rows);
+            body.noValidity();
+            body.buffer(data, bytes);
+        };
+        column(table.timestamp.data(), rows * sizeof(std::int64_t));
+        column(table.ip.data(), rows * sizeof(std::uint32_t));
+        column(table.user.data(), rows * sizeof(std::uint32_t)); // Codes are below 2^31, so valid int32 indices.
+        column(table.action.data(), rows * sizeof(std::uint32_t));
+        column(table.status.data(), rows * sizeof(std::uint32_t));
+        column(table.latencyMs.data(), rows * sizeof(std::int32_t));
+
+        detailsOffsets_.resize(rows + 1);
+        for (std::size_t row = 0; row <= rows; ++row) {
+            detailsOffsets_[row] = static_cast<std::int32_t>(table.detailsOffset[row] - table.detailsOffset[0]);
+        }
+        body.node(rows);
+        body.noValidity();
+        body.buffer(detailsOffsets_.data(), detailsOffsets_.size() * sizeof(std::int32_t));
+        body.buffer(table.detailsArena.data() + table.detailsOffset[0],
+                    static_cast<std::size_t>(table.detailsOffset[rows] - table.detailsOffset[0]));
+
+        FlatBufferBuilder builder;
+        const Ref header = recordBatchHeader(builder, rows, body);
+        recordBatchBlocks_.push_back(writeMessage(builder, arrow_format::kHeaderRecordBatch, header, body.bytes));
+    }
+
+    // Wraps 'header' in a Message and writes it as an encapsulated message:
+    // continuation marker, metadata length, metadata, body.
+    Block writeMessage(FlatBufferBuilder& builder, std::uint8_t headerType, Ref header, const std::string& body) {
+        builder.startTable();
+        builder.addInt16(0, arrow_format::kMetadataV5);
+        builder.addUint8(1, headerType);
+        builder.addOffset(2, header);
+        builder.addInt64(3, static_cast<std::int64_t>(body.size()));
+        const std::string metadata = builder.finish(builder.endTable()); // A multiple of 8 bytes.
+
+        const Block block{ position_, static_cast<std::int32_t>(8 + metadata.size()), static_cast<std::int64_t>(body.size()) };
+        scratch_.clear();
+        ByteWriter prefix(scratch_);
+        prefix.fixed32(arrow_format::kContinuation);
+        prefix.fixed32(static_cast<std::uint32_t>(metadata.size()));
+        write(scratch_);
+        write(metadata);
+        write(body);
+        return block;
+    }
+
+    std::string buildFooter(FlatBufferBuilder& builder) {
+        const auto blockVector = [&](const std::vector<Block>& blocks) {
+            std::string bytes;
+            ByteWriter writer(bytes);
+            for (const Block& block : blocks) {
+                writer.fixed64(static_cast<std::uint64_t>(block.offset));
+                writer.fixed32(static_cast<std::uint32_t>(block.metadataLength));
+                writer.fixed32(0); // Struct padding.
+                writer.fixed64(static_cast<std::uint64_t>(block.bodyLength));
+            }
+            return builder.createStructVector(bytes, 24, 8);
+        };
+        const Ref schema = buildSchema(builder);
+        const Ref dictionaries = blockVector(dictionaryBlocks_);
+        const Ref recordBatches = blockVector(recordBatchBlocks_);
+        builder.startTable();
+        builder.addInt16(0, arrow_format::kMetadataV5);
+        builder.addOffset(1, schema);
+        builder.addOffset(2, dictionaries);
+        builder.addOffset(3, recordBatches);
+        return builder.finish(builder.endTable());
+    }
+
+    void write(const std::string& bytes) {
+        out_.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+        position_ += static_cast<std::int64_t>(bytes.size());
+    }
+
+    std::ofstream out_;
+    ArrowLayout layout_ = ArrowLayout::File;
+    std::int64_t position_ = 0;
+    std::size_t dictionarySent_[3] = { 0, 0, 0 };
+    std::vector<Block> dictionaryBlocks_;
+    std::vector<Block> recordBatchBlocks_;
+    std::vector<std::int32_t> detailsOffsets_;
+    std::string scratch_;
+    std::size_t batches_ = 0;
+    std::size_t rows_ = 0;
+};
+
+// --- Exporting a Log File ---
+struct ArrowExportStats {
+    std::size_t rows = 0;
+    std::size_t batches = 0;
+    long long malformedLines = 0;
+};
+
+// Parses 'inputPath' and writes its rows to 'outputPath', one record batch per
+// 'batchRows' rows. Returns false (with 'error') on an I/O failure.
+inline bool exportArrow(const std::string& inputPath, const std::string& outputPath, const LineParser& parser,
+                        ArrowLayout layout, std::size_t batchRows, ArrowExportStats& stats, std::string& error) {
+    // Arrow's utf8 offsets are int32, so a batch's details text must stay under 2 GiB.
+    const std::size_t maxBatchTextBytes = 1u << 30;
+
+    ArrowIpcWriter writer;
+    if (!writer.open(outputPath, layout)) {
+        error = "could not write " + outputPath;
+        return false;
+    }
+    const long long size = fileSizeOf(inputPath);
+    std::ifstream input(inputPath, std::ios::binary);
+    if (size < 0 || !input.is_open()) {
+        error = "could not read " + inputPath;
+        return false;
+    }
+
+    ColumnarTable batch;
+    LogRecord record;
+    std::string block;
+    bool writeOk = true;
+    const bool readOk = forEachLineInRange(input, ByteRange{ 0, static_cast<std::uint64_t>(size) }, 8u << 20, block,
+        [&](std::string_view line, std::uint64_t) {
+            if (!parser.parse(line, record) || !batch.append(record)) {
+                batch.malformedLines++;
+                return;
+            }
+            if (batch.rows() >= batchRows || batch.detailsArena.size() >= maxBatchTextBytes) {
+                writeOk = writeOk && writer.writeBatch(batch);
+                batch.clearRows();
+            }
+        });
+    if (batch.rows() > 0) {
+        writeOk = writeOk && writer.writeBatch(batch);
+    }
+    writeOk = writer.close() && writeOk;
+
+    stats.rows = writer.rows();
+    stats.batches = writer.batches();
+    stats.malformedLines = batch.malformedLines;
+    if (!readOk) {
+        error = "I/O failure while reading " + inputPath;
+    }
+    else if (!writeOk) {
+        error = "I/O failure while writing " + outputPath;
+    }
+    return readOk && writeOk;
+}
@@ -0,0 +1,151 @@
+/**
+ * @file BinaryIO.h
+ * @brief Building and reading compact, byte-order independent binary data.
+ *
+ * @details ByteWriter appends to a std::string; ByteReader walks a
+ * std::string_view and fails cleanly (returns false) instead of reading past
+ * the end, so truncated or corrupt input is reported rather than trusted.
+ * Integers are either LEB128 varints (small values take one byte) or fixed-width
+ * little-endian, whatever the host byte order.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// --- Writing ---
+class ByteWriter {
+public:
+    explicit ByteWriter(std::string& out) : out_(out) {}
+
+    void u8(std::uint8_t value) { out_.push_back(static_cast<char>(value)); }
+
+    void varint(std::uint64_t value) {
+        while (value >= 0x80) {
+            out_.push_back(static_cast<char>((value & 0x7F) | 0x80));
+            value >>= 7;
+        }
+        out_.push_back(static_cast<char>(value));
+    }
+
+    // Signed values are zigzag-mapped first, so small negatives stay short too.
+    void svarint(std::int64_t value) {
+        varint((static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63));
+    }
+
+    void fixed32(std::uint32_t value) {
+        for (int i = 0; i < 4; ++i) {
+            out_.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+        }
+    }
+
+    void fixed64(std::uint64_t value) {
+        for (int i = 0; i < 8; ++i) {
+            out_.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+        }
+    }
+
+    // Length-prefixed bytes.
+    void string(std::string_view value) {
+        varint(value.size());
+        out_.append(value.data(), value.size());
+    }
+
+    void bytes(std::string_view value) { out_.append(value.data(), value.size()); }
+
+    std::size_t size() const { return out_.size(); }
+
+private:
+    std::string& out_;
+};
+
+// --- Reading ---
+class ByteReader {
+public:
+    explicit ByteReader(std::string_view in) : in_(in) {}
+
+    bool u8(std::uint8_t& value) {
+        if (in_.empty()) {
+            return false;
+        }
+        value = static_cast<std::uint8_t>(in_[0]);
+        in_.remove_prefix(1);
+        return true;
+    }
+
+    bool varint(std::uint64_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            std::uint8_t byte = 0;
+            if (!u8(byte)) {
+                return false;
+            }
+            value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0) {
+                return true;
+            }
+        }
+        return false; // More than ten bytes: not a valid varint.
+    }
+
+    bool svarint(std::int64_t& value) {
+        std::uint64_t raw = 0;
+        if (!varint(raw)) {
+            return false;
+        }
+        value = static_cast<std::int64_t>(raw >> 1) ^ -static_cast<std::int64_t>(raw & 1);
+        return true;
+    }
+
+    bool fixed32(std::uint32_t& value) {
+        if (in_.size() < 4) {
+            return false;
+        }
+        value = 0;
+        for (int i = 0; i < 4; ++i) {
+            value |= static_cast<std::uint32_t>(static_cast<std::uint8_t>(in_[i])) << (8 * i);
+        }
+        in_.remove_prefix(4);
+        return true;
+    }
+
+    bool fixed64(std::uint64_t& value) {
+        if (in_.size() < 8) {
+            return false;
+        }
+        value = 0;
+        for (int i = 0; i < 8; ++i) {
+            value |= static_cast<std::uint64_t>(static_cast<std::uint8_t>(in_[i])) << (8 * i);
+        }
+        in_.remove_prefix(8);
+        return true;
+    }
+
+    // A length-prefixed string, returned as a view into the input.
+    bool string(std::string_view& value) {
+        std::uint64_t length = 0;
+        if (!varint(length) || length > in_.size()) {
+            return false;
+        }
+        value = in_.substr(0, static_cast<std::size_t>(length));
+        in_.remove_prefix(static_cast<std::size_t>(length));
+        return true;
+    }
+
+    bool bytes(std::size_t count, std::string_view& value) {
+        if (count > in_.size()) {
+            return false;
+        }
+        value = in_.substr(0, count);
+        in_.remove_prefix(count);
+        return true;
+    }
+
+    std::size_t remaining() const { return in_.size(); }
+    std::string_view rest() const { return in_; }
+
+private:
+    std::string_view in_;
+};
@@ -0,0 +1,204 @@
+/**
+ * @file BinaryLog.h
+ * @brief Reading the compact binary log format ("LFAB") written by LogGenerator.
+ *
+ * @details A binary log carries the same fields as a text line, but nothing
+ * has to be searched for or converted:
+ *
+ *     file    "LFAB", u8 version (1), 3 reserved bytes, then blocks
+ *     block   fixed32 payload bytes, fixed32 record count, payload
+ *     payload a sequence of entries, each starting with a u8 tag:
+ *       1  string   varint length, bytes. Gets the next dictionary id (from 0).
+ *       2  record   fixed64 timestamp, varint ip / user / action / status ids,
+ *                   svarint latency, varint details length, details bytes.
+ *
+ * Integers are little-endian, varints are LEB128 and svarints zigzag-mapped,
+ * the same encodings as the state files (BinaryIO.h). A string is sent once per
+ * block, the first time a record in that block uses it, so every block can be
+ * decoded on its own and a file can be split between threads at any block
+ * boundary. Decoded records point straight into the block buffer.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "BinaryIO.h"
+#include "FileChunks.h"
+#include "LogRecord.h"
+
+namespace binary_log {
+constexpr std::string_view kMagic = "LFAB";
+constexpr std::uint8_t kVersion = 1;
+constexpr std::size_t kFileHeaderBytes = 8;
+constexpr std::size_t kBlockHeaderBytes = 8;
+constexpr std::uint32_t kMaxBlockBytes = 64u << 20;
+constexpr std::uint8_t kTagString = 1;
+constexpr std::uint8_t kTagRecord = 2;
+} // namespace binary_log
+
+inline bool isBinaryLog(std::string_view head) {
+    return head.size() >= binary_log::kFileHeaderBytes && head.substr(0, 4) == binary_log::kMagic;
+}
+
+// --- Splitting ---
+// Walks the block headers (one small read per block) and groups the blocks
+// into about 'parts' ranges of similar size. Returns false (with 'error') if a
+// block header points past the end of the file.
+inline bool splitBinaryLogIntoRanges(const std::string& path, std::size_t parts, std::vector<ByteRange>& ranges,
+                                     std::string& error) {
+    ranges.clear();
+    const long long size = fileSizeOf(path);
+    std::ifstream file(path, std::ios::binary);
+    if (size < static_cast<long long>(binary_log::kFileHeaderBytes) || !file.is_open()) {
+        error = "could not read " + path;
+        return false;
+    }
+    const std::uint64_t total = static_cast<std::uint64_t>(size);
+    char fileHeader[binary_log::kFileHeaderBytes];
+    if (!file.read(fileHeader, sizeof(fileHeader)) || !isBinaryLog(std::string_view(fileHeader, sizeof(fileHeader))) ||
+        static_cast<std::uint8_t>(fileHeader[4]) != binary_log::kVersion) {
+        error = path + " is not a version " + std::to_string(binary_log::kVersion) + " binary log";
+        return false;
+    }
+
+    std::vector<std::uint64_t> blockStarts;
+    std::uint64_t position = binary_log::kFileHeaderBytes;
+    while (position < total) {
+        char header[binary_log::kBlockHeaderBytes];
+        file.seekg(static_cast<std::streamoff>(position));
+        std::uint32_t payloadBytes = 0;
+        if (!file.read(header, sizeof(header)) ||
+            !ByteReader(std::string_view(header, sizeof(header))).fixed32(payloadBytes) ||
+            position + sizeof(header) + payloadBytes > total) {
+            error = path + ": truncated or corrupt block at offset " + std::to_string(position);
+            return false;
+        }
+        blockStarts.push_back(position);
+        position += sizeof(header) + payloadBytes;
+    }
+
+    parts = std::max<std::size_t>(1, parts);
+    std::uint64_t begin = binary_log::kFileHeaderBytes;
+    std::size_t part = 1;
+    for (std::size_t b = 1; b <= blockStarts.size(); ++b) {
+        const std::uint64_t end = b < blockStarts.size() ? blockStarts[b] : total;
+        if (end >= total * part / parts || b == blockStarts.size()) {
+            ranges.push_back({ begin, end });
+            begin = end;
+            while (part < parts && end >= total * part / parts) {
+                ++part;
+            }
+        }
+    }
+    return true;
+}
+
+// --- Decoding ---
+// Decodes one block payload, calling 'onRecord(const LogRecord&, std::uint64_t
+// offset)' per record. 'strings' is scratch space for the block's dictionary.
+template<typename Fn>
+bool decodeBinaryBlock(std::string_view payload, std::uint64_t payloadOffset, std::vector<std::string_view>& strings,
+                       LogRecord& record, Fn&& onRecord) {
+    strings.clear();
+    ByteReader reader(payload);
+    const auto lookup = [&](std::string_view& field) {
+        std::uint64_t id = 0;
+        if (!reader.varint(id) || id >= strings.size()) {
+            return false;
+        }
+        field = strings[static_cast<std::size_t>(id)];
+        return true;
+    };
+    while (reader.remaining() > 0) {
+        const std::uint64_t offset = payloadOffset + (payload.size() - reader.remaining());
+        std::uint8_t tag = 0;
+        reader.u8(tag);
+        if (tag == binary_log::kTagString) {
+            std::string_view value;
+            if (!reader.string(value)) {
+                return false;
+            }
+            strings.push_back(value);
+            continue;
+        }
+        std::uint64_t timestamp = 0;
+        std::int64_t latency = 0;
+        std::string_view details;
+        if (tag != binary_log::kTagRecord || !reader.fixed64(timestamp) || !lookup(record.ip) ||
+            !lookup(record.userId) || !lookup(record.action) || !lookup(record.status) ||
+            !reader.svarint(latency) || !reader.string(details) || latency < std::numeric_limits<int>::min() ||
+            latency > std::numeric_limits<int>::max()) {
+            return false;
+        }
+        record.timestamp = static_cast<long long>(timestamp);
+        record.latencyMs = static_cast<int>(latency);
+        record.details = details;
+        onRecord(static_cast<const LogRecord&>(record), offset);
+    }
+    return true;
+}
+
+// Streams the records of the blocks in 'range' (block-aligned, as made by
+// splitBinaryLogIntoRanges). Returns false (with 'error') on an I/O failure or
+// corrupt data. A 'governor' paces the reads, one block at a time; blocks are
+// as large as the writer made them.
+template<typename Fn>
+bool forEachBinaryRecord(std::ifstream& file, const ByteRange& range, std::string& buffer, Fn&& onRecord,
+                         std::string& error, ResourceGovernor* governor = nullptr) {
+    file.clear();
+    file.seekg(static_cast<std::streamoff>(range.begin));
+    std::vector<std::string_view> strings;
+    LogRecord record;
+    std::uint64_t position = range.begin;
+    while (position < range.end) {
+        char header[binary_log::kBlockHeaderBytes];
+        std::uint32_t payloadBytes = 0;
+        std::uint32_t recordCount = 0;
+        ByteReader headerReader(std::string_view(header, sizeof(header)));
+        if (!file.read(header, sizeof(header)) || !headerReader.fixed32(payloadBytes) ||
+            !headerReader.fixed32(recordCount) || payloadBytes > binary_log::kMaxBlockBytes) {
+            error = "corrupt block header at offset " + std::to_string(position);
+            return false;
+        }
+        if (governor != nullptr && !governor->beforeRead(payloadBytes)) {
+            error = "the scan was cancelled";
+            return false;
+        }
+        buffer.resize(payloadBytes);
+        if (!file.read(&buffer[0], static_cast<std::streamsize>(payloadBytes))) {
+            error = "I/O failure at offset " + std::to_string(position);
+            return false;
+        }
+        if (governor != nullptr) {
+            governor->afterRead(payloadBytes);
+        }
+        std::uint32_t decoded = 0;
+        const bool ok = decodeBinaryBlock(buffer, position + sizeof(header), strings, record,
+            [&](const LogRecord& r, std::uint64_t offset) {
+                ++decoded;
+                onRecord(r, offset);
+            });
+        if (!ok || decoded != recordCount) {
+            error = "corrupt block at offset " + std::to_string(position);
+            return false;
+        }
+        position += sizeof(header) + payloadBytes;
+    }
+    return true;
+}
+
+// The text form of a record, as a pipe-delimited line. Used where a binary
+// record has to be compared with text lines, as --dedup does.
+inline void formatPipeLogLine(const LogRecord& record, std::string& out) {
+    out.assign(std::to_string(record.timestamp)).append(1, '|');
+    out.append(record.ip).append(1, '|').append(record.userId).append(1, '|');
+    out.append(record.action).append(1, '|').append(record.status).append(1, '|');
+    out.append(std::to_string(record.latencyMs)).append("ms|").append(record.details);
+}
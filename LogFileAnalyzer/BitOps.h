@@ -0,0 +1,81 @@
+/**
+ * @file BitOps.h
+ * @brief Portable wrappers for the bit-scan and population-count instructions,
+ * and the one switch for SSE2 code.
+ *
+ * @details C++17 has no std::countr_zero or std::popcount, so these map to the
+ * MSVC intrinsics or the GCC/Clang builtins. Both compile to a single
+ * instruction on x86-64. 32-bit MSVC builds scan the two halves of a word.
+ * MSVC emits POPCNT whether or not the CPU has it, so popCount() checks the
+ * CPU once and otherwise counts in portable code.
+ *
+ * LFA_SSE2 is defined where SSE2 can be used without a runtime check: on
+ * x86-64, and on 32-bit x86 builds that target SSE2. The vector kernels test
+ * it and fall back to scalar code elsewhere.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LFA_SSE2 1
+#endif
+
+// The index of the lowest set bit of 'mask', which must not be 0.
+inline int lowestSetBit(std::uint64_t mask) {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+    unsigned long index;
+    _BitScanForward64(&index, mask);
+    return static_cast<int>(index);
+#elif defined(_MSC_VER)
+    unsigned long index;
+    if (_BitScanForward(&index, static_cast<unsigned long>(mask))) {
+        return static_cast<int>(index);
+    }
+    _BitScanForward(&index, static_cast<unsigned long>(mask >> 32));
+    return static_cast<int>(index) + 32;
+#else
+    return __builtin_ctzll(mask);
+#endif
+}
+
+// The number of set bits in 'mask', adding up the bits of each byte in parallel.
+inline int popCountPortable(std::uint64_t mask) {
+    mask -= (mask >> 1) & 0x5555555555555555ull;
+    mask = (mask & 0x3333333333333333ull) + ((mask >> 2) & 0x3333333333333333ull);
+    mask = (mask + (mask >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+    return static_cast<int>((mask * 0x0101010101010101ull) >> 56);
+}
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+// Whether the CPU has the POPCNT instruction (CPUID leaf 1, ECX bit 23).
+inline bool cpuHasPopcnt() {
+    static const bool has = []() {
+        int info[4];
+        __cpuid(info, 1);
+        return (info[2] & (1 << 23)) != 0;
+    }();
+    return has;
+}
+#endif
+
+// The number of set bits in 'mask'.
+inline int popCount(std::uint64_t mask) {
+#if defined(_MSC_VER) && defined(_M_X64)
+    return cpuHasPopcnt() ? static_cast<int>(__popcnt64(mask)) : popCountPortable(mask);
+#elif defined(_MSC_VER) && defined(_M_IX86)
+    return cpuHasPopcnt()
+        ? static_cast<int>(__popcnt(static_cast<std::uint32_t>(mask)) + __popcnt(static_cast<std::uint32_t>(mask >> 32)))
+        : popCountPortable(mask);
+#elif defined(_MSC_VER)
+    return popCountPortable(mask);
+#else
+    return __builtin_popcountll(mask);
+#endif
+}
@@ -0,0 +1,292 @@
+/**
+ * @file BlockSampler.h
+ * @brief Approximate answers from a random subset of the file (--sample).
+ *
+ * @details The file is divided into fixed-size blocks and a simple random sample
+ * of them is read. A line belongs to the block that contains its first byte, so
+ * a sampled block skips the tail of the line it starts in the middle of and
+ * reads past its own end to finish its last line. With that rule every line
+ * belongs to exactly one block and nothing is double counted.
+ *
+ * Each block is one cluster of a cluster sample. Totals are estimated as
+ * (blocks in file) x (mean per sampled block), and their 95% confidence
+ * intervals come from the spread between sampled blocks, with the finite
+ * population correction so that sampling every block gives an exact answer.
+ * The mean latency is a ratio estimate (latency sum / record count) and uses the
+ * usual linearized variance for ratio estimators.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <random>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "FileChunks.h"
+#include "LogSchema.h"
+#include "ReportWriter.h"
+
+// --- Running Sums for One Estimated Quantity ---
+// Only the sum and the sum of squares of the per-block values are kept. Blocks in
+// which a category never appears contribute zero to both, so they need no entry.
+struct ClusterSums {
+    double sum = 0.0;
+    double sumSquares = 0.0;
+
+    void addBlock(double value) {
+        sum += value;
+        sumSquares += value * value;
+    }
+
+    void merge(const ClusterSums& other) {
+        sum += other.sum;
+        sumSquares += other.sumSquares;
+    }
+};
+
+// --- Accumulated State of the Sampled Blocks ---
+struct BlockSample {
+    std::uint64_t blocksSampled = 0;
+    ClusterSums records;
+    ClusterSums latencySum;
+    double recordLatencyCross = 0.0; // Sum over blocks of records x latencySum, for the ratio variance.
+    std::map<std::string, ClusterSums, std::less<>> actionStatus; // Keyed action, '\0', status.
+
+    void merge(const BlockSample& other) {
+        blocksSampled += other.blocksSampled;
+        records.merge(other.records);
+        latencySum.merge(other.latencySum);
+        recordLatencyCross += other.recordLatencyCross;
+        for (const auto& entry : other.actionStatus) {
+            actionStatus[entry.first].merge(entry.second);
+        }
+    }
+};
+
+// --- Choosing the Blocks ---
+// Returns 'fraction' of the block indices [0, blockCount), at least one, in
+// ascending order so the reads move forward through the file. Floyd's
+// algorithm draws them directly, so the cost follows the sample size rather
+// than the file size.
+inline std::vector<std::uint64_t> chooseSampleBlocks(std::uint64_t blockCount, double fraction, std::uint64_t seed) {
+    std::uint64_t wanted = static_cast<std::uint64_t>(std::llround(fraction * static_cast<double>(blockCount)));
+    wanted = std::min(blockCount, std::max<std::uint64_t>(1, wanted));
+
+    std::mt19937_64 random(seed);
+    std::unordered_set<std::uint64_t> taken;
+    taken.reserve(static_cast<std::size_t>(wanted));
+    std::vector<std::uint64_t> chosen;
+    chosen.reserve(static_cast<std::size_t>(wanted));
+    // Each step adds one index from [0, j]; if the draw is already taken, j
+    // itself is not, and taking it keeps every subset equally likely.
+    for (std::uint64_t j = blockCount - wanted; j < blockCount; ++j) {
+        const std::uint64_t pick = std::uniform_int_distribution<std::uint64_t>(0, j)(random);
+        const std::uint64_t index = taken.insert(pick).second ? pick : j;
+        taken.insert(index);
+        chosen.push_back(index);
+    }
+    std::sort(chosen.begin(), chosen.end());
+    return chosen;
+}
+
+// --- Reading One Block ---
+// Returns the byte range of the lines that belong to block 'index'.
+inline ByteRange lineAlignedBlock(std::ifstream& file, std::uint64_t index, std::uint64_t blockBytes,
+                                  std::uint64_t fileSize) {
+    // Advances 'pos' to the start of the first line beginning at or after it.
+    auto snapToLineStart = [&](std::uint64_t pos) -> std::uint64_t {
+        if (pos == 0 || pos >= fileSize) {
+            return std::min(pos, fileSize);
+        }
+        file.clear();
+        file.seekg(static_cast<std::streamoff>(pos - 1));
+        char c = 0;
+        while (file.get(c) && c != '\n') {
+        }
+        return file ? static_cast<std::uint64_t>(file.tellg()) : fileSize;
+    };
+
+    const std::uint64_t begin = snapToLineStart(index * blockBytes);
+    const std::uint64_t end = snapToLineStart(std::min(fileSize, (index + 1) * blockBytes));
+    return { begin, std::max(begin, end) };
+}
+
+// Scans one block and folds its per-block totals into 'sample'.
+inline bool sampleBlock(std::ifstream& file, const ByteRange& range, const LineParser& parser, std::string& buffer,
+                        BlockSample& sample) {
+    LogRecord record;
+    double records = 0.0;
+    double latency = 0.0;
+    std::map<std::string, double, std::less<>> categories;
+    std::string key;
+
+    const bool ok = forEachLineInRange(file, range, 1u << 20, buffer, [&](std::string_view line, std::uint64_t) {
+        if (!parser.parse(line, record)) {
+            return;
+        }
+        records += 1.0;
+        latency += record.latencyMs;
+        key.assign(record.action.data(), record.action.size());
+        key.push_back('\0');
+        key.append(record.status.data(), record.status.size());
+        categories[key] += 1.0;
+    });
+
+    sample.blocksSampled++;
+    sample.records.addBlock(records);
+    sample.latencySum.addBlock(latency);
+    sample.recordLatencyCross += records * latency;
+    for (const auto& entry : categories) {
+        sample.actionStatus[entry.first].addBlock(entry.second);
+    }
+    return ok;
+}
+
+// --- Estimates ---
+struct Estimate {
+    double value = 0.0;
+    double halfWidth95 = 0.0; // value +/- halfWidth95 is the 95% confidence interval.
+};
+
+// Estimated file total of a per-block quantity.
+inline Estimate estimateTotal(const ClusterSums& sums, std::uint64_t sampled, std::uint64_t blockCount) {
+    const double n = static_cast<double>(sampled);
+    const double N = static_cast<double>(blockCount);
+    Estimate result;
+    if (n == 0) {
+        return result;
+    }
+    const double mean = sums.sum / n;
+    result.value = N * mean;
+    if (n > 1) {
+        const double variance = std::max(0.0, (sums.sumSquares - n * mean * mean) / (n - 1));
+        const double correction = 1.0 - n / N;
+        result.halfWidth95 = 1.96 * N * std::sqrt(correction * variance / n);
+    }
+    return result;
+}
+
+// Estimated mean latency per record (ratio of two per-block totals).
+inline Estimate estimateMeanLatency(const BlockSample& sample, std::uint64_t blockCount) {
+    const double n = static_cast<double>(sample.blocksSampled);
+    const double N = static_cast<double>(blockCount);
+    Estimate result;
+    if (n == 0 || sample.records.sum == 0) {
+        return result;
+    }
+    const double ratio = sample.latencySum.sum / sample.records.sum;
+    result.value = ratio;
+    if (n > 1) {
+        // Variance of the residuals (latency - ratio x records) between blocks.
+        const double residualSquares = sample.latencySum.sumSquares
+            - 2.0 * ratio * sample.recordLatencyCross
+            + ratio * ratio * sample.records.sumSquares;
+        const double variance = std::max(0.0, residualSquares / (n - 1));
+        const double meanRecords = sample.records.sum / n;
+        const double correction = 1.0 - n / N;
+        result.halfWidth95 = 1.96 * std::sqrt(correction * variance / n) / meanRecords;
+    }
+    return result;
+}
+
+// --- Report ---
+// The action and status of an actionStatus key.
+inline std::pair<std::string_view, std::string_view> splitActionStatus(std::string_view key) {
+    const std::size_t separator = key.find('\0');
+    return { key.substr(0, separator), key.substr(separator + 1) };
+}
+
+// Estimated counts are rounded to whole numbers; the mean latency is not.
+inline void appendEstimate(ReportBuffer& out, const Estimate& value, bool count, std::string_view between) {
+    if (count) {
+        out.integer(std::llround(value.value)).append(between).integer(std::llround(value.halfWidth95));
+    }
+    else {
+        out.decimal(value.value).append(between).decimal(value.halfWidth95);
+    }
+}
+
+inline void writeSampleReportText(ReportBuffer& out, const BlockSample& sample, std::uint64_t blockCount) {
+    out.append("Approximate results from ").integer(static_cast<long long>(sample.blocksSampled)).append(" of ")
+       .integer(static_cast<long long>(blockCount)).append(" blocks (95% confidence intervals):\n");
+    out.append("Records (estimated): ");
+    appendEstimate(out, estimateTotal(sample.records, sample.blocksSampled, blockCount), true, " +/- ");
+    out.append("\nMean latency (ms, estimated): ");
+    appendEstimate(out, estimateMeanLatency(sample, blockCount), false, " +/- ");
+    out.append("\nActions by status (estimated):\n");
+    for (const auto& entry : sample.actionStatus) {
+        const auto [action, status] = splitActionStatus(entry.first);
+        out.append("  ").append(action).append('/').append(status).append(": ");
+        appendEstimate(out, estimateTotal(entry.second, sample.blocksSampled, blockCount), true, " +/- ");
+        out.append('\n');
+    }
+}
+
+// Every estimate is an object {"estimate":...,"ci95":...}, where "ci95" is
+// the half-width of the 95% confidence interval.
+inline void writeSampleReportJson(ReportBuffer& out, const BlockSample& sample, std::uint64_t blockCount) {
+    const auto estimate = [&out](const Estimate& value, bool count = true) {
+        out.append("{\"estimate\":");
+        appendEstimate(out, value, count, ",\"ci95\":");
+        out.append('}');
+    };
+    out.append("{\"blocks_sampled\":").integer(static_cast<long long>(sample.blocksSampled));
+    out.append(",\"blocks\":").integer(static_cast<long long>(blockCount));
+    out.append(",\"records\":");
+    estimate(estimateTotal(sample.records, sample.blocksSampled, blockCount));
+    out.append(",\"latency_mean_ms\":");
+    estimate(estimateMeanLatency(sample, blockCount), false);
+    out.append(",\"actions\":{");
+    std::string_view previous;
+    bool firstAction = true;
+    for (const auto& entry : sample.actionStatus) {
+        const auto [action, status] = splitActionStatus(entry.first);
+        if (firstAction || action != previous) {
+            out.append(firstAction ? "" : "},").jsonString(action).append(":{");
+            previous = action;
+            firstAction = false;
+        }
+        else {
+            out.append(',');
+        }
+        out.jsonString(status).append(':');
+        estimate(estimateTotal(entry.second, sample.blocksSampled, blockCount));
+    }
+    out.append(firstAction ? "}}\n" : "}}}\n");
+}
+
+// The columns of the summary's CSV report, with "value" split into the
+// estimate and the half-width of its 95% confidence interval.
+inline void writeSampleReportCsv(ReportBuffer& out, const BlockSample& sample, std::uint64_t blockCount) {
+    const auto row = [&out](std::string_view metric, std::string_view action, std::string_view status,
+                            const Estimate& value, bool count = true) {
+        out.append(metric).append(',').csvField(action).append(',').csvField(status).append(',');
+        appendEstimate(out, value, count, ",");
+        out.append('\n');
+    };
+    out.append("metric,action,status,estimate,ci95\n");
+    row("blocks_sampled", "", "", Estimate{ static_cast<double>(sample.blocksSampled), 0.0 });
+    row("blocks", "", "", Estimate{ static_cast<double>(blockCount), 0.0 });
+    row("records", "", "", estimateTotal(sample.records, sample.blocksSampled, blockCount));
+    row("latency_mean_ms", "", "", estimateMeanLatency(sample, blockCount), false);
+    for (const auto& entry : sample.actionStatus) {
+        const auto [action, status] = splitActionStatus(entry.first);
+        row("count", action, status, estimateTotal(entry.second, sample.blocksSampled, blockCount));
+    }
+}
+
+inline void writeSampleReport(ReportBuffer& out, const BlockSample& sample, std::uint64_t blockCount, ReportFormat format) {
+    switch (format) {
+    case ReportFormat::Json: writeSampleReportJson(out, sample, blockCount); break;
+    case ReportFormat::Csv: writeSampleReportCsv(out, sample, blockCount); break;
+    case ReportFormat::Text: writeSampleReportText(out, sample, blockCount); break;
+    }
+}
@@ -0,0 +1,54 @@
+/**
+ * @file BloomFilter.h
+ * @brief Small Bloom filters over 64-bit hashes, for skipping blocks of rows.
+ *
+ * @details A filter is an array of 64-bit words. A key sets kProbes bits,
+ * chosen by double hashing: probe i is h1 + i * h2, where h1 and h2 are the
+ * two halves of the key's hash. Each probe is mapped onto the filter's bits by
+ * a multiply and shift, so filters need not be a power of two long. A lookup
+ * that finds one of its bits clear proves the key was never added; one that
+ * finds them all set is wrong about 1% of the time at kBitsPerKey bits per key.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace bloom {
+constexpr unsigned kProbes = 4;
+constexpr std::size_t kBitsPerKey = 10;
+
+// Words a filter for 'keys' distinct keys needs (at least one).
+inline std::size_t wordsFor(std::size_t keys) {
+    const std::size_t words = (keys * kBitsPerKey + 63) / 64;
+    return words > 0 ? words : 1;
+}
+
+// The bit of probe 'i' in a filter of 'bits' bits.
+inline std::uint64_t probeBit(std::uint64_t hash, unsigned i, std::uint64_t bits) {
+    const std::uint32_t h1 = static_cast<std::uint32_t>(hash);
+    const std::uint32_t h2 = static_cast<std::uint32_t>(hash >> 32) | 1u;
+    const std::uint32_t probe = h1 + i * h2;
+    return (static_cast<std::uint64_t>(probe) * bits) >> 32;
+}
+} // namespace bloom
+
+// Adds the key with hash 'hash' to the filter words[0, count).
+inline void bloomInsert(std::uint64_t* words, std::size_t count, std::uint64_t hash) {
+    for (unsigned i = 0; i < bloom::kProbes; ++i) {
+        const std::uint64_t bit = bloom::probeBit(hash, i, count * 64);
+        words[bit / 64] |= std::uint64_t(1) << (bit % 64);
+    }
+}
+
+// False if the key with hash 'hash' was certainly never added.
+inline bool bloomMayContain(const std::uint64_t* words, std::size_t count, std::uint64_t hash) {
+    for (unsigned i = 0; i < bloom::kProbes; ++i) {
+        const std::uint64_t bit = bloom::probeBit(hash, i, count * 64);
+        if ((words[bit / 64] & (std::uint64_t(1) << (bit % 64))) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,393 @@
+/**
+ * @file ColumnCodecs.h
+ * @brief Compact encodings for the integer columns of segment files.
+ *
+ * @details A column is cut into blocks of 128 values and every block is coded
+ * on its own:
+ *  - Frame of reference + bit packing (32-bit columns): the block's smallest
+ *    value is stored once, and each value as its distance from it in just as
+ *    many bits as the largest distance needs. Latencies of 5..250 ms take 8
+ *    bits, dictionary codes 2 or 3.
+ *  - Delta + bit packing (64-bit columns that mostly grow, such as sorted
+ *    timestamps and Details offsets): the block's first value is stored, and
+ *    each later value as its step from the one before, frame-of-reference
+ *    coded. Timestamps that move 1..5 s per line take 3 bits.
+ *  - Raw, whenever neither of the above is smaller.
+ *
+ * Packed values are laid out vertically, as in Lemire and Boytsov's SIMD-BP128:
+ * value i of a block belongs to lane i % 4, each lane packs its 32 values into
+ * consecutive 32-bit words, and the words of the four lanes are interleaved.
+ * Unpacking therefore runs on all four lanes at once with SSE2 shifts and
+ * masks and stores the values back in their original order. There is one
+ * unpacking routine per bit width, so every shift is a constant. Targets
+ * without SSE2 run the same steps one lane at a time.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "BitOps.h"
+
+enum class ColumnEncoding : std::uint8_t { Raw = 0, ForBitPacked = 1, DeltaBitPacked = 2 };
+
+// Sorted, disjoint [begin, end) ranges of value indexes.
+using IndexRanges = std::vector<std::pair<std::size_t, std::size_t>>;
+
+namespace column_codec {
+constexpr std::size_t kBlockValues = 128;
+
+inline std::size_t blockCount(std::size_t values) { return (values + kBlockValues - 1) / kBlockValues; }
+
+// Whether block 'b' overlaps one of 'ranges' (every block does if there are
+// none). 'next' is the first range not yet passed; blocks must be asked about
+// in order.
+inline bool blockWanted(const IndexRanges* ranges, std::size_t& next, std::size_t b) {
+    if (ranges == nullptr) {
+        return true;
+    }
+    const std::size_t begin = b * kBlockValues;
+    while (next < ranges->size() && (*ranges)[next].second <= begin) {
+        ++next;
+    }
+    return next < ranges->size() && (*ranges)[next].first < begin + kBlockValues;
+}
+
+inline unsigned bitWidth(std::uint32_t value) {
+    unsigned width = 0;
+    for (; value != 0; value >>= 1) {
+        ++width;
+    }
+    return width;
+}
+
+// --- Packing 128 Values ---
+// Packs 128 values, each below 2^width, into 4 * width words.
+inline void packBlock(const std::uint32_t* values, unsigned width, std::uint32_t* words) {
+    std::fill(words, words + 4 * width, 0u);
+    if (width == 0) {
+        return;
+    }
+    for (unsigned k = 0; k < 32; ++k) {
+        const unsigned word = k * width / 32;
+        const unsigned shift = k * width % 32;
+        for (unsigned lane = 0; lane < 4; ++lane) {
+            const std::uint32_t value = values[4 * k + lane];
+            words[4 * word + lane] |= value << shift;
+            if (shift + width > 32) {
+                words[4 * (word + 1) + lane] |= value >> (32 - shift);
+            }
+        }
+    }
+}
+
+// Unpacks 128 values of 'Width' bits and adds 'reference' to each.
+template<unsigned Width>
+void unpackBlockFixed(const std::uint32_t* words, std::uint32_t reference, std::uint32_t* out) {
+    if constexpr (Width == 0) {
+        (void)words;
+        std::fill(out, out + kBlockValues, reference);
+    }
+    else {
+        constexpr std::uint32_t kMask = Width == 32 ? 0xFFFFFFFFu : (1u << (Width % 32)) - 1;
+#ifdef LFA_SSE2
+        const __m128i mask = _mm_set1_epi32(static_cast<int>(kMask));
+        const __m128i base = _mm_set1_epi32(static_cast<int>(reference));
+        const __m128i* in = reinterpret_cast<const __m128i*>(words);
+        for (unsigned k = 0; k < 32; ++k) {
+            const unsigned word = k * Width / 32;
+            const unsigned shift = k * Width % 32;
+            __m128i value = _mm_srli_epi32(_mm_loadu_si128(in + word), static_cast<int>(shift));
+            if (shift + Width > 32) {
+                value = _mm_or_si128(value, _mm_slli_epi32(_mm_loadu_si128(in + word + 1), static_cast<int>(32 - shift)));
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 4 * k), _mm_add_epi32(_mm_and_si128(value, mask), base));
+        }
+#else
+        for (unsigned k = 0; k < 32; ++k) {
+            const unsigned word = k * Width / 32;
+            const unsigned shift = k * Width % 32;
+            for (unsigned lane = 0; lane < 4; ++lane) {
+                std::uint32_t value = words[4 * word + lane] >> shift;
+                if (shift + Width > 32) {
+                    value |= words[4 * (word + 1) + lane] << ((32 - shift) % 32);
+                }
+                out[4 * k + lane] = (value & kMask) + reference;
+            }
+        }
+#endif
+    }
+}
+
+using UnpackFunction = void (*)(const std::uint32_t*, std::uint32_t, std::uint32_t*);
+
+template<std::size_t... Widths>
+constexpr std::array<UnpackFunction, sizeof...(Widths)> makeUnpackTable(std::index_sequence<Widths...>) {
+    return { { &unpackBlockFixed<static_cast<unsigned>(Widths)>... } };
+}
+
+inline void unpackBlock(const std::uint32_t* words, unsigned width, std::uint32_t reference, std::uint32_t* out) {
+    static constexpr std::array<UnpackFunction, 33> kUnpack = makeUnpackTable(std::make_index_sequence<33>());
+    kUnpack[width](words, reference, out);
+}
+
+// --- Column Layouts ---
+// ForBitPacked:   u32 reference[blocks], u8 width[blocks] (padded to 4 bytes),
+//                 then the packed words of every block in turn.
+// DeltaBitPacked: i64 first[blocks], i64 minStep[blocks], u8 width[blocks]
+//                 (padded to 4 bytes), then the packed words.
+inline std::size_t paddedWidths(std::size_t blocks) { return (blocks + 3) & ~std::size_t(3); }
+
+inline void appendWords(std::string& out, const std::uint32_t* words, std::size_t count) {
+    out.append(reinterpret_cast<const char*>(words), count * 4);
+}
+
+// The size of the packed words of 'blocks' blocks with these widths.
+inline std::size_t packedBytes(const std::uint8_t* widths, std::size_t blocks) {
+    std::size_t words = 0;
+    for (std::size_t b = 0; b < blocks; ++b) {
+        words += 4 * static_cast<std::size_t>(widths[b]);
+    }
+    return words * 4;
+}
+} // namespace column_codec
+
+// --- Frame of Reference (32-bit Columns) ---
+inline void encodeForBitPacked(const std::uint32_t* values, std::size_t count, std::string& out) {
+    using namespace column_codec;
+    const std::size_t blocks = blockCount(count);
+    std::string references(blocks * 4, '\0');
+    std::string widths(paddedWidths(blocks), '\0');
+    std::string packed;
+    std::uint32_t block[kBlockValues];
+    std::uint32_t words[4 * 32];
+    for (std::size_t b = 0; b < blocks; ++b) {
+        const std::size_t begin = b * kBlockValues;
+        const std::size_t size = std::min(kBlockValues, count - begin);
+        const auto range = std::minmax_element(values + begin, values + begin + size);
+        const std::uint32_t reference = *range.first;
+        for (std::size_t i = 0; i < kBlockValues; ++i) {
+            block[i] = i < size ? values[begin + i] - reference : 0; // The tail of the last block packs as zeros.
+        }
+        const unsigned width = bitWidth(*range.second - reference);
+        packBlock(block, width, words);
+        std::memcpy(&references[b * 4], &reference, 4);
+        widths[b] = static_cast<char>(width);
+        appendWords(packed, words, 4 * width);
+    }
+    out += references;
+    out += widths;
+    out += packed;
+}
+
+// Checks that 'data' is a whole ForBitPacked column of 'count' values.
+inline bool validForBitPacked(std::string_view data, std::size_t count) {
+    using namespace column_codec;
+    const std::size_t blocks = blockCount(count);
+    const std::size_t meta = blocks * 4 + paddedWidths(blocks);
+    if (data.size() < meta) {
+        return false;
+    }
+    const auto* widths = reinterpret_cast<const std::uint8_t*>(data.data() + blocks * 4);
+    if (std::any_of(widths, widths + blocks, [](std::uint8_t width) { return width > 32; })) {
+        return false;
+    }
+    return meta + packedBytes(widths, blocks) == data.size();
+}
+
+// Decodes a column checked by validForBitPacked() into 'out' ('count' values).
+// Given 'ranges', only the blocks that overlap them are decoded; the other
+// values of 'out' are left as they are.
+inline void decodeForBitPacked(std::string_view data, std::size_t count, std::uint32_t* out, const IndexRanges* ranges = nullptr) {
+    using namespace column_codec;
+    const std::size_t blocks = blockCount(count);
+    const char* references = data.data();
+    const auto* widths = reinterpret_cast<const std::uint8_t*>(data.data() + blocks * 4);
+    const char* packed = data.data() + blocks * 4 + paddedWidths(blocks);
+    std::uint32_t tail[kBlockValues];
+    std::size_t next = 0;
+    for (std::size_t b = 0; b < blocks; ++b) {
+        std::uint32_t reference = 0;
+        std::memcpy(&reference, references + b * 4, 4);
+        const auto* words = reinterpret_cast<const std::uint32_t*>(packed); // 4-byte aligned by the layout.
+        packed += 16 * static_cast<std::size_t>(widths[b]);
+        if (!blockWanted(ranges, next, b)) {
+            continue;
+        }
+        const std::size_t begin = b * kBlockValues;
+        if (count - begin >= kBlockValues) {
+            unpackBlock(words, widths[b], reference, out + begin);
+        }
+        else {
+            unpackBlock(words, widths[b], reference, tail);
+            std::copy(tail, tail + (count - begin), out + begin);
+        }
+    }
+}
+
+// --- Delta (64-bit Columns) ---
+// Returns false, writing nothing, if some block's steps span 2^32 or more.
+inline bool encodeDeltaBitPacked(const std::int64_t* values, std::size_t count, std::string& out) {
+    using namespace column_codec;
+    const std::size_t blocks = blockCount(count);
+    std::string firsts(blocks * 8, '\0');
+    std::string minSteps(blocks * 8, '\0');
+    std::string widths(paddedWidths(blocks), '\0');
+    std::string packed;
+    std::uint32_t block[kBlockValues];
+    std::uint32_t words[4 * 32];
+    for (std::size_t b = 0; b < blocks; ++b) {
+        const std::size_t begin = b * kBlockValues;
+        const std::size_t size = std::min(kBlockValues, count - begin);
+        // Steps are taken in unsigned arithmetic, so they wrap instead of overflowing.
+        const auto step = [&](std::size_t i) {
+            return static_cast<std::int64_t>(static_cast<std::uint64_t>(values[begin + i]) - static_cast<std::uint64_t>(values[begin + i - 1]));
+        };
+        std::int64_t minStep = 0;
+        std::int64_t maxStep = 0;
+        for (std::size_t i = 1; i < size; ++i) {
+            minStep = i == 1 ? step(i) : std::min(minStep, step(i));
+            maxStep = i == 1 ? step(i) : std::max(maxStep, step(i));
+        }
+        const std::uint64_t span = static_cast<std::uint64_t>(maxStep) - static_cast<std::uint64_t>(minStep);
+        if (span > 0xFFFFFFFFu) {
+            return false;
+        }
+        block[0] = 0;
+        for (std::size_t i = 1; i < kBlockValues; ++i) {
+            block[i] = i < size ? static_cast<std::uint32_t>(static_cast<std::uint64_t>(step(i)) - static_cast<std::uint64_t>(minStep)) : 0;
+        }
+        const unsigned width = bitWidth(static_cast<std::uint32_t>(span));
+        packBlock(block, width, words);
+        std::memcpy(&firsts[b * 8], &values[begin], 8);
+        std::memcpy(&minSteps[b * 8], &minStep, 8);
+        widths[b] = static_cast<char>(width);
+        appendWords(packed, words, 4 * width);
+    }
+    out += firsts;
+    out += minSteps;
+    out += widths;
+    out += packed;
+    return true;
+}
+
+inline bool validDeltaBitPacked(std::string_view data, std::size_t count) {
+    using namespace column_codec;
+    const std::size_t blocks = blockCount(count);
+    const std::size_t meta = blocks * 16 + paddedWidths(blocks);
+    if (data.size() < meta) {
+        return false;
+    }
+    const auto* widths = reinterpret_cast<const std::uint8_t*>(data.data() + blocks * 16);
+    if (std::any_of(widths, widths + blocks, [](std::uint8_t width) { return width > 32; })) {
+        return false;
+    }
+    return meta + packedBytes(widths, blocks) == data.size();
+}
+
+namespace column_codec {
+// Decodes block 'b' of a DeltaBitPacked column of 'count' values, whose packed
+// words start at 'words', into 'out'.
+inline void decodeDeltaBlock(std::string_view data, std::size_t count, std::size_t b, const char* words, std::int64_t* out) {
+    const std::size_t blocks = blockCount(count);
+    std::uint64_t value = 0;
+    std::uint64_t minStep = 0;
+    std::memcpy(&value, data.data() + b * 8, 8);
+    std::memcpy(&minStep, data.data() + blocks * 8 + b * 8, 8);
+    const auto* widths = reinterpret_cast<const std::uint8_t*>(data.data() + blocks * 16);
+    std::uint32_t steps[kBlockValues];
+    unpackBlock(reinterpret_cast<const std::uint32_t*>(words), widths[b], 0, steps);
+
+    const std::size_t size = std::min(kBlockValues, count - b * kBlockValues);
+    out[0] = static_cast<std::int64_t>(value);
+    for (std::size_t i = 1; i < size; ++i) {
+        value += minStep + steps[i];
+        out[i] = static_cast<std::int64_t>(value);
+    }
+}
+} // namespace column_codec
+
+// Decodes a column checked by validDeltaBitPacked(), as decodeForBitPacked().
+inline void decodeDeltaBitPacked(std::string_view data, std::size_t count, std::int64_t* out, const IndexRanges* ranges = nullptr) {
+    using namespace column_codec;
+    const std::size_t blocks = blockCount(count);
+    const auto* widths = reinterpret_cast<const std::uint8_t*>(data.data() + blocks * 16);
+    const char* packed = data.data() + blocks * 16 + paddedWidths(blocks);
+    std::size_t next = 0;
+    for (std::size_t b = 0; b < blocks; ++b) {
+        if (blockWanted(ranges, next, b)) {
+            decodeDeltaBlock(data, count, b, packed, out + b * kBlockValues);
+        }
+        packed += 16 * static_cast<std::size_t>(widths[b]);
+    }
+}
+
+// The first value of each block of a DeltaBitPacked column, stored in front of
+// the packed words. For a sorted column they bound every block's values.
+inline const std::int64_t* deltaBlockFirsts(std::string_view data) { return reinterpret_cast<const std::int64_t*>(data.data()); }
+
+// Reads single values of a DeltaBitPacked column (checked by
+// validDeltaBitPacked()), decoding only the block each one is in.
+class DeltaColumnReader {
+public:
+    void open(std::string_view data, std::size_t count) {
+        using namespace column_codec;
+        data_ = data;
+        count_ = count;
+        const std::size_t blocks = blockCount(count);
+        const auto* widths = reinterpret_cast<const std::uint8_t*>(data.data() + blocks * 16);
+        std::size_t offset = blocks * 16 + paddedWidths(blocks);
+        blockWords_.resize(blocks);
+        for (std::size_t b = 0; b < blocks; ++b) {
+            blockWords_[b] = offset;
+            offset += 16 * static_cast<std::size_t>(widths[b]);
+        }
+        cachedBlock_ = SIZE_MAX;
+    }
+
+    std::int64_t at(std::size_t index) const {
+        const std::size_t b = index / column_codec::kBlockValues;
+        if (b != cachedBlock_) {
+            column_codec::decodeDeltaBlock(data_, count_, b, data_.data() + blockWords_[b], cache_);
+            cachedBlock_ = b;
+        }
+        return cache_[index % column_codec::kBlockValues];
+    }
+
+private:
+    std::string_view data_;
+    std::size_t count_ = 0;
+    std::vector<std::size_t> blockWords_; // Where each block's packed words start.
+    mutable std::size_t cachedBlock_ = SIZE_MAX;
+    mutable std::int64_t cache_[column_codec::kBlockValues];
+};
+
+// --- Choosing an Encoding ---
+// Appends the smallest encoding of 'values' to 'out' and returns which it is.
+inline ColumnEncoding encodeColumn32(const std::uint32_t* values, std::size_t count, std::string& out) {
+    std::string encoded;
+    encodeForBitPacked(values, count, encoded);
+    if (encoded.size() < count * 4) {
+        out += encoded;
+        return ColumnEncoding::ForBitPacked;
+    }
+    out.append(reinterpret_cast<const char*>(values), count * 4);
+    return ColumnEncoding::Raw;
+}
+
+inline ColumnEncoding encodeColumn64(const std::int64_t* values, std::size_t count, std::string& out) {
+    std::string encoded;
+    if (encodeDeltaBitPacked(values, count, encoded) && encoded.size() < count * 8) {
+        out += encoded;
+        return ColumnEncoding::DeltaBitPacked;
+    }
+    out.append(reinterpret_cast<const char*>(values), count * 8);
+    return ColumnEncoding::Raw;
+}
@@ -0,0 +1,342 @@
+/**
+ * @file ColumnarTable.h
+ * @brief An in-memory, column-oriented copy of a parsed log.
+ *
+ * @details Instead of one struct per line, every field lives in its own array,
+ * so a query that only looks at two fields only touches those two arrays.
+ *  - UserID, Action and Status are dictionary-encoded: each distinct string is
+ *    stored once and the column holds small integer codes.
+ *  - The IP address is packed into a uint32_t, the timestamp into an int64_t and
+ *    the latency into an int32_t.
+ *  - Details strings are appended back to back into one arena, with an offset
+ *    column marking where each row's text starts.
+ *
+ * Tables are built in parallel: each worker fills its own table with its own
+ * dictionaries, and appendTable() then merges them, remapping the codes.
+ *
+ * Queries read a table through a ColumnarView, a set of plain column pointers,
+ * so the same code also runs over columns that live in a mapped segment file
+ * (SegmentStore.h).
+ */
+
+#pragma once
+
+#include <charconv>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "CpuPlacement.h"
+#include "FileChunks.h"
+#include "LogSchema.h"
+
+// --- String Dictionary ---
+class Dictionary {
+public:
+    // Returns the code of 'value', adding it if it is new.
+    std::uint32_t intern(std::string_view value) {
+        scratch_.assign(value.data(), value.size());
+        auto found = codes_.find(scratch_);
+        if (found != codes_.end()) {
+            return found->second;
+        }
+        const std::uint32_t code = static_cast<std::uint32_t>(values_.size());
+        values_.push_back(scratch_);
+        codes_.emplace(scratch_, code);
+        return code;
+    }
+
+    // Looks 'value' up without adding it. Returns false if it is not present.
+    bool find(std::string_view value, std::uint32_t& code) const {
+        auto found = codes_.find(std::string(value));
+        if (found == codes_.end()) {
+            return false;
+        }
+        code = found->second;
+        return true;
+    }
+
+    const std::string& value(std::uint32_t code) const { return values_[code]; }
+    std::size_t size() const { return values_.size(); }
+
+private:
+    std::vector<std::string> values_;
+    std::unordered_map<std::string, std::uint32_t> codes_;
+    std::string scratch_;
+};
+
+// --- Read-Only Columns ---
+// Which columns a reader needs, so a view can leave the others out.
+enum ColumnSet : unsigned {
+    kColumnTimestamp = 1, kColumnIp = 2, kColumnUser = 4, kColumnAction = 8, kColumnStatus = 16,
+    kColumnLatency = 32, kColumnDetails = 64, kAllColumns = 127
+};
+
+// Sorted, disjoint [begin, end) ranges of rows.
+using RowRanges = std::vector<std::pair<std::size_t, std::size_t>>;
+
+// Finds single rows' Details for a view whose detailsOffset column is not
+// decoded up front (see Segment in SegmentStore.h).
+class DetailsSource {
+public:
+    virtual ~DetailsSource() = default;
+    virtual std::string_view details(std::size_t row) const = 0;
+};
+
+struct ColumnarView {
+    std::size_t rows = 0;
+    const std::int64_t* timestamp = nullptr;
+    const std::uint32_t* ip = nullptr;
+    const std::uint32_t* user = nullptr;
+    const std::uint32_t* action = nullptr;
+    const std::uint32_t* status = nullptr;
+    const std::int32_t* latencyMs = nullptr;
+    const std::uint64_t* detailsOffset = nullptr; // rows + 1 entries.
+    const char* detailsArena = nullptr;
+    const DetailsSource* detailsSource = nullptr; // Used when detailsOffset is null.
+    const Dictionary* users = nullptr;
+    const Dictionary* actions = nullptr;
+    const Dictionary* statuses = nullptr;
+    bool sortedByTime = false; // Lets a time range be found by binary search.
+    const RowRanges* rowRanges = nullptr; // If set, only these rows were read, and only they may match.
+    // Statistics for the query planner (QueryEngine.h), where known.
+    bool hasTimeRange = false;    // Every timestamp lies in [minTimestamp, maxTimestamp].
+    std::int64_t minTimestamp = 0;
+    std::int64_t maxTimestamp = 0;
+    std::size_t distinctIps = 0;  // An estimate; 0 if unknown.
+
+    std::string_view details(std::size_t row) const {
+        if (detailsOffset == nullptr) {
+            return detailsSource->details(row);
+        }
+        return std::string_view(detailsArena + detailsOffset[row],
+                                static_cast<std::size_t>(detailsOffset[row + 1] - detailsOffset[row]));
+    }
+};
+
+// --- The Table ---
+struct ColumnarTable {
+    std::vector<std::int64_t> timestamp;
+    std::vector<std::uint32_t> ip;
+    std::vector<std::uint32_t> user;    // Codes into 'users'.
+    std::vector<std::uint32_t> action;  // Codes into 'actions'.
+    std::vector<std::uint32_t> status;  // Codes into 'statuses'.
+    std::vector<std::int32_t> latencyMs;
+    std::vector<std::uint64_t> detailsOffset; // Row i's text is [detailsOffset[i], detailsOffset[i + 1]).
+    std::string detailsArena;
+
+    Dictionary users;
+    Dictionary actions;
+    Dictionary statuses;
+
+    long long malformedLines = 0; // Lines skipped while loading.
+
+    ColumnarTable() { detailsOffset.push_back(0); }
+
+    std::size_t rows() const { return timestamp.size(); }
+
+    // The bytes the columns hold, counting spare capacity but not the
+    // dictionaries, which stay small.
+    std::size_t memoryBytes() const {
+        return timestamp.capacity() * sizeof(std::int64_t) + detailsOffset.capacity() * sizeof(std::uint64_t) +
+               (ip.capacity() + user.capacity() + action.capacity() + status.capacity()) * sizeof(std::uint32_t) +
+               latencyMs.capacity() * sizeof(std::int32_t) + detailsArena.capacity();
+    }
+
+    std::string_view details(std::size_t row) const {
+        return std::string_view(detailsArena.data() + detailsOffset[row],
+                                static_cast<std::size_t>(detailsOffset[row + 1] - detailsOffset[row]));
+    }
+
+    ColumnarView view() const {
+        ColumnarView v;
+        v.rows = rows();
+        v.timestamp = timestamp.data();
+        v.ip = ip.data();
+        v.user = user.data();
+        v.action = action.data();
+        v.status = status.data();
+        v.latencyMs = latencyMs.data();
+        v.detailsOffset = detailsOffset.data();
+        v.detailsArena = detailsArena.data();
+        v.users = &users;
+        v.actions = &actions;
+        v.statuses = &statuses;
+        return v;
+    }
+
+    // Appends one parsed line. Returns false (and appends nothing) if the IP
+    // field is not a valid IPv4 address.
+    bool append(const LogRecord& record) {
+        std::uint32_t packedIp = 0;
+        if (!parseIpv4(record.ip, packedIp)) {
+            return false;
+        }
+        timestamp.push_back(record.timestamp);
+        ip.push_back(packedIp);
+        user.push_back(users.intern(record.userId));
+        action.push_back(actions.intern(record.action));
+        status.push_back(statuses.intern(record.status));
+        latencyMs.push_back(record.latencyMs);
+        detailsArena.append(record.details.data(), record.details.size());
+        detailsOffset.push_back(detailsArena.size());
+        return true;
+    }
+
+    // Drops all rows but keeps the dictionaries, so codes stay stable while a
+    // long input is processed one batch of rows at a time.
+    void clearRows() {
+        timestamp.clear();
+        ip.clear();
+        user.clear();
+        action.clear();
+        status.clear();
+        latencyMs.clear();
+        detailsOffset.assign(1, 0);
+        detailsArena.clear();
+    }
+
+    // Makes room for 'moreRows' rows and 'moreDetails' bytes of Details, so
+    // that appending them does not reallocate.
+    void reserveMore(std::size_t moreRows, std::size_t moreDetails) {
+        timestamp.reserve(rows() + moreRows);
+        ip.reserve(rows() + moreRows);
+        user.reserve(rows() + moreRows);
+        action.reserve(rows() + moreRows);
+        status.reserve(rows() + moreRows);
+        latencyMs.reserve(rows() + moreRows);
+        detailsOffset.reserve(rows() + moreRows + 1);
+        detailsArena.reserve(detailsArena.size() + moreDetails);
+    }
+
+    // Appends every row of 'other', translating its dictionary codes into ours.
+    void appendTable(const ColumnarTable& other) {
+        const auto remap = [](Dictionary& into, const Dictionary& from) {
+            std::vector<std::uint32_t> mapping(from.size());
+            for (std::uint32_t code = 0; code < from.size(); ++code) {
+                mapping[code] = into.intern(from.value(code));
+            }
+            return mapping;
+        };
+        const std::vector<std::uint32_t> userMap = remap(users, other.users);
+        const std::vector<std::uint32_t> actionMap = remap(actions, other.actions);
+        const std::vector<std::uint32_t> statusMap = remap(statuses, other.statuses);
+
+        timestamp.insert(timestamp.end(), other.timestamp.begin(), other.timestamp.end());
+        ip.insert(ip.end(), other.ip.begin(), other.ip.end());
+        latencyMs.insert(latencyMs.end(), other.latencyMs.begin(), other.latencyMs.end());
+        for (std::uint32_t code : other.user) {
+            user.push_back(userMap[code]);
+        }
+        for (std::uint32_t code : other.action) {
+            action.push_back(actionMap[code]);
+        }
+        for (std::uint32_t code : other.status) {
+            status.push_back(statusMap[code]);
+        }
+        const std::uint64_t base = detailsArena.size();
+        detailsArena += other.detailsArena;
+        for (std::size_t row = 1; row < other.detailsOffset.size(); ++row) {
+            detailsOffset.push_back(base + other.detailsOffset[row]);
+        }
+        malformedLines += other.malformedLines;
+    }
+};
+
+// --- Loading a Log File ---
+// Parses 'path' on 'threadCount' workers and concatenates their tables in file
+// order. Returns false (with 'error') on an I/O error. With a 'governor', the
+// workers read blocks of its size, and their tables take their bytes from its
+// memory budget. Merging them needs the finished table and the workers'
+// tables at once, so a log loads only if its table fits in half the budget.
+// With a 'placement', each worker is pinned before it builds its table.
+inline bool loadColumnarTable(const std::string& path, unsigned threadCount, const LineParser& parser, ColumnarTable& table,
+                              std::string& error, ResourceGovernor* governor = nullptr,
+                              const WorkerPlacement* placement = nullptr) {
+    constexpr std::size_t kRowsPerReservation = 65536;
+    const std::size_t blockBytes = governor != nullptr ? governor->blockBytes() : kReadBlockBytes;
+    const std::vector<ByteRange> ranges = splitFileIntoRanges(path, threadCount);
+    std::vector<ColumnarTable> parts(ranges.size());
+    std::vector<std::size_t> reserved(ranges.size(), 0); // Bytes each part holds of the budget.
+    std::vector<char> workerOk(ranges.size(), 1);
+
+    // Takes the bytes 'part' has grown by since the last call from the budget,
+    // and cancels the load if they are not there.
+    const auto account = [&](std::size_t w) {
+        const std::size_t bytes = parts[w].memoryBytes();
+        if (bytes > reserved[w]) {
+            if (!governor->memory().reserve(bytes - reserved[w])) {
+                governor->cancel("the table for " + path + " needs more than the memory limit allows");
+                return;
+            }
+            reserved[w] = bytes;
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (std::size_t w = 0; w < ranges.size(); ++w) {
+        workers.emplace_back([&, w]() {
+            if (placement != nullptr) {
+                placement->pin(w);
+            }
+            ResourceGovernor::Worker place(governor);
+            std::ifstream input(path, std::ios::binary);
+            std::string block;
+            LogRecord record;
+            ColumnarTable& part = parts[w];
+            std::size_t sinceReservation = 0;
+            workerOk[w] = input.is_open() &&
+                forEachLineInRange(input, ranges[w], blockBytes, block, [&](std::string_view line, std::uint64_t) {
+                    if (!parser.parse(line, record) || !part.append(record)) {
+                        part.malformedLines++;
+                    }
+                    if (governor != nullptr && ++sinceReservation == kRowsPerReservation) {
+                        sinceReservation = 0;
+                        account(w);
+                    }
+                }, governor);
+            if (governor != nullptr && workerOk[w]) {
+                account(w);
+                workerOk[w] = !governor->cancelled();
+            }
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    if (governor != nullptr) {
+        governor->releaseReadBuffers();
+    }
+    for (std::size_t w = 0; w < parts.size(); ++w) {
+        if (!workerOk[w]) {
+            error = governor != nullptr && governor->cancelled() ? governor->cancelReason()
+                                                                 : "I/O failure while reading " + path;
+            return false;
+        }
+    }
+
+    std::size_t rows = 0;
+    std::size_t detailsBytes = 0;
+    for (const ColumnarTable& part : parts) {
+        rows += part.rows();
+        detailsBytes += part.detailsArena.size();
+    }
+    table.reserveMore(rows, detailsBytes);
+    if (governor != nullptr && !governor->memory().reserve(table.memoryBytes())) {
+        error = "merging the table for " + path + " needs more than the memory limit allows";
+        return false;
+    }
+    for (std::size_t w = 0; w < parts.size(); ++w) {
+        table.appendTable(parts[w]);
+        parts[w] = ColumnarTable(); // Release each part as soon as it is merged.
+        if (governor != nullptr) {
+            governor->memory().release(reserved[w]);
+        }
+    }
+    return true;
+}
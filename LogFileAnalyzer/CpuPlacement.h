@@ -0,0 +1,177 @@
+/**
+ * @file CpuPlacement.h
+ * @brief Pinning worker threads to cores, spread over the NUMA nodes (--pin-threads).
+ *
+ * @details On a host with several sockets, each socket's memory is close to
+ * its own cores and slower to reach from the others. A worker that wanders
+ * between sockets reads its buffers across the interconnect. With pinning,
+ * worker w stays on one core of node w % nodes, so the workers are spread
+ * evenly over the nodes' memory bandwidth. Each worker pins itself before it
+ * allocates anything. The kernel places a page on the node of the thread that
+ * first touches it, so the worker's read buffer and partial results are
+ * local to it.
+ *
+ * Only the CPUs the process may run on (taskset, cgroups) are used. The
+ * nodes come from /sys/devices/system/node on Linux. Windows is treated as
+ * one node of up to 64 CPUs. Elsewhere, threads are not pinned.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN // Keeps windows.h from pulling in the old winsock.h.
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Parses a kernel list of CPUs or nodes, such as "0-15,32-47".
+inline std::vector<unsigned> parseCpuList(const std::string& text) {
+    std::vector<unsigned> cpus;
+    std::size_t position = 0;
+    while (position < text.size()) {
+        std::size_t end = text.find(',', position);
+        if (end == std::string::npos) {
+            end = text.size();
+        }
+        const std::string item = text.substr(position, end - position);
+        const std::size_t dash = item.find('-');
+        try {
+            const unsigned first = static_cast<unsigned>(std::stoul(item.substr(0, dash)));
+            const unsigned last = dash == std::string::npos ? first : static_cast<unsigned>(std::stoul(item.substr(dash + 1)));
+            for (unsigned cpu = first; cpu <= last; ++cpu) {
+                cpus.push_back(cpu);
+            }
+        }
+        catch (const std::exception&) {
+            // A blank or malformed item; skip it.
+        }
+        position = end + 1;
+    }
+    return cpus;
+}
+
+// --- Placement ---
+class WorkerPlacement {
+public:
+    // Reads the topology if 'enabled'; otherwise nothing is ever pinned.
+    explicit WorkerPlacement(bool enabled) {
+        if (enabled) {
+            readTopology();
+        }
+    }
+
+    bool enabled() const { return !nodes_.empty(); }
+    std::size_t nodeCount() const { return nodes_.size(); }
+
+    // The node of worker 'worker' (0 when not pinned).
+    std::size_t nodeOf(std::size_t worker) const { return nodes_.empty() ? 0 : worker % nodes_.size(); }
+
+    // Pins the calling thread to the core of worker 'worker'. Returns false if
+    // placement is off or the system refused.
+    bool pin(std::size_t worker) const {
+        if (nodes_.empty()) {
+            return false;
+        }
+        const std::vector<unsigned>& cpus = nodes_[nodeOf(worker)];
+        const unsigned cpu = cpus[(worker / nodes_.size()) % cpus.size()];
+#ifdef _WIN32
+        const bool ok = SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu) != 0;
+#elif defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        const bool ok = pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+        (void)cpu;
+        const bool ok = false;
+#endif
+        pinned_ += ok ? 1 : 0;
+        return ok;
+    }
+
+    // E.g. "8 of 8 workers pinned over 2 NUMA nodes (32 CPUs)".
+    std::string describe(std::size_t workers) const {
+        std::size_t cpus = 0;
+        for (const std::vector<unsigned>& node : nodes_) {
+            cpus += node.size();
+        }
+        return std::to_string(pinned_.load()) + " of " + std::to_string(workers) + " workers pinned over " +
+               std::to_string(nodes_.size()) + (nodes_.size() == 1 ? " NUMA node (" : " NUMA nodes (") +
+               std::to_string(cpus) + (cpus == 1 ? " CPU)" : " CPUs)");
+    }
+
+private:
+    void readTopology() {
+#ifdef _WIN32
+        DWORD_PTR processMask = 0;
+        DWORD_PTR systemMask = 0;
+        std::vector<unsigned> cpus;
+        if (GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask)) {
+            for (unsigned cpu = 0; cpu < sizeof(DWORD_PTR) * 8; ++cpu) {
+                if (processMask & (DWORD_PTR(1) << cpu)) {
+                    cpus.push_back(cpu);
+                }
+            }
+        }
+        if (!cpus.empty()) {
+            nodes_.push_back(cpus);
+        }
+#elif defined(__linux__)
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+            return;
+        }
+        const auto keepAllowed = [&](const std::vector<unsigned>& cpus) {
+            std::vector<unsigned> kept;
+            for (unsigned cpu : cpus) {
+                if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)) {
+                    kept.push_back(cpu);
+                }
+            }
+            return kept;
+        };
+        // Node numbers can have gaps, e.g. after memory is taken offline.
+        std::ifstream online("/sys/devices/system/node/online");
+        std::string text;
+        std::getline(online, text);
+        for (unsigned node : parseCpuList(text)) {
+            std::ifstream list("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+            std::string cpuList;
+            std::getline(list, cpuList);
+            std::vector<unsigned> cpus = keepAllowed(parseCpuList(cpuList));
+            if (!cpus.empty()) {
+                nodes_.push_back(std::move(cpus));
+            }
+        }
+        if (nodes_.empty()) {
+            std::vector<unsigned> all;
+            for (unsigned cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+                all.push_back(cpu);
+            }
+            std::vector<unsigned> cpus = keepAllowed(all);
+            if (!cpus.empty()) {
+                nodes_.push_back(std::move(cpus));
+            }
+        }
+#endif
+    }
+
+    std::vector<std::vector<unsigned>> nodes_; // The allowed CPUs of each node that has any.
+    mutable std::atomic<std::size_t> pinned_{ 0 }; // Threads pin() has pinned.
+};
@@ -0,0 +1,165 @@
+/**
+ * @file Deduplicator.h
+ * @brief Dropping log lines that were replayed after a shipper failover.
+ *
+ * @details A replayed segment repeats lines that were already delivered a short
+ * time earlier, so duplicates only need to be looked for among recent lines.
+ * The Deduplicator keeps the lines whose timestamps fall inside a sliding time
+ * window, grouped into buckets of a few seconds each. When the newest timestamp
+ * moves forward, whole buckets that fell out of the window are freed at once,
+ * which keeps memory proportional to the window rather than to the file.
+ *
+ * Each bucket has two layers:
+ *  - a small Bloom filter over the 64-bit line hashes, which answers "definitely
+ *    new" for almost every line without touching the hash table, and
+ *  - an exact table from hash to the stored line text, consulted only when the
+ *    Bloom filter says "maybe", so a hash collision can never drop a real line.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "Hash.h"
+
+// --- Time-Windowed Duplicate Filter ---
+class Deduplicator {
+public:
+    // 'windowSeconds' is how far back a replay may reach. Lines older than the
+    // window (relative to the newest timestamp seen) are never reported as
+    // duplicates, because the evidence needed to tell has been discarded.
+    explicit Deduplicator(long long windowSeconds)
+        : windowSeconds_(windowSeconds < 1 ? 1 : windowSeconds),
+          bucketSeconds_(windowSeconds_ < kBucketsPerWindow ? 1 : windowSeconds_ / kBucketsPerWindow) {}
+
+    // Returns true if an identical line was already seen inside the window;
+    // otherwise remembers the line and returns false. 'timestamp' must be the
+    // line's own timestamp, so identical lines always land in the same bucket.
+    bool isDuplicate(long long timestamp, std::string_view line) {
+        if (!buckets_.empty() && timestamp < newestTimestamp_ - windowSeconds_) {
+            ++linesOutsideWindow_;
+            return false;
+        }
+        if (buckets_.empty() || timestamp > newestTimestamp_) {
+            newestTimestamp_ = timestamp;
+            evictExpired();
+        }
+
+        Bucket& bucket = bucketFor(timestamp / bucketSeconds_);
+        const std::uint64_t hash = hashLine(line);
+
+        if (bucket.mayContain(hash)) {
+            auto range = bucket.exact.equal_range(hash);
+            for (auto it = range.first; it != range.second; ++it) {
+                if (bucket.textAt(it->second) == line) {
+                    return true;
+                }
+            }
+        }
+        bucket.insert(hash, line);
+        return false;
+    }
+
+    // Lines that arrived too late to be checked against the window.
+    long long linesOutsideWindow() const { return linesOutsideWindow_; }
+
+    // Bytes currently held for the window; useful for checking the memory bound.
+    std::size_t retainedBytes() const {
+        std::size_t bytes = 0;
+        for (const Bucket& bucket : buckets_) {
+            bytes += bucket.text.capacity() + bucket.bloom.size() * sizeof(std::uint64_t) +
+                     bucket.exact.size() * (sizeof(std::uint64_t) + sizeof(std::uint32_t) * 2);
+        }
+        return bytes;
+    }
+
+private:
+    static constexpr long long kBucketsPerWindow = 16;
+    static constexpr std::size_t kInitialBloomWords = 1024; // 64 Kbit per bucket to start with.
+
+    struct Bucket {
+        long long id = 0;
+        std::vector<std::uint64_t> bloom = std::vector<std::uint64_t>(kInitialBloomWords, 0);
+        std::string text;                                   // Every stored line, back to back.
+        std::unordered_multimap<std::uint64_t, std::uint32_t> exact; // hash -> offset into 'text'.
+
+        // Two probe bits derived from the one hash. With ~8 bits per stored line
+        // the false-positive rate stays around 5%, and a false positive only
+        // costs one exact lookup.
+        bool mayContain(std::uint64_t hash) const {
+            const std::size_t bits = bloom.size() * 64;
+            const std::size_t a = static_cast<std::size_t>(hash % bits);
+            const std::size_t b = static_cast<std::size_t>((hash >> 32) % bits);
+            return (bloom[a / 64] >> (a % 64) & 1) && (bloom[b / 64] >> (b % 64) & 1);
+        }
+
+        void setBits(std::uint64_t hash) {
+            const std::size_t bits = bloom.size() * 64;
+            const std::size_t a = static_cast<std::size_t>(hash % bits);
+            const std::size_t b = static_cast<std::size_t>((hash >> 32) % bits);
+            bloom[a / 64] |= 1ull << (a % 64);
+            bloom[b / 64] |= 1ull << (b % 64);
+        }
+
+        void insert(std::uint64_t hash, std::string_view line) {
+            // Double the filter when it gets crowded, rebuilding it from the
+            // exact table so its error rate stays low as the bucket fills.
+            if ((exact.size() + 1) * 8 > bloom.size() * 64) {
+                bloom.assign(bloom.size() * 2, 0);
+                for (const auto& entry : exact) {
+                    setBits(entry.first);
+                }
+            }
+            // Lines are stored length-prefixed so 'exact' only needs an offset.
+            const std::uint32_t offset = static_cast<std::uint32_t>(text.size());
+            const std::uint32_t length = static_cast<std::uint32_t>(line.size());
+            text.append(reinterpret_cast<const char*>(&length), sizeof(length));
+            text.append(line.data(), line.size());
+            exact.emplace(hash, offset);
+            setBits(hash);
+        }
+
+        std::string_view textAt(std::uint32_t offset) const {
+            std::uint32_t length = 0;
+            std::memcpy(&length, text.data() + offset, sizeof(length));
+            return std::string_view(text.data() + offset + sizeof(length), length);
+        }
+    };
+
+    Bucket& bucketFor(long long id) {
+        // Buckets are kept in ascending id order; timestamps are mostly in order,
+        // so the wanted bucket is almost always the last one.
+        for (auto it = buckets_.rbegin(); it != buckets_.rend(); ++it) {
+            if (it->id == id) {
+                return *it;
+            }
+            if (it->id < id) {
+                auto inserted = buckets_.insert(it.base(), Bucket());
+                inserted->id = id;
+                return *inserted;
+            }
+        }
+        buckets_.emplace_front();
+        buckets_.front().id = id;
+        return buckets_.front();
+    }
+
+    void evictExpired() {
+        const long long oldestKept = (newestTimestamp_ - windowSeconds_) / bucketSeconds_;
+        while (!buckets_.empty() && buckets_.front().id < oldestKept) {
+            buckets_.pop_front();
+        }
+    }
+
+    long long windowSeconds_;
+    long long bucketSeconds_;
+    long long newestTimestamp_ = 0;
+    long long linesOutsideWindow_ = 0;
+    std::deque<Bucket> buckets_;
+};
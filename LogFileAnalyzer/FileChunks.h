@@ -0,0 +1,139 @@
+/**
+ * @file FileChunks.h
+ * @brief Splitting a log file into newline-aligned byte ranges for parallel scans.
+ *
+ * @details Worker threads each own one ByteRange. A range always starts at the
+ * first byte of a line and ends just after a '\n' (or at end of file), so no line
+ * is ever split between two workers and every line is seen exactly once.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ResourceGovernor.h"
+
+// --- A Half-Open Slice [begin, end) of a File ---
+struct ByteRange {
+    std::uint64_t begin = 0;
+    std::uint64_t end = 0;
+};
+
+// Returns the size of the file in bytes, or -1 if it cannot be opened.
+inline long long fileSizeOf(const std::string& path) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) {
+        return -1;
+    }
+    return static_cast<long long>(file.tellg());
+}
+
+// --- Range Splitting ---
+// Cuts the file into roughly 'parts' equal ranges, then nudges every interior
+// boundary forward to just past the next newline. Empty ranges (possible when a
+// single line is longer than a whole part) are dropped.
+inline std::vector<ByteRange> splitFileIntoRanges(const std::string& path, std::size_t parts) {
+    std::vector<ByteRange> ranges;
+    const long long size = fileSizeOf(path);
+    if (size <= 0) {
+        return ranges;
+    }
+    parts = std::max<std::size_t>(1, parts);
+
+    std::ifstream file(path, std::ios::binary);
+    const std::uint64_t total = static_cast<std::uint64_t>(size);
+    std::uint64_t begin = 0;
+
+    for (std::size_t i = 1; i <= parts && begin < total; ++i) {
+        std::uint64_t end = (i == parts) ? total : total * i / parts;
+        if (end <= begin) {
+            continue;
+        }
+        if (end < total) {
+            // Scan forward from the tentative boundary to the end of its line.
+            file.clear();
+            file.seekg(static_cast<std::streamoff>(end - 1));
+            char c = 0;
+            while (file.get(c) && c != '\n') {
+            }
+            end = file ? static_cast<std::uint64_t>(file.tellg()) : total;
+        }
+        ranges.push_back({ begin, end });
+        begin = end;
+    }
+    return ranges;
+}
+
+// Calls 'onLine(std::string_view)' for every line in 'text', without the '\n'.
+// A final line with no trailing newline is still reported.
+template<typename Fn>
+void forEachLine(std::string_view text, Fn&& onLine) {
+    while (!text.empty()) {
+        const std::size_t newline = text.find('\n');
+        if (newline == std::string_view::npos) {
+            onLine(text);
+            return;
+        }
+        onLine(text.substr(0, newline));
+        text.remove_prefix(newline + 1);
+    }
+}
+
+// --- Range Reading ---
+// Streams the lines of 'range' to 'onLine(std::string_view line, std::uint64_t
+// offset)' in blocks of about
+// 'blockSize' bytes, so a worker never holds more than one block (plus one
+// partial line) in memory no matter how large its range is. 'buffer' is
+// reused across calls to avoid reallocating per block. 'offset' is the position
+// of the line's first byte in the file, so the line can be re-read later. A
+// 'governor' paces the reads and may pause or cancel the scan between blocks;
+// while it tunes the scan, its blockBytes() replaces 'blockSize'.
+template<typename Fn>
+bool forEachLineInRange(std::ifstream& file, const ByteRange& range, std::size_t blockSize,
+                        std::string& buffer, Fn&& onLine, ResourceGovernor* governor = nullptr) {
+    file.clear();
+    file.seekg(static_cast<std::streamoff>(range.begin));
+
+    std::uint64_t remaining = range.end - range.begin;
+    std::size_t carry = 0; // Bytes of an unfinished line kept from the previous block.
+    std::uint64_t bufferStart = range.begin; // File offset of buffer[0].
+
+    while (remaining > 0) {
+        const std::size_t size = governor != nullptr ? governor->blockBytes() : blockSize;
+        const std::size_t want = static_cast<std::size_t>(std::min<std::uint64_t>(remaining, size));
+        if (governor != nullptr && !governor->beforeRead(want)) {
+            return false;
+        }
+        buffer.resize(carry + want);
+        file.read(&buffer[carry], static_cast<std::streamsize>(want));
+        if (static_cast<std::size_t>(file.gcount()) != want) {
+            return false;
+        }
+        if (governor != nullptr) {
+            governor->afterRead(want);
+        }
+        remaining -= want;
+
+        std::string_view block(buffer.data(), buffer.size());
+        const std::size_t lastNewline = block.rfind('\n');
+        if (remaining > 0 && lastNewline == std::string_view::npos) {
+            // One line is longer than the whole block; keep growing the carry.
+            carry = buffer.size();
+            continue;
+        }
+        const std::size_t complete = (remaining == 0) ? block.size() : lastNewline + 1;
+        forEachLine(block.substr(0, complete), [&](std::string_view line) {
+            onLine(line, bufferStart + static_cast<std::uint64_t>(line.data() - buffer.data()));
+        });
+
+        carry = block.size() - complete;
+        buffer.erase(0, complete);
+        bufferStart += complete;
+    }
+    return true;
+}
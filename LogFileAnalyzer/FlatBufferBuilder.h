@@ -0,0 +1,159 @@
+/**
+ * @file FlatBufferBuilder.h
+ * @brief A minimal FlatBuffers encoder, enough to write Arrow IPC metadata.
+ *
+ * @details FlatBuffers are built back to front: children (strings, vectors,
+ * sub-tables) are written before the table that points at them, and every
+ * reference is an offset measured from the end of the buffer. This builder
+ * keeps the bytes in reverse order so that "prepend" is a cheap append, and
+ * flips them once in finish().
+ *
+ * Only what the Arrow schema needs is supported: tables with scalar, offset and
+ * union fields, strings, vectors of tables, and vectors of plain structs.
+ * Tables cannot be nested while being built; finish each child first.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+class FlatBufferBuilder {
+public:
+    // A reference to something already written: its distance from the end of
+    // the buffer.
+    using Ref = std::uint32_t;
+
+    // --- Tables ---
+    void startTable() {
+        fields_.clear();
+        tableEnd_ = size();
+    }
+
+    void addBool(std::uint16_t id, bool value) { addScalar<std::uint8_t>(id, value ? 1 : 0); }
+    void addUint8(std::uint16_t id, std::uint8_t value) { addScalar(id, value); }
+    void addInt16(std::uint16_t id, std::int16_t value) { addScalar(id, value); }
+    void addInt32(std::uint16_t id, std::int32_t value) { addScalar(id, value); }
+    void addInt64(std::uint16_t id, std::int64_t value) { addScalar(id, value); }
+
+    void addOffset(std::uint16_t id, Ref target) {
+        prepareFor(4, 0);
+        prependOffset(target);
+        fields_.emplace_back(id, size());
+    }
+
+    Ref endTable() {
+        // The table starts with a signed offset to its vtable, patched below.
+        prepareFor(4, 0);
+        prependScalar<std::int32_t>(0);
+        const Ref table = size();
+
+        std::uint16_t fieldCount = 0;
+        for (const auto& field : fields_) {
+            fieldCount = std::max<std::uint16_t>(fieldCount, static_cast<std::uint16_t>(field.first + 1));
+        }
+        std::vector<std::uint16_t> slots(fieldCount, 0);
+        for (const auto& field : fields_) {
+            slots[field.first] = static_cast<std::uint16_t>(table - field.second);
+        }
+        // vtable: [vtable bytes][table bytes][one slot per field id]. It goes
+        // directly in front of the table, so no padding is needed.
+        for (std::size_t i = slots.size(); i-- > 0;) {
+            prependScalar(slots[i]);
+        }
+        prependScalar(static_cast<std::uint16_t>(table - tableEnd_));
+        prependScalar(static_cast<std::uint16_t>(4 + 2 * slots.size()));
+        const Ref vtable = size();
+
+        patchInt32(table, static_cast<std::int32_t>(vtable - table));
+        fields_.clear();
+        return table;
+    }
+
+    // --- Strings and Vectors ---
+    Ref createString(std::string_view text) {
+        prepareFor(4, text.size() + 1);
+        reversed_.push_back('\0');
+        reversed_.append(text.rbegin(), text.rend());
+        prependScalar(static_cast<std::uint32_t>(text.size()));
+        return size();
+    }
+
+    Ref createTableVector(const std::vector<Ref>& items) {
+        prepareFor(4, 4 * items.size());
+        for (std::size_t i = items.size(); i-- > 0;) {
+            prependOffset(items[i]);
+        }
+        prependScalar(static_cast<std::uint32_t>(items.size()));
+        return size();
+    }
+
+    // A vector of structs given as raw little-endian bytes, 'elementSize' each.
+    Ref createStructVector(std::string_view elements, std::size_t elementSize, std::size_t alignment) {
+        const std::size_t count = elementSize == 0 ? 0 : elements.size() / elementSize;
+        prepareFor(4, elements.size());
+        prepareFor(alignment, elements.size());
+        reversed_.append(elements.rbegin(), elements.rend());
+        prependScalar(static_cast<std::uint32_t>(count));
+        return size();
+    }
+
+    // Writes the root offset and returns the finished buffer, whose size is a
+    // multiple of 8 so it can be followed directly by 8-byte aligned data.
+    std::string finish(Ref root) {
+        prepareFor(std::max<std::size_t>(maxAlignment_, 8), 4);
+        prependOffset(root);
+        std::string out(reversed_.rbegin(), reversed_.rend());
+        reversed_.clear();
+        maxAlignment_ = 1;
+        return out;
+    }
+
+private:
+    Ref size() const { return static_cast<Ref>(reversed_.size()); }
+
+    // Pads so that, after 'additional' more bytes, the next 'alignment'-sized
+    // value lands on a multiple of 'alignment' from the end.
+    void prepareFor(std::size_t alignment, std::size_t additional) {
+        maxAlignment_ = std::max(maxAlignment_, alignment);
+        const std::size_t padding = (~(reversed_.size() + additional) + 1) & (alignment - 1);
+        reversed_.append(padding, '\0');
+    }
+
+    template <typename T>
+    void prependScalar(T value) {
+        prepareFor(sizeof(T), 0);
+        const auto bits = static_cast<std::uint64_t>(value);
+        for (std::size_t i = sizeof(T); i-- > 0;) {
+            reversed_.push_back(static_cast<char>((bits >> (8 * i)) & 0xFF));
+        }
+    }
+
+    // An unsigned offset is relative to its own position, pointing forward.
+    void prependOffset(Ref target) {
+        prepareFor(4, 0);
+        prependScalar(static_cast<std::uint32_t>(size() + 4 - target));
+    }
+
+    template <typename T>
+    void addScalar(std::uint16_t id, T value) {
+        prependScalar(value);
+        fields_.emplace_back(id, size());
+    }
+
+    void patchInt32(Ref at, std::int32_t value) {
+        const auto bits = static_cast<std::uint32_t>(value);
+        for (std::size_t k = 0; k < 4; ++k) {
+            reversed_[at - 1 - k] = static_cast<char>((bits >> (8 * k)) & 0xFF);
+        }
+    }
+
+    std::string reversed_;
+    std::size_t maxAlignment_ = 1;
+    std::vector<std::pair<std::uint16_t, Ref>> fields_; // Field id -> where it was written.
+    Ref tableEnd_ = 0;
+};
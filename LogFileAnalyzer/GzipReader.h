@@ -0,0 +1,564 @@
+/**
+ * @file GzipReader.h
+ * @brief Streaming decompression of gzip files, without zlib.
+ *
+ * @details A gzip file is one or more members, each a small header, a DEFLATE
+ * stream (RFC 1951) and a CRC-32 and size trailer (RFC 1952). GzipReader
+ * inflates the file piece by piece into one buffer that also serves as the
+ * 32 KiB back-reference window, so memory use does not depend on the size of
+ * the file. Huffman codes of up to 10 bits are decoded with one table lookup,
+ * which covers nearly every symbol in practice. Longer codes take a bit-by-bit
+ * walk over the canonical code.
+ *
+ * A compressed file cannot be split into ranges for several threads: the
+ * decoder has to start at the beginning. Each gzip file is therefore read by
+ * one worker.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "FileChunks.h"
+
+// --- CRC-32 (the gzip trailer checksum) ---
+inline std::uint32_t updateCrc32(std::uint32_t crc, const char* data, std::size_t size) {
+    // Slicing by 4: four table lookups per 32-bit word instead of one per byte.
+    static const auto tables = [] {
+        std::array<std::array<std::uint32_t, 256>, 4> t{};
+        for (std::uint32_t i = 0; i < 256; ++i) {
+            std::uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            t[0][i] = c;
+        }
+        for (std::uint32_t i = 0; i < 256; ++i) {
+            for (std::size_t s = 1; s < 4; ++s) {
+                t[s][i] = (t[s - 1][i] >> 8) ^ t[0][t[s - 1][i] & 0xFF];
+            }
+        }
+        return t;
+    }();
+
+    const auto* p = reinterpret_cast<const unsigned char*>(data);
+    crc = ~crc;
+    for (; size >= 4; size -= 4, p += 4) {
+        crc ^= static_cast<std::uint32_t>(p[0]) | static_cast<std::uint32_t>(p[1]) << 8 |
+               static_cast<std::uint32_t>(p[2]) << 16 | static_cast<std::uint32_t>(p[3]) << 24;
+        crc = tables[3][crc & 0xFF] ^ tables[2][(crc >> 8) & 0xFF] ^ tables[1][(crc >> 16) & 0xFF] ^ tables[0][crc >> 24];
+    }
+    for (; size > 0; --size, ++p) {
+        crc = tables[0][(crc ^ *p) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+// --- Huffman Tables ---
+class HuffmanTable {
+public:
+    static constexpr unsigned kMaxBits = 15;
+    static constexpr unsigned kFastBits = 10;
+
+    // Builds the canonical code for 'lengths' (0 = symbol unused). Returns
+    // false if the lengths over-subscribe the code space.
+    bool build(const std::uint8_t* lengths, unsigned symbolCount) {
+        counts_.fill(0);
+        fast_.fill(0);
+        for (unsigned s = 0; s < symbolCount; ++s) {
+            counts_[lengths[s]]++;
+        }
+        counts_[0] = 0;
+        int left = 1;
+        for (unsigned length = 1; length <= kMaxBits; ++length) {
+            left = (left << 1) - counts_[length];
+            if (left < 0) {
+                return false;
+            }
+        }
+
+        std::array<std::uint16_t, kMaxBits + 2> offsets{};
+        for (unsigned length = 1; length <= kMaxBits; ++length) {
+            offsets[length + 1] = static_cast<std::uint16_t>(offsets[length] + counts_[length]);
+        }
+        for (unsigned s = 0; s < symbolCount; ++s) {
+            if (lengths[s] != 0) {
+                symbols_[offsets[lengths[s]]++] = static_cast<std::uint16_t>(s);
+            }
+        }
+
+        // Short codes go into the lookup table, bit-reversed because DEFLATE
+        // packs Huffman codes starting from their most significant bit.
+        unsigned code = 0;
+        unsigned index = 0;
+        for (unsigned length = 1; length <= kFastBits; ++length) {
+            for (unsigned i = 0; i < counts_[length]; ++i, ++code, ++index) {
+                unsigned reversed = 0;
+                for (unsigned b = 0; b < length; ++b) {
+                    reversed |= ((code >> b) & 1u) << (length - 1 - b);
+                }
+                const auto entry = static_cast<std::uint16_t>(symbols_[index] << 4 | length);
+                for (unsigned fill = reversed; fill < (1u << kFastBits); fill += 1u << length) {
+                    fast_[fill] = entry;
+                }
+            }
+            code <<= 1;
+        }
+        return true;
+    }
+
+    // Decodes one symbol from the low bits of 'bits', of which 'available'
+    // are valid. Sets 'length' to the number of bits used; 0 means invalid.
+    unsigned decode(std::uint64_t bits, unsigned available, unsigned& length) const {
+        const std::uint16_t entry = fast_[bits & ((1u << kFastBits) - 1)];
+        if (entry != 0) {
+            length = (entry & 15u) <= available ? entry & 15u : 0;
+            return entry >> 4;
+        }
+        int code = 0;
+        int first = 0;
+        int index = 0;
+        for (unsigned bit = 1; bit <= kMaxBits && bit <= available; ++bit) {
+            code |= static_cast<int>((bits >> (bit - 1)) & 1u);
+            const int count = counts_[bit];
+            if (code - count < first) {
+                length = bit;
+                return symbols_[static_cast<std::size_t>(index + (code - first))];
+            }
+            index += count;
+            first = (first + count) << 1;
+            code <<= 1;
+        }
+        length = 0;
+        return 0;
+    }
+
+private:
+    std::array<std::uint16_t, kMaxBits + 1> counts_{};
+    std::array<std::uint16_t, 288> symbols_{};
+    std::array<std::uint16_t, 1u << kFastBits> fast_{};
+};
+
+// --- The Reader ---
+class GzipReader {
+public:
+    static constexpr std::size_t kWindowBytes = 32u << 10;
+    static constexpr std::size_t kChunkBytes = 4u << 20;
+
+    // 'chunkBytes' caps the pieces next() returns, and with them the buffer.
+    // A 'governor' paces the reads of compressed data.
+    bool open(const std::string& path, std::size_t chunkBytes = kChunkBytes, ResourceGovernor* governor = nullptr) {
+        file_.open(path, std::ios::binary);
+        chunkBytes_ = std::min(chunkBytes, kChunkBytes);
+        governor_ = governor;
+        input_.resize(1u << 16);
+        output_.resize(kWindowBytes + chunkBytes_ + 512);
+        state_ = State::Header;
+        return file_.is_open();
+    }
+
+    // Decompresses the next piece of the file, of about 'maxBytes' bytes.
+    // Returns false once everything has been returned, or on an error (then
+    // failed() is true).
+    bool next(std::string_view& chunk, std::size_t maxBytes = kChunkBytes) {
+        maxBytes = std::min(maxBytes, chunkBytes_);
+        // Everything handed out so far is the caller's to forget; keep only the
+        // window that later back-references may point into.
+        updateCheck();
+        if (outEnd_ > kWindowBytes) {
+            const std::size_t shift = outEnd_ - kWindowBytes;
+            std::memmove(&output_[0], &output_[shift], kWindowBytes);
+            memberStart_ = memberStart_ > shift ? memberStart_ - shift : 0;
+            outEnd_ = kWindowBytes;
+            checked_ = kWindowBytes;
+        }
+        const std::size_t start = outEnd_;
+        while (state_ != State::Done && state_ != State::Failed && outEnd_ - start < maxBytes) {
+            step(start + maxBytes);
+        }
+        chunk = std::string_view(output_.data() + start, outEnd_ - start);
+        return state_ != State::Failed && !chunk.empty();
+    }
+
+    bool failed() const { return state_ == State::Failed; }
+    const std::string& error() const { return error_; }
+
+private:
+    enum class State { Header, BlockHeader, Stored, Compressed, Trailer, Done, Failed };
+
+    // --- Bits ---
+    // Tops the bit buffer up to at least 'count' bits if the file has them.
+    bool need(unsigned count) {
+        while (bitCount_ < count) {
+            if (inPos_ == inEnd_) {
+                if (governor_ != nullptr && !governor_->beforeRead(input_.size())) {
+                    return fail("the scan was cancelled");
+                }
+                file_.read(reinterpret_cast<char*>(input_.data()), static_cast<std::streamsize>(input_.size()));
+                inPos_ = 0;
+                inEnd_ = static_cast<std::size_t>(file_.gcount());
+                if (governor_ != nullptr) {
+                    governor_->afterRead(inEnd_);
+                }
+                if (inEnd_ == 0) {
+                    return false;
+                }
+            }
+            while (bitCount_ <= 56 && inPos_ < inEnd_) {
+                bitBuffer_ |= static_cast<std::uint64_t>(input_[inPos_++]) << bitCount_;
+                bitCount_ += 8;
+            }
+        }
+        return true;
+    }
+
+    unsigned take(unsigned count) {
+        const auto value = static_cast<unsigned>(bitBuffer_ & ((std::uint64_t(1) << count) - 1));
+        bitBuffer_ >>= count;
+        bitCount_ -= count;
+        return value;
+    }
+
+    bool read(unsigned count, unsigned& value) {
+        if (!need(count)) {
+            return fail("unexpected end of compressed data");
+        }
+        value = take(count);
+        return true;
+    }
+
+    bool symbol(const HuffmanTable& table, unsigned& value) {
+        need(HuffmanTable::kMaxBits); // Near the end of the file fewer bits may be left.
+        unsigned length = 0;
+        value = table.decode(bitBuffer_, bitCount_, length);
+        if (length == 0) {
+            return fail("invalid Huffman code");
+        }
+        take(length);
+        return true;
+    }
+
+    bool fail(const char* message) {
+        if (state_ != State::Failed) {
+            error_ = message;
+            state_ = State::Failed;
+        }
+        return false;
+    }
+
+    // --- Decoding ---
+    void step(std::size_t limit) {
+        switch (state_) {
+        case State::Header: readHeader(); break;
+        case State::BlockHeader: readBlockHeader(); break;
+        case State::Stored: copyStored(limit); break;
+        case State::Compressed: inflateSymbols(limit); break;
+        case State::Trailer: readTrailer(); break;
+        case State::Done:
+        case State::Failed: break;
+        }
+    }
+
+    void readHeader() {
+        unsigned id1 = 0, id2 = 0, method = 0, flags = 0, skipped = 0;
+        if (!read(8, id1) || !read(8, id2) || id1 != 0x1F || id2 != 0x8B) {
+            fail("not a gzip file");
+            return;
+        }
+        if (!read(8, method) || method != 8 || !read(8, flags)) {
+            fail("unsupported gzip compression method");
+            return;
+        }
+        for (int i = 0; i < 6; ++i) { // Modification time, extra flags, OS.
+            if (!read(8, skipped)) return;
+        }
+        if (flags & 4) { // FEXTRA
+            unsigned low = 0, high = 0;
+            if (!read(8, low) || !read(8, high)) return;
+            for (unsigned i = 0; i < (low | high << 8); ++i) {
+                if (!read(8, skipped)) return;
+            }
+        }
+        for (unsigned flag : { 8u, 16u }) { // FNAME, FCOMMENT: zero-terminated.
+            if (flags & flag) {
+                do {
+                    if (!read(8, skipped)) return;
+                } while (skipped != 0);
+            }
+        }
+        if (flags & 2) { // FHCRC
+            if (!read(16, skipped)) return;
+        }
+        crc_ = 0;
+        memberSize_ = 0;
+        state_ = State::BlockHeader;
+    }
+
+    void readBlockHeader() {
+        unsigned isFinal = 0, type = 0;
+        if (!read(1, isFinal) || !read(2, type)) {
+            return;
+        }
+        lastBlock_ = isFinal != 0;
+        if (type == 0) {
+            take(bitCount_ % 8); // Stored blocks start on a byte boundary.
+            unsigned length = 0, complement = 0;
+            if (!read(16, length) || !read(16, complement)) return;
+            if ((length ^ 0xFFFFu) != complement) {
+                fail("corrupt stored block length");
+                return;
+            }
+            storedRemaining_ = length;
+            state_ = State::Stored;
+        }
+        else if (type == 1) {
+            useFixedTables();
+            state_ = State::Compressed;
+        }
+        else if (type == 2) {
+            if (readDynamicTables()) {
+                state_ = State::Compressed;
+            }
+        }
+        else {
+            fail("invalid block type");
+        }
+    }
+
+    void useFixedTables() {
+        std::uint8_t lengths[288 + 30];
+        std::memset(lengths, 8, 144);
+        std::memset(lengths + 144, 9, 112);
+        std::memset(lengths + 256, 7, 24);
+        std::memset(lengths + 280, 8, 8);
+        std::memset(lengths + 288, 5, 30);
+        literals_.build(lengths, 288);
+        distances_.build(lengths + 288, 30);
+    }
+
+    bool readDynamicTables() {
+        static const std::uint8_t kOrder[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+        unsigned literalCount = 0, distanceCount = 0, codeLengthCount = 0;
+        if (!read(5, literalCount) || !read(5, distanceCount) || !read(4, codeLengthCount)) {
+            return false;
+        }
+        literalCount += 257;
+        distanceCount += 1;
+        codeLengthCount += 4;
+        if (literalCount > 286 || distanceCount > 30) {
+            return fail("too many length or distance codes");
+        }
+
+        std::uint8_t lengths[288 + 32] = {};
+        for (unsigned i = 0; i < codeLengthCount; ++i) {
+            unsigned length = 0;
+            if (!read(3, length)) return false;
+            lengths[kOrder[i]] = static_cast<std::uint8_t>(length);
+        }
+        HuffmanTable codeLengths;
+        if (!codeLengths.build(lengths, 19)) {
+            return fail("invalid code length codes");
+        }
+
+        std::uint8_t all[288 + 32] = {};
+        for (unsigned i = 0; i < literalCount + distanceCount;) {
+            unsigned code = 0;
+            if (!symbol(codeLengths, code)) return false;
+            if (code < 16) {
+                all[i++] = static_cast<std::uint8_t>(code);
+                continue;
+            }
+            unsigned repeat = 0;
+            std::uint8_t value = 0;
+            if (code == 16) {
+                if (i == 0) return fail("length repeat with no previous length");
+                value = all[i - 1];
+                if (!read(2, repeat)) return false;
+                repeat += 3;
+            }
+            else if (code == 17) {
+                if (!read(3, repeat)) return false;
+                repeat += 3;
+            }
+            else {
+                if (!read(7, repeat)) return false;
+                repeat += 11;
+            }
+            if (i + repeat > literalCount + distanceCount) {
+                return fail("code lengths overflow the table");
+            }
+            while (repeat-- > 0) {
+                all[i++] = value;
+            }
+        }
+        if (all[256] == 0) {
+            return fail("missing end-of-block code");
+        }
+        if (!literals_.build(all, literalCount) || !distances_.build(all + literalCount, distanceCount)) {
+            return fail("invalid literal or distance lengths");
+        }
+        return true;
+    }
+
+    void copyStored(std::size_t limit) {
+        while (storedRemaining_ > 0 && outEnd_ < limit) {
+            unsigned byte = 0;
+            if (!read(8, byte)) return;
+            output_[outEnd_++] = static_cast<char>(byte);
+            --storedRemaining_;
+        }
+        if (storedRemaining_ == 0) {
+            endBlock();
+        }
+    }
+
+    void inflateSymbols(std::size_t limit) {
+        static const std::uint16_t kLengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                                       35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+        static const std::uint8_t kLengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                                       3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+        static const std::uint16_t kDistanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129,
+                                                         193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097,
+                                                         6145, 8193, 12289, 16385, 24577 };
+        static const std::uint8_t kDistanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6,
+                                                         6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+        char* out = &output_[0];
+        while (outEnd_ < limit) {
+            unsigned code = 0;
+            if (!symbol(literals_, code)) return;
+            if (code < 256) {
+                out[outEnd_++] = static_cast<char>(code);
+                continue;
+            }
+            if (code == 256) {
+                endBlock();
+                return;
+            }
+            code -= 257;
+            unsigned extra = 0, distanceCode = 0, distanceExtra = 0;
+            if (code >= 29 || !read(kLengthExtra[code], extra) || !symbol(distances_, distanceCode)) {
+                fail("invalid length code");
+                return;
+            }
+            if (distanceCode >= 30 || !read(kDistanceExtra[distanceCode], distanceExtra)) {
+                fail("invalid distance code");
+                return;
+            }
+            const std::size_t length = kLengthBase[code] + extra;
+            const std::size_t distance = kDistanceBase[distanceCode] + distanceExtra;
+            if (distance > outEnd_ - memberStart_) {
+                fail("distance reaches before the start of the data");
+                return;
+            }
+            const char* from = out + outEnd_ - distance;
+            char* to = out + outEnd_;
+            if (distance >= length) {
+                std::memcpy(to, from, length);
+            }
+            else {
+                // Byte by byte: the copy overlaps the bytes it is writing (runs).
+                for (std::size_t i = 0; i < length; ++i) {
+                    to[i] = from[i];
+                }
+            }
+            outEnd_ += length;
+        }
+    }
+
+    void endBlock() {
+        state_ = lastBlock_ ? State::Trailer : State::BlockHeader;
+    }
+
+    void readTrailer() {
+        take(bitCount_ % 8);
+        unsigned crcLow = 0, crcHigh = 0, sizeLow = 0, sizeHigh = 0;
+        if (!read(16, crcLow) || !read(16, crcHigh) || !read(16, sizeLow) || !read(16, sizeHigh)) {
+            return;
+        }
+        updateCheck();
+        if ((crcLow | crcHigh << 16) != crc_ || (sizeLow | sizeHigh << 16) != memberSize_) {
+            fail("gzip checksum mismatch; the file is corrupt");
+            return;
+        }
+        // Concatenated gzip files decompress to the concatenated contents.
+        // Anything else after a member (such as zero padding) is ignored.
+        const bool anotherMember = need(16) && (bitBuffer_ & 0xFFFF) == 0x8B1F;
+        if (failed()) {
+            return; // The scan was cancelled.
+        }
+        memberStart_ = outEnd_;
+        state_ = anotherMember ? State::Header : State::Done;
+    }
+
+    void updateCheck() {
+        crc_ = updateCrc32(crc_, output_.data() + checked_, outEnd_ - checked_);
+        memberSize_ += static_cast<std::uint32_t>(outEnd_ - checked_);
+        checked_ = outEnd_;
+    }
+
+    std::ifstream file_;
+    std::size_t chunkBytes_ = kChunkBytes;
+    ResourceGovernor* governor_ = nullptr;
+    std::vector<unsigned char> input_;
+    std::size_t inPos_ = 0;
+    std::size_t inEnd_ = 0;
+    std::uint64_t bitBuffer_ = 0;
+    unsigned bitCount_ = 0;
+
+    std::string output_;          // The window, then the piece being decompressed.
+    std::size_t outEnd_ = 0;
+    std::size_t checked_ = 0;     // output_[0, checked_) is in crc_ already.
+    std::size_t memberStart_ = 0; // Back-references may not reach before this.
+
+    State state_ = State::Done;
+    std::string error_;
+    bool lastBlock_ = false;
+    std::size_t storedRemaining_ = 0;
+    HuffmanTable literals_;
+    HuffmanTable distances_;
+    std::uint32_t crc_ = 0;
+    std::uint32_t memberSize_ = 0;
+};
+
+// --- Reading Lines ---
+// Streams the decompressed lines of 'reader' to 'onLine(std::string_view line,
+// std::uint64_t offset)', where 'offset' counts decompressed bytes. A line that
+// spans two pieces is stitched together in 'carry'.
+template<typename Fn>
+bool forEachLineInGzip(GzipReader& reader, std::string& carry, Fn&& onLine) {
+    carry.clear();
+    std::uint64_t position = 0; // Decompressed offset of the start of 'chunk'.
+    std::string_view chunk;
+    while (reader.next(chunk)) {
+        std::size_t start = 0;
+        if (!carry.empty()) {
+            const std::size_t newline = chunk.find('\n');
+            carry.append(chunk.data(), newline == std::string_view::npos ? chunk.size() : newline);
+            if (newline == std::string_view::npos) {
+                position += chunk.size();
+                continue;
+            }
+            onLine(std::string_view(carry), position - (carry.size() - newline));
+            carry.clear();
+            start = newline + 1;
+        }
+        const std::size_t lastNewline = chunk.rfind('\n');
+        const std::size_t complete = (lastNewline == std::string_view::npos || lastNewline < start) ? start : lastNewline + 1;
+        forEachLine(chunk.substr(start, complete - start), [&](std::string_view line) {
+            onLine(line, position + static_cast<std::uint64_t>(line.data() - chunk.data()));
+        });
+        carry.assign(chunk.data() + complete, chunk.size() - complete);
+        position += chunk.size();
+    }
+    if (!carry.empty()) {
+        onLine(std::string_view(carry), position - carry.size());
+    }
+    return !reader.failed();
+}
@@ -0,0 +1,45 @@
+/**
+ * @file Hash.h
+ * @brief A fast, non-cryptographic 64-bit hash for log lines, byte blobs and
+ * integer keys.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+// --- Mixing ---
+// The MurmurHash3 64-bit finalizer: every input bit affects every output bit.
+inline std::uint64_t mixBits64(std::uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDull;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+// --- Fast 64-bit Line Hash ---
+// Consumes 8 bytes per step and finishes with the MurmurHash3 64-bit mixer. It is
+// not cryptographic; it only needs to spread similar log lines apart quickly.
+inline std::uint64_t hashLine(std::string_view text) {
+    const std::uint64_t k = 0x9E3779B97F4A7C15ull;
+    std::uint64_t h = 0x243F6A8885A308D3ull ^ (text.size() * k);
+    const char* p = text.data();
+    std::size_t n = text.size();
+
+    while (n >= 8) {
+        std::uint64_t word;
+        std::memcpy(&word, p, 8); // memcpy is the portable way to do an unaligned load.
+        h = (h ^ (word * k)) * 0xFF51AFD7ED558CCDull;
+        h ^= h >> 29;
+        p += 8;
+        n -= 8;
+    }
+    std::uint64_t tail = 0;
+    std::memcpy(&tail, p, n);
+    h = (h ^ (tail * k)) * 0xC4CEB9FE1A85EC53ull;
+    return mixBits64(h);
+}
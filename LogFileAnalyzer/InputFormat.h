@@ -0,0 +1,247 @@
+/**
+ * @file InputFormat.h
+ * @brief Telling what kind of log a file holds from its first 4 KiB.
+ *
+ * @details Before a file is scanned, its first 4 KiB are read once:
+ *  - Compression is recognized by the magic bytes at the start. gzip files are
+ *    decompressed on the fly (see GzipReader.h); zstd, bzip2 and xz files are
+ *    recognized so that the error message can say what they are.
+ *  - The line format is found by parsing the first few complete lines with
+ *    every candidate parser (a --schema, the pipe format, JSON) and keeping the
+ *    one that accepts the most of them. Only the choice between the schema and
+ *    the built-in formats changes how the file is parsed. Pipe, JSON and Mixed
+ *    all use the built-in parser, which reads both formats line by line, since
+ *    a file may mix them beyond its first 4 KiB. Telling them apart only names
+ *    the format in progress messages.
+ *
+ * Binary logs (BinaryLog.h) are recognized by their own magic bytes; inside
+ * gzip they are rejected, since their blocks are read at random. A file whose
+ * first lines no parser accepts is rejected too, rather than scanned as one
+ * long run of malformed lines.
+ *
+ * This costs one small read (and, for gzip, inflating 4 KiB) per file, and lets
+ * a single run mix plain and compressed files, text and binary logs, and files
+ * in a declared format with files in the built-in ones. scanInput() then reads
+ * each file with the reader its profile calls for.
+ */
+
+#pragma once
+
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "BinaryLog.h"
+#include "FileChunks.h"
+#include "GzipReader.h"
+#include "LogSchema.h"
+
+// --- What a File Holds ---
+enum class Compression { None, Gzip, Zstd, Bzip2, Xz };
+enum class LineFormat { Pipe, Json, Mixed, Schema, Binary };
+
+struct InputProfile {
+    Compression compression = Compression::None;
+    LineFormat format = LineFormat::Mixed;
+};
+
+inline const char* compressionName(Compression compression) {
+    switch (compression) {
+    case Compression::None: return "uncompressed";
+    case Compression::Gzip: return "gzip";
+    case Compression::Zstd: return "zstd";
+    case Compression::Bzip2: return "bzip2";
+    case Compression::Xz: return "xz";
+    }
+    return "unknown";
+}
+
+inline const char* lineFormatName(LineFormat format) {
+    switch (format) {
+    case LineFormat::Pipe: return "pipe-delimited";
+    case LineFormat::Json: return "JSON lines";
+    case LineFormat::Mixed: return "pipe-delimited and JSON lines";
+    case LineFormat::Schema: return "schema";
+    case LineFormat::Binary: return "binary records";
+    }
+    return "unknown";
+}
+
+// --- Detection ---
+constexpr std::size_t kSniffBytes = 4096;
+
+inline Compression detectCompression(std::string_view head) {
+    const auto startsWith = [head](std::string_view magic) { return head.substr(0, magic.size()) == magic; };
+    if (startsWith("\x1F\x8B")) return Compression::Gzip;
+    if (startsWith(std::string_view("\x28\xB5\x2F\xFD", 4))) return Compression::Zstd;
+    if (startsWith("BZh")) return Compression::Bzip2;
+    if (startsWith(std::string_view("\xFD" "7zXZ\0", 6))) return Compression::Xz;
+    return Compression::None;
+}
+
+// 'sample' is the start of the text; unless it is 'complete', its last line
+// may be cut off and is not looked at. Returns false if the sample has lines
+// but no parser accepts any of them.
+inline bool detectLineFormat(std::string_view sample, bool complete, const LogSchema* schema, LineFormat& format) {
+    if (!complete) {
+        const std::size_t lastNewline = sample.rfind('\n');
+        sample = sample.substr(0, lastNewline == std::string_view::npos ? 0 : lastNewline + 1);
+    }
+    int schemaLines = 0;
+    int pipeLines = 0;
+    int jsonLines = 0;
+    int looked = 0;
+    LogRecord record;
+    forEachLine(sample, [&](std::string_view line) {
+        if (line.empty() || ++looked > 64) {
+            return;
+        }
+        schemaLines += schema != nullptr && schema->decode(line, record) ? 1 : 0;
+        pipeLines += parsePipeLogLine(line, record) ? 1 : 0;
+        jsonLines += line.front() == '{' && parseJsonLogLine(line, record) ? 1 : 0;
+    });
+
+    if (looked > 0 && schemaLines + pipeLines + jsonLines == 0) {
+        return false;
+    }
+    if (schema != nullptr && (schemaLines >= pipeLines + jsonLines)) {
+        format = LineFormat::Schema; // Also the choice for a file with nothing to go on.
+    }
+    else if (pipeLines > 0 && jsonLines > 0) {
+        format = LineFormat::Mixed;
+    }
+    else if (jsonLines > 0) {
+        format = LineFormat::Json;
+    }
+    else {
+        format = pipeLines > 0 ? LineFormat::Pipe : LineFormat::Mixed;
+    }
+    return true;
+}
+
+inline std::string unrecognizedFormatError(const std::string& path, const LogSchema* schema) {
+    return path + ": none of its first lines is a " + (schema != nullptr ? "line of the schema, a " : "") +
+           "pipe-delimited or a JSON log line";
+}
+
+// Reads the start of 'path' and fills 'profile'. Returns false (with 'error')
+// if the file cannot be read, is compressed in a way that is not supported,
+// or holds lines no parser accepts.
+inline bool sniffInput(const std::string& path, const LogSchema* schema, InputProfile& profile, std::string& error) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        error = "could not open " + path;
+        return false;
+    }
+    std::string head(kSniffBytes, '\0');
+    file.read(&head[0], static_cast<std::streamsize>(head.size()));
+    head.resize(static_cast<std::size_t>(file.gcount()));
+    const bool wholeFile = head.size() < kSniffBytes;
+
+    profile.compression = detectCompression(head);
+    if (isBinaryLog(head)) {
+        profile.format = LineFormat::Binary;
+        return true;
+    }
+    if (profile.compression == Compression::None) {
+        if (!detectLineFormat(head, wholeFile, schema, profile.format)) {
+            error = unrecognizedFormatError(path, schema);
+            return false;
+        }
+        return true;
+    }
+    if (profile.compression != Compression::Gzip) {
+        error = path + " is " + compressionName(profile.compression) + "-compressed; only gzip is supported, so decompress it first";
+        return false;
+    }
+
+    GzipReader reader;
+    std::string_view text;
+    if (!reader.open(path) || (!reader.next(text, kSniffBytes) && reader.failed())) {
+        error = path + ": " + reader.error();
+        return false;
+    }
+    // Binary logs are read with random access, which a gzip stream does not allow.
+    if (isBinaryLog(text)) {
+        error = path + " is a gzip-compressed binary log; decompress it first";
+        return false;
+    }
+    if (!detectLineFormat(text, text.size() < kSniffBytes, schema, profile.format)) {
+        error = unrecognizedFormatError(path, schema);
+        return false;
+    }
+    return true;
+}
+
+// The parser for a file with this profile: the schema's, or the built-in one,
+// which takes pipe-delimited and JSON lines whatever the detected format.
+inline LineParser lineParserFor(const InputProfile& profile, const LogSchema* schema) {
+    return profile.format == LineFormat::Schema ? LineParser(schema) : LineParser();
+}
+
+// A description for progress messages, e.g. "JSON lines, gzip".
+inline std::string describeInput(const InputProfile& profile) {
+    std::string text = lineFormatName(profile.format);
+    if (profile.compression != Compression::None) {
+        text += ", ";
+        text += compressionName(profile.compression);
+    }
+    return text;
+}
+
+// --- Reading an Input ---
+// The parts an input can be scanned in: newline-aligned ranges of a text file,
+// block-aligned ranges of a binary log, or for a gzip file a single part, since
+// it can only be decoded from the start.
+inline bool splitInput(const std::string& path, const InputProfile& profile, std::size_t parts,
+                       std::vector<ByteRange>& ranges, std::string& error) {
+    if (profile.compression != Compression::None) {
+        ranges.assign(1, ByteRange{});
+        return true;
+    }
+    if (profile.format == LineFormat::Binary) {
+        return splitBinaryLogIntoRanges(path, parts, ranges, error);
+    }
+    ranges = splitFileIntoRanges(path, parts);
+    return true;
+}
+
+// Streams one part of an input to 'onRecord(const LogRecord* record,
+// std::string_view line, std::uint64_t offset)'. 'record' is null for a line
+// that does not parse, and 'line' is empty for a binary record. 'file' must be
+// open on 'path'; a gzip file is opened separately. Returns false (with
+// 'error') on an I/O failure or corrupt data. A 'governor' sets the size of
+// the reads and paces them.
+template<typename Fn>
+bool scanInput(const std::string& path, const InputProfile& profile, const LineParser& parser, std::ifstream& file,
+               const ByteRange& range, std::string& buffer, Fn&& onRecord, std::string& error,
+               ResourceGovernor* governor = nullptr) {
+    const std::size_t blockBytes = governor != nullptr ? governor->blockBytes() : kReadBlockBytes;
+    LogRecord record;
+    const auto onLine = [&](std::string_view line, std::uint64_t offset) {
+        onRecord(parser.parse(line, record) ? &record : nullptr, line, offset);
+    };
+    if (profile.compression == Compression::Gzip) {
+        GzipReader reader;
+        if (!reader.open(path, blockBytes, governor) || !forEachLineInGzip(reader, buffer, onLine)) {
+            error = path + ": " + (reader.failed() ? reader.error() : "could not be read");
+            return false;
+        }
+        return true;
+    }
+    if (profile.format == LineFormat::Binary) {
+        const bool ok = forEachBinaryRecord(file, range, buffer, [&](const LogRecord& binaryRecord, std::uint64_t offset) {
+            onRecord(&binaryRecord, std::string_view(), offset);
+        }, error, governor);
+        if (!ok) {
+            error = path + ": " + error;
+        }
+        return ok;
+    }
+    if (!forEachLineInRange(file, range, blockBytes, buffer, onLine, governor)) {
+        error = governor != nullptr && governor->cancelled() ? governor->cancelReason() : "I/O failure while reading " + path;
+        return false;
+    }
+    return true;
+}
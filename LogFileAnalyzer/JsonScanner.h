@@ -0,0 +1,347 @@
+/**
+ * @file JsonScanner.h
+ * @brief Fast field extraction from one flat JSON object per line.
+ *
+ * @details Parsing works in two stages, in the style of simdjson:
+ *  1. A vectorized pass classifies 64 bytes at a time into bitmasks: quotes,
+ *     backslashes and the structural characters { } [ ] : ,. Escaped quotes are
+ *     removed, a prefix XOR over the quote mask marks which bytes are inside a
+ *     string, and structural characters inside strings are discarded. What is
+ *     left is the position of every token boundary in the line.
+ *  2. A small state machine walks those positions (key, colon, value, comma)
+ *     and hands each top-level key and its raw value to a callback. It never
+ *     looks at the bytes between boundaries. Nested objects and arrays are
+ *     skipped as a whole.
+ *
+ * Values are returned as views into the line. String values are only copied
+ * (by unescapeJsonString) if they actually contain escape sequences. SSE2 is
+ * used wherever it is available (every x86-64 compiler); other targets use a
+ * scalar classifier with the same results.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#include "BitOps.h"
+
+// --- Bit Helpers ---
+// Bit i of the result is the XOR of bits 0..i of 'mask'. Applied to the quote
+// mask, this marks every byte from an opening quote up to its closing quote.
+inline std::uint64_t prefixXor(std::uint64_t mask) {
+    mask ^= mask << 1;
+    mask ^= mask << 2;
+    mask ^= mask << 4;
+    mask ^= mask << 8;
+    mask ^= mask << 16;
+    mask ^= mask << 32;
+    return mask;
+}
+
+// --- Stage 1: Classify 64 Bytes ---
+struct JsonBlockMasks {
+    std::uint64_t quotes = 0;
+    std::uint64_t backslashes = 0;
+    std::uint64_t structurals = 0; // { } [ ] : ,
+};
+
+inline JsonBlockMasks classifyJsonBlock(const char* block) {
+    JsonBlockMasks masks;
+#ifdef LFA_SSE2
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i colon = _mm_set1_epi8(':');
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i openBrace = _mm_set1_epi8('{');
+    const __m128i closeBrace = _mm_set1_epi8('}');
+    const __m128i openBracket = _mm_set1_epi8('[');
+    const __m128i closeBracket = _mm_set1_epi8(']');
+    for (int part = 0; part < 4; ++part) {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16 * part));
+        const __m128i structural = _mm_or_si128(
+            _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(bytes, colon), _mm_cmpeq_epi8(bytes, comma)),
+                         _mm_or_si128(_mm_cmpeq_epi8(bytes, openBrace), _mm_cmpeq_epi8(bytes, closeBrace))),
+            _mm_or_si128(_mm_cmpeq_epi8(bytes, openBracket), _mm_cmpeq_epi8(bytes, closeBracket)));
+        const int shift = 16 * part;
+        masks.quotes |= static_cast<std::uint64_t>(static_cast<std::uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, quote)))) << shift;
+        masks.backslashes |= static_cast<std::uint64_t>(static_cast<std::uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, backslash)))) << shift;
+        masks.structurals |= static_cast<std::uint64_t>(static_cast<std::uint16_t>(_mm_movemask_epi8(structural))) << shift;
+    }
+#else
+    for (int i = 0; i < 64; ++i) {
+        const char c = block[i];
+        const std::uint64_t bit = std::uint64_t(1) << i;
+        if (c == '"') masks.quotes |= bit;
+        else if (c == '\\') masks.backslashes |= bit;
+        else if (c == '{' || c == '}' || c == '[' || c == ']' || c == ':' || c == ',') masks.structurals |= bit;
+    }
+#endif
+    return masks;
+}
+
+// --- Stage 1: Token Boundaries in Order ---
+// Yields, one at a time, the positions of unescaped quotes and of structural
+// characters outside strings. Masks are computed one 64-byte block at a time,
+// as they are needed.
+class JsonBoundaryScanner {
+public:
+    explicit JsonBoundaryScanner(std::string_view text) : text_(text) {}
+
+    bool next(std::size_t& position) {
+        while (pending_ == 0) {
+            if (blockStart_ >= text_.size()) {
+                return false;
+            }
+            loadBlock();
+        }
+        position = (blockStart_ - 64) + static_cast<std::size_t>(lowestSetBit(pending_));
+        pending_ &= pending_ - 1;
+        return true;
+    }
+
+    // True if any byte scanned so far was a backslash. Most log lines have
+    // none, which lets string values skip the search for escape sequences.
+    bool sawBackslash() const { return sawBackslash_; }
+
+private:
+    void loadBlock() {
+        JsonBlockMasks masks;
+        const std::size_t remaining = text_.size() - blockStart_;
+        if (remaining >= 64) {
+            masks = classifyJsonBlock(text_.data() + blockStart_);
+        }
+        else {
+            char tail[64] = {}; // The end of the line, padded with bytes that match nothing.
+            std::memcpy(tail, text_.data() + blockStart_, remaining);
+            masks = classifyJsonBlock(tail);
+        }
+        blockStart_ += 64;
+
+        // A backslash escapes the byte after it, unless it is escaped itself.
+        std::uint64_t escaped = 0;
+        std::uint64_t backslashes = masks.backslashes;
+        sawBackslash_ = sawBackslash_ || backslashes != 0;
+        if (escapeNext_) {
+            escaped |= 1;
+            backslashes &= ~std::uint64_t(1);
+        }
+        escapeNext_ = false;
+        while (backslashes != 0) {
+            const int i = lowestSetBit(backslashes);
+            if (i == 63) {
+                escapeNext_ = true;
+            }
+            else {
+                escaped |= std::uint64_t(1) << (i + 1);
+                backslashes &= ~(std::uint64_t(1) << (i + 1));
+            }
+            backslashes &= backslashes - 1;
+        }
+
+        const std::uint64_t quotes = masks.quotes & ~escaped;
+        const std::uint64_t inString = prefixXor(quotes) ^ insideString_;
+        insideString_ = (inString >> 63) ? ~std::uint64_t(0) : 0;
+        pending_ = quotes | (masks.structurals & ~inString);
+    }
+
+    std::string_view text_;
+    std::size_t blockStart_ = 0;
+    std::uint64_t pending_ = 0;
+    std::uint64_t insideString_ = 0; // All ones if the previous block ended inside a string.
+    bool escapeNext_ = false;
+    bool sawBackslash_ = false;
+};
+
+// --- Stage 2: Top-Level Fields ---
+struct JsonValue {
+    std::string_view text; // Strings: without the quotes, still escaped. Others: trimmed raw text.
+    bool isString = false;
+    bool mayHaveEscapes = false; // False guarantees a string value contains no backslash.
+};
+
+inline bool isJsonSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+inline std::string_view trimJsonSpace(std::string_view text) {
+    while (!text.empty() && isJsonSpace(text.front())) {
+        text.remove_prefix(1);
+    }
+    while (!text.empty() && isJsonSpace(text.back())) {
+        text.remove_suffix(1);
+    }
+    return text;
+}
+
+// Calls onField(key, value) for every top-level member of the object in
+// 'line'. Returns false if the line is not a well-formed flat JSON object (the
+// callback may already have been called for some fields).
+template <typename Fn>
+bool forEachJsonField(std::string_view line, Fn&& onField) {
+    JsonBoundaryScanner scanner(line);
+    std::size_t at = 0;
+    if (!scanner.next(at) || line[at] != '{' || !trimJsonSpace(line.substr(0, at)).empty()) {
+        return false;
+    }
+    for (;;) {
+        std::size_t keyOpen = 0, keyClose = 0, colon = 0, next = 0;
+        if (!scanner.next(keyOpen)) {
+            return false;
+        }
+        if (line[keyOpen] == '}') {
+            return true; // Empty object.
+        }
+        if (line[keyOpen] != '"' || !scanner.next(keyClose) || !scanner.next(colon) || line[colon] != ':' ||
+            !scanner.next(next)) {
+            return false;
+        }
+        const std::string_view key = line.substr(keyOpen + 1, keyClose - keyOpen - 1);
+
+        JsonValue value;
+        std::size_t valueEnd = 0; // Just past a string or nested value; only spaces may follow.
+        const char c = line[next];
+        if ((c == '"' || c == '{' || c == '[') && !trimJsonSpace(line.substr(colon + 1, next - colon - 1)).empty()) {
+            return false;
+        }
+        if (c == '"') {
+            std::size_t close = 0;
+            if (!scanner.next(close)) {
+                return false;
+            }
+            value.text = line.substr(next + 1, close - next - 1);
+            value.isString = true;
+            value.mayHaveEscapes = scanner.sawBackslash();
+            valueEnd = close + 1;
+            if (!scanner.next(next)) {
+                return false;
+            }
+        }
+        else if (c == '{' || c == '[') {
+            // A nested value: skip to its matching close.
+            int depth = 1;
+            const std::size_t open = next;
+            while (depth > 0) {
+                if (!scanner.next(next)) {
+                    return false;
+                }
+                const char d = line[next];
+                depth += (d == '{' || d == '[') ? 1 : (d == '}' || d == ']') ? -1 : 0;
+            }
+            value.text = line.substr(open, next - open + 1);
+            valueEnd = next + 1;
+            if (!scanner.next(next)) {
+                return false;
+            }
+        }
+        else {
+            value.text = trimJsonSpace(line.substr(colon + 1, next - colon - 1));
+            if (value.text.empty()) {
+                return false;
+            }
+        }
+        if (valueEnd != 0 && !trimJsonSpace(line.substr(valueEnd, next - valueEnd)).empty()) {
+            return false;
+        }
+        onField(key, value);
+
+        if (line[next] == '}') {
+            return true;
+        }
+        if (line[next] != ',') {
+            return false;
+        }
+    }
+}
+
+// --- String Values ---
+inline void appendUtf8(std::string& out, std::uint32_t codePoint) {
+    if (codePoint < 0x80) {
+        out.push_back(static_cast<char>(codePoint));
+    }
+    else if (codePoint < 0x800) {
+        out.push_back(static_cast<char>(0xC0 | (codePoint >> 6)));
+        out.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+    }
+    else if (codePoint < 0x10000) {
+        out.push_back(static_cast<char>(0xE0 | (codePoint >> 12)));
+        out.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+    }
+    else {
+        out.push_back(static_cast<char>(0xF0 | (codePoint >> 18)));
+        out.push_back(static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+    }
+}
+
+inline bool parseHex4(std::string_view text, std::size_t at, std::uint32_t& out) {
+    if (at + 4 > text.size()) {
+        return false;
+    }
+    out = 0;
+    for (std::size_t i = at; i < at + 4; ++i) {
+        const char c = text[i];
+        const int digit = (c >= '0' && c <= '9') ? c - '0' : (c >= 'a' && c <= 'f') ? c - 'a' + 10
+                        : (c >= 'A' && c <= 'F') ? c - 'A' + 10 : -1;
+        if (digit < 0) {
+            return false;
+        }
+        out = (out << 4) | static_cast<std::uint32_t>(digit);
+    }
+    return true;
+}
+
+// Returns the decoded text of a string value. Without escapes this is 'raw'
+// itself; otherwise the decoded text is appended to 'storage' and a view of it
+// is returned. The decoded text is never longer than 'raw', so if 'storage' has
+// reserved room for the whole line, earlier views into it stay valid.
+inline bool unescapeJsonString(std::string_view raw, std::string& storage, std::string_view& out) {
+    if (std::memchr(raw.data(), '\\', raw.size()) == nullptr) {
+        out = raw;
+        return true;
+    }
+    const std::size_t start = storage.size();
+    for (std::size_t i = 0; i < raw.size(); ++i) {
+        if (raw[i] != '\\') {
+            storage.push_back(raw[i]);
+            continue;
+        }
+        if (++i >= raw.size()) {
+            return false;
+        }
+        switch (raw[i]) {
+        case '"': storage.push_back('"'); break;
+        case '\\': storage.push_back('\\'); break;
+        case '/': storage.push_back('/'); break;
+        case 'b': storage.push_back('\b'); break;
+        case 'f': storage.push_back('\f'); break;
+        case 'n': storage.push_back('\n'); break;
+        case 'r': storage.push_back('\r'); break;
+        case 't': storage.push_back('\t'); break;
+        case 'u': {
+            std::uint32_t codePoint = 0;
+            if (!parseHex4(raw, i + 1, codePoint)) {
+                return false;
+            }
+            i += 4;
+            // A high surrogate must be followed by an escaped low surrogate.
+            std::uint32_t low = 0;
+            if (codePoint >= 0xD800 && codePoint < 0xDC00 && i + 2 < raw.size() && raw[i + 1] == '\\' &&
+                raw[i + 2] == 'u' && parseHex4(raw, i + 3, low) && low >= 0xDC00 && low < 0xE000) {
+                codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+                i += 6;
+            }
+            appendUtf8(storage, codePoint);
+            break;
+        }
+        default:
+            return false;
+        }
+    }
+    out = std::string_view(storage.data() + start, storage.size() - start);
+    return true;
+}
@@ -17,8 +17,1268 @@
 #include <iostream> // For standard input/output operations (like writing to the console with std::cout).
 #include <fstream>  // For file stream operations, specifically for reading files (std::ifstream).
 #include <string>   // For using the std::string class to handle text data.
-#include <vector>   // For using the std::vector container. While not used in this initial version,
-                    // we will need it soon to store our parsed log data.
+#include <vector>   // For using the std::vector container.
+#include <thread>   // For std::thread, used by the parallel scan modes.
+#include <filesystem> // For creating output directories.
+#include <charconv> // For std::from_chars when reading numeric option values.
+#include <memory>   // For std::unique_ptr.
+#include <random>   // For seeding the example-line samplers.
+#include <cstdlib>  // For std::strtod when reading fractional option values.
+#include <chrono>   // For timing queries in interactive mode.
+#include <atomic>   // For stopping the daemon's server thread.
+#include <csignal>  // For shutting the daemon down cleanly on Ctrl+C / SIGTERM.
+#include <cstdio>   // For std::remove of the daemon's socket file.
+
+#include "FileChunks.h"   // Newline-aligned byte ranges for splitting work between threads.
+#include "Partitioner.h"  // --partition-by: one output file per user or action.
+#include "Aggregates.h"   // The metrics that make up the summary report.
+#include "Deduplicator.h" // --dedup: dropping replayed lines before they are counted.
+#include "Reservoir.h"    // --examples: a few real lines per (action, status).
+#include "BlockSampler.h" // --sample: approximate answers from a random subset of blocks.
+#include "QueryEngine.h"  // --interactive: queries over a resident columnar table.
+#include "LogFollower.h"  // --daemon: reading logs as they grow.
+#include "MetricsDaemon.h" // --daemon: rolling aggregates served over local sockets.
+#include "AggregateState.h" // --emit-state and `merge`: combining reports from many hosts.
+#include "ShardCoordinator.h" // --processes: one file scanned by several worker processes.
+#include "ReportWriter.h" // --format: text, JSON or CSV reports.
+#include "ArrowExport.h"  // --export-arrow: parsed rows as an Arrow IPC file.
+#include "LogSchema.h"    // --schema: user-declared line formats.
+#include "InputFormat.h"  // Detecting each file's compression and line format.
+#include "SegmentStore.h" // --store and `query`: the daemon's rows, kept on disk.
+#include "ResourceGovernor.h" // --max-memory-mib and friends: scans that stay within a budget.
+#include "CpuPlacement.h" // --pin-threads: workers pinned to cores, spread over NUMA nodes.
+
+// --- Command-Line Options ---
+// Everything after the log file path is an optional "--flag value" pair, a
+// bare switch such as --interactive, or the path of another log file.
+struct Options {
+    std::string logFilePath;
+    std::vector<std::string> moreLogFiles; // Further log files after the first; analysis mode only.
+    bool partition = false;              // --partition-by user|action
+    PartitionKey partitionKey = PartitionKey::User;
+    std::string outputDir = "partitions"; // --out-dir <dir>
+    unsigned threads = 0;                 // --threads <n>; 0 means "one per hardware thread".
+    ResourceLimits limits;                // --max-memory-mib, --io-limit-mibps, --pressure-limit
+    bool pinThreads = false;              // --pin-threads
+    bool autotune = false;                // --autotune; default analysis only.
+    bool stats = false;                   // --stats; default analysis only.
+    std::size_t maxOpenFiles = 64;        // --max-open-files <n>
+    std::size_t partitionBufferKiB = 1024; // --partition-buffer-kib <n>
+    long long dedupWindowSeconds = 0;      // --dedup <seconds>; 0 disables deduplication.
+    std::size_t examplesPerCategory = 0;   // --examples <k>; 0 disables example lines.
+    double sampleFraction = 0.0;           // --sample <fraction>; 0 means read the whole file.
+    std::size_t sampleBlockKiB = 1024;     // --sample-block-kib <n>
+    bool interactive = false;              // --interactive
+    PlanMode planMode = PlanMode::Run;     // --explain or --analyze; --interactive only.
+    bool daemon = false;                   // --daemon
+    std::vector<std::string> followPaths;  // --follow <path>, repeatable; extra logs for --daemon.
+    std::size_t httpPort = 0;              // --http-port <n>; 0 means no TCP listener.
+    std::string socketPath;                // --socket <path>; empty means no Unix socket.
+    long long windowSeconds = 300;         // --window <seconds>
+    std::string sharedMemoryName;          // --shm <name>; empty means no shared-memory publishing.
+    std::size_t ingestUdpPort = 0;         // --udp <port>; receive lines on 127.0.0.1:<port>.
+    std::string ingestUnixDatagram;        // --unix-dgram <path>
+    std::string ingestUnixStream;          // --unix-stream <path>
+    std::string storeDir;                  // --store <dir>; empty means the daemon keeps no rows.
+    long long storePartitionSeconds = 86400; // --store-partition <seconds>
+    std::string emitStatePath;             // --emit-state <path>; also save the summary as a state file.
+    std::size_t processes = 0;             // --processes <n>; 0 means scan with threads in this process.
+    std::size_t rangeTimeoutSeconds = 600; // --range-timeout <seconds>; a worker stuck longer is killed.
+    std::size_t shardWorkerPort = 0;       // --shard-worker <port>; internal, set on worker processes.
+    ReportFormat format = ReportFormat::Text; // --format text|json|csv
+    std::string exportArrowPath;           // --export-arrow <path>; write parsed rows as Arrow IPC.
+    ArrowLayout arrowLayout = ArrowLayout::File; // --arrow-format file|stream
+    std::size_t arrowBatchRows = 65536;    // --arrow-batch-rows <n>
+    std::string schemaPath;                // --schema <path>; parse lines with a declared format.
+    LineParser parser;                     // Set up by main() for the first log file.
+};
+
+// One log file to scan, with the reader and parser its first 4 KiB called for.
+struct LogInput {
+    std::string path;
+    InputProfile profile;
+    LineParser parser;
+};
+
+// Progress and status messages. They go to stdout next to a text report, but to
+// stderr when stdout carries JSON or CSV, so the output stays machine-readable.
+static std::ostream& statusStream(ReportFormat format) {
+    return format == ReportFormat::Text ? std::cout : std::cerr;
+}
+
+static void printUsage(const char* programName) {
+    std::cerr << "Usage: " << programName << " <path_to_log_file> [more_log_files...] [options]\n"
+              << "       " << programName << " merge <state_file>... [--emit-state <path>] [--format <f>]\n"
+              << "       " << programName << " bench <log_file>... [--schema <path>] [--threads <n>]\n"
+              << "       " << programName << " query <store_dir> <query> [--format <f>] [--explain | --analyze]\n"
+              << "  --partition-by user|action   Split the log into one file per key.\n"
+              << "  --out-dir <dir>              Where partition files go (default: partitions).\n"
+              << "  --threads <n>                Worker threads (default: hardware threads).\n"
+              << "  --max-memory-mib <n>         Fit the scan's buffers and tables in n MiB.\n"
+              << "  --io-limit-mibps <n>         Read the logs at no more than n MiB per second.\n"
+              << "  --pressure-limit <percent>   Pause workers while CPU pressure is above this (Linux).\n"
+              << "  --pin-threads                Pin workers to cores, spread over the NUMA nodes.\n"
+              << "  --autotune                   Tune the read size and worker count as the scan runs.\n"
+              << "  --stats                      Report the scan's settings, throughput and bottleneck.\n"
+              << "  --max-open-files <n>         Open partition files at once (default: 64).\n"
+              << "  --partition-buffer-kib <n>   Buffer per partition per thread (default: 1024).\n"
+              << "  --dedup <seconds>            Drop lines repeated within this time window.\n"
+              << "  --examples <k>               Show k sample lines per action/status.\n"
+              << "  --sample <fraction>          Estimate results from this fraction of the file.\n"
+              << "  --sample-block-kib <n>       Size of one sampled block (default: 1024).\n"
+              << "  --interactive                Load the log once, then answer queries at a prompt.\n"
+              << "  --explain                    With --interactive or query: print each query's plan, not its result.\n"
+              << "  --analyze                    With --interactive or query: run each query, then print its plan\n"
+              << "                               with the rows and time of every step.\n"
+              << "  --daemon                     Keep following the log and serve live metrics.\n"
+              << "  --follow <path>              Another log for --daemon to follow (repeatable).\n"
+              << "  --http-port <n>              Serve metrics on 127.0.0.1:<n>.\n"
+              << "  --socket <path>              Serve metrics on a Unix domain socket.\n"
+              << "  --window <seconds>           Length of the daemon's rolling window (default: 300).\n"
+              << "  --shm <name>                 Also publish the daemon's rollups in shared memory.\n"
+              << "  --udp <port>                 Daemon: receive log lines on UDP 127.0.0.1:<port>.\n"
+              << "  --unix-dgram <path>          Daemon: receive log lines on a Unix datagram socket.\n"
+              << "  --unix-stream <path>         Daemon: receive log lines on a Unix stream socket.\n"
+              << "  --store <dir>                Daemon: keep every parsed row in a segment store.\n"
+              << "  --store-partition <seconds>  Time partition of the store's segments (default: 86400).\n"
+              << "  --emit-state <path>          Save the summary as a mergeable state file.\n"
+              << "  --processes <n>              Scan with n worker processes instead of threads.\n"
+              << "  --range-timeout <seconds>    Kill a worker stuck on one range this long (default: 600).\n"
+              << "  --format text|json|csv       Report format (default: text).\n"
+              << "  --export-arrow <path>        Write the parsed rows as Apache Arrow IPC.\n"
+              << "  --arrow-format file|stream  Arrow IPC file (default) or stream format.\n"
+              << "  --arrow-batch-rows <n>       Rows per Arrow record batch (default: 65536).\n"
+              << "  --schema <path>              Parse lines with the format declared in a schema file.\n"
+              << "With --daemon, a log file path of '-' means: no file, sockets only.\n";
+}
+
+// Reads a non-negative integer option value; rejects trailing junk like "8x".
+static bool parseCount(const std::string& text, std::size_t& out) {
+    const char* end = text.data() + text.size();
+    auto result = std::from_chars(text.data(), end, out);
+    return result.ec == std::errc() && result.ptr == end && !text.empty();
+}
+
+// Parses argv into 'options'. Returns false (after printing why) on bad input.
+static bool parseOptions(int argc, char* argv[], Options& options) {
+    if (argc < 2) {
+        std::cerr << "Error: Incorrect number of arguments.\n";
+        return false;
+    }
+    options.logFilePath = argv[1];
+
+    for (int i = 2; i < argc; ++i) {
+        const std::string flag = argv[i];
+        if (flag.rfind("--", 0) != 0) {
+            options.moreLogFiles.push_back(flag);
+            continue;
+        }
+        if (flag == "--interactive") {
+            options.interactive = true;
+            continue;
+        }
+        if (flag == "--daemon") {
+            options.daemon = true;
+            continue;
+        }
+        if (flag == "--pin-threads") {
+            options.pinThreads = true;
+            continue;
+        }
+        if (flag == "--autotune") {
+            options.autotune = true;
+            continue;
+        }
+        if (flag == "--stats") {
+            options.stats = true;
+            continue;
+        }
+        if (flag == "--explain" || flag == "--analyze") {
+            options.planMode = flag == "--explain" ? PlanMode::Explain : PlanMode::Analyze;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            std::cerr << "Error: Missing value for " << flag << '\n';
+            return false;
+        }
+        const std::string value = argv[++i];
+        std::size_t number = 0;
+        const bool isNumber = parseCount(value, number);
+
+        if (flag == "--partition-by") {
+            if (!parsePartitionKey(value, options.partitionKey)) {
+                std::cerr << "Error: --partition-by expects 'user' or 'action', got '" << value << "'\n";
+                return false;
+            }
+            options.partition = true;
+        }
+        else if (flag == "--out-dir") {
+            options.outputDir = value;
+        }
+        else if (flag == "--threads" && isNumber) {
+            options.threads = static_cast<unsigned>(number);
+        }
+        else if (flag == "--max-memory-mib" && isNumber && number > 0) {
+            options.limits.memoryBytes = number << 20;
+        }
+        else if (flag == "--io-limit-mibps" && isNumber && number > 0) {
+            options.limits.ioBytesPerSecond = static_cast<std::uint64_t>(number) << 20;
+        }
+        else if (flag == "--pressure-limit") {
+            char* end = nullptr;
+            options.limits.cpuPressurePercent = std::strtod(value.c_str(), &end);
+            if (end == value.c_str() || *end != '\0' || !(options.limits.cpuPressurePercent > 0.0 && options.limits.cpuPressurePercent <= 100.0)) {
+                std::cerr << "Error: --pressure-limit expects a percentage in (0, 100], got '" << value << "'\n";
+                return false;
+            }
+        }
+        else if (flag == "--max-open-files" && isNumber && number > 0) {
+            options.maxOpenFiles = number;
+        }
+        else if (flag == "--partition-buffer-kib" && isNumber && number > 0) {
+            options.partitionBufferKiB = number;
+        }
+        else if (flag == "--dedup" && isNumber && number > 0) {
+            options.dedupWindowSeconds = static_cast<long long>(number);
+        }
+        else if (flag == "--examples" && isNumber) {
+            options.examplesPerCategory = number;
+        }
+        else if (flag == "--sample") {
+            char* end = nullptr;
+            options.sampleFraction = std::strtod(value.c_str(), &end);
+            if (end == value.c_str() || *end != '\0' || !(options.sampleFraction > 0.0 && options.sampleFraction <= 1.0)) {
+                std::cerr << "Error: --sample expects a fraction in (0, 1], got '" << value << "'\n";
+                return false;
+            }
+        }
+        else if (flag == "--sample-block-kib" && isNumber && number > 0) {
+            options.sampleBlockKiB = number;
+        }
+        else if (flag == "--follow") {
+            options.followPaths.push_back(value);
+        }
+        else if (flag == "--http-port" && isNumber && number > 0 && number < 65536) {
+            options.httpPort = number;
+        }
+        else if (flag == "--socket") {
+            options.socketPath = value;
+        }
+        else if (flag == "--window" && isNumber && number > 0) {
+            options.windowSeconds = static_cast<long long>(number);
+        }
+        else if (flag == "--shm" && !value.empty()) {
+            options.sharedMemoryName = value;
+        }
+        else if (flag == "--udp" && isNumber && number > 0 && number < 65536) {
+            options.ingestUdpPort = number;
+        }
+        else if (flag == "--unix-dgram" && !value.empty()) {
+            options.ingestUnixDatagram = value;
+        }
+        else if (flag == "--unix-stream" && !value.empty()) {
+            options.ingestUnixStream = value;
+        }
+        else if (flag == "--store" && !value.empty()) {
+            options.storeDir = value;
+        }
+        else if (flag == "--store-partition" && isNumber && number > 0) {
+            options.storePartitionSeconds = static_cast<long long>(number);
+        }
+        else if (flag == "--emit-state" && !value.empty()) {
+            options.emitStatePath = value;
+        }
+        else if (flag == "--processes" && isNumber && number > 0 && number <= 256) {
+            options.processes = number;
+        }
+        else if (flag == "--range-timeout" && isNumber && number > 0) {
+            options.rangeTimeoutSeconds = number;
+        }
+        else if (flag == "--shard-worker" && isNumber && number > 0 && number < 65536) {
+            options.shardWorkerPort = number;
+        }
+        else if (flag == "--export-arrow" && !value.empty()) {
+            options.exportArrowPath = value;
+        }
+        else if (flag == "--arrow-format") {
+            if (!parseArrowLayout(value, options.arrowLayout)) {
+                std::cerr << "Error: --arrow-format expects 'file' or 'stream', got '" << value << "'\n";
+                return false;
+            }
+        }
+        else if (flag == "--arrow-batch-rows" && isNumber && number > 0) {
+            options.arrowBatchRows = number;
+        }
+        else if (flag == "--schema" && !value.empty()) {
+            options.schemaPath = value;
+        }
+        else if (flag == "--format") {
+            if (!parseReportFormat(value, options.format)) {
+                std::cerr << "Error: --format expects 'text', 'json' or 'csv', got '" << value << "'\n";
+                return false;
+            }
+        }
+        else {
+            std::cerr << "Error: Unknown option or bad value: " << flag << " " << value << '\n';
+            return false;
+        }
+    }
+    return true;
+}
+
+static unsigned resolveThreadCount(unsigned requested) {
+    if (requested != 0) {
+        return requested;
+    }
+    const unsigned hardware = std::thread::hardware_concurrency();
+    return hardware == 0 ? 1 : hardware;
+}
+
+// --- Partition Mode ---
+// One parallel pass: the file is cut into newline-aligned ranges, and each
+// thread streams its range through its own PartitionWriter. Under a memory
+// limit, the read blocks take at most half of it and the writers share the
+// rest, so they spill their buffers to the partition files sooner.
+static int runPartition(const Options& options) {
+    std::error_code ec;
+    std::filesystem::create_directories(options.outputDir, ec);
+    if (ec) {
+        std::cerr << "Fatal Error: Could not create output directory " << options.outputDir
+                  << ": " << ec.message() << '\n';
+        return 1;
+    }
+
+    ResourceGovernor governor(options.limits);
+    const std::size_t threadCount = governor.fitWorkers(resolveThreadCount(options.threads), 0.5);
+    const WorkerPlacement placement(options.pinThreads);
+    const std::vector<ByteRange> ranges = splitFileIntoRanges(options.logFilePath, threadCount);
+    const std::size_t readBlockBytes = governor.blockBytes();
+    // A per-thread budget of 64 partition buffers bounds memory even when
+    // partitioning by a key with thousands of distinct values.
+    std::size_t bufferBytes = options.partitionBufferKiB * 1024;
+    std::size_t writerBudgetBytes = bufferBytes * 64;
+    if (options.limits.memoryBytes > 0) {
+        writerBudgetBytes = std::min(writerBudgetBytes, governor.memory().available() / std::max<std::size_t>(1, ranges.size()));
+        bufferBytes = std::min(bufferBytes, writerBudgetBytes);
+        governor.memory().reserve(writerBudgetBytes * ranges.size());
+    }
+
+    PartitionFileSet files(options.outputDir, options.maxOpenFiles);
+    std::vector<long long> linesPerWorker(ranges.size(), 0);
+    std::vector<char> workerOk(ranges.size(), 1);
+
+    std::vector<std::thread> workers;
+    for (std::size_t w = 0; w < ranges.size(); ++w) {
+        workers.emplace_back([&, w]() {
+            placement.pin(w); // Before the worker allocates anything.
+            ResourceGovernor::Worker place(&governor);
+            std::ifstream input(options.logFilePath, std::ios::binary);
+            PartitionWriter writer(files, bufferBytes, writerBudgetBytes);
+            std::string block;
+            long long lines = 0;
+            LogRecord record; // Owns the key while it is written.
+            std::string_view key;
+            const bool readOk = input.is_open() &&
+                forEachLineInRange(input, ranges[w], readBlockBytes, block, [&](std::string_view line, std::uint64_t) {
+                    if (partitionKeyOf(line, options.partitionKey, options.parser, record, key)) {
+                        writer.write(key, line);
+                    }
+                    else {
+                        writer.writeUnparsed(line);
+                    }
+                    ++lines;
+                }, &governor);
+            writer.flushAll();
+            linesPerWorker[w] = lines;
+            workerOk[w] = (readOk && writer.ok()) ? 1 : 0;
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    long long totalLines = 0;
+    for (std::size_t w = 0; w < ranges.size(); ++w) {
+        totalLines += linesPerWorker[w];
+        if (!workerOk[w]) {
+            std::cerr << "Fatal Error: I/O failure while partitioning.\n";
+            return 1;
+        }
+    }
+
+    std::cout << "Partitioning finished.\n";
+    std::cout << "Total lines processed: " << totalLines << '\n';
+    std::cout << "Partitions written: " << files.partitionCount() << " (in " << options.outputDir << ")\n";
+    if (options.limits.any()) {
+        std::cout << "Resource limits: " << governor.summary() << '\n';
+    }
+    if (placement.enabled()) {
+        std::cout << "Placement: " << placement.describe(ranges.size()) << '\n';
+    }
+    std::cout << "------------------------------------\n";
+    return 0;
+}
+
+// --- Analysis Mode ---
+// Every input becomes one or more scan tasks (see splitInput): newline-aligned
+// ranges of a text file, block-aligned ranges of a binary log, or the whole of a
+// compressed file. Worker threads take tasks in turn,
+// each into its own LogSummary and ExampleSampler, so the hot loop shares
+// nothing; the partial results are merged once every worker has finished.
+// With --pin-threads, each NUMA node in use gets its own run of consecutive
+// tasks. The same part of a file then goes to the same node on every run,
+// so the page cache tends to hold it in that node's memory. Once a node's
+// run is done, its workers help with the other nodes' runs.
+struct ScanTask {
+    std::size_t input = 0;
+    ByteRange range;
+};
+
+struct WorkerResult {
+    LogSummary summary;
+    ExampleSampler examples;
+    long long linesOutsideDedupWindow = 0;
+    bool ok = true;
+    std::string error;
+
+    WorkerResult(std::size_t examplesPerCategory, std::uint64_t seed)
+        : examples(examplesPerCategory, seed) {}
+};
+
+// Saves 'summary' for --emit-state; an empty path means "not requested".
+static bool emitState(const std::string& path, const LogSummary& summary, ReportFormat format) {
+    if (path.empty()) {
+        return true;
+    }
+    if (!writeStateFile(path, summary)) {
+        std::cerr << "Fatal Error: Could not write state file " << path << '\n';
+        return false;
+    }
+    statusStream(format) << "State written to: " << path << '\n';
+    return true;
+}
+
+// Writes the final report to stdout with a single write. Text reports start
+// with a heading line and the raw line count.
+static void printReport(ReportFormat format, std::string_view heading, const LogSummary& summary) {
+    ReportBuffer report;
+    if (format == ReportFormat::Text) {
+        report.append(heading).append('\n');
+        report.append("Total lines processed: ").integer(summary.totalLines).append('\n');
+    }
+    writeSummary(report, summary, format);
+    report.writeTo(std::cout);
+}
+
+static int runAnalysis(const Options& options, const std::vector<LogInput>& inputs) {
+    // Deduplication compares each line with the ones shortly before it in the
+    // file, so it needs to see the whole file in order on a single worker.
+    ResourceGovernor governor(options.limits);
+    const std::size_t threadCount = governor.fitWorkers(options.dedupWindowSeconds > 0 ? 1 : resolveThreadCount(options.threads));
+    if (options.autotune) {
+        governor.autotune();
+    }
+    else if (options.stats) {
+        governor.measureStages();
+    }
+    // Tuning pauses some workers for a while. Smaller tasks let the running
+    // ones take over the rest of the input, so none runs out of work early.
+    const std::size_t tasksPerWorker = options.autotune ? 4 : 1;
+
+    // Compressed files go first: each is one long task, best started early.
+    std::vector<ScanTask> tasks;
+    for (const bool compressed : { true, false }) {
+        for (std::size_t i = 0; i < inputs.size(); ++i) {
+            if ((inputs[i].profile.compression != Compression::None) != compressed) {
+                continue;
+            }
+            std::vector<ByteRange> ranges;
+            std::string error;
+            if (!splitInput(inputs[i].path, inputs[i].profile, threadCount * tasksPerWorker, ranges, error)) {
+                std::cerr << "Fatal Error: " << error << '\n';
+                return 1;
+            }
+            for (const ByteRange& range : ranges) {
+                tasks.push_back({ i, range });
+            }
+        }
+    }
+    const std::size_t workerCount = std::max<std::size_t>(1, std::min<std::size_t>(threadCount, tasks.size()));
+
+    std::random_device seedSource;
+    std::vector<WorkerResult> results;
+    results.reserve(workerCount + 1);
+    results.emplace_back(options.examplesPerCategory, seedSource()); // Merge target, even for an empty file.
+    for (std::size_t w = 0; w < workerCount; ++w) {
+        results.emplace_back(options.examplesPerCategory, seedSource());
+    }
+
+    const WorkerPlacement placement(options.pinThreads);
+    const std::size_t runCount = std::max<std::size_t>(1, std::min(placement.nodeCount(), workerCount));
+    const auto runBegin = [&](std::size_t run) { return run * tasks.size() / runCount; };
+    std::vector<std::atomic<std::size_t>> nextTask(runCount);
+    for (std::size_t run = 0; run < runCount; ++run) {
+        nextTask[run] = runBegin(run);
+    }
+
+    using Clock = std::chrono::steady_clock;
+    const Clock::time_point scanStart = Clock::now();
+    std::vector<std::thread> workers;
+    for (std::size_t w = 0; w < workerCount; ++w) {
+        workers.emplace_back([&, w]() {
+            placement.pin(w); // Before the worker allocates anything.
+            ResourceGovernor::Worker place(&governor);
+            WorkerResult& result = results[w + 1];
+            LogSummary& summary = result.summary;
+
+            // The dedup stage only exists when asked for; a null pointer means "off".
+            std::unique_ptr<Deduplicator> deduplicator;
+            if (options.dedupWindowSeconds > 0) {
+                deduplicator = std::make_unique<Deduplicator>(options.dedupWindowSeconds);
+            }
+            const bool sampling = result.examples.enabled();
+
+            std::string lineText; // The text form of a binary record, for dedup.
+            const auto onRecord = [&](const LogRecord* record, std::string_view line, std::uint64_t offset) {
+                summary.totalLines++;
+                if (record == nullptr) {
+                    summary.malformedLines++;
+                    return;
+                }
+                // Replayed lines are dropped here, before they reach any metric.
+                if (deduplicator) {
+                    if (line.empty()) {
+                        formatPipeLogLine(*record, lineText);
+                        line = lineText;
+                    }
+                    if (deduplicator->isDuplicate(record->timestamp, line)) {
+                        summary.duplicateLines++;
+                        return;
+                    }
+                }
+                summary.add(*record);
+                if (sampling) {
+                    result.examples.offer(record->action, record->status, offset);
+                }
+            };
+
+            std::ifstream input;
+            std::size_t openInput = inputs.size(); // Which input 'input' has open.
+            std::string block;
+            for (std::size_t k = 0; k < runCount && result.ok; ++k) {
+                const std::size_t run = (placement.nodeOf(w) + k) % runCount;
+                for (std::size_t t = nextTask[run]++; result.ok && t < runBegin(run + 1); t = nextTask[run]++) {
+                    const ScanTask& task = tasks[t];
+                    const LogInput& source = inputs[task.input];
+                    if (source.profile.compression == Compression::None && openInput != task.input) {
+                        input.close();
+                        input.clear();
+                        input.open(source.path, std::ios::binary);
+                        openInput = task.input;
+                    }
+                    result.ok = scanInput(source.path, source.profile, source.parser, input, task.range, block, onRecord,
+                                          result.error, &governor);
+                }
+            }
+            if (deduplicator) {
+                result.linesOutsideDedupWindow = deduplicator->linesOutsideWindow();
+            }
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    const double scanSeconds = std::chrono::duration<double>(Clock::now() - scanStart).count();
+
+    WorkerResult& total = results.front();
+    for (std::size_t w = 1; w < results.size(); ++w) {
+        if (!results[w].ok) {
+            std::cerr << "Fatal Error: " << results[w].error << '\n';
+            return 1;
+        }
+        total.summary.merge(results[w].summary);
+        total.examples.merge(results[w].examples);
+        total.linesOutsideDedupWindow += results[w].linesOutsideDedupWindow;
+    }
+
+    printReport(options.format, "Analysis finished.", total.summary);
+    std::ostream& status = statusStream(options.format);
+    if (total.linesOutsideDedupWindow > 0) {
+        status << "Lines too old for the dedup window (not checked): " << total.linesOutsideDedupWindow << '\n';
+    }
+    if (options.limits.any()) {
+        status << "Resource limits: " << governor.summary() << '\n';
+    }
+    if (placement.enabled()) {
+        status << "Placement: " << placement.describe(workerCount) << '\n';
+    }
+    if (options.stats) {
+        status << "Scan statistics:\n" << governor.statistics(scanSeconds);
+    }
+    if (total.examples.enabled()) {
+        total.examples.print(options.logFilePath, status);
+    }
+    return emitState(options.emitStatePath, total.summary, options.format) ? 0 : 1;
+}
+
+// --- Merge Subcommand ---
+// `merge a.state b.state ...` combines the summaries saved by --emit-state on
+// several hosts into one report, optionally saving the result as a new state.
+static int runMerge(int argc, char* argv[]) {
+    std::vector<std::string> inputs;
+    std::string outputPath;
+    ReportFormat format = ReportFormat::Text;
+    for (int i = 2; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--emit-state" || arg == "--format") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: Missing value for " << arg << '\n';
+                return 1;
+            }
+            const std::string value = argv[++i];
+            if (arg == "--emit-state") {
+                outputPath = value;
+            }
+            else if (!parseReportFormat(value, format)) {
+                std::cerr << "Error: --format expects 'text', 'json' or 'csv', got '" << value << "'\n";
+                return 1;
+            }
+        }
+        else {
+            inputs.push_back(arg);
+        }
+    }
+    if (inputs.empty()) {
+        std::cerr << "Error: merge needs at least one state file.\n";
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    LogSummary total;
+    for (const std::string& path : inputs) {
+        LogSummary part;
+        std::string error;
+        if (!readStateFile(path, part, error)) {
+            std::cerr << "Fatal Error: " << error << '\n';
+            return 1;
+        }
+        total.merge(part);
+    }
+
+    const std::string heading = "Merged " + std::to_string(inputs.size()) + " state file(s).";
+    printReport(format, heading, total);
+    return emitState(outputPath, total, format) ? 0 : 1;
+}
+
+// --- Bench Subcommand ---
+// `bench a.log a.lfab ...` times how fast one thread turns each file into
+// records, so text, JSON, gzip and binary copies of the same log can be compared.
+// Each file is read twice, once only decoding records and once also adding them
+// to a summary, as the analysis does; each figure is the best of three runs, so
+// the file comes from the page cache. With --threads, each file is also
+// scanned by that many workers as the analysis does, once with the workers
+// left to the scheduler and once pinned (see CpuPlacement.h).
+
+// The best of three parallel scans of 'path' in ms, or a negative value (with
+// 'error') on failure. Each worker builds its own summary, and they are merged
+// at the end.
+static double timeParallelScan(const std::string& path, const InputProfile& profile, const LineParser& parser,
+                               std::size_t threads, bool pin, std::string& error) {
+    using Clock = std::chrono::steady_clock;
+    std::vector<ByteRange> ranges;
+    if (!splitInput(path, profile, threads, ranges, error)) {
+        return -1;
+    }
+    double bestMs = -1;
+    for (int run = 0; run < 3; ++run) {
+        const WorkerPlacement placement(pin);
+        std::vector<LogSummary> partials(ranges.size());
+        std::vector<std::string> errors(ranges.size());
+        std::vector<char> workerOk(ranges.size(), 1);
+        const auto start = Clock::now();
+        std::vector<std::thread> workers;
+        for (std::size_t w = 0; w < ranges.size(); ++w) {
+            workers.emplace_back([&, w]() {
+                placement.pin(w);
+                LogSummary summary; // Built here, so a pinned worker's summary is in its node's memory.
+                std::ifstream file(path, std::ios::binary);
+                std::string buffer;
+                workerOk[w] = scanInput(path, profile, parser, file, ranges[w], buffer,
+                    [&](const LogRecord* record, std::string_view, std::uint64_t) {
+                        summary.totalLines++;
+                        if (record == nullptr) {
+                            summary.malformedLines++;
+                        }
+                        else {
+                            summary.add(*record);
+                        }
+                    }, errors[w]);
+                partials[w] = std::move(summary);
+            });
+        }
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+        LogSummary total;
+        for (std::size_t w = 0; w < ranges.size(); ++w) {
+            if (!workerOk[w]) {
+                error = errors[w];
+                return -1;
+            }
+            total.merge(partials[w]);
+        }
+        const double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        bestMs = run == 0 ? ms : std::min(bestMs, ms);
+    }
+    return bestMs;
+}
+
+static int runBench(int argc, char* argv[]) {
+    std::vector<std::string> paths;
+    std::string schemaPath;
+    std::size_t threads = 0; // 0: single-threaded figures only.
+    for (int i = 2; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--schema" || arg == "--threads") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: Missing value for " << arg << '\n';
+                return 1;
+            }
+            const std::string value = argv[++i];
+            if (arg == "--schema") {
+                schemaPath = value;
+            }
+            else if (!parseCount(value, threads) || threads == 0) {
+                std::cerr << "Error: --threads expects a positive number, got '" << value << "'\n";
+                return 1;
+            }
+        }
+        else {
+            paths.push_back(arg);
+        }
+    }
+    if (paths.empty()) {
+        std::cerr << "Error: bench needs at least one log file.\n";
+        printUsage(argv[0]);
+        return 1;
+    }
+    LogSchema schema;
+    std::string error;
+    if (!schemaPath.empty() && !schema.load(schemaPath, error)) {
+        std::cerr << "Fatal Error: " << error << '\n';
+        return 1;
+    }
+    const LogSchema* declaredSchema = schemaPath.empty() ? nullptr : &schema;
+
+    using Clock = std::chrono::steady_clock;
+    std::cout << "Single-threaded ingest, best of 3 runs:\n";
+    for (const std::string& path : paths) {
+        InputProfile profile;
+        std::vector<ByteRange> ranges;
+        if (!sniffInput(path, declaredSchema, profile, error) || !splitInput(path, profile, 1, ranges, error)) {
+            std::cerr << "Fatal Error: " << error << '\n';
+            return 1;
+        }
+        const LineParser parser = lineParserFor(profile, declaredSchema);
+
+        long long records = 0;
+        double bestMs[2] = { 0.0, 0.0 }; // Decoding only; decoding and aggregating.
+        for (int aggregate = 0; aggregate < 2; ++aggregate) {
+            for (int run = 0; run < 3; ++run) {
+                LogSummary summary;
+                long long latencySum = 0; // Stored below so the decode-only loop is not optimized away.
+                std::ifstream file(path, std::ios::binary);
+                std::string buffer;
+                const auto start = Clock::now();
+                for (const ByteRange& range : ranges) {
+                    const auto onRecord = [&](const LogRecord* record, std::string_view, std::uint64_t) {
+                        summary.totalLines++;
+                        if (record == nullptr) {
+                            summary.malformedLines++;
+                        }
+                        else if (aggregate) {
+                            summary.add(*record);
+                        }
+                        else {
+                            latencySum += record->latencyMs;
+                        }
+                    };
+                    if (!scanInput(path, profile, parser, file, range, buffer, onRecord, error)) {
+                        std::cerr << "Fatal Error: " << error << '\n';
+                        return 1;
+                    }
+                }
+                const double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+                bestMs[aggregate] = run == 0 ? ms : std::min(bestMs[aggregate], ms);
+                records = summary.totalLines - summary.malformedLines;
+                volatile long long sink = latencySum;
+                (void)sink;
+            }
+        }
+
+        const double megabytes = static_cast<double>(std::max(0LL, fileSizeOf(path))) / 1e6;
+        const double perRecord = records > 0 ? 1e6 / static_cast<double>(records) : 0.0;
+        ReportBuffer line;
+        line.append(path).append(" (").append(describeInput(profile)).append("): ");
+        line.decimal(megabytes).append(" MB, ").integer(records).append(" records\n");
+        line.append("  decode:             ").decimal(bestMs[0]).append(" ms, ").decimal(megabytes * 1000.0 / bestMs[0])
+            .append(" MB/s, ").decimal(bestMs[0] * perRecord).append(" ns/record\n");
+        line.append("  decode + aggregate: ").decimal(bestMs[1]).append(" ms, ").decimal(megabytes * 1000.0 / bestMs[1])
+            .append(" MB/s, ").decimal(bestMs[1] * perRecord).append(" ns/record\n");
+        for (const bool pin : { false, true }) {
+            if (threads == 0) {
+                break;
+            }
+            const double ms = timeParallelScan(path, profile, parser, threads, pin, error);
+            if (ms < 0) {
+                std::cerr << "Fatal Error: " << error << '\n';
+                return 1;
+            }
+            line.append("  ").integer(static_cast<long long>(threads)).append(pin ? " threads, pinned:   " : " threads, unpinned: ")
+                .decimal(ms).append(" ms, ").decimal(megabytes * 1000.0 / ms).append(" MB/s\n");
+        }
+        line.writeTo(std::cout);
+    }
+    return 0;
+}
+
+// The query language, shared by --interactive and the query subcommand. Only
+// the interactive prompt takes 'explain'/'analyze' prefixes and 'quit'.
+static void printQueryHelp(bool interactive) {
+    std::cout << "Queries:\n"
+              << "  count   [by <column>]  [where <predicate> [and <predicate>]...]\n"
+              << "  top <k> <column>       [where ...]\n"
+              << "  latency [by <column>]  [where ...]\n"
+              << "  histogram [<bucket_ms>] [where ...]   (latency histogram, 50 ms buckets by default)\n"
+              << "  rows [<limit>]         [where ...]     (the first matching records, 20 by default)\n"
+              << "Columns: user, action, status, ip (group-by and =, !=), latency, time (all comparisons).\n"
+              << "user, action and status also take 'in (a,b,...)'; details~<text> matches Details containing text.\n"
+              << "Example: top 3 user where action=TRADE_EXECUTE and latency>200\n";
+    if (interactive) {
+        std::cout << "Prefix a query with 'explain' to see its plan, or 'analyze' to run it and see each step's rows and time.\n"
+                  << "Type 'quit' to exit.\n";
+    }
+    else {
+        std::cout << "Add --explain to see a query's plan, or --analyze to run it and see each step's rows and time.\n";
+    }
+}
+
+// --- Query Subcommand ---
+// `query <store_dir> count by action where time>=...` answers one query from a
+// daemon's --store, in the --interactive query language. It can run while the
+// daemon is still writing to the store. --explain prints the query's plan
+// instead; --analyze prints it after the result.
+static int runStoreQuery(int argc, char* argv[]) {
+    std::string dir;
+    std::string text;
+    ReportFormat format = ReportFormat::Text;
+    PlanMode mode = PlanMode::Run;
+    for (int i = 2; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--explain" || arg == "--analyze") {
+            mode = arg == "--explain" ? PlanMode::Explain : PlanMode::Analyze;
+        }
+        else if (arg == "--format") {
+            if (i + 1 >= argc || !parseReportFormat(argv[i + 1], format)) {
+                std::cerr << "Error: --format expects 'text', 'json' or 'csv'\n";
+                return 1;
+            }
+            ++i;
+        }
+        else if (dir.empty()) {
+            dir = arg;
+        }
+        else {
+            text += (text.empty() ? "" : " ") + arg;
+        }
+    }
+    if (dir.empty() || text.empty()) {
+        std::cerr << "Error: query needs a store directory and a query.\n";
+        printUsage(argv[0]);
+        return 1;
+    }
+    if (normalizeQuery(text) == "help") {
+        printQueryHelp(false);
+        return 0;
+    }
+    if (!std::filesystem::exists(std::filesystem::path(dir) / "MANIFEST")) {
+        std::cerr << "Fatal Error: " << dir << " is not a store (no MANIFEST)\n";
+        return 1;
+    }
+
+    Query query;
+    std::string result;
+    std::string error;
+    StoreQueryStats stats;
+    PlanStep plan;
+    if (!parseQuery(text, query, error) || !queryStore(dir, query, result, error, format, stats, mode, &plan)) {
+        std::cerr << "Error: " << error << '\n';
+        return 1;
+    }
+    std::cout << result;
+    if (mode != PlanMode::Run) {
+        writePlan(statusStream(format), plan);
+    }
+    if (mode == PlanMode::Explain) {
+        return 0;
+    }
+    statusStream(format) << "(" << stats.segmentsScanned << " of " << stats.segments << " segments scanned, " << stats.rowsRead
+                         << " of " << stats.segmentRows << " segment rows read, " << stats.walRows << " rows from the WAL)\n";
+    return 0;
+}
+
+// --- Multi-Process Mode ---
+// The file is cut into several ranges per process so a slow or restarted
+// worker holds up only a small part of the work.
+static int runProcesses(const Options& options, const char* programPath) {
+    if (options.dedupWindowSeconds > 0 || options.examplesPerCategory > 0) {
+        std::cerr << "Fatal Error: --dedup and --examples are not supported with --processes.\n";
+        return 1;
+    }
+    SocketRuntime sockets;
+    const std::vector<ByteRange> ranges = splitFileIntoRanges(options.logFilePath, static_cast<unsigned>(options.processes * 4));
+    std::vector<std::string> workerCommand = {programPath, options.logFilePath};
+    if (!options.schemaPath.empty()) {
+        workerCommand.insert(workerCommand.end(), {"--schema", options.schemaPath});
+    }
+    workerCommand.push_back("--shard-worker"); // The coordinator appends the port.
+    ShardCoordinator coordinator(workerCommand, static_cast<unsigned>(options.processes),
+                                 std::chrono::seconds(static_cast<long long>(options.rangeTimeoutSeconds)));
+    LogSummary total;
+    std::string error;
+    if (!coordinator.run(ranges, total, error)) {
+        std::cerr << "Fatal Error: " << error << '\n';
+        return 1;
+    }
+
+    printReport(options.format, "Analysis finished.", total);
+    statusStream(options.format) << "Worker processes started: " << coordinator.workersStarted()
+                                 << " (ranges retried: " << coordinator.rangesRetried()
+                                 << ", workers timed out: " << coordinator.workersTimedOut() << ")\n";
+    return emitState(options.emitStatePath, total, options.format) ? 0 : 1;
+}
+
+// --- Arrow Export ---
+static int runArrowExport(const Options& options) {
+    ArrowExportStats stats;
+    std::string error;
+    if (!exportArrow(options.logFilePath, options.exportArrowPath, options.parser, options.arrowLayout, options.arrowBatchRows, stats, error)) {
+        std::cerr << "Fatal Error: " << error << '\n';
+        return 1;
+    }
+    statusStream(options.format) << "Exported " << stats.rows << " rows in " << stats.batches << " record batches to "
+                                 << options.exportArrowPath << " (" << stats.malformedLines << " malformed lines skipped).\n";
+    return 0;
+}
+
+// --- Approximate (Sampled) Mode ---
+// Only the chosen blocks are read, so the run time follows the sample size. The
+// blocks are dealt round-robin to the workers, each with its own file handle.
+static int runSample(const Options& options) {
+    const long long size = fileSizeOf(options.logFilePath);
+    const std::uint64_t fileSize = size > 0 ? static_cast<std::uint64_t>(size) : 0;
+    const std::uint64_t blockBytes = static_cast<std::uint64_t>(options.sampleBlockKiB) * 1024;
+    const std::uint64_t blockCount = (fileSize + blockBytes - 1) / blockBytes;
+
+    std::random_device seedSource;
+    const std::vector<std::uint64_t> blocks = chooseSampleBlocks(blockCount, options.sampleFraction, seedSource());
+
+    const std::size_t threadCount = std::max<std::size_t>(1, std::min<std::size_t>(resolveThreadCount(options.threads), blocks.size()));
+    std::vector<BlockSample> partials(threadCount);
+    std::vector<char> workerOk(threadCount, 1);
+
+    std::vector<std::thread> workers;
+    for (std::size_t w = 0; w < threadCount; ++w) {
+        workers.emplace_back([&, w]() {
+            std::ifstream input(options.logFilePath, std::ios::binary);
+            std::string buffer;
+            bool ok = input.is_open();
+            for (std::size_t i = w; ok && i < blocks.size(); i += threadCount) {
+                const ByteRange range = lineAlignedBlock(input, blocks[i], blockBytes, fileSize);
+                ok = sampleBlock(input, range, options.parser, buffer, partials[w]);
+            }
+            workerOk[w] = ok ? 1 : 0;
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    BlockSample total;
+    for (std::size_t w = 0; w < threadCount; ++w) {
+        if (!workerOk[w]) {
+            std::cerr << "Fatal Error: I/O failure while reading " << options.logFilePath << '\n';
+            return 1;
+        }
+        total.merge(partials[w]);
+    }
+
+    statusStream(options.format) << "Sampling finished.\n";
+    ReportBuffer report;
+    writeSampleReport(report, total, blockCount, options.format);
+    report.writeTo(std::cout);
+    return 0;
+}
+
+// --- Interactive Mode ---
+// The file is parsed once into a ColumnarTable; after that every query only
+// scans the in-memory columns it needs.
+
+static int runInteractive(const Options& options) {
+    using Clock = std::chrono::steady_clock;
+    const auto millisecondsSince = [](Clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    };
+
+    // The table is most of the memory; the read blocks get a quarter of the budget.
+    const Clock::time_point loadStart = Clock::now();
+    ResourceGovernor governor(options.limits);
+    const std::size_t threadCount = governor.fitWorkers(resolveThreadCount(options.threads), 0.25);
+    const WorkerPlacement placement(options.pinThreads);
+    ColumnarTable table;
+    std::string loadError;
+    if (!loadColumnarTable(options.logFilePath, static_cast<unsigned>(threadCount), options.parser, table, loadError,
+                           &governor, &placement)) {
+        std::cerr << "Fatal Error: " << loadError << '\n';
+        return 1;
+    }
+    std::vector<ColumnarView> parts{ table.view() };
+    collectStatistics(parts[0]);
+    std::ostream& status = statusStream(options.format);
+    status << "Loaded " << table.rows() << " rows (" << table.malformedLines << " malformed lines skipped) in "
+           << millisecondsSince(loadStart) << " ms. Type 'help' for the query syntax.\n";
+    if (options.limits.any()) {
+        status << "Resource limits: " << governor.summary() << '\n';
+    }
+    if (placement.enabled()) {
+        status << "Placement: " << placement.describe(threadCount) << '\n';
+    }
+
+    QueryCache cache(64);
+    std::string input;
+    while (status << "> " << std::flush, std::getline(std::cin, input)) {
+        const std::string key = normalizeQuery(input);
+        if (key.empty()) {
+            continue;
+        }
+        if (key == "quit" || key == "exit") {
+            break;
+        }
+        if (key == "help") {
+            printQueryHelp(true);
+            continue;
+        }
+
+        // Plans are not cached: --analyze has to run the query to time it.
+        PlanMode mode = options.planMode;
+        std::string text = key;
+        if (key.rfind("explain ", 0) == 0 || key.rfind("analyze ", 0) == 0) {
+            mode = key[0] == 'e' ? PlanMode::Explain : PlanMode::Analyze;
+            text = key.substr(8);
+        }
+        if (mode != PlanMode::Run) {
+            Query query;
+            std::string result;
+            std::string error;
+            PlanStep plan;
+            if (!parseQuery(text, query, error) || !planQuery(parts, {}, query, mode, plan, result, error, options.format)) {
+                status << "Error: " << error << '\n';
+                continue;
+            }
+            std::cout << result << std::flush;
+            writePlan(status, plan);
+            continue;
+        }
+
+        const Clock::time_point queryStart = Clock::now();
+        if (const std::string* cached = cache.find(key)) {
+            std::cout << *cached << std::flush;
+            status << "(" << millisecondsSince(queryStart) << " ms, cached)\n";
+            continue;
+        }
+
+        Query query;
+        std::string result;
+        std::string error;
+        if (!parseQuery(key, query, error) || !executeQuery(parts, query, result, error, options.format)) {
+            status << "Error: " << error << '\n';
+            continue;
+        }
+        std::cout << result << std::flush;
+        status << "(" << millisecondsSince(queryStart) << " ms)\n";
+        cache.insert(key, std::move(result));
+    }
+    return 0;
+}
+
+// --- Daemon Mode ---
+// Set from the signal handler; checked by the ingest loop between polls.
+static volatile std::sig_atomic_t g_stopRequested = 0;
+
+static void requestStop(int) {
+    g_stopRequested = 1;
+}
+
+static int runDaemon(const Options& options) {
+    SocketRuntime sockets;
+    if (!sockets.ok()) {
+        std::cerr << "Fatal Error: could not initialize sockets.\n";
+        return 1;
+    }
+
+    std::vector<SocketHandle> listeners;
+    std::string error;
+    if (options.httpPort != 0) {
+        SocketHandle listener = listenTcpLoopback(static_cast<std::uint16_t>(options.httpPort), error);
+        if (listener == kInvalidSocket || !fitsInFdSet(listener)) {
+            std::cerr << "Fatal Error: " << (listener == kInvalidSocket ? error : "too many open files to serve metrics") << '\n';
+            return 1;
+        }
+        listeners.push_back(listener);
+        std::cout << "Serving metrics on http://127.0.0.1:" << options.httpPort << "/metrics\n";
+    }
+    if (!options.socketPath.empty()) {
+        SocketHandle listener = listenUnixStream(options.socketPath, error);
+        if (listener == kInvalidSocket || !fitsInFdSet(listener)) {
+            std::cerr << "Fatal Error: " << (listener == kInvalidSocket ? error : "too many open files to serve metrics") << '\n';
+            return 1;
+        }
+        listeners.push_back(listener);
+        std::cout << "Serving metrics on unix:" << options.socketPath << '\n';
+    }
+    // Shared memory is optional, and on its own is a valid way to serve readers.
+    SharedMetricsWriter sharedMetrics;
+    SharedMetricsPayload sharedPayload;
+    const bool publishShared = !options.sharedMemoryName.empty();
+    if (publishShared) {
+        if (!sharedMetrics.open(options.sharedMemoryName)) {
+            std::cerr << "Fatal Error: could not create shared memory segment " << options.sharedMemoryName << '\n';
+            return 1;
+        }
+        std::cout << "Publishing metrics in shared memory segment " << options.sharedMemoryName << '\n';
+    }
+    if (listeners.empty() && !publishShared) {
+        std::cerr << "Error: --daemon needs --http-port, --socket and/or --shm.\n";
+        return 1;
+    }
+    std::cout.flush(); // The daemon runs until stopped; show the endpoints now.
+
+    // Lines can also arrive over sockets; they share the ingest path with files.
+    SocketIngest socketIngest;
+    const bool ingestOk =
+        (options.ingestUdpPort == 0 || socketIngest.addUdp(static_cast<std::uint16_t>(options.ingestUdpPort), error)) &&
+        (options.ingestUnixDatagram.empty() || socketIngest.addUnixDatagram(options.ingestUnixDatagram, error)) &&
+        (options.ingestUnixStream.empty() || socketIngest.addUnixStream(options.ingestUnixStream, error));
+    if (!ingestOk) {
+        std::cerr << "Fatal Error: " << error << '\n';
+        return 1;
+    }
+
+    // Every parsed row is also kept on disk when asked for.
+    std::unique_ptr<SegmentStore> store;
+    if (!options.storeDir.empty()) {
+        StoreConfig storeConfig;
+        storeConfig.partitionSeconds = options.storePartitionSeconds;
+        store = std::make_unique<SegmentStore>(storeConfig);
+        if (!store->open(options.storeDir, error)) {
+            std::cerr << "Fatal Error: " << error << '\n';
+            return 1;
+        }
+        std::cout << "Storing rows in " << options.storeDir << " (" << store->segmentCount() << " segments, "
+                  << store->recoveredRows() << " rows recovered from the WAL)\n";
+    }
+
+    std::vector<LogFollower> followers;
+    if (options.logFilePath != "-") {
+        followers.emplace_back(options.logFilePath);
+    }
+    for (const std::string& path : options.followPaths) {
+        followers.emplace_back(path);
+    }
+
+    std::signal(SIGINT, requestStop);
+    std::signal(SIGTERM, requestStop);
+
+    // 60 buckets: a 300 s window moves forward in 5 s steps.
+    RollingAggregates aggregates(options.windowSeconds, 60);
+    SnapshotBoard board;
+    const auto publish = [&]() {
+        board.publish(renderSnapshot(aggregates, socketIngest.stats()));
+        if (publishShared) {
+            fillSharedPayload(aggregates, sharedPayload);
+            sharedMetrics.publish(sharedPayload);
+        }
+    };
+    publish();
+
+    std::atomic<bool> stopServer(false);
+    std::thread server;
+    if (!listeners.empty()) {
+        server = std::thread(serveMetrics, std::cref(listeners), std::cref(board), std::cref(stopServer));
+    }
+
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point lastPublish = Clock::now();
+    bool dirty = false;
+    LogRecord record;
+    const auto ingest = [&](std::string_view line) {
+        aggregates.addLine();
+        if (options.parser.parse(line, record)) {
+            aggregates.add(record);
+            if (store) {
+                store->append(record);
+            }
+        }
+        else {
+            aggregates.addMalformed();
+        }
+    };
+
+    while (!g_stopRequested) {
+        std::uint64_t consumed = 0;
+        for (LogFollower& follower : followers) {
+            consumed += follower.poll(8u << 20, ingest);
+        }
+        // Waiting on the sockets doubles as the idle pause between file polls.
+        const bool filesBusy = consumed > 0;
+        if (!socketIngest.empty()) {
+            consumed += socketIngest.poll(filesBusy ? 0 : 200, ingest);
+        }
+        dirty = dirty || consumed > 0;
+        // One WAL sync per batch of input.
+        if (store && consumed > 0 && !store->commit(error)) {
+            std::cerr << "Fatal Error: " << error << '\n';
+            break;
+        }
+
+        if (dirty && Clock::now() - lastPublish >= std::chrono::seconds(1)) {
+            publish();
+            lastPublish = Clock::now();
+            dirty = false;
+        }
+        if (consumed == 0 && socketIngest.empty()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(200)); // Nothing new; wait for writers.
+        }
+    }
+
+    stopServer = true;
+    if (server.joinable()) {
+        server.join();
+    }
+    for (SocketHandle listener : listeners) {
+        closeSocket(listener);
+    }
+    if (!options.socketPath.empty()) {
+        std::remove(options.socketPath.c_str());
+    }
+    std::cout << "Daemon stopped after " << aggregates.cumulative().totalLines << " lines.\n";
+    if (store) {
+        store->close();
+        std::cout << "Store: " << store->segmentCount() << " segments, " << store->activeRows()
+                  << " rows in the WAL, " << store->compactions() << " compactions.\n";
+    }
+    return error.empty() ? 0 : 1;
+}
 
 // --- Main Function ---
 // This is the starting point of every C++ program. Execution begins here.
@@ -28,24 +1288,57 @@ int main(int argc, char* argv[]) {
     // A professional command-line tool should always validate its input.
     // 'argc' (argument count) stores the number of arguments passed.
     // 'argv' (argument vector) is an array of C-style strings containing the arguments.
-    // The first argument (argv[0]) is always the name of the program itself.
-    // We expect exactly one more argument: the path to the log file.
-    // Therefore, argc should be exactly 2.
-    if (argc != 2) {
-        // We use std::cerr for error messages. It's the standard error stream.
-        // This is good practice as it separates error output from normal program output.
-        std::cerr << "Error: Incorrect number of arguments." << std::endl;
-        std::cerr << "Usage: " << argv[0] << " <path_to_log_file>" << std::endl;
+    // The first argument (argv[0]) is always the name of the program itself, the
+    // second is the path to the log file, and anything after that is an option.
+    // `merge`, `bench` and `query` are subcommands rather than log files.
+    if (argc >= 2 && std::string(argv[1]) == "merge") {
+        return runMerge(argc, argv);
+    }
+    if (argc >= 2 && std::string(argv[1]) == "bench") {
+        return runBench(argc, argv);
+    }
+    if (argc >= 2 && std::string(argv[1]) == "query") {
+        return runStoreQuery(argc, argv);
+    }
+
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage(argv[0]);
         return 1; // Returning a non-zero value from main() indicates that the program terminated with an error.
     }
 
+    // A declared line format, used for every file whose lines match it.
+    LogSchema schema;
+    const LogSchema* declaredSchema = nullptr;
+    if (!options.schemaPath.empty()) {
+        std::string error;
+        if (!schema.load(options.schemaPath, error)) {
+            std::cerr << "Fatal Error: " << error << '\n';
+            return 1;
+        }
+        declaredSchema = &schema;
+    }
+
+    // A worker process started by --processes reports only to its coordinator.
+    if (options.shardWorkerPort != 0) {
+        InputProfile profile;
+        std::string error;
+        if (!sniffInput(options.logFilePath, declaredSchema, profile, error)) {
+            return 1;
+        }
+        SocketRuntime sockets;
+        return runShardWorker(options.logFilePath, static_cast<std::uint16_t>(options.shardWorkerPort),
+                              lineParserFor(profile, declaredSchema));
+    }
+
     // Store the log file path from the command-line arguments into a C++ std::string.
-    std::string logFilePath = argv[1];
+    const std::string& logFilePath = options.logFilePath;
 
     // Announce the start of the program. This provides good user feedback.
-    std::cout << "Initializing Log File Analyzer..." << std::endl;
-    std::cout << "------------------------------------" << std::endl;
-    std::cout << "Target log file: " << logFilePath << std::endl;
+    std::ostream& progress = statusStream(options.format);
+    progress << "Initializing Log File Analyzer...\n";
+    progress << "------------------------------------\n";
+    progress << "Target log file: " << logFilePath << '\n';
 
     // --- File Handling ---
     // Create an input file stream object. The constructor takes the file path.
@@ -54,34 +1347,101 @@ int main(int argc, char* argv[]) {
 
     // CRITICAL: Always check if the file was successfully opened before trying to read it.
     // The .is_open() method returns 'false' if the file couldn't be found or opened for any reason.
-    if (!logFile.is_open()) {
-        std::cerr << "Fatal Error: Could not open the log file at: " << logFilePath << std::endl;
+    // The one exception is a daemon fed only by sockets, which names its file "-".
+    const bool socketsOnly = options.daemon && logFilePath == "-";
+    if (!logFile.is_open() && !socketsOnly) {
+        std::cerr << "Fatal Error: Could not open the log file at: " << logFilePath << '\n';
         return 1; // Exit with an error code.
     }
 
-    std::cout << "File opened successfully. Starting analysis..." << std::endl;
+    // Each file's first 4 KiB decide how it is read and parsed. Followed files
+    // may still be empty, so the daemon takes every line format as it comes.
+    std::vector<LogInput> inputs;
+    if (options.daemon) {
+        options.parser = LineParser(declaredSchema);
+    }
+    else {
+        std::vector<std::string> paths = { logFilePath };
+        paths.insert(paths.end(), options.moreLogFiles.begin(), options.moreLogFiles.end());
+        for (const std::string& path : paths) {
+            LogInput input{ path, InputProfile(), LineParser() };
+            std::string error;
+            if (!sniffInput(path, declaredSchema, input.profile, error)) {
+                std::cerr << "Fatal Error: " << error << '\n';
+                return 1;
+            }
+            input.parser = lineParserFor(input.profile, declaredSchema);
+            progress << "Input: " << path << " (" << describeInput(input.profile) << ")\n";
+            inputs.push_back(std::move(input));
+        }
+        options.parser = inputs.front().parser;
+    }
 
-    // --- Reading the File Line-by-Line ---
-    std::string currentLine;
-    long long lineCounter = 0; // Use long long for potentially very large files.
+    // Only the default analysis reads several files, or decompresses as it goes.
+    const bool analysisMode = !options.partition && options.exportArrowPath.empty() && !options.daemon &&
+                              !options.interactive && options.sampleFraction == 0.0 && options.processes == 0;
+    const bool streamed = !inputs.empty() && (inputs.front().profile.compression != Compression::None ||
+                                              inputs.front().profile.format == LineFormat::Binary);
+    if (!analysisMode && (!options.moreLogFiles.empty() || streamed)) {
+        std::cerr << "Fatal Error: several log files, compressed logs and binary logs are only supported by the default analysis.\n";
+        return 1;
+    }
+    if (options.limits.any() && !analysisMode && !options.partition && !options.interactive) {
+        std::cerr << "Fatal Error: --max-memory-mib, --io-limit-mibps and --pressure-limit only apply to the default analysis, --partition-by and --interactive.\n";
+        return 1;
+    }
+    if (options.format != ReportFormat::Text && (options.partition || !options.exportArrowPath.empty() || options.daemon)) {
+        std::cerr << "Fatal Error: --format does not apply to --partition-by, --export-arrow or --daemon, which write no report.\n";
+        return 1;
+    }
+    if ((options.autotune || options.stats) && !analysisMode) {
+        std::cerr << "Fatal Error: --autotune and --stats only apply to the default analysis.\n";
+        return 1;
+    }
+    if (options.examplesPerCategory > 0 && (!options.moreLogFiles.empty() || streamed)) {
+        std::cerr << "Fatal Error: --examples needs a single uncompressed text log file.\n";
+        return 1;
+    }
+
+    progress << "File opened successfully. Starting analysis...\n";
+
+    if (options.partition) {
+        return runPartition(options);
+    }
+
+    // The stream was only needed to confirm the file is readable; every worker
+    // opens its own handle so threads never share a file position.
+    logFile.close();
 
-    // This is the most memory-efficient way to read a large file.
-    // The 'while' loop continues as long as std::getline is able to read a new line from the file.
-    // It reads one line at a time into the 'currentLine' string, overwriting its previous content.
-    // This means we only ever store one line in memory at any given moment.
-    while (std::getline(logFile, currentLine)) {
-        lineCounter++;
-        // In the next phase, we will add code *inside this loop* to parse 'currentLine'.
+    int status = 0;
+    if (!options.exportArrowPath.empty()) {
+        status = runArrowExport(options);
+    }
+    else if (options.daemon) {
+        status = runDaemon(options);
+    }
+    else if (options.interactive) {
+        status = runInteractive(options);
+    }
+    else if (options.sampleFraction > 0.0) {
+        status = runSample(options);
+    }
+    else if (options.processes > 0) {
+        status = runProcesses(options, argv[0]);
+    }
+    else {
+        status = runAnalysis(options, inputs);
+    }
+    if (status != 0) {
+        return status;
     }
 
     // --- Program Completion ---
-    // When the 'logFile' object goes out of scope at the end of 'main', its destructor
-    // is automatically called, which safely closes the file. This is a core C++
-    // principle called RAII (Resource Acquisition Is Initialization), which helps prevent resource leaks.
+    // Every worker's file stream was closed by its destructor when the worker's
+    // lambda returned. This is a core C++ principle called RAII (Resource
+    // Acquisition Is Initialization), which helps prevent resource leaks.
 
-    std::cout << "Analysis finished." << std::endl;
-    std::cout << "Total lines processed: " << lineCounter << std::endl;
-    std::cout << "------------------------------------" << std::endl;
+    progress << "------------------------------------\n";
 
     return 0; // Return 0 to indicate successful execution.
 }
@@ -0,0 +1,189 @@
+/**
+ * @file LogFollower.h
+ * @brief Reading lines as they are appended to a growing log file ("tail -f").
+ *
+ * @details The follower remembers how far into the file it has read. Each call
+ * to poll() reads whatever has been appended since, hands every complete line
+ * to the caller and keeps a trailing partial line until its newline arrives.
+ *
+ * Reading restarts from the beginning when the file was truncated (it became
+ * shorter than the remembered position) or replaced by log rotation. A rotated
+ * file may already have grown past the old position by the next poll, so
+ * rotation is recognized by the file's identity: its device and inode, or its
+ * volume and file index on Windows.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN // Keeps windows.h from pulling in the old winsock.h.
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "FileChunks.h"
+
+// --- File Identity ---
+// Tells two files apart even when one has replaced the other under the same
+// path. 'known' is false until the file has been looked at.
+struct FileIdentity {
+    std::uint64_t device = 0;
+    std::uint64_t file = 0;
+    bool known = false;
+
+    bool operator==(const FileIdentity& other) const {
+        return device == other.device && file == other.file && known == other.known;
+    }
+    bool operator!=(const FileIdentity& other) const { return !(*this == other); }
+};
+
+// --- One Open Look at the File ---
+// The identity, size and bytes all come from the same handle, so a rotation
+// between opening the path and looking at the file cannot mix up two files.
+class FollowedFile {
+public:
+    explicit FollowedFile(const std::string& path) {
+#ifdef _WIN32
+        // Share everything, so reading never stops the writer from rotating the file.
+        handle_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                              nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+#else
+        fd_ = ::open(path.c_str(), O_RDONLY);
+#endif
+    }
+    ~FollowedFile() {
+#ifdef _WIN32
+        if (handle_ != INVALID_HANDLE_VALUE) {
+            CloseHandle(handle_);
+        }
+#else
+        if (fd_ >= 0) {
+            ::close(fd_);
+        }
+#endif
+    }
+    FollowedFile(const FollowedFile&) = delete;
+    FollowedFile& operator=(const FollowedFile&) = delete;
+
+    // Fills 'identity' and 'size'. Returns false if the file is not open or cannot be looked at.
+    bool inspect(FileIdentity& identity, std::uint64_t& size) const {
+#ifdef _WIN32
+        BY_HANDLE_FILE_INFORMATION info;
+        if (handle_ == INVALID_HANDLE_VALUE || !GetFileInformationByHandle(handle_, &info)) {
+            return false;
+        }
+        identity.device = info.dwVolumeSerialNumber;
+        identity.file = (static_cast<std::uint64_t>(info.nFileIndexHigh) << 32) | info.nFileIndexLow;
+        size = (static_cast<std::uint64_t>(info.nFileSizeHigh) << 32) | info.nFileSizeLow;
+#else
+        struct stat info;
+        if (fd_ < 0 || ::fstat(fd_, &info) != 0) {
+            return false;
+        }
+        identity.device = static_cast<std::uint64_t>(info.st_dev);
+        identity.file = static_cast<std::uint64_t>(info.st_ino);
+        size = static_cast<std::uint64_t>(info.st_size);
+#endif
+        identity.known = true;
+        return true;
+    }
+
+    // Reads up to 'count' bytes at 'offset'. Returns how many were read.
+    std::size_t readAt(std::uint64_t offset, char* out, std::size_t count) const {
+        std::size_t got = 0;
+        while (got < count) {
+#ifdef _WIN32
+            OVERLAPPED at{};
+            at.Offset = static_cast<DWORD>(offset + got);
+            at.OffsetHigh = static_cast<DWORD>((offset + got) >> 32);
+            DWORD read = 0;
+            const DWORD want = static_cast<DWORD>(std::min<std::size_t>(count - got, 1u << 30));
+            if (!ReadFile(handle_, out + got, want, &read, &at) || read == 0) {
+                break;
+            }
+#else
+            const ssize_t read = ::pread(fd_, out + got, count - got, static_cast<off_t>(offset + got));
+            if (read <= 0) {
+                break;
+            }
+#endif
+            got += static_cast<std::size_t>(read);
+        }
+        return got;
+    }
+
+private:
+#ifdef _WIN32
+    HANDLE handle_ = INVALID_HANDLE_VALUE;
+#else
+    int fd_ = -1;
+#endif
+};
+
+class LogFollower {
+public:
+    explicit LogFollower(std::string path) : path_(std::move(path)) {}
+
+    const std::string& path() const { return path_; }
+
+    // Delivers newly appended complete lines to 'onLine(std::string_view)'.
+    // Reads at most 'maxBytes' per call so one busy file cannot starve others.
+    // Returns the number of bytes consumed (0 if nothing new or the file is
+    // currently missing).
+    template<typename Fn>
+    std::uint64_t poll(std::size_t maxBytes, Fn&& onLine) {
+        const FollowedFile file(path_);
+        FileIdentity identity;
+        std::uint64_t size = 0;
+        if (!file.inspect(identity, size)) {
+            return 0;
+        }
+        const bool replaced = identity_.known && identity != identity_;
+        identity_ = identity;
+        if (replaced || size < offset_) {
+            offset_ = 0;
+            pending_.clear();
+            ++rotations_;
+        }
+        if (size == offset_) {
+            return 0;
+        }
+
+        const std::size_t want = static_cast<std::size_t>(std::min<std::uint64_t>(size - offset_, maxBytes));
+        const std::size_t carried = pending_.size();
+        pending_.resize(carried + want);
+        const std::size_t got = file.readAt(offset_, &pending_[carried], want);
+        pending_.resize(carried + got);
+        offset_ += got;
+
+        const std::size_t lastNewline = pending_.rfind('\n');
+        if (lastNewline != std::string::npos) {
+            forEachLine(std::string_view(pending_.data(), lastNewline + 1), onLine);
+            pending_.erase(0, lastNewline + 1);
+        }
+        return got;
+    }
+
+    // How many times the file was seen to shrink or be replaced (truncation or rotation).
+    long long rotations() const { return rotations_; }
+
+private:
+    std::string path_;
+    std::uint64_t offset_ = 0;
+    FileIdentity identity_; // The file 'offset_' refers to.
+    std::string pending_; // A line whose newline has not been written yet.
+    long long rotations_ = 0;
+};
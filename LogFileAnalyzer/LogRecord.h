@@ -0,0 +1,194 @@
+/**
+ * @file LogRecord.h
+ * @brief Zero-copy parsing of a single log line, pipe-delimited or JSON.
+ *
+ * @details A log line has the format documented in the README:
+ *
+ *     Timestamp|IP_Address|UserID|Action|Status|Latency|Details
+ *
+ * or, for services that log JSON lines, one object with the same fields:
+ *
+ *     {"timestamp":1672531203,"ip":"172.16.31.45","user_id":"admin_zeta",
+ *      "action":"FAILED_LOGIN","status":"FAILURE","latency_ms":146,"details":"..."}
+ *
+ * The two can be mixed freely; a line starting with '{' is read as JSON.
+ *
+ * The parsers do not allocate. Every text field of a LogRecord is a
+ * std::string_view pointing back into the caller's line buffer, so a record is
+ * only valid for as long as that buffer is alive and unchanged. The one
+ * exception is a JSON string containing escape sequences: its decoded text is
+ * kept in the record's own 'storage'.
+ */
+
+#pragma once
+
+#include <charconv>     // For std::from_chars, the fastest standard way to parse integers.
+#include <cstdint>      // For packed IPv4 addresses.
+#include <string>       // For the decoded text of escaped JSON strings and formatted addresses.
+#include <string_view>  // For non-owning views into the line buffer.
+
+#include "JsonScanner.h" // Vectorized field extraction for JSON lines.
+
+// --- Parsed Representation of One Log Line ---
+struct LogRecord {
+    long long timestamp = 0;       // UNIX epoch seconds.
+    std::string_view ip;           // e.g. "198.51.100.2"
+    std::string_view userId;       // e.g. "trader_delta"
+    std::string_view action;       // e.g. "TRADE_EXECUTE"
+    std::string_view status;       // e.g. "SUCCESS"
+    int latencyMs = 0;             // The "89ms" field, without the unit suffix.
+    std::string_view details;      // Everything after the sixth pipe, verbatim.
+    std::string storage;           // Backing text for unescaped JSON strings; reused between lines.
+};
+
+// --- IPv4 Packing ---
+// "198.51.100.2" -> 0xC6336402. Returns false if 'text' is not a dotted quad.
+inline bool parseIpv4(std::string_view text, std::uint32_t& out) {
+    // A hand-rolled loop: this runs on every line of an interactive load, and
+    // four from_chars calls cost more than the rest of the line.
+    std::uint32_t value = 0;
+    unsigned octet = 0;
+    int digits = 0;
+    int dots = 0;
+    for (const char c : text) {
+        if (c >= '0' && c <= '9') {
+            octet = octet * 10 + static_cast<unsigned>(c - '0');
+            if (octet > 255) {
+                return false;
+            }
+            ++digits;
+        }
+        else if (c == '.' && digits > 0 && dots < 3) {
+            value = (value << 8) | octet;
+            octet = 0;
+            digits = 0;
+            ++dots;
+        }
+        else {
+            return false;
+        }
+    }
+    if (dots != 3 || digits == 0) {
+        return false;
+    }
+    out = (value << 8) | octet;
+    return true;
+}
+
+inline std::string formatIpv4(std::uint32_t ip) {
+    return std::to_string(ip >> 24) + "." + std::to_string((ip >> 16) & 255) + "." +
+           std::to_string((ip >> 8) & 255) + "." + std::to_string(ip & 255);
+}
+
+// --- Pipe-Delimited Lines ---
+// Splits 'line' on '|' and fills 'out'. Returns false if the line does not have
+// all seven fields or if the numeric fields are not numbers; 'out' is then left
+// in an unspecified state and should not be used.
+inline bool parsePipeLogLine(std::string_view line, LogRecord& out) {
+    // Tolerate files written with Windows line endings.
+    if (!line.empty() && line.back() == '\r') {
+        line.remove_suffix(1);
+    }
+
+    // Cut the next field off the front of 'line'. The last field (Details) may
+    // itself contain pipes in theory, so it is simply "whatever is left".
+    std::string_view fields[6];
+    for (std::string_view& field : fields) {
+        const std::size_t pipe = line.find('|');
+        if (pipe == std::string_view::npos) {
+            return false;
+        }
+        field = line.substr(0, pipe);
+        line.remove_prefix(pipe + 1);
+    }
+
+    const char* tsBegin = fields[0].data();
+    const char* tsEnd = tsBegin + fields[0].size();
+    auto tsResult = std::from_chars(tsBegin, tsEnd, out.timestamp);
+    if (tsResult.ec != std::errc() || tsResult.ptr != tsEnd) {
+        return false;
+    }
+
+    // The latency field carries an "ms" unit suffix, which from_chars stops at.
+    const char* latBegin = fields[5].data();
+    const char* latEnd = latBegin + fields[5].size();
+    auto latResult = std::from_chars(latBegin, latEnd, out.latencyMs);
+    if (latResult.ec != std::errc()) {
+        return false;
+    }
+
+    out.ip = fields[1];
+    out.userId = fields[2];
+    out.action = fields[3];
+    out.status = fields[4];
+    out.details = line;
+    return true;
+}
+
+// --- JSON Lines ---
+// Reads the same seven fields from a flat JSON object. Keys are matched
+// exactly; "user"/"userId" and "latency"/"latencyMs" are accepted as aliases.
+// Numbers may also be given as strings ("146ms" works for the latency). Unknown
+// keys are ignored and "details" is optional.
+inline bool parseJsonLogLine(std::string_view line, LogRecord& out) {
+    out.storage.clear();
+    out.storage.reserve(line.size()); // Decoded text never outgrows the line, so views into it stay valid.
+    out.details = std::string_view();
+
+    enum : unsigned { kTimestamp = 1, kIp = 2, kUser = 4, kAction = 8, kStatus = 16, kLatency = 32, kRequired = 63 };
+    unsigned seen = 0;
+    bool valid = true;
+    const auto text = [&](const JsonValue& value, std::string_view& field) {
+        if (!value.mayHaveEscapes) {
+            field = value.text;
+            return true;
+        }
+        return unescapeJsonString(value.text, out.storage, field);
+    };
+    const auto integer = [](std::string_view digits, auto& number, bool whole) {
+        const char* end = digits.data() + digits.size();
+        const auto result = std::from_chars(digits.data(), end, number);
+        return result.ec == std::errc() && (!whole || result.ptr == end);
+    };
+
+    const bool wellFormed = forEachJsonField(line, [&](std::string_view key, const JsonValue& value) {
+        if (key == "timestamp") {
+            valid = valid && integer(value.text, out.timestamp, true);
+            seen |= kTimestamp;
+        }
+        else if (key == "ip") {
+            valid = valid && text(value, out.ip);
+            seen |= kIp;
+        }
+        else if (key == "user_id" || key == "userId" || key == "user") {
+            valid = valid && text(value, out.userId);
+            seen |= kUser;
+        }
+        else if (key == "action") {
+            valid = valid && text(value, out.action);
+            seen |= kAction;
+        }
+        else if (key == "status") {
+            valid = valid && text(value, out.status);
+            seen |= kStatus;
+        }
+        else if (key == "latency_ms" || key == "latencyMs" || key == "latency") {
+            valid = valid && integer(value.text, out.latencyMs, false);
+            seen |= kLatency;
+        }
+        else if (key == "details") {
+            valid = valid && text(value, out.details);
+        }
+    });
+    return wellFormed && valid && seen == kRequired;
+}
+
+// --- Line Parser ---
+// Parses one line in either format. Returns false if the line is malformed;
+// 'out' is then left in an unspecified state and should not be used.
+inline bool parseLogLine(std::string_view line, LogRecord& out) {
+    if (!line.empty() && line.front() == '{') {
+        return parseJsonLogLine(line, out);
+    }
+    return parsePipeLogLine(line, out);
+}
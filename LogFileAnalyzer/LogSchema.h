@@ -0,0 +1,532 @@
+/**
+ * @file LogSchema.h
+ * @brief User-declared line formats, compiled into a specialized decoder.
+ *
+ * @details A schema file describes a delimited log format that is not the
+ * built-in "Timestamp|IP|UserID|Action|Status|Latency|Details" layout:
+ *
+ *     # Comma-separated gateway logs.
+ *     delimiter ,
+ *     field time     iso8601
+ *     field client   ipv4
+ *     field region   enum eu us apac
+ *     field action   enum
+ *     field attrs    kv ; =
+ *     field latency  int ms
+ *
+ * Each field has a name and a type:
+ *  - epoch           integer UNIX seconds.
+ *  - iso8601         "2023-01-01T00:00:03Z", with an optional fraction and
+ *                    "+hh:mm" offset; no offset means UTC.
+ *  - ipv4            a dotted quad, checked and kept as text.
+ *  - enum [values]   a token; if values are listed, it must be one of them.
+ *  - int [suffix]    an integer, followed by exactly 'suffix' if one is given.
+ *  - kv [sep] [eq]   "key=value" pairs separated by ';' (or 'sep'). Keys that
+ *                    name a record field fill that field.
+ *  - text            anything, kept verbatim.
+ *
+ * Field names pick where the value goes: timestamp/time/ts, ip, user_id/user,
+ * action, status, latency_ms/latency and details. Other names are checked and
+ * then ignored. The last field takes the rest of the line, delimiters and all.
+ *
+ * When the schema is loaded, every field is bound to a decoder instantiated
+ * from a template for its (type, destination) pair, so the per-line loop is
+ * just "split, call" with no switch on the field type.
+ */
+
+#pragma once
+
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "LogRecord.h"
+
+// --- Field Types and Destinations ---
+enum class SchemaFieldType { Epoch, Iso8601, Ipv4, Enum, Int, KeyValue, Text };
+
+enum class RecordSlot : unsigned {
+    None = 0, Timestamp = 1, Ip = 2, UserId = 4, Action = 8, Status = 16, Latency = 32, Details = 64
+};
+
+// The slots every record needs; details are optional.
+constexpr unsigned kRequiredSlots = 63;
+
+inline RecordSlot recordSlotFor(std::string_view name) {
+    if (name == "timestamp" || name == "time" || name == "ts") return RecordSlot::Timestamp;
+    if (name == "ip") return RecordSlot::Ip;
+    if (name == "user_id" || name == "userId" || name == "user") return RecordSlot::UserId;
+    if (name == "action") return RecordSlot::Action;
+    if (name == "status") return RecordSlot::Status;
+    if (name == "latency_ms" || name == "latencyMs" || name == "latency") return RecordSlot::Latency;
+    if (name == "details") return RecordSlot::Details;
+    return RecordSlot::None;
+}
+
+constexpr bool isNumericSlot(RecordSlot slot) {
+    return slot == RecordSlot::Timestamp || slot == RecordSlot::Latency;
+}
+
+struct SchemaField {
+    std::string name;
+    SchemaFieldType type = SchemaFieldType::Text;
+    RecordSlot slot = RecordSlot::None;
+    std::string suffix;                  // int: the unit after the digits.
+    std::vector<std::string> enumValues; // enum: the allowed values; empty means any.
+    char pairSeparator = ';';            // kv
+    char keyValueSeparator = '=';        // kv
+};
+
+// --- Value Decoding ---
+namespace schema_detail {
+
+// Reads exactly 'count' digits.
+inline bool fixedDigits(const char*& p, const char* end, int count, int& out) {
+    if (end - p < count) {
+        return false;
+    }
+    int value = 0;
+    for (int i = 0; i < count; ++i, ++p) {
+        if (*p < '0' || *p > '9') {
+            return false;
+        }
+        value = value * 10 + (*p - '0');
+    }
+    out = value;
+    return true;
+}
+
+// Days since 1970-01-01 of a proleptic Gregorian date.
+inline long long daysFromCivil(long long year, int month, int day) {
+    year -= month <= 2 ? 1 : 0;
+    const long long era = (year >= 0 ? year : year - 399) / 400;
+    const long long yearOfEra = year - era * 400;
+    const long long dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    const long long dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + dayOfEra - 719468;
+}
+
+// "YYYY-MM-DD[T ]hh:mm:ss[.fraction][Z|+hh:mm|+hhmm]" -> epoch seconds.
+inline bool parseIso8601(std::string_view text, long long& out) {
+    const char* p = text.data();
+    const char* end = p + text.size();
+    int year = 0, month = 0, day = 0, hour = 0, minute = 0, second = 0;
+    const auto separator = [&](std::string_view allowed) {
+        if (p == end || allowed.find(*p) == std::string_view::npos) {
+            return false;
+        }
+        ++p;
+        return true;
+    };
+    if (!fixedDigits(p, end, 4, year) || !separator("-") || !fixedDigits(p, end, 2, month) || !separator("-") ||
+        !fixedDigits(p, end, 2, day) || !separator("T ") || !fixedDigits(p, end, 2, hour) || !separator(":") ||
+        !fixedDigits(p, end, 2, minute) || !separator(":") || !fixedDigits(p, end, 2, second)) {
+        return false;
+    }
+    if (month < 1 || month > 12 || day < 1 || day > 31 || hour > 23 || minute > 59 || second > 60) {
+        return false;
+    }
+    if (p != end && *p == '.') {
+        do {
+            ++p;
+        } while (p != end && *p >= '0' && *p <= '9');
+    }
+    long long offset = 0;
+    if (p != end && *p == 'Z') {
+        ++p;
+    }
+    else if (p != end && (*p == '+' || *p == '-')) {
+        const long long sign = *p++ == '-' ? -1 : 1;
+        int offsetHours = 0, offsetMinutes = 0;
+        if (!fixedDigits(p, end, 2, offsetHours)) {
+            return false;
+        }
+        if (p != end && *p == ':') {
+            ++p;
+        }
+        if (!fixedDigits(p, end, 2, offsetMinutes)) {
+            return false;
+        }
+        offset = sign * (offsetHours * 3600LL + offsetMinutes * 60LL);
+    }
+    if (p != end) {
+        return false;
+    }
+    out = daysFromCivil(year, month, day) * 86400 + hour * 3600LL + minute * 60LL + second - offset;
+    return true;
+}
+
+template <typename Number>
+inline bool parseWholeNumber(std::string_view text, Number& out) {
+    const char* end = text.data() + text.size();
+    const auto result = std::from_chars(text.data(), end, out);
+    return result.ec == std::errc() && result.ptr == end;
+}
+
+// Returns false if 'value' does not fit the slot.
+template <RecordSlot Slot>
+inline bool storeNumber(LogRecord& out, long long value) {
+    if constexpr (Slot == RecordSlot::Timestamp) {
+        out.timestamp = value;
+    }
+    else if constexpr (Slot == RecordSlot::Latency) {
+        if (value < std::numeric_limits<int>::min() || value > std::numeric_limits<int>::max()) {
+            return false;
+        }
+        out.latencyMs = static_cast<int>(value);
+    }
+    return true;
+}
+
+template <RecordSlot Slot>
+inline void storeText(LogRecord& out, std::string_view value) {
+    if constexpr (Slot == RecordSlot::Ip) out.ip = value;
+    else if constexpr (Slot == RecordSlot::UserId) out.userId = value;
+    else if constexpr (Slot == RecordSlot::Action) out.action = value;
+    else if constexpr (Slot == RecordSlot::Status) out.status = value;
+    else if constexpr (Slot == RecordSlot::Details) out.details = value;
+}
+
+// A value found inside a kv field. It has no declared type, so the latency
+// may carry an "ms" unit suffix.
+inline bool storeKeyValue(RecordSlot slot, std::string_view value, LogRecord& out) {
+    switch (slot) {
+    case RecordSlot::Timestamp: return parseWholeNumber(value, out.timestamp);
+    case RecordSlot::Latency: {
+        const char* end = value.data() + value.size();
+        const auto result = std::from_chars(value.data(), end, out.latencyMs);
+        return result.ec == std::errc() && (result.ptr == end || std::string_view(result.ptr, end - result.ptr) == "ms");
+    }
+    case RecordSlot::Ip: out.ip = value; return true;
+    case RecordSlot::UserId: out.userId = value; return true;
+    case RecordSlot::Action: out.action = value; return true;
+    case RecordSlot::Status: out.status = value; return true;
+    case RecordSlot::Details: out.details = value; return true;
+    case RecordSlot::None: return true;
+    }
+    return true;
+}
+
+} // namespace schema_detail
+
+// One field decoder: checks 'text', stores it in 'out' and marks its slot in
+// 'seen'. Returns false if the value does not match the declared type.
+using SchemaFieldDecoder = bool (*)(std::string_view text, const SchemaField& field, LogRecord& out, unsigned& seen);
+
+template <SchemaFieldType Type, RecordSlot Slot>
+inline bool decodeSchemaField(std::string_view text, const SchemaField& field, LogRecord& out, unsigned& seen) {
+    using namespace schema_detail;
+    if constexpr (Type == SchemaFieldType::Epoch || Type == SchemaFieldType::Iso8601 || Type == SchemaFieldType::Int) {
+        long long value = 0;
+        if constexpr (Type == SchemaFieldType::Iso8601) {
+            if (!parseIso8601(text, value)) {
+                return false;
+            }
+        }
+        else {
+            if constexpr (Type == SchemaFieldType::Int) {
+                const std::string_view suffix = field.suffix;
+                if (text.size() < suffix.size() || text.substr(text.size() - suffix.size()) != suffix) {
+                    return false;
+                }
+                text.remove_suffix(suffix.size());
+            }
+            if (!parseWholeNumber(text, value)) {
+                return false;
+            }
+        }
+        if (!storeNumber<Slot>(out, value)) {
+            return false;
+        }
+    }
+    else if constexpr (Type == SchemaFieldType::KeyValue) {
+        while (!text.empty()) {
+            const std::size_t next = text.find(field.pairSeparator);
+            const std::string_view pair = text.substr(0, next);
+            text.remove_prefix(next == std::string_view::npos ? text.size() : next + 1);
+            const std::size_t equals = pair.find(field.keyValueSeparator);
+            if (equals == std::string_view::npos) {
+                if (pair.empty()) {
+                    continue;
+                }
+                return false;
+            }
+            const RecordSlot slot = recordSlotFor(pair.substr(0, equals));
+            if (!storeKeyValue(slot, pair.substr(equals + 1), out)) {
+                return false;
+            }
+            seen |= static_cast<unsigned>(slot);
+        }
+    }
+    else {
+        if constexpr (Type == SchemaFieldType::Ipv4) {
+            std::uint32_t packed = 0;
+            if (!parseIpv4(text, packed)) {
+                return false;
+            }
+        }
+        else if constexpr (Type == SchemaFieldType::Enum) {
+            if (text.empty()) {
+                return false;
+            }
+            if (!field.enumValues.empty()) {
+                bool known = false;
+                for (const std::string& value : field.enumValues) {
+                    known = known || text == value;
+                }
+                if (!known) {
+                    return false;
+                }
+            }
+        }
+        storeText<Slot>(out, text);
+    }
+    seen |= static_cast<unsigned>(Slot);
+    return true;
+}
+
+// Which destinations each type can fill; everything can be ignored.
+constexpr bool isValidBinding(SchemaFieldType type, RecordSlot slot) {
+    if (slot == RecordSlot::None) {
+        return true;
+    }
+    switch (type) {
+    case SchemaFieldType::Epoch:
+    case SchemaFieldType::Iso8601:
+    case SchemaFieldType::Int: return isNumericSlot(slot);
+    case SchemaFieldType::Ipv4: return slot == RecordSlot::Ip;
+    case SchemaFieldType::KeyValue: return false;
+    case SchemaFieldType::Enum:
+    case SchemaFieldType::Text: return !isNumericSlot(slot);
+    }
+    return false;
+}
+
+template <SchemaFieldType Type>
+inline SchemaFieldDecoder schemaDecoderFor(RecordSlot slot) {
+    switch (slot) {
+    case RecordSlot::Timestamp: return &decodeSchemaField<Type, RecordSlot::Timestamp>;
+    case RecordSlot::Ip: return &decodeSchemaField<Type, RecordSlot::Ip>;
+    case RecordSlot::UserId: return &decodeSchemaField<Type, RecordSlot::UserId>;
+    case RecordSlot::Action: return &decodeSchemaField<Type, RecordSlot::Action>;
+    case RecordSlot::Status: return &decodeSchemaField<Type, RecordSlot::Status>;
+    case RecordSlot::Latency: return &decodeSchemaField<Type, RecordSlot::Latency>;
+    case RecordSlot::Details: return &decodeSchemaField<Type, RecordSlot::Details>;
+    case RecordSlot::None: return &decodeSchemaField<Type, RecordSlot::None>;
+    }
+    return nullptr;
+}
+
+inline SchemaFieldDecoder schemaDecoderFor(SchemaFieldType type, RecordSlot slot) {
+    switch (type) {
+    case SchemaFieldType::Epoch: return schemaDecoderFor<SchemaFieldType::Epoch>(slot);
+    case SchemaFieldType::Iso8601: return schemaDecoderFor<SchemaFieldType::Iso8601>(slot);
+    case SchemaFieldType::Ipv4: return schemaDecoderFor<SchemaFieldType::Ipv4>(slot);
+    case SchemaFieldType::Enum: return schemaDecoderFor<SchemaFieldType::Enum>(slot);
+    case SchemaFieldType::Int: return schemaDecoderFor<SchemaFieldType::Int>(slot);
+    case SchemaFieldType::KeyValue: return schemaDecoderFor<SchemaFieldType::KeyValue>(slot);
+    case SchemaFieldType::Text: return schemaDecoderFor<SchemaFieldType::Text>(slot);
+    }
+    return nullptr;
+}
+
+// --- A Loaded Schema ---
+class LogSchema {
+public:
+    // Reads and compiles a schema file. Returns false (with 'error') if the
+    // file cannot be read or declares something invalid.
+    bool load(const std::string& path, std::string& error) {
+        std::ifstream file(path);
+        if (!file.is_open()) {
+            error = "could not read schema file " + path;
+            return false;
+        }
+        std::stringstream text;
+        text << file.rdbuf();
+        if (!parse(text.str(), error)) {
+            error = path + ": " + error;
+            return false;
+        }
+        return true;
+    }
+
+    bool parse(const std::string& text, std::string& error) {
+        fields_.clear();
+        delimiter_ = '|';
+        std::istringstream lines(text);
+        std::string line;
+        for (int number = 1; std::getline(lines, line); ++number) {
+            if (!parseLine(line, error)) {
+                error = "line " + std::to_string(number) + ": " + error;
+                return false;
+            }
+        }
+        return compile(error);
+    }
+
+    // Decodes one line. Returns false if it does not match the schema; 'out'
+    // is then left in an unspecified state and should not be used.
+    bool decode(std::string_view line, LogRecord& out) const {
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        out.details = std::string_view();
+        unsigned seen = 0;
+        const std::size_t last = decoders_.size() - 1;
+        for (std::size_t i = 0; i < last; ++i) {
+            const void* found = std::memchr(line.data(), delimiter_, line.size());
+            if (found == nullptr) {
+                return false;
+            }
+            const std::size_t length = static_cast<std::size_t>(static_cast<const char*>(found) - line.data());
+            if (!decoders_[i](line.substr(0, length), fields_[i], out, seen)) {
+                return false;
+            }
+            line.remove_prefix(length + 1);
+        }
+        return decoders_[last](line, fields_[last], out, seen) && (seen & kRequiredSlots) == kRequiredSlots;
+    }
+
+    char delimiter() const { return delimiter_; }
+    const std::vector<SchemaField>& fields() const { return fields_; }
+
+private:
+    // A word that starts with '#' begins a comment, unless it is the single
+    // character given as a separator, so "delimiter #" and "enum a#b" work.
+    bool parseLine(const std::string& line, std::string& error) {
+        std::istringstream words(line);
+        std::string keyword;
+        if (!(words >> keyword) || keyword[0] == '#') {
+            return true; // Blank line or comment.
+        }
+        std::vector<std::string> args;
+        for (std::string word; words >> word;) {
+            const bool separator = (keyword == "delimiter" && args.empty()) ||
+                                   (keyword == "field" && args.size() >= 2 && args[1] == "kv" && args.size() <= 3);
+            if (word[0] == '#' && !(separator && word.size() == 1)) {
+                break;
+            }
+            args.push_back(word);
+        }
+
+        if (keyword == "delimiter") {
+            return args.size() == 1 && parseSeparator(args[0], delimiter_, error);
+        }
+        if (keyword != "field") {
+            error = "unknown keyword '" + keyword + "'";
+            return false;
+        }
+        if (args.size() < 2) {
+            error = "expected 'field <name> <type> [arguments]'";
+            return false;
+        }
+
+        SchemaField field;
+        field.name = args[0];
+        field.slot = recordSlotFor(field.name);
+        const std::string& type = args[1];
+        const std::vector<std::string> extra(args.begin() + 2, args.end());
+        if (type == "epoch" && extra.empty()) {
+            field.type = SchemaFieldType::Epoch;
+        }
+        else if ((type == "iso8601" || type == "iso") && extra.empty()) {
+            field.type = SchemaFieldType::Iso8601;
+        }
+        else if (type == "ipv4" && extra.empty()) {
+            field.type = SchemaFieldType::Ipv4;
+        }
+        else if (type == "enum") {
+            field.type = SchemaFieldType::Enum;
+            field.enumValues = extra;
+        }
+        else if (type == "int" && extra.size() <= 1) {
+            field.type = SchemaFieldType::Int;
+            field.suffix = extra.empty() ? std::string() : extra[0];
+        }
+        else if (type == "kv" && extra.size() <= 2) {
+            field.type = SchemaFieldType::KeyValue;
+            if ((extra.size() > 0 && !parseSeparator(extra[0], field.pairSeparator, error)) ||
+                (extra.size() > 1 && !parseSeparator(extra[1], field.keyValueSeparator, error))) {
+                return false;
+            }
+            field.slot = RecordSlot::None; // Its keys, not its name, say where values go.
+        }
+        else if (type == "text" && extra.empty()) {
+            field.type = SchemaFieldType::Text;
+        }
+        else {
+            error = "unknown type or bad arguments for field '" + field.name + "'";
+            return false;
+        }
+        if (!isValidBinding(field.type, field.slot)) {
+            error = "field '" + field.name + "' cannot be declared as " + type;
+            return false;
+        }
+        fields_.push_back(std::move(field));
+        return true;
+    }
+
+    static bool parseSeparator(const std::string& word, char& out, std::string& error) {
+        if (word == "tab" || word == "\\t") out = '\t';
+        else if (word == "space") out = ' ';
+        else if (word.size() == 1) out = word[0];
+        else {
+            error = "a separator is one character, 'tab' or 'space', got '" + word + "'";
+            return false;
+        }
+        return true;
+    }
+
+    // Binds every field to its decoder and checks that a record can be filled.
+    bool compile(std::string& error) {
+        decoders_.clear();
+        if (fields_.empty()) {
+            error = "the schema declares no fields";
+            return false;
+        }
+        unsigned declared = 0;
+        bool hasKeyValue = false;
+        for (const SchemaField& field : fields_) {
+            const unsigned slot = static_cast<unsigned>(field.slot);
+            if ((declared & slot) != 0) {
+                error = "field '" + field.name + "' fills the same record field as an earlier one";
+                return false;
+            }
+            declared |= slot;
+            hasKeyValue = hasKeyValue || field.type == SchemaFieldType::KeyValue;
+            decoders_.push_back(schemaDecoderFor(field.type, field.slot));
+        }
+        // Without a kv field, a missing slot would make every line malformed.
+        if (!hasKeyValue && (declared & kRequiredSlots) != kRequiredSlots) {
+            error = "the schema needs timestamp, ip, user_id, action, status and latency fields";
+            return false;
+        }
+        return true;
+    }
+
+    char delimiter_ = '|';
+    std::vector<SchemaField> fields_;
+    std::vector<SchemaFieldDecoder> decoders_; // One per field, in order.
+};
+
+// --- Choosing a Parser ---
+// What the scan loops call for every line: the built-in formats by default, or
+// a loaded schema. Cheap to copy; the schema must outlive it.
+class LineParser {
+public:
+    LineParser() = default;
+    explicit LineParser(const LogSchema* schema) : schema_(schema) {}
+
+    bool parse(std::string_view line, LogRecord& out) const {
+        return schema_ != nullptr ? schema_->decode(line, out) : parseLogLine(line, out);
+    }
+
+private:
+    const LogSchema* schema_ = nullptr;
+};
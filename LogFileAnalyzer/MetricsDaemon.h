@@ -0,0 +1,396 @@
+/**
+ * @file MetricsDaemon.h
+ * @brief Rolling aggregates and a tiny local HTTP server for --daemon mode.
+ *
+ * @details The daemon has two sides that never wait for each other:
+ *  - The ingest side (the main thread) follows the logs and updates a
+ *    RollingAggregates. About once a second it renders a complete
+ *    MetricsSnapshot and publishes it on the SnapshotBoard.
+ *  - The server thread answers requests. It takes the current snapshot from the
+ *    board and sends text that was already rendered, so a slow client costs the
+ *    ingest side nothing.
+ *
+ * Snapshots are immutable once published. Publishing swaps a shared_ptr
+ * atomically, so a reader keeps a consistent snapshot alive for as long as it
+ * needs it, even if newer ones are published meanwhile.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Aggregates.h"
+#include "ReportWriter.h"
+#include "SharedMetrics.h"
+#include "SocketCompat.h"
+#include "SocketIngest.h"
+
+// --- Totals Plus a Sliding Window ---
+// The window is measured in log time (the newest timestamp seen), split into a
+// ring of buckets. Old buckets are recycled as time moves on, so the window
+// costs a fixed amount of memory however long the daemon runs.
+class RollingAggregates {
+public:
+    RollingAggregates(long long windowSeconds, std::size_t bucketCount)
+        : bucketSeconds_(std::max<long long>(1, windowSeconds / static_cast<long long>(std::max<std::size_t>(1, bucketCount)))),
+          buckets_(std::max<std::size_t>(1, bucketCount)) {}
+
+    void addLine() { cumulative_.totalLines++; }
+    void addMalformed() { cumulative_.malformedLines++; }
+
+    void add(const LogRecord& record) {
+        cumulative_.add(record);
+        const long long id = record.timestamp / bucketSeconds_;
+        newestBucket_ = std::max(newestBucket_, id);
+        if (id <= newestBucket_ - static_cast<long long>(buckets_.size())) {
+            return; // Older than the whole window; it only counts towards the totals.
+        }
+        Bucket& bucket = buckets_[static_cast<std::size_t>(id % static_cast<long long>(buckets_.size()))];
+        if (bucket.id != id) {
+            bucket.id = id;
+            bucket.summary = LogSummary();
+        }
+        bucket.summary.totalLines++;
+        bucket.summary.add(record);
+    }
+
+    const LogSummary& cumulative() const { return cumulative_; }
+
+    // Merges the buckets that are still inside the window.
+    LogSummary window() const {
+        LogSummary merged;
+        for (const Bucket& bucket : buckets_) {
+            if (bucket.id > newestBucket_ - static_cast<long long>(buckets_.size())) {
+                merged.merge(bucket.summary);
+            }
+        }
+        return merged;
+    }
+
+    long long windowSeconds() const { return bucketSeconds_ * static_cast<long long>(buckets_.size()); }
+
+private:
+    struct Bucket {
+        long long id = -1;
+        LogSummary summary;
+    };
+
+    long long bucketSeconds_;
+    long long newestBucket_ = 0;
+    std::vector<Bucket> buckets_;
+    LogSummary cumulative_;
+};
+
+// --- Immutable Published State ---
+struct MetricsSnapshot {
+    std::string prometheus; // Prometheus text exposition format 0.0.4.
+    std::string json;
+};
+
+// Escapes a Prometheus label value: backslash, double quote and newline.
+inline void appendLabelValue(std::string& out, std::string_view value) {
+    for (char c : value) {
+        if (c == '\\' || c == '"') {
+            out.push_back('\\');
+            out.push_back(c);
+        }
+        else if (c == '\n') {
+            out += "\\n";
+        }
+        else {
+            out.push_back(c);
+        }
+    }
+}
+
+// Writes per action/status record counts as 'recordsMetric' (of Prometheus type
+// 'recordsType') and latency as a summary named 'latencyMetric'. 'scope' ends
+// both HELP texts, e.g. "since the daemon started".
+inline void appendPrometheusSummary(std::string& out, const LogSummary& summary, const std::string& recordsMetric,
+                                    std::string_view recordsType, const std::string& latencyMetric,
+                                    std::string_view scope) {
+    out += "# HELP " + recordsMetric + " Parsed records by action and status, " + std::string(scope) + ".\n";
+    out += "# TYPE " + recordsMetric + " " + std::string(recordsType) + "\n";
+    for (const auto& action : summary.actionStatusCounts) {
+        for (const auto& status : action.second) {
+            out += recordsMetric + "{action=\"";
+            appendLabelValue(out, action.first);
+            out += "\",status=\"";
+            appendLabelValue(out, status.first);
+            out += "\"} " + std::to_string(status.second) + "\n";
+        }
+    }
+    out += "# HELP " + latencyMetric + " Latency of the parsed records in milliseconds, " + std::string(scope) + ".\n";
+    out += "# TYPE " + latencyMetric + " summary\n";
+    out += latencyMetric + "_sum " + std::to_string(summary.latency.sumMs) + "\n";
+    out += latencyMetric + "_count " + std::to_string(summary.latency.count) + "\n";
+}
+
+inline void appendJsonSummary(std::string& out, const LogSummary& summary) {
+    out += "{\"records\":" + std::to_string(summary.latency.count);
+    out += ",\"latency_ms\":{\"sum\":" + std::to_string(summary.latency.sumMs);
+    if (summary.latency.count > 0) {
+        out += ",\"min\":" + std::to_string(summary.latency.minMs);
+        out += ",\"max\":" + std::to_string(summary.latency.maxMs);
+        out += ",\"mean\":" + std::to_string(summary.latency.meanMs());
+    }
+    out += "},\"actions\":{";
+    bool firstAction = true;
+    for (const auto& action : summary.actionStatusCounts) {
+        out += firstAction ? "" : ",";
+        firstAction = false;
+        appendJsonString(out, action.first);
+        out += ":{";
+        bool firstStatus = true;
+        for (const auto& status : action.second) {
+            out += firstStatus ? "" : ",";
+            firstStatus = false;
+            appendJsonString(out, status.first);
+            out += ":" + std::to_string(status.second);
+        }
+        out += "}";
+    }
+    out += "}}";
+}
+
+// Socket ingest counters, including every way a line can be lost on the way in.
+inline void appendPrometheusIngest(std::string& out, const IngestStats& ingest) {
+    const auto counter = [&](const char* name, const char* help, std::uint64_t value) {
+        out += std::string("# HELP log_analyzer_ingest_") + name + " " + help + "\n";
+        out += std::string("# TYPE log_analyzer_ingest_") + name + " counter\n";
+        out += std::string("log_analyzer_ingest_") + name + " " + std::to_string(value) + "\n";
+    };
+    counter("datagrams_total", "Datagrams received on UDP and Unix datagram sockets.", ingest.datagrams);
+    counter("bytes_total", "Bytes received on all ingest sockets.", ingest.bytes);
+    counter("lines_total", "Lines received on all ingest sockets.", ingest.lines);
+    counter("kernel_drops_total", "Datagrams dropped by the kernel because the receive queue was full.", ingest.kernelDrops);
+    counter("truncated_datagrams_total", "Datagrams larger than the receive buffer.", ingest.truncatedDatagrams);
+    counter("oversized_lines_total", "Stream lines discarded for exceeding the line length limit.", ingest.oversizedLines);
+    counter("stream_connections_total", "Connections accepted on Unix stream sockets.", ingest.streamConnections);
+}
+
+// Renders everything a reader could ask for, once, at publish time.
+inline std::shared_ptr<const MetricsSnapshot> renderSnapshot(const RollingAggregates& aggregates,
+                                                              const IngestStats& ingest) {
+    auto snapshot = std::make_shared<MetricsSnapshot>();
+    const LogSummary& total = aggregates.cumulative();
+    const LogSummary window = aggregates.window();
+
+    std::string& prom = snapshot->prometheus;
+    prom += "# HELP log_analyzer_lines_total Lines read from all followed logs and ingest sockets.\n";
+    prom += "# TYPE log_analyzer_lines_total counter\n";
+    prom += "log_analyzer_lines_total " + std::to_string(total.totalLines) + "\n";
+    prom += "# HELP log_analyzer_malformed_lines_total Lines that could not be parsed.\n";
+    prom += "# TYPE log_analyzer_malformed_lines_total counter\n";
+    prom += "log_analyzer_malformed_lines_total " + std::to_string(total.malformedLines) + "\n";
+    prom += "# HELP log_analyzer_window_seconds Length of the rolling window in log time.\n";
+    prom += "# TYPE log_analyzer_window_seconds gauge\n";
+    prom += "log_analyzer_window_seconds " + std::to_string(aggregates.windowSeconds()) + "\n";
+    appendPrometheusSummary(prom, total, "log_analyzer_records_total", "counter", "log_analyzer_latency_ms",
+                            "since the daemon started");
+    appendPrometheusSummary(prom, window, "log_analyzer_window_records", "gauge", "log_analyzer_window_latency_ms",
+                            "in the rolling window");
+    appendPrometheusIngest(prom, ingest);
+
+    std::string& json = snapshot->json;
+    json += "{\"lines\":" + std::to_string(total.totalLines);
+    json += ",\"malformed_lines\":" + std::to_string(total.malformedLines);
+    json += ",\"window_seconds\":" + std::to_string(aggregates.windowSeconds());
+    json += ",\"total\":";
+    appendJsonSummary(json, total);
+    json += ",\"window\":";
+    appendJsonSummary(json, window);
+    json += ",\"ingest\":{\"datagrams\":" + std::to_string(ingest.datagrams);
+    json += ",\"bytes\":" + std::to_string(ingest.bytes);
+    json += ",\"lines\":" + std::to_string(ingest.lines);
+    json += ",\"kernel_drops\":" + std::to_string(ingest.kernelDrops);
+    json += ",\"truncated_datagrams\":" + std::to_string(ingest.truncatedDatagrams);
+    json += ",\"oversized_lines\":" + std::to_string(ingest.oversizedLines);
+    json += ",\"stream_connections\":" + std::to_string(ingest.streamConnections) + "}";
+    json += "}\n";
+    return snapshot;
+}
+
+// Flattens the rollups into the fixed shared-memory layout (--shm).
+inline void fillSharedPayload(const RollingAggregates& aggregates, SharedMetricsPayload& payload) {
+    std::memset(&payload, 0, sizeof(payload));
+    const LogSummary& total = aggregates.cumulative();
+    const LogSummary window = aggregates.window();
+
+    payload.publishedAtUnixMs = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+    payload.lines = static_cast<std::uint64_t>(total.totalLines);
+    payload.malformedLines = static_cast<std::uint64_t>(total.malformedLines);
+    payload.records = static_cast<std::uint64_t>(total.latency.count);
+    payload.latencySumMs = static_cast<std::uint64_t>(total.latency.sumMs);
+    payload.latencyMinMs = total.latency.count > 0 ? total.latency.minMs : 0;
+    payload.latencyMaxMs = total.latency.count > 0 ? total.latency.maxMs : 0;
+    payload.windowSeconds = static_cast<std::uint64_t>(aggregates.windowSeconds());
+    payload.windowRecords = static_cast<std::uint64_t>(window.latency.count);
+    payload.windowLatencySumMs = static_cast<std::uint64_t>(window.latency.sumMs);
+
+    for (const auto& action : total.actionStatusCounts) {
+        for (const auto& status : action.second) {
+            if (payload.categoryCount == kSharedMaxCategories) {
+                payload.categoriesDropped++;
+                continue;
+            }
+            SharedCategory& category = payload.categories[payload.categoryCount++];
+            copySharedName(category.action, action.first);
+            copySharedName(category.status, status.first);
+            category.totalRecords = static_cast<std::uint64_t>(status.second);
+
+            auto windowAction = window.actionStatusCounts.find(action.first);
+            if (windowAction != window.actionStatusCounts.end()) {
+                auto windowStatus = windowAction->second.find(status.first);
+                if (windowStatus != windowAction->second.end()) {
+                    category.windowRecords = static_cast<std::uint64_t>(windowStatus->second);
+                }
+            }
+        }
+    }
+}
+
+// --- Lock-Free Hand-Off Between Ingest and Readers ---
+class SnapshotBoard {
+public:
+    SnapshotBoard() : current_(std::make_shared<const MetricsSnapshot>()) {}
+
+    void publish(std::shared_ptr<const MetricsSnapshot> snapshot) {
+        std::atomic_store(&current_, std::move(snapshot));
+    }
+
+    std::shared_ptr<const MetricsSnapshot> current() const {
+        return std::atomic_load(&current_);
+    }
+
+private:
+    std::shared_ptr<const MetricsSnapshot> current_;
+};
+
+// --- Request Handling ---
+// Both listeners speak minimal HTTP/1.0, so `curl http://127.0.0.1:<port>/metrics`
+// and `curl --unix-socket <path> http://localhost/metrics.json` both work.
+inline std::string httpResponseFor(std::string_view request, const MetricsSnapshot& snapshot) {
+    const auto respond = [](std::string_view status, std::string_view type, std::string_view body) {
+        std::string response = "HTTP/1.0 ";
+        response += status;
+        response += "\r\nContent-Type: ";
+        response += type;
+        response += "\r\nContent-Length: " + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n";
+        response += body;
+        return response;
+    };
+
+    const std::size_t lineEnd = request.find_first_of("\r\n");
+    const std::string_view firstLine = request.substr(0, lineEnd);
+    const std::size_t pathStart = firstLine.find(' ');
+    const std::size_t pathEnd = firstLine.find(' ', pathStart + 1);
+    if (firstLine.substr(0, pathStart) != "GET" || pathStart == std::string_view::npos) {
+        return respond("405 Method Not Allowed", "text/plain", "only GET is supported\n");
+    }
+    const std::string_view path = firstLine.substr(pathStart + 1, pathEnd - pathStart - 1);
+
+    if (path == "/metrics") {
+        return respond("200 OK", "text/plain; version=0.0.4", snapshot.prometheus);
+    }
+    if (path == "/metrics.json" || path == "/json") {
+        return respond("200 OK", "application/json", snapshot.json);
+    }
+    return respond("404 Not Found", "text/plain", "try /metrics or /metrics.json\n");
+}
+
+// How long one client may take to send its request and read the response.
+constexpr std::chrono::milliseconds kMetricsClientTimeout{ 2000 };
+
+// Serves every listener until 'stop' becomes true. All connections are
+// non-blocking and share one select() loop, so an idle or slow client never
+// holds up a scrape. Requests are answered from a pre-rendered snapshot, so
+// this needs no worker pool.
+
+inline void serveMetrics(const std::vector<SocketHandle>& listeners, const SnapshotBoard& board,
+                         const std::atomic<bool>& stop) {
+    using Clock = std::chrono::steady_clock;
+    struct Client {
+        SocketHandle socket;
+        Clock::time_point deadline;
+        std::string request;
+        std::string response; // Empty until the whole request is in.
+        std::size_t sent = 0;
+    };
+    std::vector<Client> clients;
+    char buffer[4096];
+
+    while (!stop.load()) {
+        fd_set readable;
+        fd_set writable;
+        FD_ZERO(&readable);
+        FD_ZERO(&writable);
+        SocketHandle highest = 0;
+        for (SocketHandle listener : listeners) {
+            FD_SET(listener, &readable);
+            highest = std::max(highest, listener);
+        }
+        for (const Client& client : clients) {
+            FD_SET(client.socket, client.response.empty() ? &readable : &writable);
+            highest = std::max(highest, client.socket);
+        }
+        timeval timeout{ 0, 250 * 1000 };
+        const int ready = ::select(static_cast<int>(highest) + 1, &readable, &writable, nullptr, &timeout);
+
+        if (ready > 0) {
+            for (SocketHandle listener : listeners) {
+                if (!FD_ISSET(listener, &readable)) {
+                    continue;
+                }
+                const SocketHandle accepted = ::accept(listener, nullptr, nullptr);
+                if (accepted == kInvalidSocket) {
+                    continue;
+                }
+                if (clients.size() >= FD_SETSIZE / 2 || !fitsInFdSet(accepted) || !setNonBlocking(accepted)) {
+                    closeSocket(accepted); // select() cannot watch it (see fitsInFdSet()).
+                    continue;
+                }
+                clients.push_back({ accepted, Clock::now() + kMetricsClientTimeout, std::string(), std::string() });
+            }
+        }
+
+        const Clock::time_point now = Clock::now();
+        for (std::size_t c = 0; c < clients.size();) {
+            Client& client = clients[c];
+            bool done = now >= client.deadline;
+            if (!done && client.response.empty() && ready > 0 && FD_ISSET(client.socket, &readable)) {
+                const int got = receiveSome(client.socket, buffer, sizeof(buffer));
+                if (got > 0) {
+                    client.request.append(buffer, static_cast<std::size_t>(got));
+                }
+                if (got == 0 || (got < 0 && !lastCallWouldBlock()) || client.request.size() >= 16384 ||
+                    client.request.find("\r\n\r\n") != std::string::npos || client.request.find("\n\n") != std::string::npos) {
+                    const std::shared_ptr<const MetricsSnapshot> snapshot = board.current();
+                    client.response = httpResponseFor(client.request, *snapshot);
+                }
+            }
+            else if (!done && !client.response.empty() && ready > 0 && FD_ISSET(client.socket, &writable)) {
+                const int sent = sendSome(client.socket, std::string_view(client.response).substr(client.sent));
+                if (sent > 0) {
+                    client.sent += static_cast<std::size_t>(sent);
+                }
+                done = client.sent == client.response.size() || (sent < 0 && !lastCallWouldBlock());
+            }
+            if (done) {
+                closeSocket(client.socket);
+                clients.erase(clients.begin() + static_cast<std::ptrdiff_t>(c));
+                continue;
+            }
+            ++c;
+        }
+    }
+    for (const Client& client : clients) {
+        closeSocket(client.socket);
+    }
+}
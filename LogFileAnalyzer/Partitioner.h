@@ -0,0 +1,294 @@
+/**
+ * @file Partitioner.h
+ * @brief Splitting a log into one output file per user or per action.
+ *
+ * @details Partitioning is a single parallel pass. Every worker thread owns a
+ * PartitionWriter that appends rows to an in-memory buffer per partition and
+ * only touches the disk when a buffer fills up. The actual files are owned by one
+ * shared PartitionFileSet, which keeps at most a fixed number of them open at a
+ * time (least-recently-used ones are closed first) so that splitting by a
+ * high-cardinality key cannot exhaust the process's file handles.
+ *
+ * Rows inside one partition file keep their original relative order within a
+ * worker's byte range, but blocks written by different workers may interleave.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "Hash.h"
+#include "LogSchema.h"
+
+// --- Which Field Decides the Output File ---
+enum class PartitionKey {
+    User,
+    Action,
+};
+
+// Maps the command-line spelling ("user" / "action") to a PartitionKey.
+inline bool parsePartitionKey(std::string_view text, PartitionKey& out) {
+    if (text == "user") {
+        out = PartitionKey::User;
+        return true;
+    }
+    if (text == "action") {
+        out = PartitionKey::Action;
+        return true;
+    }
+    return false;
+}
+
+// Lines that do not parse are still preserved, in a file of their own. No
+// key's file name starts with '_' (see PartitionFileSet::safeFileName()).
+constexpr std::string_view kUnparsedFileName = "_unparsed.log";
+constexpr std::string_view kEmptyKeyFileName = "_empty.log";
+
+// Sets 'out' to the partition key of a raw line. Returns false if the line
+// does not parse, and belongs in kUnparsedFileName instead. 'out' may point
+// into 'record' (a JSON key with escapes is unescaped into its storage), so
+// the caller keeps 'record' alive for as long as it uses 'out'.
+inline bool partitionKeyOf(std::string_view line, PartitionKey key, const LineParser& parser, LogRecord& record,
+                           std::string_view& out) {
+    if (!parser.parse(line, record)) {
+        return false;
+    }
+    out = (key == PartitionKey::User) ? record.userId : record.action;
+    return true;
+}
+
+// --- Shared Set of Partition Files ---
+class PartitionFileSet {
+public:
+    PartitionFileSet(std::filesystem::path outputDir, std::size_t maxOpenFiles)
+        : outputDir_(std::move(outputDir)), maxOpenFiles_(maxOpenFiles == 0 ? 1 : maxOpenFiles) {}
+
+    // Appends 'bytes' to the file 'fileName' in the output directory.
+    // Thread-safe. The first append to a file during this run truncates any
+    // older file.
+    bool append(const std::string& fileName, std::string_view bytes) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::ofstream* stream = acquire(fileName);
+        if (stream == nullptr) {
+            return false;
+        }
+        stream->write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+        return static_cast<bool>(*stream);
+    }
+
+    std::size_t partitionCount() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return created_.size();
+    }
+
+    // Returns the file name of 'key' for this run. Thread-safe. Usually it is
+    // safeFileName(key), but if that name, ignoring case, already belongs to
+    // another key, '~' and a number are added: after "LOGIN.log", the key
+    // "login" is written to "login~2.log", so the two never share a file
+    // where file names ignore case.
+    std::string fileNameFor(std::string_view key) {
+        if (key.empty()) {
+            return std::string(kEmptyKeyFileName); // No other name starts with '_'.
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto found = names_.find(std::string(key));
+        if (found != names_.end()) {
+            return found->second;
+        }
+        const std::string base = safeFileName(key);
+        std::string name = base + ".log";
+        for (unsigned n = 2; !taken_.insert(foldCase(name)).second; ++n) {
+            name = base + '~' + std::to_string(n) + ".log";
+        }
+        names_.emplace(std::string(key), name);
+        return name;
+    }
+
+    // Turns a non-empty partition key into a file name, without ".log", that cannot
+    // leave the directory. Bytes other than letters, digits, '-', '_' and '.'
+    // become "%XX", as do a leading '_' or '.'. A name that would be too long
+    // is cut short and ends in '~' and a hash of the key instead.
+    static std::string safeFileName(std::string_view key) {
+        static const char kHex[] = "0123456789ABCDEF";
+        static const char kLowerHex[] = "0123456789abcdef";
+        std::string name;
+        for (std::size_t i = 0; i < key.size(); ++i) {
+            const unsigned char c = static_cast<unsigned char>(key[i]);
+            const bool safe = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+                              c == '-' || ((c == '_' || c == '.') && i > 0);
+            if (safe) {
+                name.push_back(static_cast<char>(c));
+            }
+            else {
+                name.push_back('%');
+                name.push_back(kHex[c >> 4]);
+                name.push_back(kHex[c & 15]);
+            }
+        }
+        if (name.size() > kMaxNameBytes) {
+            name.resize(kMaxNameBytes);
+            const std::uint64_t hash = hashLine(key);
+            name.push_back('~');
+            for (int shift = 60; shift >= 0; shift -= 4) {
+                name.push_back(kLowerHex[(hash >> shift) & 15]);
+            }
+        }
+        return name;
+    }
+
+private:
+    // Leaves room for a hash, a collision number and ".log" within the usual
+    // 255-byte limit.
+    static constexpr std::size_t kMaxNameBytes = 200;
+
+    struct OpenFile {
+        std::ofstream stream;
+        std::list<std::string>::iterator lruPosition;
+    };
+
+    // Files are tracked by their lower-case names, so that the count and the
+    // truncation stay right where the file system ignores case.
+    static std::string foldCase(std::string name) {
+        for (char& c : name) {
+            if (c >= 'A' && c <= 'Z') {
+                c = static_cast<char>(c - 'A' + 'a');
+            }
+        }
+        return name;
+    }
+
+    // Returns an open stream for 'fileName', evicting the least recently used
+    // file if the open-handle budget is exhausted. Caller must hold 'mutex_'.
+    std::ofstream* acquire(const std::string& fileName) {
+        const std::string key = foldCase(fileName);
+        auto found = open_.find(key);
+        if (found != open_.end()) {
+            lru_.splice(lru_.begin(), lru_, found->second.lruPosition);
+            return &found->second.stream;
+        }
+
+        if (open_.size() >= maxOpenFiles_) {
+            open_.erase(lru_.back()); // The ofstream destructor flushes and closes it.
+            lru_.pop_back();
+        }
+
+        const bool firstTime = created_.insert(key).second;
+        const auto mode = std::ios::binary | (firstTime ? std::ios::trunc : std::ios::app);
+
+        OpenFile& file = open_[key];
+        file.stream.open(outputDir_ / fileName, mode);
+        if (!file.stream.is_open()) {
+            open_.erase(key);
+            return nullptr;
+        }
+        lru_.push_front(key);
+        file.lruPosition = lru_.begin();
+        return &file.stream;
+    }
+
+    std::filesystem::path outputDir_;
+    std::size_t maxOpenFiles_;
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, OpenFile> open_; // By folded file name, as are the two below.
+    std::list<std::string> lru_;               // Front = most recently used.
+    std::unordered_set<std::string> created_;  // Every file written so far.
+    std::unordered_map<std::string, std::string> names_; // Key -> its file name.
+    std::unordered_set<std::string> taken_;    // Folded file names handed out.
+};
+
+// --- Per-Thread Buffered Writer ---
+class PartitionWriter {
+public:
+    // 'bufferBytes' is the size a single partition's buffer may reach before it
+    // is written out. 'budgetBytes' caps the sum of all of this writer's buffers,
+    // which matters when there are many small partitions.
+    PartitionWriter(PartitionFileSet& files, std::size_t bufferBytes, std::size_t budgetBytes)
+        : files_(files), bufferBytes_(bufferBytes), budgetBytes_(budgetBytes) {}
+
+    ~PartitionWriter() { flushAll(); }
+
+    PartitionWriter(const PartitionWriter&) = delete;
+    PartitionWriter& operator=(const PartitionWriter&) = delete;
+
+    // Queues 'line' (plus a newline) for partition 'key'.
+    void write(std::string_view key, std::string_view line) {
+        // Reusing one scratch string keeps the lookup allocation-free.
+        scratchKey_.assign(key.data(), key.size());
+        auto found = buffers_.find(scratchKey_);
+        if (found == buffers_.end()) {
+            found = buffers_.emplace(scratchKey_, Buffer{ files_.fileNameFor(key), std::string() }).first;
+        }
+
+        Buffer& buffer = found->second;
+        buffer.rows.append(line.data(), line.size());
+        buffer.rows.push_back('\n');
+        buffered_ += line.size() + 1;
+
+        if (buffer.rows.size() >= bufferBytes_) {
+            flush(buffer.fileName, buffer.rows);
+        }
+        checkBudget();
+    }
+
+    // Queues 'line' (plus a newline) for the file of lines that do not parse.
+    void writeUnparsed(std::string_view line) {
+        unparsed_.append(line.data(), line.size());
+        unparsed_.push_back('\n');
+        buffered_ += line.size() + 1;
+        if (unparsed_.size() >= bufferBytes_) {
+            flush(std::string(kUnparsedFileName), unparsed_);
+        }
+        checkBudget();
+    }
+
+    void flushAll() {
+        for (auto& entry : buffers_) {
+            flush(entry.second.fileName, entry.second.rows);
+        }
+        flush(std::string(kUnparsedFileName), unparsed_);
+    }
+
+    bool ok() const { return ok_; }
+
+private:
+    struct Buffer {
+        std::string fileName; // Asked of the file set once per key.
+        std::string rows;
+    };
+
+    void checkBudget() {
+        if (buffered_ >= budgetBytes_) {
+            // Too many partitions are holding memory at once: write everything
+            // out and drop the buffers themselves, not just their contents.
+            flushAll();
+            buffers_.clear();
+        }
+    }
+
+    void flush(const std::string& fileName, std::string& buffer) {
+        if (buffer.empty()) {
+            return;
+        }
+        ok_ = files_.append(fileName, buffer) && ok_;
+        buffered_ -= buffer.size();
+        buffer.clear(); // Keeps the capacity for the next batch of rows.
+    }
+
+    PartitionFileSet& files_;
+    std::size_t bufferBytes_;
+    std::size_t budgetBytes_;
+    std::size_t buffered_ = 0;
+    bool ok_ = true;
+    std::string scratchKey_;
+    std::unordered_map<std::string, Buffer> buffers_;
+    std::string unparsed_;
+};
@@ -0,0 +1,208 @@
+/**
+ * @file PredicateKernels.h
+ * @brief Batch kernels that evaluate query predicates into selection bitmaps.
+ *
+ * @details A batch of up to kBatchRows rows has a SelectionBitmap with one bit
+ * per row: bit i of word w stands for row 64 * w + i of the batch. It starts
+ * with every row set. Each predicate then clears the rows it rejects. Words
+ * that are already empty are skipped, so once the first predicates have thrown
+ * most rows out, the later ones read almost nothing.
+ *
+ * Predicates are compared against the encoded columns, never strings:
+ *  - Every comparison on a 32-bit column is a range test, low <= v <= high, or
+ *    its negation. Dictionary codes and packed IPv4 addresses are unsigned, so
+ *    they are compared with their top bit flipped. That way one SSE2 kernel,
+ *    four rows per compare, serves codes, addresses and latencies.
+ *  - Timestamps are 64-bit. SSE2 cannot compare those directly, so two
+ *    timestamps at a time are compared through their 32-bit halves.
+ *  - "in (...)" on a dictionary column looks each code up in a table with one
+ *    byte per code.
+ *
+ * Finally, toSelection() turns the bitmap into the selection vector the
+ * aggregate kernels take, four rows per step. The query engine switches to
+ * that vector early once few rows are left, and skips it altogether when a
+ * query only counts rows.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <vector>
+
+#include "AggregateKernels.h"
+#include "BitOps.h"
+
+constexpr std::size_t kBitmapWords = kBatchRows / 64;
+
+// --- The Bitmap ---
+struct SelectionBitmap {
+    std::uint64_t words[kBitmapWords];
+    std::size_t rows = 0;
+
+    // Selects rows [0, count).
+    void fill(std::size_t count) {
+        rows = count;
+        for (std::size_t w = 0; w < kBitmapWords; ++w) {
+            const std::size_t first = 64 * w;
+            words[w] = count >= first + 64 ? ~std::uint64_t(0) : count > first ? (std::uint64_t(1) << (count - first)) - 1 : 0;
+        }
+    }
+
+    bool any() const {
+        std::uint64_t bits = 0;
+        for (std::size_t w = 0; w < wordCount(); ++w) {
+            bits |= words[w];
+        }
+        return bits != 0;
+    }
+
+    std::size_t count() const {
+        std::size_t total = 0;
+        for (std::size_t w = 0; w < wordCount(); ++w) {
+            total += static_cast<std::size_t>(popCount(words[w]));
+        }
+        return total;
+    }
+
+    std::size_t wordCount() const { return (rows + 63) / 64; }
+};
+
+// --- Refining ---
+// Keeps the rows whose value v (column[i] ^ flip, compared as signed) lies in
+// [low, high], or outside it if 'negate' is set. 'column' points at the
+// batch's first row.
+inline void refineRange32(const std::uint32_t* column, std::uint32_t flip, std::int32_t low, std::int32_t high, bool negate,
+                          SelectionBitmap& bitmap) {
+    const std::uint64_t invert = negate ? ~std::uint64_t(0) : 0;
+    const std::size_t fullWords = bitmap.rows / 64;
+    for (std::size_t w = 0; w < bitmap.wordCount(); ++w) {
+        if (bitmap.words[w] == 0) {
+            continue;
+        }
+        const std::uint32_t* values = column + 64 * w;
+        std::uint64_t bits = 0;
+#ifdef LFA_SSE2
+        if (w < fullWords) {
+            const __m128i flipBits = _mm_set1_epi32(static_cast<int>(flip));
+            const __m128i lowBound = _mm_set1_epi32(low);
+            const __m128i highBound = _mm_set1_epi32(high);
+            for (int k = 0; k < 16; ++k) {
+                const __m128i v = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(values + 4 * k)), flipBits);
+                const __m128i outside = _mm_or_si128(_mm_cmplt_epi32(v, lowBound), _mm_cmpgt_epi32(v, highBound));
+                const unsigned outsideBits = static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(outside)));
+                bits |= static_cast<std::uint64_t>(~outsideBits & 0xFu) << (4 * k);
+            }
+            bitmap.words[w] &= bits ^ invert;
+            continue;
+        }
+#endif
+        const std::size_t count = w < fullWords ? 64 : bitmap.rows % 64;
+        for (std::size_t i = 0; i < count; ++i) {
+            const std::int32_t v = static_cast<std::int32_t>(values[i] ^ flip);
+            bits |= static_cast<std::uint64_t>(v >= low && v <= high) << i;
+        }
+        bitmap.words[w] &= bits ^ invert;
+    }
+}
+
+// The same for a 64-bit column. low <= v <= high is tested as one unsigned
+// compare, v - low <= high - low. SSE2 has no 64-bit compare, so with SSE2 it
+// is built from 32-bit ones: the high halves decide unless they are equal.
+inline void refineRange64(const std::int64_t* column, std::int64_t low, std::int64_t high, bool negate, SelectionBitmap& bitmap) {
+    const std::uint64_t invert = negate ? ~std::uint64_t(0) : 0;
+    const std::uint64_t offset = static_cast<std::uint64_t>(low);
+    const std::uint64_t width = static_cast<std::uint64_t>(high) - offset;
+    const std::size_t fullWords = bitmap.rows / 64;
+    for (std::size_t w = 0; w < bitmap.wordCount(); ++w) {
+        if (bitmap.words[w] == 0) {
+            continue;
+        }
+        const std::int64_t* values = column + 64 * w;
+        std::uint64_t bits = 0;
+#ifdef LFA_SSE2
+        if (w < fullWords) {
+            const __m128i signs = _mm_set1_epi32(INT32_MIN); // Makes the signed 32-bit compares unsigned.
+            const __m128i offsets = _mm_set1_epi64x(static_cast<long long>(offset));
+            const __m128i widths = _mm_xor_si128(_mm_set1_epi64x(static_cast<long long>(width)), signs);
+            for (int k = 0; k < 32; ++k) {
+                const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + 2 * k));
+                const __m128i distance = _mm_xor_si128(_mm_sub_epi64(v, offsets), signs);
+                const __m128i greater = _mm_cmpgt_epi32(distance, widths);
+                const __m128i equal = _mm_cmpeq_epi32(distance, widths);
+                // The high half of each lane: high greater, or high equal and low greater.
+                const __m128i outside = _mm_or_si128(greater, _mm_and_si128(equal, _mm_shuffle_epi32(greater, _MM_SHUFFLE(2, 2, 0, 0))));
+                const unsigned outsideBits = static_cast<unsigned>(_mm_movemask_pd(_mm_castsi128_pd(outside)));
+                bits |= static_cast<std::uint64_t>(~outsideBits & 0x3u) << (2 * k);
+            }
+            bitmap.words[w] &= bits ^ invert;
+            continue;
+        }
+#endif
+        const std::size_t count = w < fullWords ? 64 : bitmap.rows % 64;
+        for (std::size_t i = 0; i < count; ++i) {
+            bits |= static_cast<std::uint64_t>(static_cast<std::uint64_t>(values[i]) - offset <= width) << i;
+        }
+        bitmap.words[w] &= bits ^ invert;
+    }
+}
+
+// Keeps the rows whose code has members[code] set.
+inline void refineMembers(const std::uint32_t* codes, const std::vector<std::uint8_t>& members, SelectionBitmap& bitmap) {
+    for (std::size_t w = 0; w < bitmap.wordCount(); ++w) {
+        if (bitmap.words[w] == 0) {
+            continue;
+        }
+        const std::uint32_t* values = codes + 64 * w;
+        const std::size_t count = std::min<std::size_t>(64, bitmap.rows - 64 * w);
+        std::uint64_t bits = 0;
+        for (std::size_t i = 0; i < count; ++i) {
+            bits |= static_cast<std::uint64_t>(members[values[i]]) << i;
+        }
+        bitmap.words[w] &= bits;
+    }
+}
+
+// --- To a Selection Vector ---
+namespace bitmap_detail {
+// For each 4-bit value, the positions of its set bits, padded with zeros.
+alignas(16) constexpr std::uint32_t kNibblePositions[16][4] = {
+    { 0, 0, 0, 0 }, { 0, 0, 0, 0 }, { 1, 0, 0, 0 }, { 0, 1, 0, 0 },
+    { 2, 0, 0, 0 }, { 0, 2, 0, 0 }, { 1, 2, 0, 0 }, { 0, 1, 2, 0 },
+    { 3, 0, 0, 0 }, { 0, 3, 0, 0 }, { 1, 3, 0, 0 }, { 0, 1, 3, 0 },
+    { 2, 3, 0, 0 }, { 0, 2, 3, 0 }, { 1, 2, 3, 0 }, { 0, 1, 2, 3 },
+};
+constexpr std::uint8_t kNibbleCounts[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+} // namespace bitmap_detail
+
+// Writes the selected rows, offset by 'firstRow', to 'rows'. Every 4 bits of
+// the bitmap store four row numbers at once, taken from a table of the set
+// bits' positions, and the cursor advances by the number of set bits; the
+// extra numbers are overwritten by the next store.
+inline void toSelection(const SelectionBitmap& bitmap, std::uint32_t firstRow, std::vector<std::uint32_t>& rows) {
+    using namespace bitmap_detail;
+    rows.resize(bitmap.rows + 4);
+    std::uint32_t* out = rows.data();
+    std::size_t kept = 0;
+    for (std::size_t w = 0; w < bitmap.wordCount(); ++w) {
+        const std::uint64_t bits = bitmap.words[w];
+        if (bits == 0) {
+            continue;
+        }
+        for (unsigned k = 0; k < 16; ++k) {
+            const unsigned nibble = static_cast<unsigned>(bits >> (4 * k)) & 0xFu;
+            const std::uint32_t base = firstRow + static_cast<std::uint32_t>(64 * w + 4 * k);
+#ifdef LFA_SSE2
+            const __m128i positions = _mm_load_si128(reinterpret_cast<const __m128i*>(kNibblePositions[nibble]));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + kept), _mm_add_epi32(positions, _mm_set1_epi32(static_cast<int>(base))));
+#else
+            for (unsigned i = 0; i < 4; ++i) {
+                out[kept + i] = base + kNibblePositions[nibble][i];
+            }
+#endif
+            kept += kNibbleCounts[nibble];
+        }
+    }
+    rows.resize(kept);
+}
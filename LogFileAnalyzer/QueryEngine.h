@@ -0,0 +1,1386 @@
+/**
+ * @file QueryEngine.h
+ * @brief A small query language over a ColumnarTable, for --interactive mode.
+ *
+ * @details Queries have one of four shapes:
+ *
+ *     count   [by <column>]  [where <predicate> [and <predicate>]...]
+ *     top <k> <column>       [where ...]
+ *     latency [by <column>]  [where ...]
+ *     histogram [<bucket_ms>] [where ...]
+ *
+ * A predicate is written without spaces, e.g. user=trader_delta,
+ * action!=LOGIN, latency>=200 or time<1672600000. User, action, status and ip
+ * support = and !=; latency and time support = != < <= > >=. Group-by columns
+ * are user, action, status and ip.
+ *
+ * Execution is column at a time, in batches of kBatchRows rows. Within a batch,
+ * each predicate is resolved (a string becomes a dictionary code, an address
+ * becomes a uint32_t) and then applied to one column in a tight loop that
+ * writes the surviving row numbers into a selection vector without branching.
+ * The next predicate only looks at the rows that survived. The batch's
+ * selection is then handed to the aggregate kernels of AggregateKernels.h,
+ * which only read the columns the query needs.
+ *
+ * A query can also run over several parts, such as the segments of a store
+ * (SegmentStore.h), each with its own dictionaries. Every part is filtered and
+ * grouped on its own, and the groups are then merged by label. A part that is
+ * sorted by time starts from just the rows inside the query's time range,
+ * found by binary search.
+ *
+ * Before a part is scanned, a simple planner puts its predicates in order. Each
+ * predicate's selectivity is estimated from the part's statistics: dictionary
+ * sizes, the time range (a zone map) and, for segments, the number of distinct
+ * addresses. The predicate that throws out the most rows per unit of cost runs
+ * first, so the later ones see fewer rows. --explain prints the plan, and
+ * --analyze also runs the query and shows each step's actual rows and time
+ * (QueryPlan.h).
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "AggregateKernels.h"
+#include "ColumnarTable.h"
+#include "PredicateKernels.h"
+#include "QueryPlan.h"
+#include "ReportWriter.h"
+
+// --- Query Representation ---
+enum class Column { User, Action, Status, Ip, Latency, Time, Details };
+enum class CompareOp { Eq, Ne, Lt, Le, Gt, Ge, In, Contains };
+enum class QueryKind { Count, Top, Latency, Histogram, Rows };
+
+struct Predicate {
+    Column column = Column::User;
+    CompareOp op = CompareOp::Eq;
+    std::string value;
+    std::vector<std::string> values; // For 'in'.
+};
+
+struct Query {
+    QueryKind kind = QueryKind::Count;
+    bool grouped = false;
+    Column groupBy = Column::User;
+    std::size_t topK = 10;
+    int bucketMs = 50;       // Histogram bucket width.
+    std::size_t limit = 20;  // Rows to print.
+    std::vector<Predicate> where;
+};
+
+inline bool parseColumn(std::string_view name, Column& out) {
+    if (name == "user") { out = Column::User; return true; }
+    if (name == "action") { out = Column::Action; return true; }
+    if (name == "status") { out = Column::Status; return true; }
+    if (name == "ip") { out = Column::Ip; return true; }
+    if (name == "latency") { out = Column::Latency; return true; }
+    if (name == "time") { out = Column::Time; return true; }
+    if (name == "details") { out = Column::Details; return true; }
+    return false;
+}
+
+inline const char* columnName(Column column) {
+    switch (column) {
+    case Column::User: return "user";
+    case Column::Action: return "action";
+    case Column::Status: return "status";
+    case Column::Ip: return "ip";
+    case Column::Latency: return "latency";
+    case Column::Time: return "time";
+    case Column::Details: return "details";
+    }
+    return "?";
+}
+
+inline bool isNumericColumn(Column column) {
+    return column == Column::Latency || column == Column::Time;
+}
+
+// Splits "latency>=200" into column, operator and value.
+inline bool parsePredicate(std::string_view text, Predicate& out, std::string& error) {
+    const std::size_t opStart = text.find_first_of("=!<>~");
+    if (opStart == std::string_view::npos || opStart == 0) {
+        error = "expected <column><op><value>, got '" + std::string(text) + "'";
+        return false;
+    }
+    std::size_t opLength = (opStart + 1 < text.size() && text[opStart + 1] == '=') ? 2 : 1;
+    const std::string_view op = text.substr(opStart, opLength);
+    if (op == "=") { out.op = CompareOp::Eq; }
+    else if (op == "!=") { out.op = CompareOp::Ne; }
+    else if (op == "<") { out.op = CompareOp::Lt; }
+    else if (op == "<=") { out.op = CompareOp::Le; }
+    else if (op == ">") { out.op = CompareOp::Gt; }
+    else if (op == ">=") { out.op = CompareOp::Ge; }
+    else if (op == "~") { out.op = CompareOp::Contains; }
+    else {
+        error = "unknown operator '" + std::string(op) + "'";
+        return false;
+    }
+    if (!parseColumn(text.substr(0, opStart), out.column)) {
+        error = "unknown column '" + std::string(text.substr(0, opStart)) + "'";
+        return false;
+    }
+    if ((out.column == Column::Details) != (out.op == CompareOp::Contains)) {
+        error = "~ (contains) applies to details, and only ~ does";
+        return false;
+    }
+    if (!isNumericColumn(out.column) && out.column != Column::Details && out.op != CompareOp::Eq && out.op != CompareOp::Ne) {
+        error = "only = and != apply to " + std::string(text.substr(0, opStart));
+        return false;
+    }
+    out.value = std::string(text.substr(opStart + opLength));
+    return true;
+}
+
+// Parses "<column> in (<value>,<value>...)" starting at tokens[i]; the list may
+// be split across tokens. Leaves 'i' at its last token.
+inline bool parseInList(const std::vector<std::string>& tokens, std::size_t& i, Predicate& out, std::string& error) {
+    if (!parseColumn(tokens[i], out.column) || isNumericColumn(out.column) || out.column == Column::Ip || out.column == Column::Details) {
+        error = "'in' applies to user, action and status";
+        return false;
+    }
+    out.op = CompareOp::In;
+    std::string list;
+    for (i += 2; i < tokens.size(); ++i) {
+        list += tokens[i];
+        if (list.back() == ')') {
+            break;
+        }
+    }
+    if (list.size() < 2 || list.front() != '(' || list.back() != ')') {
+        error = "expected 'in (<value>,<value>...)'";
+        return false;
+    }
+    std::istringstream values(list.substr(1, list.size() - 2));
+    for (std::string value; std::getline(values, value, ',');) {
+        if (!value.empty()) {
+            out.values.push_back(value);
+        }
+    }
+    if (out.values.empty()) {
+        error = "empty 'in' list";
+        return false;
+    }
+    return true;
+}
+
+// Parses a whole query line. On failure, 'error' says why.
+inline bool parseQuery(std::string_view text, Query& query, std::string& error) {
+    std::vector<std::string> tokens;
+    std::istringstream stream{ std::string(text) };
+    for (std::string token; stream >> token;) {
+        tokens.push_back(token);
+    }
+    if (tokens.empty()) {
+        error = "empty query";
+        return false;
+    }
+
+    std::size_t i = 1;
+    if (tokens[0] == "count") {
+        query.kind = QueryKind::Count;
+    }
+    else if (tokens[0] == "latency") {
+        query.kind = QueryKind::Latency;
+    }
+    else if (tokens[0] == "top") {
+        query.kind = QueryKind::Top;
+        query.grouped = true;
+        std::size_t k = 0;
+        if (tokens.size() < 3 || std::from_chars(tokens[1].data(), tokens[1].data() + tokens[1].size(), k).ec != std::errc() ||
+            k == 0 || !parseColumn(tokens[2], query.groupBy)) {
+            error = "usage: top <k> <column> [where ...]";
+            return false;
+        }
+        query.topK = k;
+        i = 3;
+    }
+    else if (tokens[0] == "rows") {
+        query.kind = QueryKind::Rows;
+        if (tokens.size() > 1 && tokens[1] != "where") {
+            std::size_t limit = 0;
+            if (std::from_chars(tokens[1].data(), tokens[1].data() + tokens[1].size(), limit).ec != std::errc() || limit == 0) {
+                error = "usage: rows [<limit>] [where ...]";
+                return false;
+            }
+            query.limit = limit;
+            i = 2;
+        }
+    }
+    else if (tokens[0] == "histogram") {
+        query.kind = QueryKind::Histogram;
+        if (tokens.size() > 1 && tokens[1] != "where") {
+            int width = 0;
+            if (std::from_chars(tokens[1].data(), tokens[1].data() + tokens[1].size(), width).ec != std::errc() || width <= 0) {
+                error = "usage: histogram [<bucket_ms>] [where ...]";
+                return false;
+            }
+            query.bucketMs = width;
+            i = 2;
+        }
+    }
+    else {
+        error = "unknown query '" + tokens[0] + "' (try 'help')";
+        return false;
+    }
+
+    if ((query.kind == QueryKind::Count || query.kind == QueryKind::Latency) && i + 1 < tokens.size() && tokens[i] == "by") {
+        if (!parseColumn(tokens[i + 1], query.groupBy)) {
+            error = "unknown column '" + tokens[i + 1] + "'";
+            return false;
+        }
+        query.grouped = true;
+        i += 2;
+    }
+    if (query.grouped && isNumericColumn(query.groupBy)) {
+        error = "cannot group by a numeric column";
+        return false;
+    }
+    if (query.grouped && query.groupBy == Column::Details) {
+        error = "cannot group by details";
+        return false;
+    }
+
+    if (i < tokens.size()) {
+        if (tokens[i] != "where" || i + 1 >= tokens.size()) {
+            error = "expected 'where <predicate>' after the query";
+            return false;
+        }
+        for (++i; i < tokens.size(); ++i) {
+            if (tokens[i] == "and") {
+                continue;
+            }
+            Predicate predicate;
+            const bool inList = i + 1 < tokens.size() && tokens[i + 1] == "in";
+            if (inList ? !parseInList(tokens, i, predicate, error) : !parsePredicate(tokens[i], predicate, error)) {
+                return false;
+            }
+            query.where.push_back(predicate);
+        }
+    }
+    return true;
+}
+
+// --- Predicates ---
+// A predicate resolved against one part's encoding: a string becomes a
+// dictionary code, an address a uint32_t, and every comparison a range.
+struct BoundPredicate {
+    enum class Kind { Nothing, Everything, Range32, Range64, Members, Contains };
+    Kind kind = Kind::Everything;
+    const std::uint32_t* column32 = nullptr;
+    const std::int64_t* column64 = nullptr;
+    std::uint32_t flip = 0; // 0x80000000 for unsigned columns (see refineRange32()).
+    long long low = LLONG_MIN;
+    long long high = LLONG_MAX;
+    bool negate = false;
+    std::vector<std::uint8_t> members; // One byte per dictionary code, for 'in'.
+    std::string_view text;             // For '~'.
+};
+
+// The range of values 'op value' accepts, as [low, high] or, if 'negate', its
+// complement. Returns false if it accepts no value at all.
+inline bool comparisonRange(CompareOp op, long long value, long long& low, long long& high, bool& negate) {
+    low = LLONG_MIN;
+    high = LLONG_MAX;
+    negate = false;
+    switch (op) {
+    case CompareOp::Eq: low = high = value; return true;
+    case CompareOp::Ne: low = high = value; negate = true; return true;
+    case CompareOp::Lt: high = value > LLONG_MIN ? value - 1 : value; return value > LLONG_MIN;
+    case CompareOp::Le: high = value; return true;
+    case CompareOp::Gt: low = value < LLONG_MAX ? value + 1 : value; return value < LLONG_MAX;
+    case CompareOp::Ge: low = value; return true;
+    case CompareOp::In:
+    case CompareOp::Contains: break;
+    }
+    return true;
+}
+
+// Resolves 'predicate' for 'table'. Returns false if its value is malformed.
+inline bool bindPredicate(const ColumnarView& table, const Predicate& predicate, BoundPredicate& bound, std::string& error) {
+    using Kind = BoundPredicate::Kind;
+    constexpr std::uint32_t kUnsigned = 0x80000000u;
+    const auto bindEquality = [&](const std::uint32_t* column, std::uint32_t value) {
+        bound.kind = Kind::Range32;
+        bound.column32 = column;
+        bound.flip = kUnsigned;
+        bound.low = bound.high = static_cast<std::int32_t>(value ^ kUnsigned);
+        bound.negate = (predicate.op == CompareOp::Ne);
+    };
+    const auto bindCode = [&](const std::uint32_t* column, const Dictionary& dictionary) {
+        if (predicate.op == CompareOp::In) {
+            bound.kind = Kind::Nothing;
+            bound.members.assign(dictionary.size(), 0);
+            for (const std::string& value : predicate.values) {
+                std::uint32_t code = 0;
+                if (dictionary.find(value, code)) {
+                    bound.members[code] = 1;
+                    bound.kind = Kind::Members;
+                    bound.column32 = column;
+                }
+            }
+            return;
+        }
+        std::uint32_t code = 0;
+        if (!dictionary.find(predicate.value, code)) {
+            // A value that never occurs matches nothing for '=' and everything for '!='.
+            bound.kind = predicate.op == CompareOp::Eq ? Kind::Nothing : Kind::Everything;
+            return;
+        }
+        bindEquality(column, code);
+    };
+
+    switch (predicate.column) {
+    case Column::User: bindCode(table.user, *table.users); return true;
+    case Column::Action: bindCode(table.action, *table.actions); return true;
+    case Column::Status: bindCode(table.status, *table.statuses); return true;
+    case Column::Details:
+        bound.kind = Kind::Contains;
+        bound.text = predicate.value;
+        return true;
+    case Column::Ip: {
+        std::uint32_t ip = 0;
+        if (!parseIpv4(predicate.value, ip)) {
+            error = "'" + predicate.value + "' is not an IPv4 address";
+            return false;
+        }
+        bindEquality(table.ip, ip);
+        return true;
+    }
+    case Column::Latency:
+    case Column::Time: {
+        long long number = 0;
+        const char* end = predicate.value.data() + predicate.value.size();
+        auto result = std::from_chars(predicate.value.data(), end, number);
+        if (result.ec != std::errc() || (result.ptr != end && std::string_view(result.ptr, end - result.ptr) != "ms")) {
+            error = "'" + predicate.value + "' is not a number";
+            return false;
+        }
+        if (!comparisonRange(predicate.op, number, bound.low, bound.high, bound.negate)) {
+            bound.kind = Kind::Nothing;
+            return true;
+        }
+        if (predicate.column == Column::Time) {
+            bound.kind = Kind::Range64;
+            bound.column64 = table.timestamp;
+            return true;
+        }
+        // Latencies are 32-bit, so the range is clipped to what they can hold.
+        bound.low = std::max<long long>(bound.low, INT32_MIN);
+        bound.high = std::min<long long>(bound.high, INT32_MAX);
+        if (bound.low > bound.high) {
+            bound.kind = bound.negate ? Kind::Everything : Kind::Nothing;
+            return true;
+        }
+        bound.kind = Kind::Range32;
+        bound.column32 = reinterpret_cast<const std::uint32_t*>(table.latencyMs);
+        return true;
+    }
+    }
+    return true;
+}
+
+// The predicate as it is written in a query, e.g. "latency>=200".
+inline std::string predicateText(const Predicate& predicate) {
+    std::string text = columnName(predicate.column);
+    switch (predicate.op) {
+    case CompareOp::Eq: text += '='; break;
+    case CompareOp::Ne: text += "!="; break;
+    case CompareOp::Lt: text += '<'; break;
+    case CompareOp::Le: text += "<="; break;
+    case CompareOp::Gt: text += '>'; break;
+    case CompareOp::Ge: text += ">="; break;
+    case CompareOp::Contains: text += '~'; break;
+    case CompareOp::In: {
+        text += " in (";
+        for (std::size_t i = 0; i < predicate.values.size(); ++i) {
+            text += (i > 0 ? "," : "") + predicate.values[i];
+        }
+        return text + ')';
+    }
+    }
+    return text + predicate.value;
+}
+
+// --- Planning ---
+// What a query reports about its plan: nothing, the plan alone (--explain), or
+// the plan next to what each of its steps did (--analyze).
+enum class PlanMode { Run, Explain, Analyze };
+
+// The share of rows a predicate is guessed to keep when nothing is known about
+// its column: the textbook guesses for an equality and for a range.
+constexpr double kGuessEquality = 0.1;
+constexpr double kGuessRange = 1.0 / 3;
+
+// The share of the rows of 'table' that 'predicate', bound as 'bound', is
+// expected to keep. A dictionary column is assumed to hold each of its values
+// equally often, and the rows to spread evenly over the part's time range.
+inline double estimateSelectivity(const ColumnarView& table, const Predicate& predicate, const BoundPredicate& bound) {
+    using Kind = BoundPredicate::Kind;
+    if (bound.kind == Kind::Nothing || bound.kind == Kind::Everything) {
+        return bound.kind == Kind::Nothing ? 0.0 : 1.0;
+    }
+    const Dictionary* dictionary = predicate.column == Column::User ? table.users
+                                 : predicate.column == Column::Action ? table.actions
+                                 : predicate.column == Column::Status ? table.statuses : nullptr;
+    double share = (predicate.op == CompareOp::Eq || predicate.op == CompareOp::Ne || predicate.op == CompareOp::Contains)
+                       ? kGuessEquality : kGuessRange;
+    if (dictionary != nullptr && dictionary->size() > 0) {
+        const double values = static_cast<double>(dictionary->size());
+        share = bound.kind == Kind::Members ? static_cast<double>(std::count(bound.members.begin(), bound.members.end(), 1)) / values
+                                            : 1.0 / values;
+    }
+    else if (predicate.column == Column::Ip && table.distinctIps > 0) {
+        share = 1.0 / static_cast<double>(table.distinctIps);
+    }
+    else if (predicate.column == Column::Time && table.hasTimeRange) {
+        const double first = static_cast<double>(table.minTimestamp);
+        const double last = static_cast<double>(table.maxTimestamp);
+        const double low = std::max(static_cast<double>(bound.low), first);
+        const double high = std::min(static_cast<double>(bound.high), last);
+        share = low > high ? 0.0 : (high - low + 1) / (last - first + 1);
+    }
+    share = std::min(1.0, std::max(0.0, share));
+    return bound.negate ? 1.0 - share : share;
+}
+
+// Rough cost per row of a bound predicate, relative to a 32-bit range test.
+inline double predicateCost(const BoundPredicate& predicate) {
+    switch (predicate.kind) {
+    case BoundPredicate::Kind::Range64: return 2;   // Two 32-bit compares per value (see refineRange64()).
+    case BoundPredicate::Kind::Members: return 4;   // A table lookup per row, without SIMD.
+    case BoundPredicate::Kind::Contains: return 50; // A substring search in each row's Details.
+    default: return 1;
+    }
+}
+
+// One predicate of a part's scan: what the planner expected of it and, when
+// the scan is measured (--analyze), what it did.
+struct PredicateProfile {
+    std::size_t position = 0; // In query.where.
+    double selectivity = 1;   // Estimated share of its input rows it keeps.
+    bool skipped = false;     // Holds for every row of the part, so never evaluated.
+    bool nothing = false;     // Holds for no row of the part, so the part is not scanned.
+    long long rowsIn = 0;
+    long long rowsOut = 0;
+    double milliseconds = 0;
+};
+
+struct ScanProfile {
+    bool measure = false; // Count and time each predicate's rows; costs a little per batch.
+    bool ran = false;     // The part was scanned.
+    std::vector<PredicateProfile> predicates; // In the order they run.
+    long long rowsScanned = 0;
+    long long rowsMatched = 0;
+    double milliseconds = 0;
+};
+
+// Binds the query's predicates for 'table' into 'bound', in the order they
+// should run: the one that throws out the most rows per unit of cost first.
+// '~' always comes last, after the rows it reads have been narrowed down (see
+// evaluateBatch()). On a part sorted by time, the time range is found by
+// binary search before the predicates run, so time predicates are expected to
+// keep every row they see. 'profile' gets the estimates. Returns false if a
+// predicate's value is malformed.
+inline bool planPart(const ColumnarView& table, const Query& query, std::vector<BoundPredicate>& bound, ScanProfile& profile,
+                     std::string& error) {
+    const std::size_t count = query.where.size();
+    std::vector<BoundPredicate> given(count);
+    std::vector<PredicateProfile> steps(count);
+    std::vector<double> rank(count);
+    for (std::size_t p = 0; p < count; ++p) {
+        const Predicate& predicate = query.where[p];
+        if (!bindPredicate(table, predicate, given[p], error)) {
+            return false;
+        }
+        const bool sought = table.sortedByTime && given[p].kind == BoundPredicate::Kind::Range64 && !given[p].negate;
+        steps[p].position = p;
+        steps[p].selectivity = sought ? 1.0 : estimateSelectivity(table, predicate, given[p]);
+        steps[p].skipped = given[p].kind == BoundPredicate::Kind::Everything;
+        steps[p].nothing = given[p].kind == BoundPredicate::Kind::Nothing;
+        rank[p] = given[p].kind == BoundPredicate::Kind::Contains ? -1.0 : (1.0 - steps[p].selectivity) / predicateCost(given[p]);
+    }
+    std::vector<std::size_t> order(count);
+    std::iota(order.begin(), order.end(), std::size_t(0));
+    std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) { return rank[a] > rank[b]; });
+    bound.clear();
+    profile.predicates.clear();
+    for (const std::size_t p : order) {
+        bound.push_back(std::move(given[p]));
+        profile.predicates.push_back(steps[p]);
+    }
+    return true;
+}
+
+// Fills in the statistics an in-memory part can give the planner, with one
+// pass over its timestamps: their range, and whether they are sorted, which
+// lets a query on a time range seek to it instead of scanning every row.
+inline void collectStatistics(ColumnarView& table) {
+    table.hasTimeRange = table.rows > 0;
+    if (!table.hasTimeRange) {
+        return;
+    }
+    const std::int64_t* timestamps = table.timestamp;
+    std::int64_t low = timestamps[0];
+    std::int64_t high = timestamps[0];
+    bool sorted = true;
+    for (std::size_t row = 1; row < table.rows; ++row) {
+        sorted = sorted && timestamps[row] >= timestamps[row - 1];
+        low = std::min(low, timestamps[row]);
+        high = std::max(high, timestamps[row]);
+    }
+    table.minTimestamp = low;
+    table.maxTimestamp = high;
+    table.sortedByTime = table.sortedByTime || sorted;
+}
+
+// --- Selections ---
+// The rows of one batch, [begin, end), that the predicates have kept. While
+// that is every row, 'all' is set and 'rows' is not filled. A scan that only
+// counts rows gets 'counted' set instead; then size() is all there is.
+struct Selection {
+    std::size_t begin = 0;
+    std::size_t end = 0;
+    bool all = true;
+    bool counted = false;
+    std::size_t matched = 0;
+    std::vector<std::uint32_t> rows;
+
+    std::size_t size() const { return all ? end - begin : counted ? matched : rows.size(); }
+    std::uint32_t at(std::size_t i) const { return all ? static_cast<std::uint32_t>(begin + i) : rows[i]; }
+};
+
+// Keeps the rows of 'selection' for which 'keep(row)' is true. The row number
+// is always written and the output cursor only advances on a match, so the loop
+// has no data-dependent branch.
+template<typename Keep>
+void filterSelection(Selection& selection, Keep keep) {
+    const std::size_t count = selection.size();
+    std::vector<std::uint32_t>& rows = selection.rows;
+    rows.resize(count);
+    std::size_t kept = 0;
+    for (std::size_t i = 0; i < count; ++i) {
+        const std::uint32_t row = selection.at(i);
+        rows[kept] = row;
+        kept += keep(row) ? 1 : 0;
+    }
+    rows.resize(kept);
+    selection.all = false;
+}
+
+// Keeps the rows of 'selection' that pass an integer predicate, one row at a
+// time.
+inline void filterBound(Selection& selection, const BoundPredicate& predicate) {
+    using Kind = BoundPredicate::Kind;
+    const long long low = predicate.low;
+    const long long high = predicate.high;
+    const bool negate = predicate.negate;
+    switch (predicate.kind) {
+    case Kind::Range32: {
+        const std::uint32_t* column = predicate.column32;
+        const std::uint32_t flip = predicate.flip;
+        filterSelection(selection, [&](std::uint32_t row) {
+            const std::int32_t v = static_cast<std::int32_t>(column[row] ^ flip);
+            return (v >= low && v <= high) != negate;
+        });
+        break;
+    }
+    case Kind::Range64: {
+        const std::int64_t* column = predicate.column64;
+        filterSelection(selection, [&](std::uint32_t row) { return (column[row] >= low && column[row] <= high) != negate; });
+        break;
+    }
+    case Kind::Members: {
+        const std::uint32_t* column = predicate.column32;
+        const std::uint8_t* members = predicate.members.data();
+        filterSelection(selection, [&](std::uint32_t row) { return members[column[row]] != 0; });
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+// Once no more than one row in kSparseBatch is left, the remaining integer
+// predicates check the selected rows one by one instead of refining the bitmap,
+// which would still read nearly every word of their columns.
+constexpr std::size_t kSparseBatch = 2;
+
+// Selects the rows of the batch [begin, end) that match every bound
+// predicate. Predicates on integer columns run first, into a bitmap. Only the
+// rows that pass all of them have their Details read, for '~'. With
+// 'countOnly', and no '~', the bitmap's set bits are counted and not listed.
+// With a 'profile' (one entry per bound predicate), each predicate's rows in
+// and out and its time are added to it.
+inline void evaluateBatch(const ColumnarView& table, const std::vector<BoundPredicate>& bound, std::size_t begin, std::size_t end,
+                          bool countOnly, SelectionBitmap& bitmap, Selection& selection, ScanProfile* profile = nullptr) {
+    using Kind = BoundPredicate::Kind;
+    using Clock = std::chrono::steady_clock;
+    selection.begin = begin;
+    selection.end = end;
+    selection.all = true;
+    selection.counted = false;
+    const auto isInteger = [](const BoundPredicate& predicate) {
+        return predicate.kind == Kind::Range32 || predicate.kind == Kind::Range64 || predicate.kind == Kind::Members;
+    };
+    std::size_t left = end - begin; // Rows still selected; only kept up to date for a profile.
+    const auto record = [&](std::size_t p, std::size_t kept, Clock::time_point start) {
+        PredicateProfile& step = profile->predicates[p];
+        step.rowsIn += static_cast<long long>(left);
+        step.rowsOut += static_cast<long long>(kept);
+        step.milliseconds += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        left = kept;
+    };
+    std::size_t pending = static_cast<std::size_t>(std::count_if(bound.begin(), bound.end(), isInteger));
+    const bool refined = pending > 0;
+    bool sparse = false;
+    bitmap.fill(end - begin);
+    for (std::size_t p = 0; p < bound.size(); ++p) {
+        const BoundPredicate& predicate = bound[p];
+        if (!isInteger(predicate)) {
+            continue;
+        }
+        --pending;
+        const Clock::time_point start = profile != nullptr ? Clock::now() : Clock::time_point();
+        if (sparse) {
+            filterBound(selection, predicate);
+        }
+        else if (predicate.kind == Kind::Range32) {
+            refineRange32(predicate.column32 + begin, predicate.flip, static_cast<std::int32_t>(predicate.low),
+                          static_cast<std::int32_t>(predicate.high), predicate.negate, bitmap);
+        }
+        else if (predicate.kind == Kind::Range64) {
+            refineRange64(predicate.column64 + begin, predicate.low, predicate.high, predicate.negate, bitmap);
+        }
+        else {
+            refineMembers(predicate.column32 + begin, predicate.members, bitmap);
+        }
+        if (profile != nullptr) {
+            record(p, sparse ? selection.size() : bitmap.count(), start);
+        }
+        if (!sparse && pending > 0 && bitmap.count() * kSparseBatch <= end - begin) {
+            toSelection(bitmap, static_cast<std::uint32_t>(begin), selection.rows);
+            selection.all = false;
+            sparse = true;
+        }
+    }
+    if (refined && !sparse) {
+        const std::size_t matched = bitmap.count();
+        if (matched != end - begin) {
+            selection.all = false;
+            if (countOnly) {
+                selection.counted = true;
+                selection.matched = matched;
+            }
+            else {
+                toSelection(bitmap, static_cast<std::uint32_t>(begin), selection.rows);
+            }
+        }
+    }
+    for (std::size_t p = 0; p < bound.size(); ++p) {
+        const BoundPredicate& predicate = bound[p];
+        if (predicate.kind == Kind::Contains && selection.size() > 0) {
+            const Clock::time_point start = profile != nullptr ? Clock::now() : Clock::time_point();
+            filterSelection(selection, [&](std::uint32_t row) { return table.details(row).find(predicate.text) != std::string_view::npos; });
+            if (profile != nullptr) {
+                record(p, selection.size(), start);
+            }
+        }
+    }
+}
+
+// The time range [first, last] that the query's time predicates allow. It may
+// be wider than the exact answer; the predicates still run on every row in it.
+inline void queryTimeBounds(const Query& query, long long& first, long long& last) {
+    first = LLONG_MIN;
+    last = LLONG_MAX;
+    for (const Predicate& predicate : query.where) {
+        long long value = 0;
+        const char* end = predicate.value.data() + predicate.value.size();
+        if (predicate.column != Column::Time || std::from_chars(predicate.value.data(), end, value).ec != std::errc()) {
+            continue; // A malformed value is reported by applyPredicate().
+        }
+        switch (predicate.op) {
+        case CompareOp::Eq: first = std::max(first, value); last = std::min(last, value); break;
+        case CompareOp::Lt: last = std::min(last, value > LLONG_MIN ? value - 1 : value); break;
+        case CompareOp::Le: last = std::min(last, value); break;
+        case CompareOp::Gt: first = std::max(first, value < LLONG_MAX ? value + 1 : value); break;
+        case CompareOp::Ge: first = std::max(first, value); break;
+        case CompareOp::Ne:
+        case CompareOp::In:
+        case CompareOp::Contains: break;
+        }
+    }
+}
+
+// The columns (a ColumnSet) that running 'query' reads.
+inline unsigned queryColumns(const Query& query) {
+    const auto bit = [](Column column) -> unsigned {
+        switch (column) {
+        case Column::User: return kColumnUser;
+        case Column::Action: return kColumnAction;
+        case Column::Status: return kColumnStatus;
+        case Column::Ip: return kColumnIp;
+        case Column::Latency: return kColumnLatency;
+        case Column::Time: return kColumnTimestamp;
+        case Column::Details: return kColumnDetails;
+        }
+        return 0;
+    };
+    if (query.kind == QueryKind::Rows) {
+        return kAllColumns;
+    }
+    unsigned columns = 0;
+    for (const Predicate& predicate : query.where) {
+        columns |= bit(predicate.column);
+    }
+    if (query.grouped) {
+        columns |= bit(query.groupBy);
+    }
+    // Grouping by IP always collects latencies (see PartAggregator).
+    if (query.kind == QueryKind::Latency || query.kind == QueryKind::Histogram || (query.grouped && query.groupBy == Column::Ip)) {
+        columns |= kColumnLatency;
+    }
+    return columns;
+}
+
+// Narrows the rows [begin, end) of 'table' to those that can match the query's
+// time predicates: all of them, unless the table is sorted by time and the
+// query restricts it.
+inline void queryRowRange(const ColumnarView& table, const Query& query, std::size_t& begin, std::size_t& end) {
+    long long first = 0;
+    long long last = 0;
+    queryTimeBounds(query, first, last);
+    if (table.sortedByTime && (first != LLONG_MIN || last != LLONG_MAX)) {
+        const std::int64_t* timestamps = table.timestamp;
+        const std::size_t limit = end;
+        begin = static_cast<std::size_t>(std::lower_bound(timestamps + begin, timestamps + limit, first) - timestamps);
+        end = first > last ? begin : static_cast<std::size_t>(std::upper_bound(timestamps + begin, timestamps + limit, last) - timestamps);
+    }
+}
+
+// --- Aggregation ---
+struct GroupRow {
+    std::string label;
+    GroupStats stats;
+    long long bucket = 0; // Histogram rows: the bucket number, which orders them.
+};
+
+// Aggregates one part's matching rows, a batch at a time, into one GroupRow per
+// distinct value of the group-by column (or per histogram bucket, or a single
+// row if the query is not grouped).
+class PartAggregator {
+public:
+    PartAggregator(const ColumnarView& table, const Query& query)
+        : table_(table), query_(query), codes_(groupCodes(table, query)), dictionary_(groupDictionary(table, query)),
+          summarizer_(query.kind == QueryKind::Latency && dictionary_ != nullptr ? dictionary_->size() : 0),
+          counter_(query.kind != QueryKind::Latency && dictionary_ != nullptr ? dictionary_->size() : 0) {}
+
+    // Adds the selected rows of one batch.
+    void add(const Selection& selection) {
+        const std::size_t begin = selection.begin;
+        const std::size_t count = selection.size();
+        const std::uint32_t* selected = selection.rows.data();
+        const bool dense = (count == selection.end - begin); // Then the selected rows are [begin, end).
+        const auto column = [&](const auto* values, auto* buffer) {
+            if (dense) {
+                return values + begin;
+            }
+            gatherSelected(values, selected, count, buffer);
+            return static_cast<const std::remove_pointer_t<decltype(buffer)>*>(buffer);
+        };
+
+        if (query_.kind == QueryKind::Histogram) {
+            addToHistogram(column(table_.latencyMs, latencies_), count);
+        }
+        else if (!query_.grouped) {
+            if (query_.kind == QueryKind::Latency) {
+                summarizeValues(column(table_.latencyMs, latencies_), count, all_);
+            }
+            else {
+                all_.count += static_cast<long long>(count);
+            }
+        }
+        else if (dictionary_ == nullptr) {
+            const std::uint32_t* ips = column(table_.ip, codeBuffer_);
+            const std::int32_t* latencies = column(table_.latencyMs, latencies_);
+            for (std::size_t i = 0; i < count; ++i) {
+                byIp_[ips[i]].add(latencies[i]);
+            }
+        }
+        else if (query_.kind == QueryKind::Latency) {
+            summarizer_.add(column(codes_, codeBuffer_), column(table_.latencyMs, latencies_), count);
+        }
+        else {
+            counter_.add(column(codes_, codeBuffer_), count);
+        }
+    }
+
+    std::vector<GroupRow> rows() const {
+        std::vector<GroupRow> rows;
+        if (query_.kind == QueryKind::Histogram) {
+            for (const auto& entry : histogram_) {
+                const long long low = entry.first * query_.bucketMs;
+                GroupRow row{ std::to_string(low) + "-" + std::to_string(low + query_.bucketMs - 1) + " ms", GroupStats(), entry.first };
+                row.stats.count = entry.second;
+                rows.push_back(std::move(row));
+            }
+        }
+        else if (!query_.grouped) {
+            rows.push_back({ "all", all_ });
+        }
+        else if (dictionary_ == nullptr) {
+            for (const auto& entry : byIp_) {
+                rows.push_back({ formatIpv4(entry.first), entry.second });
+            }
+        }
+        else {
+            // Dictionary codes are dense, so the groups are simply an array indexed by code.
+            for (std::uint32_t code = 0; code < dictionary_->size(); ++code) {
+                GroupStats stats;
+                if (query_.kind == QueryKind::Latency) {
+                    stats = summarizer_.stats(code);
+                }
+                else {
+                    stats.count = counter_.count(code);
+                }
+                if (stats.count > 0) {
+                    rows.push_back({ dictionary_->value(code), stats });
+                }
+            }
+        }
+        return rows;
+    }
+
+private:
+    static const std::uint32_t* groupCodes(const ColumnarView& table, const Query& query) {
+        if (!query.grouped) return nullptr;
+        if (query.groupBy == Column::User) return table.user;
+        if (query.groupBy == Column::Action) return table.action;
+        if (query.groupBy == Column::Status) return table.status;
+        return nullptr;
+    }
+
+    static const Dictionary* groupDictionary(const ColumnarView& table, const Query& query) {
+        if (!query.grouped) return nullptr;
+        if (query.groupBy == Column::User) return table.users;
+        if (query.groupBy == Column::Action) return table.actions;
+        if (query.groupBy == Column::Status) return table.statuses;
+        return nullptr;
+    }
+
+    void addToHistogram(const std::int32_t* latencies, std::size_t count) {
+        if (count == 0) {
+            return;
+        }
+        GroupStats range;
+        summarizeValues(latencies, count, range);
+        const long long firstBucket = floorDivide(range.latencyMin, query_.bucketMs);
+        const long long buckets = floorDivide(range.latencyMax, query_.bucketMs) - firstBucket + 1;
+        if (buckets > static_cast<long long>(kBatchRows)) {
+            // Too spread out for a dense count; this only happens with very narrow buckets.
+            for (std::size_t i = 0; i < count; ++i) {
+                ++histogram_[floorDivide(latencies[i], query_.bucketMs)];
+            }
+            return;
+        }
+        bucketValues(latencies, count, query_.bucketMs, firstBucket, codeBuffer_);
+        CodeCounter counter(static_cast<std::size_t>(buckets));
+        counter.add(codeBuffer_, count);
+        for (std::uint32_t bucket = 0; bucket < buckets; ++bucket) {
+            if (const long long n = counter.count(bucket)) {
+                histogram_[firstBucket + bucket] += n;
+            }
+        }
+    }
+
+    const ColumnarView& table_;
+    const Query& query_;
+    const std::uint32_t* codes_;    // The group-by column, when it is dictionary-encoded.
+    const Dictionary* dictionary_;
+    GroupStats all_;
+    CodeSummarizer summarizer_; // Per code, for latency queries.
+    CodeCounter counter_;       // Per code, for count and top queries.
+    std::unordered_map<std::uint32_t, GroupStats> byIp_;
+    std::map<long long, long long> histogram_; // Bucket number -> rows.
+    std::uint32_t codeBuffer_[kBatchRows];
+    std::int32_t latencies_[kBatchRows];
+};
+
+// --- Scanning a Part ---
+// Calls 'onBatch(const Selection&)' with the matching rows of each batch of
+// one part, in order, for as long as it returns true. Only the part's
+// rowRanges are scanned, if it has them. A 'profile' gets the plan (see
+// planPart()). If profile->measure is set, it also gets the rows scanned and
+// matched, and each predicate's rows and time. Returns false if a predicate's
+// value is malformed.
+template<typename Fn>
+bool scanPart(const ColumnarView& table, const Query& query, Fn&& onBatch, std::string& error, ScanProfile* profile = nullptr) {
+    ScanProfile planned;
+    ScanProfile& plan = profile != nullptr ? *profile : planned;
+    std::vector<BoundPredicate> bound;
+    if (!planPart(table, query, bound, plan, error)) {
+        return false;
+    }
+    if (std::any_of(bound.begin(), bound.end(), [](const BoundPredicate& b) { return b.kind == BoundPredicate::Kind::Nothing; })) {
+        return true;
+    }
+
+    const bool countOnly = query.kind == QueryKind::Count && !query.grouped &&
+                           std::none_of(bound.begin(), bound.end(), [](const BoundPredicate& b) { return b.kind == BoundPredicate::Kind::Contains; });
+    ScanProfile* measured = plan.measure ? &plan : nullptr;
+    const RowRanges allRows{ { 0, table.rows } };
+    SelectionBitmap bitmap;
+    Selection selection;
+    selection.rows.reserve(kBatchRows);
+    for (const auto& range : table.rowRanges != nullptr ? *table.rowRanges : allRows) {
+        std::size_t first = range.first;
+        std::size_t last = range.second;
+        queryRowRange(table, query, first, last);
+        for (std::size_t begin = first; begin < last; begin += kBatchRows) {
+            const std::size_t end = std::min(last, begin + kBatchRows);
+            evaluateBatch(table, bound, begin, end, countOnly, bitmap, selection, measured);
+            if (measured != nullptr) {
+                measured->rowsScanned += static_cast<long long>(end - begin);
+                measured->rowsMatched += static_cast<long long>(selection.size());
+            }
+            if (!onBatch(static_cast<const Selection&>(selection))) {
+                return true;
+            }
+        }
+    }
+    return true;
+}
+
+// Runs the query over one part and returns the part's groups.
+inline bool aggregatePart(const ColumnarView& table, const Query& query, std::vector<GroupRow>& rows, std::string& error,
+                          ScanProfile* profile = nullptr) {
+    PartAggregator aggregator(table, query);
+    const bool ok = scanPart(table, query, [&](const Selection& selection) {
+        aggregator.add(selection);
+        return true;
+    }, error, profile);
+    rows = aggregator.rows();
+    return ok;
+}
+
+// --- Printing Rows ---
+// One matching row with every field read back out of its columns.
+struct RecordRow {
+    long long timestamp = 0;
+    std::uint32_t ip = 0;
+    std::string_view user;
+    std::string_view action;
+    std::string_view status;
+    int latencyMs = 0;
+    std::string_view details; // Points into the part, which outlives the result.
+};
+
+// Appends the first rows of 'table' that match, up to query.limit rows in all.
+// Only these rows have their fields, Details included, read at all.
+inline bool collectRows(const ColumnarView& table, const Query& query, std::vector<RecordRow>& out, std::string& error,
+                        ScanProfile* profile = nullptr) {
+    return scanPart(table, query, [&](const Selection& selection) {
+        for (std::size_t i = 0; i < selection.size() && out.size() < query.limit; ++i) {
+            const std::uint32_t row = selection.at(i);
+            out.push_back({ table.timestamp[row], table.ip[row], table.users->value(table.user[row]),
+                            table.actions->value(table.action[row]), table.statuses->value(table.status[row]),
+                            table.latencyMs[row], table.details(row) });
+        }
+        return out.size() < query.limit;
+    }, error, profile);
+}
+
+inline void writeRecordRows(ReportBuffer& out, const std::vector<RecordRow>& rows, ReportFormat format) {
+    if (format == ReportFormat::Csv) {
+        out.append("timestamp,ip,user,action,status,latency_ms,details\n");
+    }
+    if (format == ReportFormat::Json) {
+        out.append('[');
+    }
+    bool first = true;
+    for (const RecordRow& row : rows) {
+        const std::string ip = formatIpv4(row.ip);
+        switch (format) {
+        case ReportFormat::Text:
+            out.append("  ").integer(row.timestamp).append('|').append(ip).append('|').append(row.user).append('|');
+            out.append(row.action).append('|').append(row.status).append('|').integer(row.latencyMs).append("ms|");
+            out.append(row.details).append('\n');
+            break;
+        case ReportFormat::Json:
+            out.append(first ? "{\"timestamp\":" : ",{\"timestamp\":").integer(row.timestamp);
+            out.append(",\"ip\":").jsonString(ip).append(",\"user\":").jsonString(row.user);
+            out.append(",\"action\":").jsonString(row.action).append(",\"status\":").jsonString(row.status);
+            out.append(",\"latency_ms\":").integer(row.latencyMs).append(",\"details\":").jsonString(row.details).append('}');
+            break;
+        case ReportFormat::Csv:
+            out.integer(row.timestamp).append(',').csvField(ip).append(',').csvField(row.user).append(',');
+            out.csvField(row.action).append(',').csvField(row.status).append(',').integer(row.latencyMs).append(',');
+            out.csvField(row.details).append('\n');
+            break;
+        }
+        first = false;
+    }
+    if (format == ReportFormat::Json) {
+        out.append("]\n");
+    }
+}
+
+// Renders group rows in the chosen report format. Latency columns are only
+// present for latency queries.
+inline void writeGroupRows(ReportBuffer& out, const std::vector<GroupRow>& rows, QueryKind kind, ReportFormat format) {
+    const bool latency = (kind == QueryKind::Latency);
+    if (format == ReportFormat::Csv) {
+        out.append(latency ? "group,count,latency_min_ms,latency_mean_ms,latency_max_ms\n" : "group,count\n");
+    }
+    if (format == ReportFormat::Json) {
+        out.append('[');
+    }
+    bool first = true;
+    for (const GroupRow& row : rows) {
+        const bool withLatency = latency && row.stats.count > 0;
+        const double mean = withLatency ? static_cast<double>(row.stats.latencySum) / row.stats.count : 0.0;
+        switch (format) {
+        case ReportFormat::Text:
+            out.append("  ").append(row.label).append(": ").integer(row.stats.count);
+            if (withLatency) {
+                out.append(" rows, latency min ").integer(row.stats.latencyMin)
+                   .append(" / mean ").decimal(mean)
+                   .append(" / max ").integer(row.stats.latencyMax).append(" ms");
+            }
+            out.append('\n');
+            break;
+        case ReportFormat::Json:
+            out.append(first ? "{\"group\":" : ",{\"group\":").jsonString(row.label);
+            out.append(",\"count\":").integer(row.stats.count);
+            if (withLatency) {
+                out.append(",\"latency_min_ms\":").integer(row.stats.latencyMin);
+                out.append(",\"latency_mean_ms\":").decimal(mean);
+                out.append(",\"latency_max_ms\":").integer(row.stats.latencyMax);
+            }
+            out.append('}');
+            break;
+        case ReportFormat::Csv:
+            out.csvField(row.label).append(',').integer(row.stats.count);
+            if (latency) {
+                out.append(',');
+                if (withLatency) {
+                    out.integer(row.stats.latencyMin).append(',').decimal(mean).append(',').integer(row.stats.latencyMax);
+                }
+                else {
+                    out.append(",,");
+                }
+            }
+            out.append('\n');
+            break;
+        }
+        first = false;
+    }
+    if (format == ReportFormat::Json) {
+        out.append("]\n");
+    }
+}
+
+// Runs 'query' over every part and returns its result as printable text in
+// 'format'. With 'profiles', each part's scan is measured into its entry.
+inline bool executeQuery(const std::vector<ColumnarView>& parts, const Query& query, std::string& result, std::string& error,
+                         ReportFormat format = ReportFormat::Text, std::vector<ScanProfile>* profiles = nullptr) {
+    using Clock = std::chrono::steady_clock;
+    if (profiles != nullptr) {
+        profiles->assign(parts.size(), ScanProfile());
+    }
+    // Runs 'scan(profile)' over part p, timing it if it has a profile.
+    const auto measure = [&](std::size_t p, auto&& scan) {
+        ScanProfile* profile = profiles != nullptr ? &(*profiles)[p] : nullptr;
+        if (profile == nullptr) {
+            return scan(profile);
+        }
+        profile->measure = true;
+        profile->ran = true;
+        const Clock::time_point start = Clock::now();
+        const bool ok = scan(profile);
+        profile->milliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        return ok;
+    };
+
+    if (query.kind == QueryKind::Rows) {
+        std::vector<RecordRow> records;
+        for (std::size_t p = 0; p < parts.size(); ++p) {
+            if (records.size() >= query.limit) {
+                break;
+            }
+            if (!measure(p, [&](ScanProfile* profile) { return collectRows(parts[p], query, records, error, profile); })) {
+                return false;
+            }
+        }
+        ReportBuffer out;
+        writeRecordRows(out, records, format);
+        result = out.str();
+        return true;
+    }
+
+    std::vector<GroupRow> rows;
+    for (std::size_t p = 0; p < parts.size(); ++p) {
+        std::vector<GroupRow> partRows;
+        if (!measure(p, [&](ScanProfile* profile) { return aggregatePart(parts[p], query, partRows, error, profile); })) {
+            return false;
+        }
+        if (rows.empty()) {
+            rows = std::move(partRows);
+            continue;
+        }
+        // Parts have their own dictionaries, so their groups meet by label.
+        std::unordered_map<std::string, std::size_t> index;
+        for (std::size_t i = 0; i < rows.size(); ++i) {
+            index.emplace(rows[i].label, i);
+        }
+        for (GroupRow& row : partRows) {
+            auto found = index.find(row.label);
+            if (found == index.end()) {
+                rows.push_back(std::move(row));
+            }
+            else {
+                rows[found->second].stats.merge(row.stats);
+            }
+        }
+    }
+    if (rows.empty() && !query.grouped && query.kind != QueryKind::Histogram) {
+        rows.push_back({ "all", GroupStats() });
+    }
+
+    if (query.kind == QueryKind::Histogram) {
+        std::sort(rows.begin(), rows.end(), [](const GroupRow& a, const GroupRow& b) { return a.bucket < b.bucket; });
+    }
+    else {
+        std::sort(rows.begin(), rows.end(), [](const GroupRow& a, const GroupRow& b) {
+            return a.stats.count != b.stats.count ? a.stats.count > b.stats.count : a.label < b.label;
+        });
+    }
+    if (query.kind == QueryKind::Top && rows.size() > query.topK) {
+        rows.resize(query.topK);
+    }
+
+    ReportBuffer out;
+    writeGroupRows(out, rows, query.kind, format);
+    result = out.str();
+    return true;
+}
+
+inline bool executeQuery(const ColumnarTable& table, const Query& query, std::string& result, std::string& error,
+                         ReportFormat format = ReportFormat::Text) {
+    return executeQuery(std::vector<ColumnarView>{ table.view() }, query, result, error, format);
+}
+
+// --- Describing a Plan ---
+// The rows a scan of 'table' reads for 'query': those of its rowRanges, or all
+// of them, narrowed to the query's time range if the part can seek to it.
+inline std::size_t rowsToScan(const ColumnarView& table, const Query& query) {
+    const RowRanges allRows{ { 0, table.rows } };
+    std::size_t total = 0;
+    for (const auto& range : table.rowRanges != nullptr ? *table.rowRanges : allRows) {
+        std::size_t first = range.first;
+        std::size_t last = range.second;
+        queryRowRange(table, query, first, last);
+        total += last - first;
+    }
+    return total;
+}
+
+// The step that turns the matching rows of every part into the result. Its
+// rows are the rows it takes in.
+inline PlanStep aggregateStep(const Query& query, std::size_t parts) {
+    PlanStep step;
+    const std::string by = query.grouped ? std::string(" by ") + columnName(query.groupBy) : std::string();
+    switch (query.kind) {
+    case QueryKind::Count: step.label = "Count" + by; break;
+    case QueryKind::Top: step.label = "Top " + std::to_string(query.topK) + by; break;
+    case QueryKind::Latency: step.label = "Latency" + by; break;
+    case QueryKind::Histogram: step.label = "Histogram, " + std::to_string(query.bucketMs) + " ms buckets"; break;
+    case QueryKind::Rows: step.label = "First " + std::to_string(query.limit) + " rows"; break;
+    }
+    const bool bitsOnly = query.kind == QueryKind::Count && !query.grouped &&
+                          std::none_of(query.where.begin(), query.where.end(), [](const Predicate& p) { return p.op == CompareOp::Contains; });
+    if (bitsOnly) {
+        step.note = "counts the set bits of each batch's bitmap";
+    }
+    else if (query.kind == QueryKind::Rows) {
+        step.note = "stops scanning once it has them";
+    }
+    else if (parts > 1) {
+        step.note = "merges the groups of " + std::to_string(parts) + " parts by label";
+    }
+    return step;
+}
+
+// One part of a query's input as its plan shows it: a step the caller has
+// labelled, perhaps with steps that ran before the scan (such as a segment's
+// block skipping), and the number of rows its scan is expected to read.
+struct PlanPart {
+    PlanStep step;
+    double rows = 0;
+    // Per predicate in query.where, the share of rows that the steps before the
+    // scan kept for it (a Bloom filter seek keeps the blocks that may hold a
+    // user). Empty if they kept all.
+    std::vector<double> kept;
+};
+
+// Adds the steps of one part's scan to 'part': how its rows are found, then
+// its predicates in the order planPart() put them. Each step's estimate
+// assumes the predicates are independent. With a profile that ran, each step
+// also gets what it did.
+inline void describeScan(const ColumnarView& table, const Query& query, const ScanProfile& profile, PlanPart& part) {
+    long long first = 0;
+    long long last = 0;
+    queryTimeBounds(query, first, last);
+    const bool seek = table.sortedByTime && (first != LLONG_MIN || last != LLONG_MAX);
+    PlanStep& access = part.step.add(seek ? "Time seek" : "Scan", part.rows);
+    if (seek) {
+        access.note = "binary search on the sorted timestamps";
+    }
+    if (profile.ran) {
+        access.actualRows = profile.rowsScanned;
+    }
+    double rows = part.rows;
+    for (const PredicateProfile& predicate : profile.predicates) {
+        const double kept = part.kept.empty() ? 1.0 : part.kept[predicate.position];
+        rows *= kept > 0 ? std::min(1.0, predicate.selectivity / kept) : 0.0;
+        PlanStep& filter = part.step.add("Filter " + predicateText(query.where[predicate.position]), rows);
+        if (predicate.skipped) {
+            filter.note = "holds for every row here, so it is not evaluated";
+        }
+        else if (predicate.nothing) {
+            filter.note = "holds for no row here, so nothing is scanned";
+        }
+        else if (profile.ran) {
+            filter.actualRows = predicate.rowsOut;
+            filter.milliseconds = predicate.milliseconds;
+        }
+    }
+    part.step.estimatedRows = rows;
+    if (profile.ran) {
+        part.step.actualRows = profile.rowsMatched;
+        part.step.milliseconds = profile.milliseconds;
+    }
+}
+
+// Plans 'query' over 'parts' into 'plan'. 'plan' may already have steps; the
+// parts' steps follow them. 'described' has one PlanPart per part, or is empty
+// to show each part as an in-memory table. With PlanMode::Analyze the query
+// also runs: 'result' gets its output, and the plan what each step did.
+// Returns false if the query fails.
+inline bool planQuery(const std::vector<ColumnarView>& parts, std::vector<PlanPart> described, const Query& query, PlanMode mode,
+                      PlanStep& plan, std::string& result, std::string& error, ReportFormat format = ReportFormat::Text) {
+    using Clock = std::chrono::steady_clock;
+    const Clock::time_point start = Clock::now();
+    std::vector<ScanProfile> profiles(parts.size());
+    if (mode == PlanMode::Analyze) {
+        if (!executeQuery(parts, query, result, error, format, &profiles)) {
+            return false;
+        }
+    }
+    else {
+        std::vector<BoundPredicate> bound;
+        for (std::size_t p = 0; p < parts.size(); ++p) {
+            if (!planPart(parts[p], query, bound, profiles[p], error)) {
+                return false;
+            }
+        }
+    }
+    if (described.empty()) {
+        for (const ColumnarView& part : parts) {
+            PlanPart table;
+            table.step.label = "In-memory table";
+            table.rows = static_cast<double>(rowsToScan(part, query));
+            described.push_back(std::move(table));
+        }
+    }
+
+    const PlanStep aggregate = aggregateStep(query, parts.size());
+    plan.label = aggregate.label;
+    plan.note = aggregate.note;
+    plan.estimatedRows = 0;
+    long long matched = 0;
+    for (std::size_t p = 0; p < parts.size(); ++p) {
+        describeScan(parts[p], query, profiles[p], described[p]);
+        if (mode == PlanMode::Analyze && !profiles[p].ran) {
+            described[p].step.note = "not reached: enough rows had matched";
+        }
+        plan.estimatedRows += described[p].step.estimatedRows;
+        matched += profiles[p].rowsMatched;
+        plan.children.push_back(std::move(described[p].step));
+    }
+    if (query.kind == QueryKind::Rows) {
+        plan.estimatedRows = std::min(plan.estimatedRows, static_cast<double>(query.limit));
+        matched = std::min(matched, static_cast<long long>(query.limit));
+    }
+    if (mode == PlanMode::Analyze) {
+        plan.actualRows = matched;
+        plan.milliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+    return true;
+}
+
+// --- Recent-Result Cache ---
+// The table never changes while the REPL runs, so a result stays valid forever;
+// the cache only has to bound how many are kept (least recently used go first).
+class QueryCache {
+public:
+    explicit QueryCache(std::size_t capacity) : capacity_(capacity) {}
+
+    const std::string* find(const std::string& key) {
+        auto found = entries_.find(key);
+        if (found == entries_.end()) {
+            return nullptr;
+        }
+        order_.splice(order_.begin(), order_, found->second.position);
+        return &found->second.result;
+    }
+
+    void insert(const std::string& key, std::string result) {
+        if (capacity_ == 0 || entries_.count(key) != 0) {
+            return;
+        }
+        if (entries_.size() >= capacity_) {
+            entries_.erase(order_.back());
+            order_.pop_back();
+        }
+        order_.push_front(key);
+        entries_.emplace(key, Entry{ std::move(result), order_.begin() });
+    }
+
+private:
+    struct Entry {
+        std::string result;
+        std::list<std::string>::iterator position;
+    };
+
+    std::size_t capacity_;
+    std::list<std::string> order_; // Front = most recently used.
+    std::unordered_map<std::string, Entry> entries_;
+};
+
+// Collapses runs of whitespace so "count  by user" and "count by user" share a cache entry.
+inline std::string normalizeQuery(std::string_view text) {
+    std::istringstream stream{ std::string(text) };
+    std::string normalized;
+    for (std::string token; stream >> token;) {
+        if (!normalized.empty()) {
+            normalized.push_back(' ');
+        }
+        normalized += token;
+    }
+    return normalized;
+}
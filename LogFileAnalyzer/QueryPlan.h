@@ -0,0 +1,71 @@
+/**
+ * @file QueryPlan.h
+ * @brief The plan of a query as --explain and --analyze print it.
+ *
+ * @details A plan is a tree of steps. A step names one operator: a scan, a
+ * seek, a filter or an aggregate. It also says why the planner chose it, and
+ * how many rows the planner expects it to produce. With --analyze the query
+ * also runs, and each step gets the rows it actually produced and the time
+ * it took. The children of a step are the steps that feed it.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <iomanip>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct PlanStep {
+    std::string label;
+    std::string note;          // Why this step, e.g. the costs it was chosen by.
+    double estimatedRows = -1; // Negative if the planner has no estimate.
+    long long actualRows = -1; // Set once the query has run (--analyze).
+    double milliseconds = -1;  // Likewise.
+    std::vector<PlanStep> children;
+
+    PlanStep& add(std::string childLabel, double estimate = -1) {
+        children.emplace_back();
+        children.back().label = std::move(childLabel);
+        children.back().estimatedRows = estimate;
+        return children.back();
+    }
+};
+
+// Writes 'step' and its children, one per line, indented by depth:
+//
+//     Filter latency>200  (est 33,412 rows; actual 30,977 rows, 0.41 ms)
+inline void writePlan(std::ostream& out, const PlanStep& step, int depth = 0) {
+    const auto rows = [&](double count) {
+        std::string digits = std::to_string(std::llround(count));
+        for (std::size_t i = digits.size(); i > 3; i -= 3) {
+            digits.insert(i - 3, 1, ',');
+        }
+        out << digits << (std::llround(count) == 1 ? " row" : " rows");
+    };
+    out << std::string(2 * static_cast<std::size_t>(depth), ' ') << step.label;
+    if (step.estimatedRows >= 0 || step.actualRows >= 0) {
+        out << "  (";
+        if (step.estimatedRows >= 0) {
+            out << "est ";
+            rows(step.estimatedRows);
+        }
+        if (step.actualRows >= 0) {
+            out << (step.estimatedRows >= 0 ? "; actual " : "actual ");
+            rows(static_cast<double>(step.actualRows));
+            if (step.milliseconds >= 0) {
+                out << ", " << std::fixed << std::setprecision(2) << step.milliseconds << " ms" << std::defaultfloat;
+            }
+        }
+        out << ')';
+    }
+    if (!step.note.empty()) {
+        out << ": " << step.note;
+    }
+    out << '\n';
+    for (const PlanStep& child : step.children) {
+        writePlan(out, child, depth + 1);
+    }
+}
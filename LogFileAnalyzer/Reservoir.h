@@ -0,0 +1,184 @@
+/**
+ * @file Reservoir.h
+ * @brief Keeping a few uniformly chosen example lines per report category.
+ *
+ * @details During the scan only the byte offset of a sampled line is stored; the
+ * line text is read back from the file when the report is printed. Sampling uses
+ * Li's "Algorithm L": once a reservoir is full it precomputes how many items to
+ * skip before the next replacement, so the common case on the hot path is a
+ * single counter comparison rather than one random number per line.
+ *
+ * Reservoirs built by different worker threads are combined with a weighted
+ * merge, so the final sample is still uniform over all lines of the category.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using SampleRng = std::mt19937_64;
+
+// --- One Reservoir of File Offsets ---
+class OffsetReservoir {
+public:
+    explicit OffsetReservoir(std::size_t capacity = 0) : capacity_(capacity) {}
+
+    // Offers the line at 'offset'. Amortized O(1), and usually just a comparison.
+    void offer(std::uint64_t offset, SampleRng& rng) {
+        ++seen_;
+        if (samples_.size() < capacity_) {
+            samples_.push_back(offset);
+            if (samples_.size() == capacity_) {
+                w_ = std::exp(std::log(uniform(rng)) / static_cast<double>(capacity_));
+                scheduleNext(rng);
+            }
+            return;
+        }
+        if (seen_ == nextReplacement_) {
+            std::uniform_int_distribution<std::size_t> slot(0, capacity_ - 1);
+            samples_[slot(rng)] = offset;
+            w_ *= std::exp(std::log(uniform(rng)) / static_cast<double>(capacity_));
+            scheduleNext(rng);
+        }
+    }
+
+    // Folds 'other' into this reservoir. Each output slot is drawn from one side
+    // with probability proportional to how many lines that side still stands
+    // for, which is what a single reservoir over both inputs would have produced.
+    void merge(const OffsetReservoir& other, SampleRng& rng) {
+        if (other.seen_ == 0) {
+            return;
+        }
+        std::vector<std::uint64_t> mine = samples_;
+        std::vector<std::uint64_t> theirs = other.samples_;
+        // Reservoir contents are uniform subsets, so after shuffling any prefix
+        // of them is a uniform subset too.
+        std::shuffle(mine.begin(), mine.end(), rng);
+        std::shuffle(theirs.begin(), theirs.end(), rng);
+
+        std::uint64_t populationMine = seen_;
+        std::uint64_t populationTheirs = other.seen_;
+        std::size_t takeMine = 0;
+        std::size_t takeTheirs = 0;
+        const std::size_t capacity = std::max(capacity_, other.capacity_);
+        const std::uint64_t total = seen_ + other.seen_;
+
+        for (std::size_t i = 0; i < capacity && i < total; ++i) {
+            std::uniform_int_distribution<std::uint64_t> pick(0, populationMine + populationTheirs - 1);
+            if (pick(rng) < populationMine) {
+                ++takeMine;
+                --populationMine;
+            }
+            else {
+                ++takeTheirs;
+                --populationTheirs;
+            }
+        }
+
+        samples_.assign(mine.begin(), mine.begin() + takeMine);
+        samples_.insert(samples_.end(), theirs.begin(), theirs.begin() + takeTheirs);
+        capacity_ = capacity;
+        seen_ = total;
+        // The skip schedule described the old stream; start a fresh one.
+        if (samples_.size() == capacity_ && capacity_ > 0) {
+            w_ = std::exp(std::log(uniform(rng)) / static_cast<double>(capacity_));
+            scheduleNext(rng);
+        }
+    }
+
+    const std::vector<std::uint64_t>& offsets() const { return samples_; }
+    std::uint64_t seen() const { return seen_; }
+
+private:
+    static double uniform(SampleRng& rng) {
+        // (0, 1]: log(0) would be -infinity.
+        return 1.0 - std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+    }
+
+    void scheduleNext(SampleRng& rng) {
+        const double skip = std::floor(std::log(uniform(rng)) / std::log(1.0 - w_));
+        nextReplacement_ = seen_ + 1 + (std::isfinite(skip) ? static_cast<std::uint64_t>(skip) : 0);
+    }
+
+    std::size_t capacity_;
+    std::uint64_t seen_ = 0;
+    std::uint64_t nextReplacement_ = 0;
+    double w_ = 1.0;
+    std::vector<std::uint64_t> samples_;
+};
+
+// --- Example Lines per (Action, Status) ---
+class ExampleSampler {
+public:
+    ExampleSampler(std::size_t perCategory, std::uint64_t seed)
+        : perCategory_(perCategory), rng_(seed) {}
+
+    bool enabled() const { return perCategory_ > 0; }
+
+    void offer(std::string_view action, std::string_view status, std::uint64_t offset) {
+        auto byAction = reservoirs_.find(action);
+        if (byAction == reservoirs_.end()) {
+            byAction = reservoirs_.emplace(std::string(action), StatusReservoirs()).first;
+        }
+        auto byStatus = byAction->second.find(status);
+        if (byStatus == byAction->second.end()) {
+            byStatus = byAction->second.emplace(std::string(status), OffsetReservoir(perCategory_)).first;
+        }
+        byStatus->second.offer(offset, rng_);
+    }
+
+    void merge(const ExampleSampler& other) {
+        for (const auto& action : other.reservoirs_) {
+            StatusReservoirs& mine = reservoirs_[action.first];
+            for (const auto& status : action.second) {
+                auto found = mine.find(status.first);
+                if (found == mine.end()) {
+                    mine.emplace(status.first, status.second);
+                }
+                else {
+                    found->second.merge(status.second, rng_);
+                }
+            }
+        }
+    }
+
+    // Reads the sampled lines back from 'path' and prints them under their
+    // category. Offsets are visited in ascending order to keep the reads sequential.
+    void print(const std::string& path, std::ostream& out) const {
+        std::ifstream file(path, std::ios::binary);
+        out << "Example lines:\n";
+        for (const auto& action : reservoirs_) {
+            for (const auto& status : action.second) {
+                std::vector<std::uint64_t> offsets = status.second.offsets();
+                std::sort(offsets.begin(), offsets.end());
+                out << "  " << action.first << " / " << status.first << ":\n";
+                std::string line;
+                for (std::uint64_t offset : offsets) {
+                    file.clear();
+                    file.seekg(static_cast<std::streamoff>(offset));
+                    if (std::getline(file, line)) {
+                        if (!line.empty() && line.back() == '\r') {
+                            line.pop_back();
+                        }
+                        out << "    " << line << "\n";
+                    }
+                }
+            }
+        }
+    }
+
+private:
+    using StatusReservoirs = std::map<std::string, OffsetReservoir, std::less<>>;
+
+    std::size_t perCategory_;
+    SampleRng rng_;
+    std::map<std::string, StatusReservoirs, std::less<>> reservoirs_;
+};
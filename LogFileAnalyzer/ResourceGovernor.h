@@ -0,0 +1,534 @@
+/**
+ * @file ResourceGovernor.h
+ * @brief Keeping a scan within a memory, I/O and CPU budget on a shared host.
+ *
+ * @details ResourceLimits says what a run may use, and a ResourceGovernor
+ * holds a scan to it. When memory or I/O is short, the scan slows down and
+ * shrinks; it only fails when the rows it has to keep do not fit at all.
+ *  - Memory: fitWorkers() chooses how many workers run and how large each
+ *    one's read block is, so that the read buffers fit their share of the
+ *    budget. It shrinks the blocks first, down to kMinReadBlockBytes, and only
+ *    then drops workers. Anything else that grows with the data takes its
+ *    bytes from the same MemoryBudget: the partition writers spill to disk
+ *    sooner, and a columnar table stops loading once the budget is used up.
+ *  - I/O: before every read, a worker takes that many bytes from a token
+ *    bucket that refills at the allowed rate. A worker that takes more than
+ *    the bucket holds waits until the refill has paid it back, so all workers
+ *    together read no faster than the rate. A rate also caps the read block
+ *    at a quarter of a second's worth, so the reads come evenly.
+ *  - CPU: Linux reports the time during which some task was waiting for a CPU
+ *    (/proc/pressure/cpu). Once a second, one worker works out that share of
+ *    the last second. Above the limit, half of the running workers pause at
+ *    their next block. Below half the limit, one paused worker resumes.
+ *    Elsewhere nothing is reported, and workers never pause.
+ *  - Tuning (autotune()): the best block size and number of workers depend
+ *    on whether a scan waits for the disk or for the CPU. For its first
+ *    seconds, the scan tries each setting for kTuneInterval, and for at
+ *    least four blocks per running worker, and measures how many bytes the
+ *    workers get through. Block sizes come first, from
+ *    the largest down, and a smaller one must be 3% faster to win. Then the
+ *    number of running workers is halved for as long as the scan stays
+ *    within 5% of its best rate. When reading is the bottleneck, that frees
+ *    cores the scan cannot use.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// --- Limits ---
+struct ResourceLimits {
+    std::size_t memoryBytes = 0;        // --max-memory-mib; 0 means no limit.
+    std::uint64_t ioBytesPerSecond = 0; // --io-limit-mibps; 0 means reads are not paced.
+    double cpuPressurePercent = 0;      // --pressure-limit; 0 means workers never pause.
+
+    bool any() const { return memoryBytes > 0 || ioBytesPerSecond > 0 || cpuPressurePercent > 0; }
+};
+
+constexpr std::size_t kReadBlockBytes = 8u << 20;      // 8 MiB reads keep the disk streaming.
+constexpr std::size_t kMinReadBlockBytes = 256u << 10; // Below this, per-read costs start to show.
+
+// --- Memory Budget ---
+// Bytes handed out against a fixed limit, from any thread. Without a limit,
+// every reservation succeeds.
+class MemoryBudget {
+public:
+    explicit MemoryBudget(std::size_t limitBytes = 0) : limit_(limitBytes) {}
+
+    // Takes 'bytes' from the budget. Returns false, taking nothing, if that
+    // would go over the limit.
+    bool reserve(std::size_t bytes) {
+        std::size_t used = used_.load(std::memory_order_relaxed);
+        do {
+            if (limit_ > 0 && bytes > limit_ - used) {
+                return false;
+            }
+        } while (!used_.compare_exchange_weak(used, used + bytes, std::memory_order_relaxed));
+        return true;
+    }
+
+    void release(std::size_t bytes) { used_.fetch_sub(bytes, std::memory_order_relaxed); }
+
+    std::size_t limit() const { return limit_; }
+    std::size_t used() const { return used_.load(std::memory_order_relaxed); }
+    // Bytes still free; the largest size_t if there is no limit.
+    std::size_t available() const {
+        const std::size_t used = this->used();
+        return limit_ == 0 ? static_cast<std::size_t>(-1) : (used < limit_ ? limit_ - used : 0);
+    }
+
+private:
+    std::size_t limit_;
+    std::atomic<std::size_t> used_{ 0 };
+};
+
+// --- Token Bucket ---
+class IoPacer {
+public:
+    explicit IoPacer(std::uint64_t bytesPerSecond = 0)
+        : rate_(static_cast<double>(bytesPerSecond)), tokens_(rate_ / 4), last_(Clock::now()) {}
+
+    // Waits until 'bytes' more may be read. Returns the seconds waited.
+    double acquire(std::size_t bytes) {
+        if (rate_ == 0) {
+            return 0;
+        }
+        double wait = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            const Clock::time_point now = Clock::now();
+            tokens_ = std::min(rate_ / 4, tokens_ + std::chrono::duration<double>(now - last_).count() * rate_);
+            last_ = now;
+            tokens_ -= static_cast<double>(bytes);
+            if (tokens_ < 0) {
+                wait = -tokens_ / rate_;
+            }
+        }
+        if (wait > 0) {
+            std::this_thread::sleep_for(std::chrono::duration<double>(wait));
+        }
+        return wait;
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+    double rate_;   // Bytes per second.
+    double tokens_; // Bytes that may be read now; negative while in debt.
+    Clock::time_point last_;
+    std::mutex mutex_;
+};
+
+// Microseconds during which some task has waited for a CPU since boot, from
+// the "some" line of /proc/pressure/cpu. Returns false where the kernel does
+// not report it.
+inline bool readCpuStallMicros(std::uint64_t& micros) {
+    std::ifstream file("/proc/pressure/cpu");
+    std::string kind;
+    std::string field;
+    while (file >> kind) {
+        while (file.peek() != '\n' && file >> field) {
+            if (kind == "some" && field.rfind("total=", 0) == 0) {
+                micros = std::stoull(field.substr(6));
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// --- The Governor ---
+class ResourceGovernor {
+public:
+    static constexpr std::chrono::milliseconds kTuneInterval{ 250 };
+
+    explicit ResourceGovernor(const ResourceLimits& limits = ResourceLimits())
+        : limits_(limits), memory_(limits.memoryBytes), pacer_(limits.ioBytesPerSecond) {
+        if (limits_.cpuPressurePercent > 0) {
+            std::uint64_t micros = 0;
+            watchPressure_ = readCpuStallMicros(micros);
+            stallMicros_ = micros;
+            sampledAt_ = Clock::now();
+        }
+    }
+
+    ResourceGovernor(const ResourceGovernor&) = delete;
+    ResourceGovernor& operator=(const ResourceGovernor&) = delete;
+
+    const ResourceLimits& limits() const { return limits_; }
+    MemoryBudget& memory() { return memory_; }
+
+    // Chooses how many of 'requested' workers run and how large a block each
+    // reads, so that their read buffers fit in 'memoryShare' of the budget,
+    // and reserves those buffers. Returns the number of workers.
+    std::size_t fitWorkers(std::size_t requested, double memoryShare = 1.0) {
+        requested_ = std::max<std::size_t>(1, requested);
+        workers_ = requested_;
+        std::size_t blockBytes = kReadBlockBytes;
+        if (limits_.ioBytesPerSecond > 0) {
+            blockBytes = static_cast<std::size_t>(std::min<std::uint64_t>(
+                blockBytes, std::max<std::uint64_t>(kMinReadBlockBytes, limits_.ioBytesPerSecond / 4)));
+        }
+        if (limits_.memoryBytes > 0) {
+            const std::size_t share = static_cast<std::size_t>(static_cast<double>(limits_.memoryBytes) * memoryShare);
+            if (share / workers_ >= kMinReadBlockBytes) {
+                blockBytes = std::min(blockBytes, share / workers_ / 1024 * 1024);
+            }
+            else {
+                workers_ = std::max<std::size_t>(1, share / kMinReadBlockBytes);
+                blockBytes = kMinReadBlockBytes;
+            }
+            // One block is needed whatever the budget; the rest of the run
+            // then has to make do with what is left.
+            readReserved_ = std::min(workers_ * blockBytes, memory_.available());
+            memory_.reserve(readReserved_);
+        }
+        blockBytes_ = blockBytes;
+        allowed_ = pressureAllowed_ = tunedAllowed_ = workers_;
+        return workers_;
+    }
+
+    // The size of the next read. It only changes while the scan is tuned.
+    std::size_t blockBytes() const { return blockBytes_.load(std::memory_order_relaxed); }
+
+    // Gives the read buffers' share of the budget back once every worker has
+    // finished reading.
+    void releaseReadBuffers() {
+        memory_.release(readReserved_);
+        readReserved_ = 0;
+    }
+
+    // Times the reads and the work between them from now on (see statistics()).
+    void measureStages() { measuring_ = true; }
+
+    // Tunes the block size and the number of running workers from now on.
+    // Call after fitWorkers(); the tuned values never exceed what it chose.
+    void autotune() {
+        measuring_ = true;
+        tuning_ = true;
+        phase_ = TunePhase::Warmup;
+        for (std::size_t bytes = blockBytes_; bytes >= kMinReadBlockBytes; bytes /= 4) {
+            blockCandidates_.push_back(bytes);
+        }
+        intervalStart_ = Clock::now();
+    }
+
+    // A worker holds a place among the running ones from its first read to
+    // its last, so that pressure or tuning can take the place away between reads.
+    class Worker {
+    public:
+        explicit Worker(ResourceGovernor* governor) : governor_(governor) {
+            if (governor_ != nullptr) {
+                governor_->enter();
+            }
+        }
+        ~Worker() {
+            if (governor_ != nullptr) {
+                governor_->leave();
+            }
+        }
+        Worker(const Worker&) = delete;
+        Worker& operator=(const Worker&) = delete;
+
+    private:
+        ResourceGovernor* governor_;
+    };
+
+    // Called by a worker before it reads 'bytes' bytes. Pauses it under CPU
+    // pressure or while tuning, and paces it to the I/O limit. Returns false
+    // once the scan is cancelled, and the worker should stop.
+    // Time spent paused is neither reading nor work; waiting for the I/O
+    // limit counts as reading.
+    bool beforeRead(std::size_t bytes) {
+        StageMarks& marks = stageMarks();
+        if (measuring_ && marks.readEnd != Clock::time_point()) {
+            workNanos_.fetch_add(nanosBetween(marks.readEnd, Clock::now()), std::memory_order_relaxed);
+            marks.readEnd = Clock::time_point();
+        }
+        if (watchPressure_ || tuning_) {
+            yieldIfAsked();
+        }
+        if (measuring_) {
+            marks.readStart = Clock::now();
+        }
+        const double waited = pacer_.acquire(bytes);
+        if (waited > 0) {
+            ioWaitMicros_.fetch_add(static_cast<long long>(waited * 1e6), std::memory_order_relaxed);
+        }
+        return !cancelled_.load(std::memory_order_relaxed);
+    }
+
+    // Called by a worker once a read of 'bytes' bytes has returned.
+    void afterRead(std::size_t bytes) {
+        if (measuring_) {
+            StageMarks& marks = stageMarks();
+            marks.readEnd = Clock::now();
+            readNanos_.fetch_add(nanosBetween(marks.readStart, marks.readEnd), std::memory_order_relaxed);
+            bytesRead_.fetch_add(bytes, std::memory_order_relaxed);
+        }
+    }
+
+    // Stops every worker at its next read, e.g. when the memory budget is
+    // used up. 'reason' is kept for the error message.
+    void cancel(const std::string& reason) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!cancelled_.exchange(true)) {
+            cancelReason_ = reason;
+        }
+        placeFreed_.notify_all();
+    }
+    bool cancelled() const { return cancelled_.load(); }
+    std::string cancelReason() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return cancelReason_;
+    }
+
+    // One line on what the limits did, e.g. "2 of 8 workers, 1024 KiB reads;
+    // workers waited 3.1 s in all for the I/O limit".
+    std::string summary() const {
+        std::ostringstream text;
+        text << workers_ << " of " << requested_ << " workers, " << blockBytes() / 1024 << " KiB reads"
+             << std::fixed << std::setprecision(1);
+        if (limits_.ioBytesPerSecond > 0) {
+            text << "; workers waited " << static_cast<double>(ioWaitMicros_.load()) / 1e6 << " s in all for the I/O limit";
+        }
+        if (limits_.cpuPressurePercent > 0) {
+            if (watchPressure_) {
+                text << "; workers paused " << static_cast<double>(pausedMicros_.load()) / 1e6 << " s in all under CPU pressure";
+            }
+            else {
+                text << "; CPU pressure is not reported on this system";
+            }
+        }
+        return text.str();
+    }
+
+    // What --stats prints for a scan that took 'seconds': the settings it ran
+    // with, its throughput, where the workers' time went, and how tuning went.
+    std::string statistics(double seconds) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const double megabytes = static_cast<double>(bytesRead_.load()) / 1e6;
+        const double readSeconds = static_cast<double>(readNanos_.load()) / 1e9;
+        const double workSeconds = static_cast<double>(workNanos_.load()) / 1e9;
+        std::ostringstream text;
+        text << std::fixed << std::setprecision(1);
+        const char* const how = !tuning_ ? "" : phase_ == TunePhase::Done ? " (tuned)" : " (untuned)";
+        text << "  Workers: " << (tuning_ ? tunedAllowed_ : workers_) << " of " << requested_ << how << '\n';
+        text << "  Read blocks: " << blockBytes() / 1024 << " KiB" << how << '\n';
+        text << "  Read: " << megabytes << " MB in " << std::setprecision(2) << seconds << " s, "
+             << std::setprecision(1) << (seconds > 0 ? megabytes / seconds : 0.0) << " MB/s\n";
+        text << "  Worker time: " << std::setprecision(2) << readSeconds << " s reading, " << workSeconds
+             << " s processing: "
+             << (readSeconds > workSeconds ? "I/O-bound" : "CPU-bound") << '\n';
+        if (tuning_) {
+            text << "  Tuning: " << (tuneTrace_.empty() ? "nothing measured" : tuneTrace_)
+                 << (phase_ == TunePhase::Done ? "" : "; the scan ended first") << '\n';
+        }
+        return text.str();
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+    enum class TunePhase { Warmup, Blocks, Workers, Done };
+
+    // When the calling thread's last read started and ended.
+    struct StageMarks {
+        Clock::time_point readStart;
+        Clock::time_point readEnd;
+    };
+    static StageMarks& stageMarks() {
+        thread_local StageMarks marks;
+        return marks;
+    }
+    static long long nanosBetween(Clock::time_point from, Clock::time_point to) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count();
+    }
+
+    void enter() {
+        stageMarks() = StageMarks();
+        if (!watchPressure_ && !tuning_) {
+            return;
+        }
+        std::unique_lock<std::mutex> lock(mutex_);
+        waitForPlace(lock);
+    }
+
+    void leave() {
+        StageMarks& marks = stageMarks();
+        if (measuring_ && marks.readEnd != Clock::time_point()) {
+            workNanos_.fetch_add(nanosBetween(marks.readEnd, Clock::now()), std::memory_order_relaxed);
+        }
+        if (!watchPressure_ && !tuning_) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        --running_;
+        ++finished_;
+        placeFreed_.notify_all();
+    }
+
+    // Blocks until fewer than 'allowed_' workers run, then runs.
+    void waitForPlace(std::unique_lock<std::mutex>& lock) {
+        if (running_ >= allowed_) {
+            const Clock::time_point start = Clock::now();
+            placeFreed_.wait(lock, [&]() { return running_ < allowed_ || cancelled_.load(); });
+            pausedMicros_.fetch_add(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count(),
+                                    std::memory_order_relaxed);
+        }
+        ++running_;
+    }
+
+    void setAllowed() {
+        const std::size_t allowed = std::min(pressureAllowed_, tunedAllowed_);
+        if (allowed > allowed_) {
+            placeFreed_.notify_all();
+        }
+        allowed_ = allowed;
+    }
+
+    void yieldIfAsked() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        const Clock::time_point now = Clock::now();
+        if (watchPressure_ && now - sampledAt_ >= std::chrono::seconds(1)) {
+            samplePressure(now);
+        }
+        if (tuning_ && phase_ != TunePhase::Done && now - intervalStart_ >= kTuneInterval &&
+            bytesRead_.load() - intervalBytes_ >= 4 * allowed_ * blockBytes()) {
+            tuneStep(now);
+        }
+        if (running_ > allowed_) {
+            --running_;
+            waitForPlace(lock);
+        }
+    }
+
+    void samplePressure(Clock::time_point now) {
+        std::uint64_t micros = 0;
+        if (readCpuStallMicros(micros)) {
+            const double elapsed = static_cast<double>(
+                std::chrono::duration_cast<std::chrono::microseconds>(now - sampledAt_).count());
+            const double percent = static_cast<double>(micros - stallMicros_) * 100.0 / elapsed;
+            if (percent > limits_.cpuPressurePercent) {
+                pressureAllowed_ = std::max<std::size_t>(1, pressureAllowed_ / 2);
+            }
+            else if (percent < limits_.cpuPressurePercent / 2 && pressureAllowed_ < workers_) {
+                ++pressureAllowed_;
+            }
+            setAllowed();
+            stallMicros_ = micros;
+        }
+        sampledAt_ = now;
+    }
+
+    // Ends one tuning interval: scores the setting it ran with and moves on
+    // to the next one to try.
+    void tuneStep(Clock::time_point now) {
+        const std::uint64_t bytes = bytesRead_.load();
+        const double rate = static_cast<double>(bytes - intervalBytes_) / 1e6 /
+                            std::chrono::duration<double>(now - intervalStart_).count();
+        std::ostringstream trace;
+        trace << std::fixed << std::setprecision(0);
+        if (finished_ > 0 && phase_ != TunePhase::Warmup) {
+            // A worker ran out of input, so the rate no longer reflects the setting.
+            tunedAllowed_ = bestWorkers_;
+            blockBytes_ = bestBlock_;
+            phase_ = TunePhase::Done;
+        }
+        else if (phase_ == TunePhase::Warmup) {
+            phase_ = TunePhase::Blocks;
+            candidate_ = 0;
+            bestBlock_ = blockCandidates_.front();
+            bestWorkers_ = workers_;
+        }
+        else if (phase_ == TunePhase::Blocks) {
+            const std::size_t tried = blockCandidates_[candidate_];
+            trace << tried / 1024 << " KiB " << rate << " MB/s";
+            if (candidate_ == 0 || rate > bestRate_ * 1.03) {
+                bestRate_ = rate;
+                bestBlock_ = tried;
+            }
+            if (++candidate_ < blockCandidates_.size()) {
+                blockBytes_ = blockCandidates_[candidate_];
+            }
+            else {
+                blockBytes_ = bestBlock_;
+                phase_ = workers_ > 1 ? TunePhase::Workers : TunePhase::Done;
+                tunedAllowed_ = workers_ > 1 ? workers_ / 2 : 1;
+            }
+        }
+        else if (phase_ == TunePhase::Workers) {
+            trace << tunedAllowed_ << (tunedAllowed_ == 1 ? " worker " : " workers ") << rate << " MB/s";
+            if (rate >= bestRate_ * 0.95) {
+                bestRate_ = std::max(bestRate_, rate);
+                bestWorkers_ = tunedAllowed_;
+            }
+            if (bestWorkers_ == tunedAllowed_ && tunedAllowed_ > 1) {
+                tunedAllowed_ /= 2;
+            }
+            else {
+                tunedAllowed_ = bestWorkers_;
+                phase_ = TunePhase::Done;
+            }
+        }
+        setAllowed();
+        if (!trace.str().empty()) {
+            tuneTrace_ += (tuneTrace_.empty() ? "" : ", ") + trace.str();
+        }
+        intervalStart_ = now;
+        intervalBytes_ = bytes;
+    }
+
+    ResourceLimits limits_;
+    MemoryBudget memory_;
+    IoPacer pacer_;
+    std::size_t requested_ = 1;
+    std::size_t workers_ = 1;
+    std::atomic<std::size_t> blockBytes_{ kReadBlockBytes };
+    std::size_t readReserved_ = 0;
+
+    // Which workers may run; guarded by 'mutex_'.
+    mutable std::mutex mutex_;
+    std::condition_variable placeFreed_;
+    bool watchPressure_ = false;
+    std::size_t allowed_ = 1;         // The lower of the two below.
+    std::size_t pressureAllowed_ = 1;
+    std::size_t tunedAllowed_ = 1;
+    std::size_t running_ = 0;
+    std::size_t finished_ = 0;
+    std::uint64_t stallMicros_ = 0;
+    Clock::time_point sampledAt_;
+
+    // Tuning; guarded by 'mutex_' once the workers have started.
+    bool tuning_ = false;
+    TunePhase phase_ = TunePhase::Done;
+    std::vector<std::size_t> blockCandidates_; // Largest first.
+    std::size_t candidate_ = 0;
+    Clock::time_point intervalStart_;
+    std::uint64_t intervalBytes_ = 0;
+    double bestRate_ = 0; // MB/s.
+    std::size_t bestBlock_ = 0;
+    std::size_t bestWorkers_ = 1;
+    std::string tuneTrace_;
+
+    // Stage times, summed over the workers.
+    bool measuring_ = false;
+    std::atomic<long long> readNanos_{ 0 };
+    std::atomic<long long> workNanos_{ 0 };
+    std::atomic<std::uint64_t> bytesRead_{ 0 };
+
+    std::atomic<bool> cancelled_{ false };
+    std::string cancelReason_;
+    std::atomic<long long> ioWaitMicros_{ 0 };
+    std::atomic<long long> pausedMicros_{ 0 };
+};
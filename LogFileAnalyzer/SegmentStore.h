@@ -0,0 +1,1442 @@
+/**
+ * @file SegmentStore.h
+ * @brief Durable storage of the daemon's parsed rows, queryable later (--store).
+ *
+ * @details A store is a directory:
+ *
+ *     MANIFEST                    which of the files below make up the store
+ *     wal-<id>.log                the write-ahead log of the active segment
+ *     <partition>/seg-<id>.lseg   immutable columnar segments
+ *
+ * New rows go to the active segment, an in-memory ColumnarTable, and to the
+ * write-ahead log (WAL). commit() writes the batch's WAL entries and syncs them
+ * to disk, so the daemon pays for one sync per batch of input, not per row.
+ * Once the active segment holds StoreConfig::sealRows rows it is sealed: its
+ * rows are sorted by time and written as one segment per time partition (a day
+ * by default, named by the partition's first second), and a fresh WAL is
+ * started.
+ *
+ * The MANIFEST is only ever replaced by renaming a new one over it, and that
+ * rename is what commits a change. A crash at any point leaves either the old
+ * set of files or the new one; files the MANIFEST does not name are leftovers
+ * and are deleted the next time the store is opened.
+ *
+ * Segments never change once written. A background thread compacts them: when
+ * a partition holds StoreConfig::compactFanIn or more small segments, they are
+ * merged into one, so a query over a long time range opens fewer files.
+ *
+ * Segment files are read through a read-only memory mapping. Their integer
+ * columns are bit-packed (ColumnCodecs.h), in the host's (little-endian) byte
+ * order, and decoded only when a query reads them. The Details offsets are the
+ * exception: they are decoded one block of 128 at a time, only for the rows a
+ * query actually reads the Details of. The Details text itself is only paged
+ * in for those rows. The text and the user, action and status dictionaries
+ * follow the integer columns. A query reads the MANIFEST,
+ * maps only the segments whose time range overlaps the query's, and runs over
+ * their columns and the WAL's rows through ColumnarView.
+ *
+ * Within a segment, a query also skips blocks of rows. Each block of 1,024 rows
+ * has a Bloom filter over its users and IPs, so "user=X" or "ip=Y" reads only
+ * the blocks whose filters may hold X or Y. The first timestamp of each block
+ * of the time column bounds the blocks a time range can touch. Skipped blocks
+ * are neither decoded nor paged in.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN // Keeps windows.h from pulling in the old winsock.h.
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "BinaryIO.h"
+#include "BloomFilter.h"
+#include "ColumnCodecs.h"
+#include "ColumnarTable.h"
+#include "GzipReader.h" // updateCrc32() for the WAL entries.
+#include "Hash.h"
+#include "QueryEngine.h"
+
+struct StoreConfig {
+    long long partitionSeconds = 86400;     // Segments never span two partitions.
+    std::size_t sealRows = 65536;           // Rows in the active segment before it is sealed.
+    std::size_t compactFanIn = 4;           // Small segments in a partition that trigger a merge.
+    std::size_t compactTargetRows = 1u << 20; // Segments this large are left alone.
+};
+
+// --- Mapping a File Read-Only ---
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile() { close(); }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Maps all of 'path'. An empty file cannot be mapped and fails too.
+    bool open(const std::string& path) {
+        close();
+#ifdef _WIN32
+        // FILE_SHARE_DELETE lets the daemon delete a compacted segment while a
+        // query still has it mapped.
+        file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL, nullptr);
+        LARGE_INTEGER size;
+        if (file_ == INVALID_HANDLE_VALUE || !GetFileSizeEx(file_, &size) || size.QuadPart == 0) {
+            close();
+            return false;
+        }
+        mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        const void* view = mapping_ == nullptr ? nullptr : MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+        if (view == nullptr) {
+            close();
+            return false;
+        }
+        data_ = static_cast<const char*>(view);
+        size_ = static_cast<std::size_t>(size.QuadPart);
+        return true;
+#else
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat info;
+        void* view = MAP_FAILED;
+        if (::fstat(fd, &info) == 0 && info.st_size > 0) {
+            view = ::mmap(nullptr, static_cast<std::size_t>(info.st_size), PROT_READ, MAP_SHARED, fd, 0);
+        }
+        ::close(fd); // The mapping stays valid without the descriptor.
+        if (view == MAP_FAILED) {
+            return false;
+        }
+        data_ = static_cast<const char*>(view);
+        size_ = static_cast<std::size_t>(info.st_size);
+        return true;
+#endif
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (data_ != nullptr) {
+            UnmapViewOfFile(data_);
+        }
+        if (mapping_ != nullptr) {
+            CloseHandle(mapping_);
+        }
+        if (file_ != INVALID_HANDLE_VALUE) {
+            CloseHandle(file_);
+        }
+        mapping_ = nullptr;
+        file_ = INVALID_HANDLE_VALUE;
+#else
+        if (data_ != nullptr) {
+            ::munmap(const_cast<char*>(data_), size_);
+        }
+#endif
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+    const char* data() const { return data_; }
+    std::size_t size() const { return size_; }
+
+private:
+#ifdef _WIN32
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+    HANDLE mapping_ = nullptr;
+#endif
+    const char* data_ = nullptr;
+    std::size_t size_ = 0;
+};
+
+// --- Writing Files Durably ---
+// An append-only file whose writes can be forced to disk with sync().
+class SyncedFile {
+public:
+    SyncedFile() = default;
+    ~SyncedFile() { close(); }
+    SyncedFile(const SyncedFile&) = delete;
+    SyncedFile& operator=(const SyncedFile&) = delete;
+
+    bool open(const std::string& path) {
+        close();
+#ifdef _WIN32
+        handle_ = CreateFileA(path.c_str(), FILE_APPEND_DATA, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_ALWAYS,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+        return handle_ != INVALID_HANDLE_VALUE;
+#else
+        fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        return fd_ >= 0;
+#endif
+    }
+
+    bool write(std::string_view data) {
+        while (!data.empty()) {
+#ifdef _WIN32
+            DWORD written = 0;
+            const DWORD chunk = static_cast<DWORD>(std::min<std::size_t>(data.size(), 1u << 30));
+            if (!WriteFile(handle_, data.data(), chunk, &written, nullptr)) {
+                return false;
+            }
+#else
+            const ssize_t written = ::write(fd_, data.data(), data.size());
+            if (written <= 0) {
+                return false;
+            }
+#endif
+            data.remove_prefix(static_cast<std::size_t>(written));
+        }
+        return true;
+    }
+
+    bool sync() {
+#ifdef _WIN32
+        return FlushFileBuffers(handle_) != 0;
+#else
+        return ::fsync(fd_) == 0;
+#endif
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (handle_ != INVALID_HANDLE_VALUE) {
+            CloseHandle(handle_);
+            handle_ = INVALID_HANDLE_VALUE;
+        }
+#else
+        if (fd_ >= 0) {
+            ::close(fd_);
+            fd_ = -1;
+        }
+#endif
+    }
+
+private:
+#ifdef _WIN32
+    HANDLE handle_ = INVALID_HANDLE_VALUE;
+#else
+    int fd_ = -1;
+#endif
+};
+
+// Makes a rename or a new file in 'dir' survive a crash. Windows has no
+// equivalent, and does not need one for NTFS metadata.
+inline void syncDirectory(const std::filesystem::path& dir) {
+#ifndef _WIN32
+    const int fd = ::open(dir.string().c_str(), O_RDONLY);
+    if (fd >= 0) {
+        ::fsync(fd);
+        ::close(fd);
+    }
+#else
+    (void)dir;
+#endif
+}
+
+// Writes 'data' to 'path' through a temporary file that is synced and then
+// renamed, so 'path' never holds a partial file.
+inline bool writeFileAtomically(const std::filesystem::path& path, std::string_view data, std::string& error) {
+    const std::filesystem::path temporary = path.string() + ".tmp";
+    {
+        std::error_code ignored;
+        std::filesystem::remove(temporary, ignored);
+        SyncedFile file;
+        if (!file.open(temporary.string()) || !file.write(data) || !file.sync()) {
+            error = "could not write " + temporary.string();
+            return false;
+        }
+    }
+    std::error_code renameError;
+    std::filesystem::rename(temporary, path, renameError);
+    if (renameError) {
+        error = "could not rename " + temporary.string() + ": " + renameError.message();
+        return false;
+    }
+    syncDirectory(path.parent_path());
+    return true;
+}
+
+// --- Segment Files ---
+// A segment starts with a 512-byte header: magic, version, row count, first and
+// last timestamp, then a directory of sections (encoding, offset, size). The
+// integer columns are coded by ColumnCodecs.h; the Details text and the
+// dictionaries are stored as they are. Every section starts at an 8-byte
+// aligned offset, so a raw column can be used in place.
+//
+// The Filters section holds one Bloom filter (BloomFilter.h) per block of
+// kFilterRows rows, over the block's user codes and IPs: fixed32 rows per
+// block (a multiple of 128), fixed32 words per filter, then every block's
+// filter words in turn.
+namespace segment_file {
+constexpr std::string_view kMagic = "LSEG";
+constexpr std::uint32_t kVersion = 3;
+constexpr std::size_t kHeaderBytes = 512;
+constexpr std::size_t kFilterRows = 1024;
+
+enum Section : std::size_t { Timestamp, Ip, User, Action, Status, Latency, DetailsOffset, Arena, Dictionaries, Filters, kSections };
+
+struct SectionEntry {
+    ColumnEncoding encoding = ColumnEncoding::Raw;
+    std::uint64_t offset = 0;
+    std::uint64_t bytes = 0;
+};
+
+// The hash a user code or an IP is filed under; 'column' keeps the two apart.
+inline std::uint64_t filterKey(Section column, std::uint32_t value) {
+    return mixBits64((static_cast<std::uint64_t>(column) << 32) | value);
+}
+
+// Appends the Filters section of 'table' to 'out'. Every filter is sized for
+// the block with the most distinct keys.
+inline void appendFilters(const ColumnarTable& table, std::string& out) {
+    const std::size_t rows = table.rows();
+    const std::size_t blocks = (rows + kFilterRows - 1) / kFilterRows;
+    std::vector<std::vector<std::uint64_t>> keys(blocks);
+    std::size_t words = 1;
+    for (std::size_t b = 0; b < blocks; ++b) {
+        std::vector<std::uint64_t>& block = keys[b];
+        for (std::size_t row = b * kFilterRows; row < std::min(rows, (b + 1) * kFilterRows); ++row) {
+            block.push_back(filterKey(User, table.user[row]));
+            block.push_back(filterKey(Ip, table.ip[row]));
+        }
+        std::sort(block.begin(), block.end());
+        block.erase(std::unique(block.begin(), block.end()), block.end());
+        words = std::max(words, bloom::wordsFor(block.size()));
+    }
+    std::vector<std::uint64_t> filters(blocks * words, 0);
+    for (std::size_t b = 0; b < blocks; ++b) {
+        for (const std::uint64_t key : keys[b]) {
+            bloomInsert(filters.data() + b * words, words, key);
+        }
+    }
+    ByteWriter writer(out);
+    writer.fixed32(static_cast<std::uint32_t>(kFilterRows));
+    writer.fixed32(static_cast<std::uint32_t>(words));
+    out.append(reinterpret_cast<const char*>(filters.data()), filters.size() * 8);
+}
+} // namespace segment_file
+
+// Writes 'table' (already in time order) as a segment file.
+inline bool writeSegmentFile(const std::filesystem::path& path, const ColumnarTable& table, std::string& error) {
+    using namespace segment_file;
+    const std::size_t rows = table.rows();
+    std::string image(kHeaderBytes, '\0');
+    SectionEntry sections[kSections];
+    const auto begin = [&](Section section) {
+        image.resize((image.size() + 7) & ~std::size_t(7));
+        sections[section].offset = image.size();
+    };
+    const auto end = [&](Section section) { sections[section].bytes = image.size() - sections[section].offset; };
+    const auto column32 = [&](Section section, const void* values) {
+        begin(section);
+        sections[section].encoding = encodeColumn32(static_cast<const std::uint32_t*>(values), rows, image);
+        end(section);
+    };
+    const auto column64 = [&](Section section, const void* values, std::size_t count) {
+        begin(section);
+        sections[section].encoding = encodeColumn64(static_cast<const std::int64_t*>(values), count, image);
+        end(section);
+    };
+
+    column64(Timestamp, table.timestamp.data(), rows);
+    column32(Ip, table.ip.data());
+    column32(User, table.user.data());
+    column32(Action, table.action.data());
+    column32(Status, table.status.data());
+    column32(Latency, table.latencyMs.data());
+    column64(DetailsOffset, table.detailsOffset.data(), rows + 1);
+    begin(Arena);
+    image += table.detailsArena;
+    end(Arena);
+    begin(Dictionaries);
+    ByteWriter dictionaries(image);
+    for (const Dictionary* dictionary : { &table.users, &table.actions, &table.statuses }) {
+        dictionaries.varint(dictionary->size());
+        for (std::uint32_t code = 0; code < dictionary->size(); ++code) {
+            dictionaries.string(dictionary->value(code));
+        }
+    }
+    end(Dictionaries);
+    begin(Filters);
+    appendFilters(table, image);
+    end(Filters);
+
+    std::string header;
+    ByteWriter writer(header);
+    writer.bytes(kMagic);
+    writer.fixed32(kVersion);
+    writer.fixed64(rows);
+    writer.fixed64(static_cast<std::uint64_t>(rows > 0 ? table.timestamp.front() : 0));
+    writer.fixed64(static_cast<std::uint64_t>(rows > 0 ? table.timestamp.back() : 0));
+    for (const SectionEntry& section : sections) {
+        writer.fixed32(static_cast<std::uint32_t>(section.encoding));
+        writer.fixed32(0);
+        writer.fixed64(section.offset);
+        writer.fixed64(section.bytes);
+    }
+    image.replace(0, header.size(), header);
+    return writeFileAtomically(path, image, error);
+}
+
+// A segment file mapped read-only. Raw columns are used in place. Encoded
+// columns are decoded the first time a view asks for them, so a query only
+// pays for the columns it reads. The dictionaries are copied out at open, so
+// predicates can look values up by hash.
+// A segment's Details, found through offsets that are decoded a block at a
+// time for just the rows asked for.
+class SegmentDetails : public DetailsSource {
+public:
+    void open(std::string_view offsets, std::size_t rows, std::string_view arena) {
+        offsets_.open(offsets, rows + 1);
+        arena_ = arena;
+    }
+
+    std::string_view details(std::size_t row) const override {
+        const std::uint64_t begin = static_cast<std::uint64_t>(offsets_.at(row));
+        const std::uint64_t end = static_cast<std::uint64_t>(offsets_.at(row + 1));
+        if (begin > end || end > arena_.size()) {
+            return std::string_view(); // Corrupt offsets; the file has no checksum to catch them earlier.
+        }
+        return arena_.substr(static_cast<std::size_t>(begin), static_cast<std::size_t>(end - begin));
+    }
+
+private:
+    DeltaColumnReader offsets_;
+    std::string_view arena_;
+};
+
+class Segment {
+public:
+    bool open(const std::string& path, std::string& error) {
+        using namespace segment_file;
+        if (!file_.open(path)) {
+            error = "could not map " + path;
+            return false;
+        }
+        const std::string_view data(file_.data(), file_.size());
+        ByteReader header(data);
+        std::string_view magic;
+        std::uint32_t version = 0;
+        std::uint64_t rows = 0;
+        std::uint64_t minTs = 0;
+        std::uint64_t maxTs = 0;
+        bool ok = header.bytes(4, magic) && magic == kMagic && header.fixed32(version) && version == kVersion &&
+                  data.size() >= kHeaderBytes && header.fixed64(rows) &&
+                  header.fixed64(minTs) && header.fixed64(maxTs) && rows < (std::uint64_t(1) << 32);
+        for (std::size_t s = 0; ok && s < kSections; ++s) {
+            std::uint32_t encoding = 0;
+            std::uint32_t reserved = 0;
+            ok = header.fixed32(encoding) && header.fixed32(reserved) && header.fixed64(sections_[s].offset) &&
+                 header.fixed64(sections_[s].bytes) && encoding <= static_cast<std::uint32_t>(ColumnEncoding::DeltaBitPacked) &&
+                 sections_[s].offset % 8 == 0 && sections_[s].offset <= data.size() &&
+                 sections_[s].bytes <= data.size() - sections_[s].offset;
+            sections_[s].encoding = static_cast<ColumnEncoding>(encoding);
+        }
+        rows_ = static_cast<std::size_t>(rows);
+        for (std::size_t s = 0; ok && s < Arena; ++s) {
+            const std::size_t count = s == DetailsOffset ? rows_ + 1 : rows_;
+            const std::size_t width = (s == Timestamp || s == DetailsOffset) ? 8 : 4;
+            switch (sections_[s].encoding) {
+            case ColumnEncoding::Raw: ok = sections_[s].bytes == count * width; break;
+            case ColumnEncoding::ForBitPacked: ok = width == 4 && validForBitPacked(section(s), count); break;
+            case ColumnEncoding::DeltaBitPacked: ok = width == 8 && validDeltaBitPacked(section(s), count); break;
+            }
+        }
+        if (ok) {
+            ByteReader filters(section(Filters));
+            std::uint32_t blockRows = 0;
+            std::uint32_t words = 0;
+            ok = filters.fixed32(blockRows) && filters.fixed32(words) && blockRows > 0 && blockRows % column_codec::kBlockValues == 0 &&
+                 words > 0 && filters.remaining() == (rows_ + blockRows - 1) / blockRows * words * 8;
+            filterRows_ = blockRows;
+            filterWords_ = words;
+        }
+        if (!ok) {
+            error = path + " is not a version " + std::to_string(kVersion) + " segment file";
+            return false;
+        }
+
+        ByteReader dictionaries(section(Dictionaries));
+        for (Dictionary* dictionary : { &users_, &actions_, &statuses_ }) {
+            std::uint64_t count = 0;
+            if (!dictionaries.varint(count)) {
+                error = path + ": corrupt dictionary";
+                return false;
+            }
+            for (std::uint64_t i = 0; i < count; ++i) {
+                std::string_view value;
+                if (!dictionaries.string(value)) {
+                    error = path + ": corrupt dictionary";
+                    return false;
+                }
+                dictionary->intern(value);
+            }
+        }
+
+        view_.rows = rows_;
+        view_.detailsArena = section(Arena).data();
+        view_.users = &users_;
+        view_.actions = &actions_;
+        view_.statuses = &statuses_;
+        view_.sortedByTime = true;
+        view_.hasTimeRange = rows_ > 0;
+        view_.minTimestamp = static_cast<std::int64_t>(minTs);
+        view_.maxTimestamp = static_cast<std::int64_t>(maxTs);
+        // Filters are sized for the block with the most distinct keys. Taking
+        // every block to hold that many, and its IPs to be new, bounds the
+        // segment's distinct IPs from above.
+        const std::size_t keysPerBlock = filterWords_ * 64 / bloom::kBitsPerKey;
+        const std::size_t usersPerBlock = std::min(users_.size(), filterRows_);
+        const std::size_t ipsPerBlock = keysPerBlock > usersPerBlock ? keysPerBlock - usersPerBlock : 1;
+        view_.distinctIps = std::min(rows_, ipsPerBlock * ((rows_ + filterRows_ - 1) / filterRows_));
+        return true;
+    }
+
+    // How a query reads this segment, as plan() chose it. Costs are bytes read.
+    struct Plan {
+        std::size_t begin = 0; // The rows the time column's blocks leave: [begin, end).
+        std::size_t end = 0;
+        bool timeBounded = false;
+        std::string nothing; // A predicate that matches no row of the segment, if any.
+        std::vector<std::vector<std::uint64_t>> required; // Per user or IP predicate, the keys a block needs one of.
+        std::vector<std::string> filtered;                // Those predicates' text.
+        std::vector<double> shares; // Per predicate in query.where, the share of blocks its keys' filters pass.
+        double share = 1;       // Estimated share of [begin, end) in blocks whose filters pass.
+        double scanBytes = 0;   // Reading the query's columns for every row of [begin, end).
+        double seekBytes = 0;   // Probing the filters, then reading the blocks that pass.
+        bool useFilters = false;
+    };
+
+    // Plans how 'query' reads the segment. The time range is narrowed with the
+    // first timestamp of each block of the time column. Then the Bloom filters
+    // are probed only if that is expected to read fewer bytes than scanning the
+    // range: they pay off for a rare user or IP, not for one in every block.
+    // A user is assumed to turn up in a block as often as an even share of the
+    // rows would. Returns false if a predicate's value is malformed.
+    bool plan(const Query& query, std::string& error) {
+        using namespace segment_file;
+        using Kind = BoundPredicate::Kind;
+        plan_ = Plan();
+        long long first = 0;
+        long long last = 0;
+        queryTimeBounds(query, first, last);
+        plan_.end = rows_;
+        plan_.timeBounded = first != LLONG_MIN || last != LLONG_MAX;
+        timeRows(first, last, plan_.begin, plan_.end);
+
+        const std::size_t blockRows = filterRows_;
+        plan_.shares.assign(query.where.size(), 1.0);
+        for (std::size_t p = 0; p < query.where.size(); ++p) {
+            const Predicate& predicate = query.where[p];
+            BoundPredicate bound;
+            if (!bindPredicate(view_, predicate, bound, error)) {
+                return false;
+            }
+            if (bound.kind == Kind::Nothing) {
+                plan_.nothing = predicateText(predicate); // E.g. a user this segment has never seen.
+                return true;
+            }
+            const Section column = predicate.column == Column::User ? User : Ip;
+            std::vector<std::uint64_t> keys;
+            if ((predicate.column == Column::User || predicate.column == Column::Ip) && bound.kind == Kind::Range32 && !bound.negate) {
+                keys.push_back(filterKey(column, static_cast<std::uint32_t>(bound.low) ^ bound.flip));
+            }
+            else if (predicate.column == Column::User && bound.kind == Kind::Members) {
+                for (std::uint32_t code = 0; code < bound.members.size(); ++code) {
+                    if (bound.members[code]) {
+                        keys.push_back(filterKey(User, code));
+                    }
+                }
+            }
+            if (keys.empty()) {
+                continue;
+            }
+            const double distinct = static_cast<double>(column == User ? users_.size() : view_.distinctIps);
+            const double inBlock = distinct > 0 ? 1.0 - std::pow(1.0 - 1.0 / distinct, static_cast<double>(blockRows)) : 1.0;
+            plan_.shares[p] = std::min(1.0, static_cast<double>(keys.size()) * inBlock);
+            plan_.share *= plan_.shares[p];
+            plan_.filtered.push_back(predicateText(predicate));
+            plan_.required.push_back(std::move(keys));
+        }
+
+        // A probe reads one filter word, which costs a whole cache line.
+        const unsigned columns = queryColumns(query);
+        double bytesPerRow = 0;
+        for (std::size_t s = 0; s < Arena; ++s) {
+            if (rows_ > 0 && (columns & (1u << s)) != 0) { // Sections up to Arena are in ColumnSet order.
+                bytesPerRow += static_cast<double>(sections_[s].bytes) / static_cast<double>(rows_);
+            }
+        }
+        std::size_t keys = 0;
+        for (const std::vector<std::uint64_t>& set : plan_.required) {
+            keys += set.size();
+        }
+        const double blocks = static_cast<double>((plan_.end + blockRows - 1) / blockRows - plan_.begin / blockRows);
+        plan_.scanBytes = static_cast<double>(plan_.end - plan_.begin) * bytesPerRow;
+        plan_.seekBytes = blocks * static_cast<double>(keys * bloom::kProbes * 64) + plan_.share * plan_.scanBytes;
+        plan_.useFilters = !plan_.required.empty() && plan_.seekBytes < plan_.scanBytes;
+        return true;
+    }
+
+    // Limits the rows view() decodes, and queries over it scan, to the blocks
+    // plan() chose for 'query': the blocks of its time range and, if it chose
+    // the Bloom filters, only those whose filters may hold a user or IP that
+    // the query requires. Must come before view(). Returns false if a
+    // predicate's value is malformed.
+    bool restrictTo(const Query& query, std::string& error) {
+        using namespace segment_file;
+        if (!plan(query, error)) {
+            return false;
+        }
+        restricted_ = true;
+        candidates_.clear();
+        if (!plan_.nothing.empty() || plan_.begin == plan_.end) {
+            return true;
+        }
+        if (!plan_.useFilters) {
+            candidates_.emplace_back(plan_.begin, plan_.end);
+            return true;
+        }
+        const auto* filters = reinterpret_cast<const std::uint64_t*>(section(Filters).data() + 8);
+        for (std::size_t row = plan_.begin; row < plan_.end;) {
+            const std::size_t block = row / filterRows_;
+            const std::size_t blockEnd = std::min(plan_.end, (block + 1) * filterRows_);
+            const std::uint64_t* filter = filters + block * filterWords_;
+            bool possible = true;
+            for (const std::vector<std::uint64_t>& keys : plan_.required) {
+                possible = possible && std::any_of(keys.begin(), keys.end(), [&](std::uint64_t key) {
+                    return bloomMayContain(filter, filterWords_, key);
+                });
+            }
+            if (possible && !candidates_.empty() && candidates_.back().second == row) {
+                candidates_.back().second = blockEnd;
+            }
+            else if (possible) {
+                candidates_.emplace_back(row, blockEnd);
+            }
+            row = blockEnd;
+        }
+        return true;
+    }
+
+    // The rows plan() expects a scan to read.
+    double estimatedRows() const {
+        if (!plan_.nothing.empty()) {
+            return 0;
+        }
+        return static_cast<double>(plan_.end - plan_.begin) * (plan_.useFilters ? plan_.share : 1.0);
+    }
+
+    // Per predicate in query.where, the share of rows plan()'s block skipping
+    // is expected to keep for it (see PlanPart::kept).
+    std::vector<double> keptShares() const {
+        return plan_.useFilters ? plan_.shares : std::vector<double>();
+    }
+
+    // Adds the steps plan() chose to pick this segment's rows to 'part'. After
+    // restrictTo(), the Bloom filter step also shows the rows it left.
+    void describe(PlanStep& part) const {
+        const auto kib = [](double bytes) { return std::to_string(std::llround(bytes / 1024)) + " KiB"; };
+        if (!plan_.nothing.empty()) {
+            part.note = "skipped, " + plan_.nothing + " matches no row of it";
+            return;
+        }
+        if (plan_.timeBounded) {
+            PlanStep& zones = part.add("Zone maps: the blocks of the time range", static_cast<double>(plan_.end - plan_.begin));
+            zones.note = "from the first timestamp of each block";
+        }
+        if (plan_.required.empty()) {
+            return;
+        }
+        std::string predicates;
+        for (const std::string& text : plan_.filtered) {
+            predicates += (predicates.empty() ? "" : " and ") + text;
+        }
+        PlanStep& seek = part.add(std::string(plan_.useFilters ? "Bloom filter seek" : "Bloom filters not used") + " for " + predicates,
+                                  plan_.useFilters ? estimatedRows() : -1);
+        seek.note = "a seek reads about " + kib(plan_.seekBytes) + ", a scan " + kib(plan_.scanBytes);
+        if (restricted_ && plan_.useFilters) {
+            seek.actualRows = static_cast<long long>(candidateRows());
+        }
+    }
+
+    // Rows a view decodes: all of them, or those left by restrictTo().
+    std::size_t candidateRows() const {
+        if (!restricted_) {
+            return rows_;
+        }
+        std::size_t total = 0;
+        for (const auto& range : candidates_) {
+            total += range.second - range.first;
+        }
+        return total;
+    }
+
+    std::size_t rows() const { return rows_; }
+
+    // The segment's columns; those not in 'columns' (a ColumnSet) may be null.
+    // After restrictTo(), only the rows in view().rowRanges hold values.
+    const ColumnarView& view(unsigned columns = kAllColumns) {
+        using namespace segment_file;
+        const unsigned wanted = columns & ~decoded_;
+        if (wanted & kColumnTimestamp) view_.timestamp = column64(Timestamp, timestamps_, rows_);
+        if (wanted & kColumnIp) view_.ip = column32(Ip, ips_);
+        if (wanted & kColumnUser) view_.user = column32(User, users32_);
+        if (wanted & kColumnAction) view_.action = column32(Action, actions32_);
+        if (wanted & kColumnStatus) view_.status = column32(Status, statuses32_);
+        if (wanted & kColumnLatency) view_.latencyMs = reinterpret_cast<const std::int32_t*>(column32(Latency, latencies_));
+        if ((wanted & kColumnDetails) && sections_[DetailsOffset].encoding == ColumnEncoding::Raw) {
+            view_.detailsOffset = reinterpret_cast<const std::uint64_t*>(section(DetailsOffset).data());
+        }
+        else if (wanted & kColumnDetails) {
+            details_.open(section(DetailsOffset), rows_, section(Arena));
+            view_.detailsSource = &details_;
+        }
+        view_.rowRanges = restricted_ ? &candidates_ : nullptr;
+        decoded_ |= columns;
+        return view_;
+    }
+
+    // Bytes the segment takes on disk.
+    std::size_t fileBytes() const { return file_.size(); }
+
+private:
+    std::string_view section(std::size_t s) const {
+        return std::string_view(file_.data() + sections_[s].offset, static_cast<std::size_t>(sections_[s].bytes));
+    }
+
+    const std::uint32_t* column32(std::size_t s, std::unique_ptr<std::uint32_t[]>& decoded) {
+        if (sections_[s].encoding == ColumnEncoding::Raw) {
+            return reinterpret_cast<const std::uint32_t*>(section(s).data());
+        }
+        decoded.reset(new std::uint32_t[rows_]);
+        decodeForBitPacked(section(s), rows_, decoded.get(), restricted_ ? &candidates_ : nullptr);
+        return decoded.get();
+    }
+
+    const std::int64_t* column64(std::size_t s, std::unique_ptr<std::int64_t[]>& decoded, std::size_t count) {
+        if (sections_[s].encoding == ColumnEncoding::Raw) {
+            return reinterpret_cast<const std::int64_t*>(section(s).data());
+        }
+        decoded.reset(new std::int64_t[count]);
+        decodeDeltaBitPacked(section(s), count, decoded.get(), restricted_ ? &candidates_ : nullptr);
+        return decoded.get();
+    }
+
+    // Narrows the rows [begin, end) to the blocks of the (sorted) timestamp
+    // column that can hold values in [first, last].
+    void timeRows(long long first, long long last, std::size_t& begin, std::size_t& end) const {
+        using namespace segment_file;
+        if (first > last) {
+            end = begin;
+            return;
+        }
+        if (first == LLONG_MIN && last == LLONG_MAX) {
+            return;
+        }
+        if (sections_[Timestamp].encoding == ColumnEncoding::Raw) {
+            const auto* timestamps = reinterpret_cast<const std::int64_t*>(section(Timestamp).data());
+            begin = static_cast<std::size_t>(std::lower_bound(timestamps, timestamps + rows_, first) - timestamps);
+            end = static_cast<std::size_t>(std::upper_bound(timestamps + begin, timestamps + rows_, last) - timestamps);
+            return;
+        }
+        // Block b holds values in [firsts[b], firsts[b + 1]]. The block before
+        // the first one starting at or after 'first' may end with matches.
+        const std::int64_t* firsts = deltaBlockFirsts(section(Timestamp));
+        const std::size_t blocks = column_codec::blockCount(rows_);
+        const std::size_t low = static_cast<std::size_t>(std::lower_bound(firsts, firsts + blocks, first) - firsts);
+        const std::size_t high = static_cast<std::size_t>(std::upper_bound(firsts, firsts + blocks, last) - firsts);
+        begin = (low > 0 ? low - 1 : 0) * column_codec::kBlockValues;
+        end = std::min(rows_, high * column_codec::kBlockValues);
+        end = std::max(begin, end);
+    }
+
+    MappedFile file_;
+    segment_file::SectionEntry sections_[segment_file::kSections];
+    std::size_t rows_ = 0;
+    unsigned decoded_ = 0; // ColumnSet bits already in view_.
+    std::size_t filterRows_ = 0;  // Rows per Bloom filter.
+    std::size_t filterWords_ = 0; // Words per Bloom filter.
+    bool restricted_ = false;
+    Plan plan_;
+    RowRanges candidates_; // The rows a restricted view holds.
+    // Decoded columns. They are left uninitialized, so the memory of rows a
+    // restricted view skips is never touched.
+    std::unique_ptr<std::int64_t[]> timestamps_;
+    std::unique_ptr<std::uint32_t[]> ips_;
+    std::unique_ptr<std::uint32_t[]> users32_;
+    std::unique_ptr<std::uint32_t[]> actions32_;
+    std::unique_ptr<std::uint32_t[]> statuses32_;
+    std::unique_ptr<std::uint32_t[]> latencies_;
+    SegmentDetails details_;
+    Dictionary users_;
+    Dictionary actions_;
+    Dictionary statuses_;
+    ColumnarView view_;
+};
+
+// Rows [begin, end) of 'view'.
+inline ColumnarView sliceView(ColumnarView view, std::size_t begin, std::size_t end) {
+    view.rows = end - begin;
+    view.timestamp += begin;
+    view.ip += begin;
+    view.user += begin;
+    view.action += begin;
+    view.status += begin;
+    view.latencyMs += begin;
+    view.detailsOffset += begin; // Offsets stay relative to the same arena.
+    return view;
+}
+
+// Builds 'out' from all rows of 'parts' in time order (ties keep their order).
+// Only the dictionary values the rows use are carried over.
+inline void mergeByTime(const std::vector<ColumnarView>& parts, ColumnarTable& out) {
+    struct RowRef {
+        std::int64_t timestamp;
+        std::uint32_t part;
+        std::uint32_t row;
+    };
+    std::vector<RowRef> order;
+    for (std::uint32_t p = 0; p < parts.size(); ++p) {
+        for (std::uint32_t row = 0; row < parts[p].rows; ++row) {
+            order.push_back({ parts[p].timestamp[row], p, row });
+        }
+    }
+    std::stable_sort(order.begin(), order.end(), [](const RowRef& a, const RowRef& b) { return a.timestamp < b.timestamp; });
+
+    constexpr std::uint32_t kUnmapped = UINT32_MAX;
+    struct CodeMaps {
+        std::vector<std::uint32_t> user, action, status;
+    };
+    std::vector<CodeMaps> maps(parts.size());
+    for (std::size_t p = 0; p < parts.size(); ++p) {
+        maps[p].user.assign(parts[p].users->size(), kUnmapped);
+        maps[p].action.assign(parts[p].actions->size(), kUnmapped);
+        maps[p].status.assign(parts[p].statuses->size(), kUnmapped);
+    }
+    const auto translate = [](std::vector<std::uint32_t>& map, std::uint32_t code, const Dictionary& from, Dictionary& into) {
+        if (map[code] == kUnmapped) {
+            map[code] = into.intern(from.value(code));
+        }
+        return map[code];
+    };
+
+    for (const RowRef& ref : order) {
+        const ColumnarView& part = parts[ref.part];
+        CodeMaps& map = maps[ref.part];
+        out.timestamp.push_back(ref.timestamp);
+        out.ip.push_back(part.ip[ref.row]);
+        out.user.push_back(translate(map.user, part.user[ref.row], *part.users, out.users));
+        out.action.push_back(translate(map.action, part.action[ref.row], *part.actions, out.actions));
+        out.status.push_back(translate(map.status, part.status[ref.row], *part.statuses, out.statuses));
+        out.latencyMs.push_back(part.latencyMs[ref.row]);
+        const std::string_view details = part.details(ref.row);
+        out.detailsArena.append(details.data(), details.size());
+        out.detailsOffset.push_back(out.detailsArena.size());
+    }
+}
+
+// --- The Manifest ---
+struct SegmentEntry {
+    std::string file;       // Relative to the store directory.
+    long long partition = 0; // First second of the segment's time partition.
+    std::uint64_t rows = 0;
+    long long minTimestamp = 0;
+    long long maxTimestamp = 0;
+};
+
+struct StoreManifest {
+    std::uint64_t nextId = 1; // Names new segment and WAL files.
+    std::string wal;          // The active WAL; empty before the first one.
+    std::vector<SegmentEntry> segments;
+};
+
+constexpr std::string_view kManifestHeader = "LFA-STORE 1";
+
+inline std::string serializeManifest(const StoreManifest& manifest) {
+    std::ostringstream out;
+    out << kManifestHeader << '\n' << "next " << manifest.nextId << '\n';
+    if (!manifest.wal.empty()) {
+        out << "wal " << manifest.wal << '\n';
+    }
+    for (const SegmentEntry& segment : manifest.segments) {
+        out << "segment " << segment.file << ' ' << segment.partition << ' ' << segment.rows << ' '
+            << segment.minTimestamp << ' ' << segment.maxTimestamp << '\n';
+    }
+    return out.str();
+}
+
+// Reads <dir>/MANIFEST. A missing file is an empty store, not an error.
+inline bool readManifest(const std::filesystem::path& dir, StoreManifest& manifest, std::string& error) {
+    manifest = StoreManifest();
+    std::ifstream file(dir / "MANIFEST");
+    if (!file.is_open()) {
+        if (std::filesystem::exists(dir / "MANIFEST")) {
+            error = "could not read " + (dir / "MANIFEST").string();
+            return false;
+        }
+        return true;
+    }
+    std::string line;
+    if (!std::getline(file, line) || line != kManifestHeader) {
+        error = (dir / "MANIFEST").string() + " is not a store manifest";
+        return false;
+    }
+    while (std::getline(file, line)) {
+        std::istringstream fields(line);
+        std::string keyword;
+        fields >> keyword;
+        bool ok = true;
+        if (keyword == "next") {
+            ok = static_cast<bool>(fields >> manifest.nextId);
+        }
+        else if (keyword == "wal") {
+            ok = static_cast<bool>(fields >> manifest.wal);
+        }
+        else if (keyword == "segment") {
+            SegmentEntry segment;
+            ok = static_cast<bool>(fields >> segment.file >> segment.partition >> segment.rows >> segment.minTimestamp >>
+                                   segment.maxTimestamp);
+            manifest.segments.push_back(segment);
+        }
+        if (!ok) {
+            error = (dir / "MANIFEST").string() + ": bad line '" + line + "'";
+            return false;
+        }
+    }
+    return true;
+}
+
+// --- The Write-Ahead Log ---
+// Each entry is fixed32 length, fixed32 CRC-32 of the payload, then the
+// payload: fixed64 timestamp, the ip / user / action / status strings, svarint
+// latency and the Details string.
+inline void appendWalEntry(std::string& out, const LogRecord& record) {
+    std::string payload;
+    ByteWriter writer(payload);
+    writer.fixed64(static_cast<std::uint64_t>(record.timestamp));
+    writer.string(record.ip);
+    writer.string(record.userId);
+    writer.string(record.action);
+    writer.string(record.status);
+    writer.svarint(record.latencyMs);
+    writer.string(record.details);
+
+    ByteWriter entry(out);
+    entry.fixed32(static_cast<std::uint32_t>(payload.size()));
+    entry.fixed32(updateCrc32(0, payload.data(), payload.size()));
+    entry.bytes(payload);
+}
+
+// Appends the WAL's entries to 'table' and returns how many bytes they take.
+// Replay stops at the first entry that is cut short or fails its CRC: the tail
+// of a write that a crash interrupted.
+inline std::size_t replayWal(std::string_view data, ColumnarTable& table) {
+    ByteReader reader(data);
+    std::size_t valid = 0;
+    LogRecord record;
+    while (reader.remaining() > 0) {
+        std::uint32_t length = 0;
+        std::uint32_t crc = 0;
+        std::string_view payload;
+        if (!reader.fixed32(length) || !reader.fixed32(crc) || !reader.bytes(length, payload) ||
+            updateCrc32(0, payload.data(), payload.size()) != crc) {
+            break;
+        }
+        ByteReader fields(payload);
+        std::uint64_t timestamp = 0;
+        std::int64_t latency = 0;
+        if (!fields.fixed64(timestamp) || !fields.string(record.ip) || !fields.string(record.userId) ||
+            !fields.string(record.action) || !fields.string(record.status) || !fields.svarint(latency) ||
+            !fields.string(record.details)) {
+            break;
+        }
+        record.timestamp = static_cast<long long>(timestamp);
+        record.latencyMs = static_cast<int>(latency);
+        table.append(record);
+        valid = data.size() - reader.remaining();
+    }
+    return valid;
+}
+
+inline bool readWholeFile(const std::filesystem::path& path, std::string& contents) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+    std::ostringstream buffer;
+    buffer << file.rdbuf();
+    contents = buffer.str();
+    return true;
+}
+
+// --- The Writer ---
+class SegmentStore {
+public:
+    explicit SegmentStore(StoreConfig config = StoreConfig()) : config_(config) {}
+    ~SegmentStore() { close(); }
+    SegmentStore(const SegmentStore&) = delete;
+    SegmentStore& operator=(const SegmentStore&) = delete;
+
+    // Opens (or creates) the store in 'dir', recovers the active segment from
+    // its WAL and starts the compaction thread.
+    bool open(const std::string& dir, std::string& error) {
+        dir_ = dir;
+        std::error_code ignored;
+        std::filesystem::create_directories(dir_, ignored);
+        if (!readManifest(dir_, manifest_, error)) {
+            return false;
+        }
+
+        // The WAL may end in a torn write. Its valid entries move to a new WAL,
+        // so appends always start from a clean end of file.
+        std::string walData;
+        if (!manifest_.wal.empty() && !readWholeFile(dir_ / manifest_.wal, walData)) {
+            error = "could not read " + (dir_ / manifest_.wal).string();
+            return false;
+        }
+        const std::size_t validBytes = replayWal(walData, active_);
+        recoveredRows_ = active_.rows();
+        manifest_.wal = "wal-" + std::to_string(manifest_.nextId++) + ".log";
+        if (!writeFileAtomically(dir_ / manifest_.wal, std::string_view(walData).substr(0, validBytes), error) ||
+            !writeFileAtomically(dir_ / "MANIFEST", serializeManifest(manifest_), error)) {
+            return false;
+        }
+        removeUnlistedFiles();
+        if (!wal_.open((dir_ / manifest_.wal).string())) {
+            error = "could not open " + (dir_ / manifest_.wal).string();
+            return false;
+        }
+
+        compactor_ = std::thread([this]() { compactLoop(); });
+        wake_.notify_one(); // Earlier runs may have left segments to merge.
+        return true;
+    }
+
+    // Adds a row to the active segment. Returns false (and stores nothing) if
+    // its IP is not a valid IPv4 address.
+    bool append(const LogRecord& record) {
+        if (!active_.append(record)) {
+            return false;
+        }
+        appendWalEntry(pending_, record);
+        return true;
+    }
+
+    // Makes every appended row durable, and seals the active segment once it is
+    // full. Returns false (with 'error') if a write fails.
+    bool commit(std::string& error) {
+        if (!pending_.empty()) {
+            if (!wal_.write(pending_) || !wal_.sync()) {
+                error = "could not write " + (dir_ / manifest_.wal).string();
+                return false;
+            }
+            pending_.clear();
+        }
+        return active_.rows() < config_.sealRows || seal(error);
+    }
+
+    // Commits what is pending and stops compaction. The active segment stays in
+    // the WAL until the store is opened again.
+    void close() {
+        if (!compactor_.joinable()) {
+            return;
+        }
+        std::string ignored;
+        commit(ignored);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_one();
+        compactor_.join();
+        wal_.close();
+    }
+
+    std::size_t recoveredRows() const { return recoveredRows_; }
+    std::size_t activeRows() const { return active_.rows(); }
+
+    std::size_t segmentCount() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return manifest_.segments.size();
+    }
+
+    long long compactions() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return compactions_;
+    }
+
+private:
+    long long partitionOf(long long timestamp) const {
+        const long long seconds = std::max<long long>(1, config_.partitionSeconds);
+        const long long index = timestamp >= 0 ? timestamp / seconds : -((-timestamp + seconds - 1) / seconds);
+        return index * seconds;
+    }
+
+    // Writes 'table' (in time order) as a new segment of 'partition'.
+    bool writeSegment(long long partition, const ColumnarTable& table, std::uint64_t id, SegmentEntry& entry,
+                      std::string& error) {
+        entry.partition = partition;
+        entry.file = std::to_string(partition) + "/seg-" + std::to_string(id) + ".lseg";
+        entry.rows = table.rows();
+        entry.minTimestamp = table.timestamp.front();
+        entry.maxTimestamp = table.timestamp.back();
+        std::error_code ignored;
+        std::filesystem::create_directories(dir_ / std::to_string(partition), ignored);
+        return writeSegmentFile(dir_ / entry.file, table, error);
+    }
+
+    // Turns the active segment into one segment per partition and starts a new
+    // WAL. Nothing changes until the new MANIFEST is in place: if sealing
+    // fails, the rows stay in the active segment and the current WAL, and the
+    // files written so far are removed.
+    bool seal(std::string& error) {
+        ColumnarTable sorted;
+        mergeByTime({ active_.view() }, sorted);
+
+        std::vector<SegmentEntry> entries;
+        std::string newWal;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            newWal = "wal-" + std::to_string(manifest_.nextId++) + ".log";
+        }
+        const auto removeWritten = [&]() {
+            std::error_code ignored;
+            for (const SegmentEntry& entry : entries) {
+                std::filesystem::remove(dir_ / entry.file, ignored);
+            }
+            std::filesystem::remove(dir_ / newWal, ignored);
+        };
+        for (std::size_t begin = 0; begin < sorted.rows();) {
+            const long long partition = partitionOf(sorted.timestamp[begin]);
+            std::size_t end = begin;
+            while (end < sorted.rows() && partitionOf(sorted.timestamp[end]) == partition) {
+                ++end;
+            }
+            ColumnarTable part;
+            mergeByTime({ sliceView(sorted.view(), begin, end) }, part);
+            std::uint64_t id = 0;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                id = manifest_.nextId++;
+            }
+            entries.emplace_back();
+            if (!writeSegment(partition, part, id, entries.back(), error)) {
+                removeWritten();
+                return false;
+            }
+            begin = end;
+        }
+        if (!writeFileAtomically(dir_ / newWal, std::string_view(), error)) {
+            removeWritten();
+            return false;
+        }
+
+        std::string oldWal;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            StoreManifest next = manifest_;
+            next.wal = newWal;
+            next.segments.insert(next.segments.end(), entries.begin(), entries.end());
+            if (!writeFileAtomically(dir_ / "MANIFEST", serializeManifest(next), error)) {
+                removeWritten();
+                return false;
+            }
+            oldWal = manifest_.wal;
+            manifest_ = std::move(next);
+        }
+        wake_.notify_one();
+
+        std::error_code ignored;
+        std::filesystem::remove(dir_ / oldWal, ignored);
+        active_ = ColumnarTable();
+        if (!wal_.open((dir_ / newWal).string())) {
+            error = "could not open " + (dir_ / newWal).string();
+            return false;
+        }
+        return true;
+    }
+
+    // Deletes segment, WAL and temporary files the manifest does not name:
+    // the leftovers of a seal or compaction that a crash interrupted.
+    void removeUnlistedFiles() {
+        std::vector<std::string> listed = { "MANIFEST", manifest_.wal };
+        for (const SegmentEntry& segment : manifest_.segments) {
+            listed.push_back(std::filesystem::path(segment.file).lexically_normal().generic_string());
+        }
+        std::error_code error;
+        std::vector<std::filesystem::path> unlisted;
+        for (auto it = std::filesystem::recursive_directory_iterator(dir_, error);
+             !error && it != std::filesystem::recursive_directory_iterator(); it.increment(error)) {
+            const std::filesystem::path& path = it->path();
+            const std::string name = path.filename().string();
+            const bool ours = path.extension() == ".lseg" || path.extension() == ".tmp" ||
+                              (name.rfind("wal-", 0) == 0 && path.extension() == ".log");
+            const std::string relative = path.lexically_relative(dir_).generic_string();
+            if (ours && std::find(listed.begin(), listed.end(), relative) == listed.end()) {
+                unlisted.push_back(path);
+            }
+        }
+        for (const std::filesystem::path& path : unlisted) {
+            std::filesystem::remove(path, error);
+        }
+    }
+
+    // --- Compaction ---
+    void compactLoop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!stopping_) {
+            std::vector<SegmentEntry> sources = pickCompaction();
+            if (sources.empty()) {
+                wake_.wait(lock);
+                continue;
+            }
+            const std::uint64_t id = manifest_.nextId++;
+            lock.unlock();
+            SegmentEntry merged;
+            std::string error;
+            const bool ok = mergeSegments(sources, id, merged, error);
+            lock.lock();
+            if (!ok || !commitCompaction(sources, merged, error)) {
+                std::cerr << "Warning: compaction failed: " << error << '\n';
+                wake_.wait_for(lock, std::chrono::seconds(10)); // Retried later; nothing was lost.
+            }
+        }
+    }
+
+    // The small segments of the partition with the most of them, oldest first,
+    // if there are enough to be worth merging. Called with 'mutex_' held.
+    std::vector<SegmentEntry> pickCompaction() const {
+        std::vector<SegmentEntry> best;
+        std::vector<long long> partitions;
+        for (const SegmentEntry& segment : manifest_.segments) {
+            partitions.push_back(segment.partition);
+        }
+        std::sort(partitions.begin(), partitions.end());
+        partitions.erase(std::unique(partitions.begin(), partitions.end()), partitions.end());
+        for (long long partition : partitions) {
+            std::vector<SegmentEntry> small;
+            std::uint64_t rows = 0;
+            for (const SegmentEntry& segment : manifest_.segments) {
+                if (segment.partition == partition && segment.rows < config_.compactTargetRows &&
+                    rows + segment.rows <= config_.compactTargetRows) {
+                    small.push_back(segment);
+                    rows += segment.rows;
+                }
+            }
+            if (small.size() >= std::max<std::size_t>(2, config_.compactFanIn) && small.size() > best.size()) {
+                best = small;
+            }
+        }
+        return best;
+    }
+
+    bool mergeSegments(const std::vector<SegmentEntry>& sources, std::uint64_t id, SegmentEntry& merged,
+                       std::string& error) {
+        std::vector<std::unique_ptr<Segment>> segments;
+        std::vector<ColumnarView> views;
+        for (const SegmentEntry& source : sources) {
+            segments.push_back(std::make_unique<Segment>());
+            if (!segments.back()->open((dir_ / source.file).string(), error)) {
+                return false;
+            }
+            views.push_back(segments.back()->view(kAllColumns));
+        }
+        ColumnarTable table;
+        mergeByTime(views, table);
+        return writeSegment(sources.front().partition, table, id, merged, error);
+    }
+
+    // Swaps the sources for the merged segment in the manifest. Called with
+    // 'mutex_' held.
+    bool commitCompaction(const std::vector<SegmentEntry>& sources, const SegmentEntry& merged, std::string& error) {
+        StoreManifest next = manifest_;
+        next.segments.clear();
+        bool placed = false;
+        for (const SegmentEntry& segment : manifest_.segments) {
+            const bool replaced = std::any_of(sources.begin(), sources.end(),
+                                              [&](const SegmentEntry& source) { return source.file == segment.file; });
+            if (!replaced) {
+                next.segments.push_back(segment);
+            }
+            else if (!placed) {
+                next.segments.push_back(merged); // Where the oldest source was.
+                placed = true;
+            }
+        }
+        if (!writeFileAtomically(dir_ / "MANIFEST", serializeManifest(next), error)) {
+            std::error_code ignored;
+            std::filesystem::remove(dir_ / merged.file, ignored);
+            return false;
+        }
+        manifest_ = next;
+        ++compactions_;
+        // A query may still have a source mapped. That is fine on POSIX; on
+        // Windows the delete can fail, and the next open() removes the file.
+        std::error_code ignored;
+        for (const SegmentEntry& source : sources) {
+            std::filesystem::remove(dir_ / source.file, ignored);
+        }
+        return true;
+    }
+
+    std::filesystem::path dir_;
+    StoreConfig config_;
+    ColumnarTable active_; // Only the ingest thread touches it.
+    std::string pending_;  // WAL entries not yet written.
+    SyncedFile wal_;
+    std::size_t recoveredRows_ = 0;
+
+    std::mutex mutex_; // Guards manifest_, the MANIFEST file and the fields below.
+    StoreManifest manifest_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+    long long compactions_ = 0;
+    std::thread compactor_;
+};
+
+// --- Querying a Store ---
+struct StoreQueryStats {
+    std::size_t segments = 0;        // In the store.
+    std::size_t segmentsScanned = 0; // With blocks that may match the query.
+    std::size_t segmentRows = 0;     // In the segments overlapping the query's time range.
+    std::size_t rowsRead = 0;        // Of those, in blocks that may match.
+    std::size_t walRows = 0;         // Rows of the active segment, read from its WAL.
+};
+
+// Runs 'query' over the store in 'dir', which a daemon may be writing to. If a
+// segment disappears between reading the manifest and mapping it (a compaction
+// finished meanwhile), the manifest is read again. Within each segment, only
+// the blocks Segment::restrictTo() leaves are decoded and scanned.
+//
+// With PlanMode::Explain the query is only planned into 'plan': segments are
+// mapped and their dictionaries read, but no filter is probed and no column
+// decoded. With PlanMode::Analyze it also runs, and 'plan' shows what each
+// step did.
+inline bool queryStore(const std::string& dir, const Query& query, std::string& result, std::string& error,
+                       ReportFormat format, StoreQueryStats& stats, PlanMode mode = PlanMode::Run, PlanStep* plan = nullptr) {
+    using Clock = std::chrono::steady_clock;
+    const Clock::time_point start = Clock::now();
+    const bool explain = mode == PlanMode::Explain;
+    long long first = 0;
+    long long last = 0;
+    queryTimeBounds(query, first, last);
+
+    for (int attempt = 0;; ++attempt) {
+        StoreManifest manifest;
+        if (!readManifest(dir, manifest, error)) {
+            return false;
+        }
+        stats = StoreQueryStats();
+        stats.segments = manifest.segments.size();
+
+        std::vector<std::unique_ptr<Segment>> segments;
+        std::vector<ColumnarView> parts;
+        std::vector<PlanPart> described;
+        std::vector<PlanStep> skipped; // Segments mapped, then left out.
+        std::size_t outside = 0;
+        bool missing = false;
+        bool failed = false;
+        for (const SegmentEntry& entry : manifest.segments) {
+            if (entry.maxTimestamp < first || entry.minTimestamp > last) {
+                ++outside;
+                continue; // Pruned: no row of this segment can match.
+            }
+            auto segment = std::make_unique<Segment>();
+            const std::filesystem::path path = std::filesystem::path(dir) / entry.file;
+            if (!segment->open(path.string(), error)) {
+                missing = !std::filesystem::exists(path);
+                failed = !missing;
+                break;
+            }
+            if (explain ? !segment->plan(query, error) : !segment->restrictTo(query, error)) {
+                return false;
+            }
+            stats.segmentRows += segment->rows();
+            PlanPart part;
+            if (plan != nullptr) {
+                part.step.label = "Segment " + entry.file + ", " + std::to_string(segment->rows()) + " rows, " +
+                                  std::to_string((segment->fileBytes() + 1023) / 1024) + " KiB";
+                part.rows = segment->estimatedRows();
+                part.kept = segment->keptShares();
+                segment->describe(part.step);
+            }
+            const std::size_t candidates = explain ? static_cast<std::size_t>(segment->estimatedRows() > 0) : segment->candidateRows();
+            if (candidates == 0) {
+                skipped.push_back(std::move(part.step));
+                continue; // Pruned by its blocks' time ranges and filters.
+            }
+            stats.rowsRead += explain ? 0 : candidates;
+            parts.push_back(segment->view(explain ? 0 : queryColumns(query)));
+            described.push_back(std::move(part));
+            segments.push_back(std::move(segment));
+        }
+        std::string walData;
+        ColumnarTable walRows;
+        if (!missing && !manifest.wal.empty() && !readWholeFile(std::filesystem::path(dir) / manifest.wal, walData)) {
+            missing = true; // Replaced by a seal since the manifest was read.
+            error = "could not read " + (std::filesystem::path(dir) / manifest.wal).string();
+        }
+        if (missing && attempt < 3) {
+            continue;
+        }
+        if (missing || failed) {
+            return false;
+        }
+        replayWal(walData, walRows);
+        ColumnarView wal = walRows.view();
+        collectStatistics(wal);
+        parts.push_back(wal);
+        stats.segmentsScanned = segments.size();
+        stats.walRows = walRows.rows();
+        if (plan == nullptr || mode == PlanMode::Run) {
+            return executeQuery(parts, query, result, error, format);
+        }
+
+        PlanPart walPart;
+        walPart.step.label = "WAL " + manifest.wal + ", replayed into memory";
+        walPart.rows = static_cast<double>(rowsToScan(wal, query));
+        described.push_back(std::move(walPart));
+        if (first != LLONG_MIN || last != LLONG_MAX) {
+            plan->add("Zone maps: " + std::to_string(outside) + " of " + std::to_string(manifest.segments.size()) +
+                      " segments lie outside the time range").note = "from the manifest";
+        }
+        if (!planQuery(parts, std::move(described), query, mode, *plan, result, error, format)) {
+            return false;
+        }
+        for (PlanStep& step : skipped) {
+            plan->children.push_back(std::move(step));
+        }
+        if (mode == PlanMode::Analyze) {
+            plan->milliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        }
+        return true;
+    }
+}
@@ -0,0 +1,646 @@
+/**
+ * @file ShardCoordinator.h
+ * @brief Scanning one large log with several worker processes.
+ *
+ * @details This is the multi-process version of the threaded scan. The
+ * coordinator cuts the file into newline-aligned byte ranges and starts worker
+ * processes (copies of this program) that connect back to it over a loopback
+ * TCP socket. Each worker is handed one range at a time, summarizes it, and
+ * returns the summary as a serialized state blob (see AggregateState.h). The
+ * coordinator merges the blobs as they arrive.
+ *
+ * A worker that crashes or is killed closes its connection. The range it was
+ * working on goes back to the queue and another worker picks it up, and a
+ * replacement process is started. A worker that hangs is killed once its
+ * range has run past the range deadline, and the range is handed out again
+ * in the same way. A range that fails on several workers in a row is
+ * reported as an error instead of being retried forever. Workers only share
+ * file paths and summaries with the coordinator, so the same protocol can
+ * later run across hosts.
+ *
+ * Any local process can connect to the loopback port, so each run has a
+ * random token. It is passed to the workers in the LFA_SHARD_TOKEN
+ * environment variable, which other users cannot read, unlike the command
+ * line (ps, /proc/<pid>/cmdline). A connection
+ * gets no work and its results are not merged until it has sent the token,
+ * together with the process ID of one of the coordinator's own workers.
+ *
+ * Wire format: every message is a fixed32 byte length followed by the payload.
+ * Coordinator to worker: u8 kind, then for kShardScan the varint begin and end
+ * offsets. Worker to coordinator: first a hello (varint process ID, then the
+ * token), then one state blob per range.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include "SocketCompat.h" // Before windows.h, so winsock2.h wins over winsock.h.
+#include <windows.h>
+#else
+#include "SocketCompat.h"
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+extern char** environ;
+#endif
+
+#include "AggregateState.h"
+#include "FileChunks.h"
+#include "LogSchema.h"
+
+// --- Framing ---
+constexpr std::size_t kMaxShardFrameBytes = 64u << 20;
+
+enum ShardMessage : std::uint8_t {
+    kShardScan = 1, // Summarize one byte range.
+    kShardQuit = 2, // No more work; exit.
+};
+
+inline bool sendFrame(SocketHandle s, std::string_view payload) {
+    std::string frame;
+    ByteWriter writer(frame);
+    writer.fixed32(static_cast<std::uint32_t>(payload.size()));
+    writer.bytes(payload);
+    return sendAll(s, frame);
+}
+
+// Collects bytes from a stream socket and hands out complete frames.
+class FrameBuffer {
+public:
+    void append(const char* data, std::size_t size) { pending_.append(data, size); }
+
+    // Moves the next complete frame into 'payload'. Returns false if none is
+    // complete yet; 'corrupt' is set if the length prefix is impossible.
+    bool next(std::string& payload, bool& corrupt) {
+        corrupt = false;
+        ByteReader reader(pending_);
+        std::uint32_t length = 0;
+        if (!reader.fixed32(length)) {
+            return false;
+        }
+        if (length > kMaxShardFrameBytes) {
+            corrupt = true;
+            return false;
+        }
+        if (reader.remaining() < length) {
+            return false;
+        }
+        payload.assign(pending_, 4, length);
+        pending_.erase(0, 4 + static_cast<std::size_t>(length));
+        return true;
+    }
+
+private:
+    std::string pending_;
+};
+
+// Blocks until one whole frame has arrived. Returns false on EOF or error.
+inline bool receiveFrame(SocketHandle s, FrameBuffer& buffer, std::string& payload) {
+    char chunk[64 * 1024];
+    bool corrupt = false;
+    while (!buffer.next(payload, corrupt)) {
+        if (corrupt) {
+            return false;
+        }
+        const int received = receiveSome(s, chunk, sizeof(chunk));
+        if (received <= 0) {
+            return false;
+        }
+        buffer.append(chunk, static_cast<std::size_t>(received));
+    }
+    return true;
+}
+
+// --- Summarizing One Range ---
+inline bool summarizeRange(std::ifstream& input, const ByteRange& range, const LineParser& parser, std::string& block,
+                           LogSummary& summary) {
+    LogRecord record;
+    return forEachLineInRange(input, range, 8u << 20, block, [&](std::string_view line, std::uint64_t) {
+        summary.totalLines++;
+        if (!parser.parse(line, record)) {
+            summary.malformedLines++;
+            return;
+        }
+        summary.add(record);
+    });
+}
+
+// --- Worker Processes ---
+struct ChildProcess {
+#ifdef _WIN32
+    HANDLE handle = nullptr;
+#else
+    pid_t pid = -1;
+#endif
+};
+
+// The worker's copy of the coordinator's token (see the file comment).
+constexpr const char* kShardTokenVariable = "LFA_SHARD_TOKEN";
+
+// Starts 'args[0]' with the given arguments, and with this process's
+// environment plus the "NAME=value" entries in 'extraEnvironment' (which
+// replace variables of the same names). On Linux the running executable is
+// used directly, so a relative argv[0] still works after a chdir.
+inline bool spawnProcess(const std::vector<std::string>& args, const std::vector<std::string>& extraEnvironment,
+                         ChildProcess& child) {
+    // True if 'entry' ("NAME=value") sets a variable that 'extraEnvironment' replaces.
+    const auto replaced = [&](std::string_view entry) {
+        for (const std::string& extra : extraEnvironment) {
+            const std::size_t nameEnd = extra.find('=') + 1;
+            if (entry.substr(0, nameEnd) == std::string_view(extra).substr(0, nameEnd)) {
+                return true;
+            }
+        }
+        return false;
+    };
+#ifdef _WIN32
+    std::string commandLine;
+    for (const std::string& arg : args) {
+        commandLine += (commandLine.empty() ? "\"" : " \"") + arg + "\"";
+    }
+    // An environment block is a run of NUL-terminated entries, ending in an empty one.
+    std::string environment;
+    char* inherited = GetEnvironmentStringsA();
+    for (const char* entry = inherited; entry != nullptr && *entry != '\0'; entry += std::strlen(entry) + 1) {
+        if (!replaced(entry)) {
+            environment.append(entry, std::strlen(entry) + 1);
+        }
+    }
+    if (inherited != nullptr) {
+        FreeEnvironmentStringsA(inherited);
+    }
+    for (const std::string& extra : extraEnvironment) {
+        environment.append(extra.c_str(), extra.size() + 1);
+    }
+    environment.push_back('\0');
+    char executable[MAX_PATH];
+    const DWORD length = GetModuleFileNameA(nullptr, executable, MAX_PATH);
+    STARTUPINFOA startup;
+    std::memset(&startup, 0, sizeof(startup));
+    startup.cb = sizeof(startup);
+    PROCESS_INFORMATION info;
+    if (!CreateProcessA(length > 0 && length < MAX_PATH ? executable : nullptr, &commandLine[0],
+                        nullptr, nullptr, FALSE, 0, &environment[0], nullptr, &startup, &info)) {
+        return false;
+    }
+    CloseHandle(info.hThread);
+    child.handle = info.hProcess;
+    return true;
+#else
+    std::vector<char*> argv;
+    for (const std::string& arg : args) {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+    std::vector<char*> envp;
+    for (char** entry = environ; *entry != nullptr; ++entry) {
+        if (!replaced(*entry)) {
+            envp.push_back(*entry);
+        }
+    }
+    for (const std::string& extra : extraEnvironment) {
+        envp.push_back(const_cast<char*>(extra.c_str()));
+    }
+    envp.push_back(nullptr);
+#ifdef __linux__
+    const int result = ::posix_spawn(&child.pid, "/proc/self/exe", nullptr, nullptr, argv.data(), envp.data());
+#else
+    const int result = ::posix_spawnp(&child.pid, args[0].c_str(), nullptr, nullptr, argv.data(), envp.data());
+#endif
+    return result == 0;
+#endif
+}
+
+// Non-blocking: true once the process has exited (and has been reaped).
+inline bool processExited(ChildProcess& child) {
+#ifdef _WIN32
+    if (WaitForSingleObject(child.handle, 0) != WAIT_OBJECT_0) {
+        return false;
+    }
+    CloseHandle(child.handle);
+    return true;
+#else
+    int status = 0;
+    const pid_t result = ::waitpid(child.pid, &status, WNOHANG);
+    return result == child.pid || result < 0;
+#endif
+}
+
+// Waits up to 'timeout' for the process to exit. Returns false if it is still running.
+inline bool waitForProcess(ChildProcess& child, std::chrono::milliseconds timeout) {
+#ifdef _WIN32
+    if (WaitForSingleObject(child.handle, static_cast<DWORD>(timeout.count())) != WAIT_OBJECT_0) {
+        return false;
+    }
+    CloseHandle(child.handle);
+    return true;
+#else
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (!processExited(child)) {
+        if (std::chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+        ::usleep(10 * 1000);
+    }
+    return true;
+#endif
+}
+
+inline void killProcess(ChildProcess& child) {
+#ifdef _WIN32
+    TerminateProcess(child.handle, 1);
+#else
+    ::kill(child.pid, SIGKILL);
+#endif
+}
+
+inline std::uint64_t processIdOf(const ChildProcess& child) {
+#ifdef _WIN32
+    return GetProcessId(child.handle);
+#else
+    return static_cast<std::uint64_t>(child.pid);
+#endif
+}
+
+inline std::uint64_t currentProcessId() {
+#ifdef _WIN32
+    return GetCurrentProcessId();
+#else
+    return static_cast<std::uint64_t>(::getpid());
+#endif
+}
+
+// --- Coordinator ---
+class ShardCoordinator {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // How long a connection may take to send its hello.
+    static constexpr std::chrono::seconds kHelloTimeout{ 10 };
+
+    // 'workerCommand' starts one worker; the coordinator's port number is
+    // appended to it, and the run's token is set in the worker's environment
+    // as kShardTokenVariable. A worker still on one range after
+    // 'rangeTimeout' is killed.
+    ShardCoordinator(std::vector<std::string> workerCommand, unsigned processCount,
+                     std::chrono::seconds rangeTimeout = std::chrono::minutes(10), int maxAttemptsPerRange = 3)
+        : workerCommand_(std::move(workerCommand)),
+          processCount_(processCount == 0 ? 1 : processCount),
+          rangeTimeout_(rangeTimeout),
+          maxAttempts_(maxAttemptsPerRange) {}
+
+    // Summarizes every range into 'total'. Returns false (with 'error') if the
+    // workers could not be started or a range kept failing.
+    bool run(const std::vector<ByteRange>& ranges, LogSummary& total, std::string& error) {
+        listener_ = listenTcpLoopback(0, error);
+        if (listener_ == kInvalidSocket) {
+            return false;
+        }
+        std::random_device random;
+        static const char kHex[] = "0123456789abcdef";
+        for (int i = 0; i < 4; ++i) {
+            const unsigned bits = random();
+            for (int shift = 0; shift < 32; shift += 4) {
+                token_.push_back(kHex[(bits >> shift) & 15]);
+            }
+        }
+        workerCommand_.push_back(std::to_string(boundTcpPort(listener_)));
+        workerEnvironment_ = { std::string(kShardTokenVariable) + "=" + token_ };
+
+        tasks_.assign(ranges.size(), Task());
+        for (std::size_t i = 0; i < ranges.size(); ++i) {
+            tasks_[i].range = ranges[i];
+            queue_.push_back(i);
+        }
+        spawnBudget_ = processCount_ * static_cast<std::size_t>(maxAttempts_);
+
+        const bool ok = loop(total, error);
+        shutDown();
+        return ok;
+    }
+
+    std::size_t workersStarted() const { return workersStarted_; }
+    std::size_t rangesRetried() const { return rangesRetried_; }
+    std::size_t workersTimedOut() const { return workersTimedOut_; }
+
+private:
+    struct Task {
+        ByteRange range{0, 0};
+        int attempts = 0;
+    };
+    struct Connection {
+        SocketHandle socket = kInvalidSocket;
+        FrameBuffer inbox;
+        long long task = -1; // Index into tasks_, or -1 while idle.
+        long long process = -1; // Index into processes_ once the hello has arrived.
+        Clock::time_point since; // When it connected, or was handed its range.
+    };
+
+    bool loop(LogSummary& total, std::string& error) {
+        std::size_t completed = 0;
+        while (completed < tasks_.size()) {
+            reapExitedWorkers();
+            if (!topUpWorkers(completed, error)) {
+                return false;
+            }
+            dispatchQueuedRanges();
+
+            fd_set readable;
+            FD_ZERO(&readable);
+            FD_SET(listener_, &readable);
+            SocketHandle highest = listener_;
+            for (const Connection& connection : connections_) {
+                FD_SET(connection.socket, &readable);
+                highest = std::max(highest, connection.socket);
+            }
+            timeval timeout{0, 200 * 1000};
+            if (::select(static_cast<int>(highest) + 1, &readable, nullptr, nullptr, &timeout) <= 0) {
+                if (!enforceDeadlines(error)) {
+                    return false;
+                }
+                continue;
+            }
+
+            if (FD_ISSET(listener_, &readable)) {
+                const SocketHandle client = ::accept(listener_, nullptr, nullptr);
+                if (client != kInvalidSocket) {
+                    connections_.push_back(Connection());
+                    connections_.back().socket = client;
+                    connections_.back().since = Clock::now();
+                }
+            }
+            for (std::size_t c = 0; c < connections_.size();) {
+                if (!FD_ISSET(connections_[c].socket, &readable)) {
+                    ++c;
+                    continue;
+                }
+                const int result = readResults(connections_[c], total, completed);
+                if (result < 0) {
+                    if (!dropConnection(c, error)) {
+                        return false;
+                    }
+                    continue; // 'c' now holds the next connection.
+                }
+                ++c;
+            }
+            if (!enforceDeadlines(error)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Drops connections that never said hello, and kills workers that have
+    // been on one range for too long, putting the range back in the queue.
+    bool enforceDeadlines(std::string& error) {
+        const Clock::time_point now = Clock::now();
+        for (std::size_t c = 0; c < connections_.size();) {
+            Connection& connection = connections_[c];
+            if (connection.process < 0 && now - connection.since > kHelloTimeout) {
+                closeSocket(connection.socket);
+                connections_.erase(connections_.begin() + static_cast<std::ptrdiff_t>(c));
+                continue;
+            }
+            if (connection.task >= 0 && now - connection.since > rangeTimeout_) {
+                if (connection.process >= 0) {
+                    killProcess(processes_[static_cast<std::size_t>(connection.process)]);
+                }
+                ++workersTimedOut_;
+                if (!dropConnection(c, error)) {
+                    error += " (the last one timed out)";
+                    return false;
+                }
+                continue;
+            }
+            ++c;
+        }
+        return true;
+    }
+
+    // Reads what has arrived on 'connection' and merges any finished ranges.
+    // Returns -1 if the worker is gone or sent something unreadable.
+    int readResults(Connection& connection, LogSummary& total, std::size_t& completed) {
+        char chunk[64 * 1024];
+        const int received = receiveSome(connection.socket, chunk, sizeof(chunk));
+        if (received <= 0) {
+            return -1;
+        }
+        connection.inbox.append(chunk, static_cast<std::size_t>(received));
+
+        std::string payload;
+        bool corrupt = false;
+        while (connection.inbox.next(payload, corrupt)) {
+            if (connection.process < 0) {
+                if (!acceptHello(connection, payload)) {
+                    return -1;
+                }
+                continue;
+            }
+            LogSummary part;
+            std::string ignored;
+            if (connection.task < 0 || !deserializeSummary(payload, part, ignored)) {
+                return -1;
+            }
+            total.merge(part);
+            ++completed;
+            connection.task = -1;
+        }
+        return corrupt ? -1 : 0;
+    }
+
+    // Checks a connection's first frame: the run's token, sent by one of the
+    // coordinator's own worker processes.
+    bool acceptHello(Connection& connection, std::string_view payload) {
+        ByteReader reader(payload);
+        std::uint64_t processId = 0;
+        std::string_view token;
+        if (!reader.varint(processId) || !reader.bytes(reader.remaining(), token) || token != token_) {
+            return false;
+        }
+        for (std::size_t i = 0; i < processes_.size(); ++i) {
+            const bool taken = std::any_of(connections_.begin(), connections_.end(),
+                                           [&](const Connection& other) { return other.process == static_cast<long long>(i); });
+            if (processIdOf(processes_[i]) == processId && !taken) {
+                connection.process = static_cast<long long>(i);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Forgets a worker connection, putting its range back in the queue.
+    bool dropConnection(std::size_t index, std::string& error) {
+        Connection& connection = connections_[index];
+        if (connection.task >= 0) {
+            Task& task = tasks_[static_cast<std::size_t>(connection.task)];
+            if (++task.attempts >= maxAttempts_) {
+                error = "bytes " + std::to_string(task.range.begin) + "-" + std::to_string(task.range.end) +
+                        " failed on " + std::to_string(task.attempts) + " workers";
+                return false;
+            }
+            queue_.push_front(static_cast<std::size_t>(connection.task));
+            ++rangesRetried_;
+        }
+        closeSocket(connection.socket);
+        connections_.erase(connections_.begin() + static_cast<std::ptrdiff_t>(index));
+        return true;
+    }
+
+    void dispatchQueuedRanges() {
+        for (Connection& connection : connections_) {
+            if (connection.task >= 0 || connection.process < 0 || queue_.empty()) {
+                continue;
+            }
+            const std::size_t index = queue_.front();
+            std::string message;
+            ByteWriter writer(message);
+            writer.u8(kShardScan);
+            writer.varint(tasks_[index].range.begin);
+            writer.varint(tasks_[index].range.end);
+            if (sendFrame(connection.socket, message)) {
+                queue_.pop_front();
+                connection.task = static_cast<long long>(index);
+                connection.since = Clock::now();
+            }
+            // A failed send means the worker is dying; its EOF will remove it.
+        }
+    }
+
+    void reapExitedWorkers() {
+        for (std::size_t i = 0; i < processes_.size();) {
+            if (!processExited(processes_[i])) {
+                ++i;
+                continue;
+            }
+            processes_.erase(processes_.begin() + static_cast<std::ptrdiff_t>(i));
+            for (Connection& connection : connections_) {
+                if (connection.process > static_cast<long long>(i)) {
+                    --connection.process;
+                }
+                else if (connection.process == static_cast<long long>(i)) {
+                    connection.process = -2; // Gone; its EOF will remove it.
+                }
+            }
+        }
+    }
+
+    // Keeps enough workers running for the work that is left.
+    bool topUpWorkers(std::size_t completed, std::string& error) {
+        const std::size_t remaining = tasks_.size() - completed;
+        const std::size_t wanted = std::min<std::size_t>(processCount_, remaining);
+        while (processes_.size() < wanted && spawnBudget_ > 0) {
+            ChildProcess child;
+            --spawnBudget_;
+            if (!spawnProcess(workerCommand_, workerEnvironment_, child)) {
+                error = "could not start a worker process";
+                return false;
+            }
+            processes_.push_back(child);
+            ++workersStarted_;
+        }
+        if (processes_.empty() && connections_.empty()) {
+            error = "every worker process exited before the work was done";
+            return false;
+        }
+        return true;
+    }
+
+    void shutDown() {
+        std::string quit(1, static_cast<char>(kShardQuit));
+        for (Connection& connection : connections_) {
+            sendFrame(connection.socket, quit);
+            closeSocket(connection.socket);
+        }
+        connections_.clear();
+        // A worker that does not quit in time is hung, or never connected.
+        for (ChildProcess& child : processes_) {
+            if (!waitForProcess(child, std::chrono::seconds(5))) {
+                killProcess(child);
+                waitForProcess(child, std::chrono::seconds(5));
+            }
+        }
+        processes_.clear();
+        if (listener_ != kInvalidSocket) {
+            closeSocket(listener_);
+            listener_ = kInvalidSocket;
+        }
+    }
+
+    std::vector<std::string> workerCommand_;
+    std::size_t processCount_;
+    std::chrono::seconds rangeTimeout_;
+    int maxAttempts_;
+    std::string token_;
+    std::vector<std::string> workerEnvironment_;
+    SocketHandle listener_ = kInvalidSocket;
+    std::vector<Task> tasks_;
+    std::deque<std::size_t> queue_; // Ranges waiting for a worker.
+    std::vector<Connection> connections_;
+    std::vector<ChildProcess> processes_;
+    std::size_t spawnBudget_ = 0;
+    std::size_t workersStarted_ = 0;
+    std::size_t rangesRetried_ = 0;
+    std::size_t workersTimedOut_ = 0;
+};
+
+// --- Worker ---
+// The body of a worker process: connect to the coordinator, say hello with
+// the token from kShardTokenVariable, then summarize ranges of 'path' until
+// told to stop. Returns the process exit code.
+inline int runShardWorker(const std::string& path, std::uint16_t port, const LineParser& parser) {
+    const char* token = std::getenv(kShardTokenVariable);
+    if (token == nullptr || *token == '\0') {
+        return 1;
+    }
+    const SocketHandle s = connectTcpLoopback(port);
+    if (s == kInvalidSocket) {
+        return 1;
+    }
+    std::string hello;
+    ByteWriter helloWriter(hello);
+    helloWriter.varint(currentProcessId());
+    helloWriter.bytes(token);
+    if (!sendFrame(s, hello)) {
+        closeSocket(s);
+        return 1;
+    }
+    std::ifstream input(path, std::ios::binary);
+    std::string block;
+    FrameBuffer inbox;
+    std::string message;
+    int status = 1;
+
+    while (input.is_open() && receiveFrame(s, inbox, message)) {
+        ByteReader reader(message);
+        std::uint8_t kind = 0;
+        ByteRange range{0, 0};
+        if (!reader.u8(kind) || kind == kShardQuit) {
+            status = 0;
+            break;
+        }
+        if (kind != kShardScan || !reader.varint(range.begin) || !reader.varint(range.end)) {
+            break;
+        }
+        LogSummary summary;
+        if (!summarizeRange(input, range, parser, block, summary) || !sendFrame(s, serializeSummary(summary))) {
+            break;
+        }
+    }
+    closeSocket(s);
+    return status;
+}
@@ -0,0 +1,253 @@
+/**
+ * @file SharedMetrics.h
+ * @brief Publishing the daemon's rollups in shared memory for local readers.
+ *
+ * @details Other processes on the same host (dashboards, alerters) can map the
+ * segment read-only and copy out a consistent snapshot with plain loads: no
+ * system call, no lock, and nothing a slow reader can do to hold up the writer.
+ *
+ * The region holds two slots (a double buffer). The writer always fills the
+ * slot readers are not pointed at, then flips 'activeSlot'. Each slot is also
+ * guarded by a sequence counter (a seqlock): the writer makes it odd before
+ * touching the slot and even again afterwards. A reader copies the active slot
+ * and accepts the copy only if the counter was the same even value before and
+ * after. Because of the double buffer, a retry is only needed if the writer
+ * published twice while the reader was copying.
+ *
+ * The layout is fixed-size and versioned so readers built from this header can
+ * check they agree with the writer. This file is self-contained so a reader
+ * program can include it on its own.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN // Keeps windows.h from pulling in the old winsock.h.
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// --- Shared Layout (version 1) ---
+constexpr std::uint32_t kSharedMetricsMagic = 0x4C414D31; // "LAM1"
+constexpr std::uint32_t kSharedMetricsLayoutVersion = 1;
+constexpr std::size_t kSharedMaxCategories = 64;
+constexpr std::size_t kSharedNameBytes = 32; // Including the terminating '\0'; longer names are cut.
+
+struct SharedCategory {
+    char action[kSharedNameBytes];
+    char status[kSharedNameBytes];
+    std::uint64_t totalRecords;
+    std::uint64_t windowRecords;
+};
+
+struct SharedMetricsPayload {
+    std::uint64_t publishedAtUnixMs;
+    std::uint64_t lines;
+    std::uint64_t malformedLines;
+    std::uint64_t records;
+    std::uint64_t latencySumMs;
+    std::int32_t latencyMinMs;
+    std::int32_t latencyMaxMs;
+    std::uint64_t windowSeconds;
+    std::uint64_t windowRecords;
+    std::uint64_t windowLatencySumMs;
+    std::uint32_t categoryCount;   // Entries of 'categories' in use.
+    std::uint32_t categoriesDropped; // Categories that did not fit.
+    SharedCategory categories[kSharedMaxCategories];
+};
+
+struct SharedMetricsSlot {
+    std::atomic<std::uint64_t> sequence; // Odd while the writer is inside the slot.
+    SharedMetricsPayload payload;
+};
+
+struct SharedMetricsRegion {
+    std::uint32_t magic;
+    std::uint32_t layoutVersion;
+    std::atomic<std::uint32_t> activeSlot;     // 0 or 1.
+    std::atomic<std::uint64_t> publishCount;   // Increments once per publish.
+    SharedMetricsSlot slots[2];
+};
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free,
+              "shared-memory atomics must be lock-free to work across processes");
+
+// --- Mapping a Named Segment ---
+class SharedMemoryMapping {
+public:
+    SharedMemoryMapping() = default;
+    ~SharedMemoryMapping() { close(); }
+    SharedMemoryMapping(const SharedMemoryMapping&) = delete;
+    SharedMemoryMapping& operator=(const SharedMemoryMapping&) = delete;
+
+    // Creates (or reuses) the segment 'name' with 'bytes' bytes, read-write.
+    bool create(const std::string& name, std::size_t bytes) { return map(name, bytes, true); }
+
+    // Opens an existing segment read-only.
+    bool openReadOnly(const std::string& name, std::size_t bytes) { return map(name, bytes, false); }
+
+    void* data() const { return data_; }
+
+    // Unmaps the segment; the writer also removes the name so it does not linger.
+    void close() {
+        if (data_ == nullptr) {
+            return;
+        }
+#ifdef _WIN32
+        UnmapViewOfFile(data_);
+        CloseHandle(handle_);
+#else
+        ::munmap(data_, bytes_);
+        if (owner_) {
+            ::shm_unlink(posixName_.c_str());
+        }
+#endif
+        data_ = nullptr;
+    }
+
+private:
+    bool map(const std::string& name, std::size_t bytes, bool writable) {
+        bytes_ = bytes;
+        owner_ = writable;
+#ifdef _WIN32
+        const std::string objectName = "Local\\" + name;
+        handle_ = writable
+            ? CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, static_cast<DWORD>(bytes), objectName.c_str())
+            : OpenFileMappingA(FILE_MAP_READ, FALSE, objectName.c_str());
+        if (handle_ == nullptr) {
+            return false;
+        }
+        data_ = MapViewOfFile(handle_, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, bytes);
+        if (data_ == nullptr) {
+            CloseHandle(handle_);
+            return false;
+        }
+        return true;
+#else
+        posixName_ = "/" + name;
+        const int fd = ::shm_open(posixName_.c_str(), writable ? (O_RDWR | O_CREAT) : O_RDONLY, 0644);
+        if (fd < 0) {
+            return false;
+        }
+        if (writable && ::ftruncate(fd, static_cast<off_t>(bytes)) != 0) {
+            ::close(fd);
+            return false;
+        }
+        void* mapped = ::mmap(nullptr, bytes, writable ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd); // The mapping stays valid without the descriptor.
+        if (mapped == MAP_FAILED) {
+            return false;
+        }
+        data_ = mapped;
+        return true;
+#endif
+    }
+
+    void* data_ = nullptr;
+    std::size_t bytes_ = 0;
+    bool owner_ = false;
+#ifdef _WIN32
+    HANDLE handle_ = nullptr;
+#else
+    std::string posixName_;
+#endif
+};
+
+// --- Writer ---
+class SharedMetricsWriter {
+public:
+    bool open(const std::string& name) {
+        if (!mapping_.create(name, sizeof(SharedMetricsRegion))) {
+            return false;
+        }
+        region_ = new (mapping_.data()) SharedMetricsRegion;
+        std::memset(&region_->slots, 0, sizeof(region_->slots));
+        region_->slots[0].sequence.store(0);
+        region_->slots[1].sequence.store(0);
+        region_->activeSlot.store(0);
+        region_->publishCount.store(0);
+        region_->layoutVersion = kSharedMetricsLayoutVersion;
+        std::atomic_thread_fence(std::memory_order_release);
+        region_->magic = kSharedMetricsMagic; // Written last: readers wait for it.
+        return true;
+    }
+
+    // Copies 'payload' into the inactive slot and makes it the active one.
+    void publish(const SharedMetricsPayload& payload) {
+        if (region_ == nullptr) {
+            return;
+        }
+        const std::uint32_t target = 1 - region_->activeSlot.load(std::memory_order_relaxed);
+        SharedMetricsSlot& slot = region_->slots[target];
+
+        const std::uint64_t sequence = slot.sequence.load(std::memory_order_relaxed);
+        slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(&slot.payload, &payload, sizeof(payload));
+        slot.sequence.store(sequence + 2, std::memory_order_release);
+
+        region_->activeSlot.store(target, std::memory_order_release);
+        region_->publishCount.fetch_add(1, std::memory_order_release);
+    }
+
+private:
+    SharedMemoryMapping mapping_;
+    SharedMetricsRegion* region_ = nullptr;
+};
+
+// --- Reader ---
+class SharedMetricsReader {
+public:
+    bool open(const std::string& name) {
+        if (!mapping_.openReadOnly(name, sizeof(SharedMetricsRegion))) {
+            return false;
+        }
+        region_ = static_cast<const SharedMetricsRegion*>(mapping_.data());
+        return region_->magic == kSharedMetricsMagic && region_->layoutVersion == kSharedMetricsLayoutVersion;
+    }
+
+    // Copies a consistent snapshot into 'out'. Returns false only if the writer
+    // kept overwriting the slot for 'maxAttempts' tries in a row.
+    bool read(SharedMetricsPayload& out, int maxAttempts = 100) const {
+        for (int attempt = 0; attempt < maxAttempts; ++attempt) {
+            const SharedMetricsSlot& slot = region_->slots[region_->activeSlot.load(std::memory_order_acquire)];
+            const std::uint64_t before = slot.sequence.load(std::memory_order_acquire);
+            if (before & 1) {
+                continue;
+            }
+            std::memcpy(&out, &slot.payload, sizeof(out));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.sequence.load(std::memory_order_relaxed) == before) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::uint64_t publishCount() const { return region_->publishCount.load(std::memory_order_acquire); }
+
+private:
+    SharedMemoryMapping mapping_;
+    const SharedMetricsRegion* region_ = nullptr;
+};
+
+// Copies 'text' into a fixed-size, always-terminated name field.
+inline void copySharedName(char (&field)[kSharedNameBytes], const std::string& text) {
+    const std::size_t length = text.size() < kSharedNameBytes - 1 ? text.size() : kSharedNameBytes - 1;
+    std::memcpy(field, text.data(), length);
+    std::memset(field + length, 0, kSharedNameBytes - length);
+}
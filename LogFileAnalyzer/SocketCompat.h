@@ -0,0 +1,284 @@
+/**
+ * @file SocketCompat.h
+ * @brief The few socket calls the analyzer needs, on both Winsock and POSIX.
+ *
+ * @details The two APIs are nearly identical; the differences are the handle type,
+ * how a socket is closed, and that Winsock has to be started before first use.
+ * Unix domain sockets are only offered on POSIX builds.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+using SocketHandle = SOCKET;
+constexpr SocketHandle kInvalidSocket = INVALID_SOCKET;
+inline void closeSocket(SocketHandle s) { closesocket(s); }
+#else
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 // macOS has no such flag; SIGPIPE must be ignored by the caller there.
+#endif
+using SocketHandle = int;
+constexpr SocketHandle kInvalidSocket = -1;
+inline void closeSocket(SocketHandle s) { ::close(s); }
+#endif
+
+// --- Process-Wide Socket Initialization ---
+// Create one of these in main() before using any other function in this file.
+class SocketRuntime {
+public:
+    SocketRuntime() {
+#ifdef _WIN32
+        WSADATA data;
+        ok_ = WSAStartup(MAKEWORD(2, 2), &data) == 0;
+#endif
+    }
+    ~SocketRuntime() {
+#ifdef _WIN32
+        if (ok_) {
+            WSACleanup();
+        }
+#endif
+    }
+    SocketRuntime(const SocketRuntime&) = delete;
+    SocketRuntime& operator=(const SocketRuntime&) = delete;
+
+    bool ok() const { return ok_; }
+
+private:
+    bool ok_ = true;
+};
+
+// --- Listening Sockets ---
+// A TCP listener on 127.0.0.1 only; nothing is exposed beyond the local host.
+inline SocketHandle listenTcpLoopback(std::uint16_t port, std::string& error) {
+    SocketHandle s = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (s == kInvalidSocket) {
+        error = "socket() failed";
+        return kInvalidSocket;
+    }
+    int reuse = 1;
+    ::setsockopt(s, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+
+    sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::bind(s, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || ::listen(s, 16) != 0) {
+        error = "could not listen on 127.0.0.1:" + std::to_string(port);
+        closeSocket(s);
+        return kInvalidSocket;
+    }
+    return s;
+}
+
+// The port a listener actually got; useful after listening on port 0, which
+// lets the OS pick any free port. Returns 0 on failure.
+inline std::uint16_t boundTcpPort(SocketHandle s) {
+    sockaddr_in address;
+    socklen_t length = sizeof(address);
+    if (::getsockname(s, reinterpret_cast<sockaddr*>(&address), &length) != 0) {
+        return 0;
+    }
+    return ntohs(address.sin_port);
+}
+
+// Connects to 127.0.0.1:<port>. Returns kInvalidSocket on failure.
+inline SocketHandle connectTcpLoopback(std::uint16_t port) {
+    SocketHandle s = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (s == kInvalidSocket) {
+        return kInvalidSocket;
+    }
+    sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(s, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+        closeSocket(s);
+        return kInvalidSocket;
+    }
+    return s;
+}
+
+// A stream listener on a Unix domain socket path. Any stale socket file at
+// 'path' is removed first.
+inline SocketHandle listenUnixStream(const std::string& path, std::string& error) {
+#ifdef _WIN32
+    (void)path;
+    error = "Unix domain sockets are not supported on this platform";
+    return kInvalidSocket;
+#else
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        error = "socket path is too long: " + path;
+        return kInvalidSocket;
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+    SocketHandle s = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (s == kInvalidSocket) {
+        error = "socket() failed";
+        return kInvalidSocket;
+    }
+    ::unlink(path.c_str());
+    if (::bind(s, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || ::listen(s, 16) != 0) {
+        error = "could not listen on " + path;
+        closeSocket(s);
+        return kInvalidSocket;
+    }
+    return s;
+#endif
+}
+
+// --- Receiving Sockets (Ingest) ---
+// Makes 's' non-blocking, so a drain loop can stop as soon as the queue is empty.
+inline bool setNonBlocking(SocketHandle s) {
+#ifdef _WIN32
+    u_long enabled = 1;
+    return ioctlsocket(s, FIONBIO, &enabled) == 0;
+#else
+    const int flags = ::fcntl(s, F_GETFL, 0);
+    return flags >= 0 && ::fcntl(s, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+}
+
+// Asks the kernel for a larger receive queue, the first line of defence
+// against datagram loss during bursts. The kernel may grant less.
+inline void requestReceiveBuffer(SocketHandle s, int bytes) {
+    ::setsockopt(s, SOL_SOCKET, SO_RCVBUF, reinterpret_cast<const char*>(&bytes), sizeof(bytes));
+}
+
+// A UDP socket bound to 127.0.0.1:'port'.
+inline SocketHandle bindUdpLoopback(std::uint16_t port, std::string& error) {
+    SocketHandle s = ::socket(AF_INET, SOCK_DGRAM, 0);
+    if (s == kInvalidSocket) {
+        error = "socket() failed";
+        return kInvalidSocket;
+    }
+    sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::bind(s, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+        error = "could not bind udp 127.0.0.1:" + std::to_string(port);
+        closeSocket(s);
+        return kInvalidSocket;
+    }
+    return s;
+}
+
+// A Unix datagram socket bound to 'path' (POSIX only).
+inline SocketHandle bindUnixDatagram(const std::string& path, std::string& error) {
+#ifdef _WIN32
+    (void)path;
+    error = "Unix domain sockets are not supported on this platform";
+    return kInvalidSocket;
+#else
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        error = "socket path is too long: " + path;
+        return kInvalidSocket;
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+    SocketHandle s = ::socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (s == kInvalidSocket) {
+        error = "socket() failed";
+        return kInvalidSocket;
+    }
+    ::unlink(path.c_str());
+    if (::bind(s, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+        error = "could not bind " + path;
+        closeSocket(s);
+        return kInvalidSocket;
+    }
+    return s;
+#endif
+}
+
+// True if the last socket call failed only because nothing was ready.
+inline bool lastCallWouldBlock() {
+#ifdef _WIN32
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
+
+// True if select() can watch 's'. On POSIX an fd_set is a bitmap indexed by
+// descriptor, so a descriptor of FD_SETSIZE or more cannot be added to one,
+// however few sockets are watched. Windows sets hold handles, up to
+// FD_SETSIZE of them.
+inline bool fitsInFdSet(SocketHandle s) {
+#ifdef _WIN32
+    (void)s;
+    return true;
+#else
+    return s < FD_SETSIZE;
+#endif
+}
+
+// --- Connection I/O ---
+// Waits up to 'timeoutMs' for 's' to become readable (or, for a listener, to
+// have a pending connection).
+inline bool waitReadable(SocketHandle s, int timeoutMs) {
+    fd_set readable;
+    FD_ZERO(&readable);
+    FD_SET(s, &readable);
+    timeval timeout;
+    timeout.tv_sec = timeoutMs / 1000;
+    timeout.tv_usec = (timeoutMs % 1000) * 1000;
+    return ::select(static_cast<int>(s) + 1, &readable, nullptr, nullptr, &timeout) > 0;
+}
+
+// One send() call: on a non-blocking socket it may take only part of 'data'.
+// Returns the bytes sent, or a negative value (see lastCallWouldBlock()).
+inline int sendSome(SocketHandle s, std::string_view data) {
+    const int chunk = static_cast<int>(std::min<std::size_t>(data.size(), 1u << 20));
+#ifdef _WIN32
+    return ::send(s, data.data(), chunk, 0);
+#else
+    return static_cast<int>(::send(s, data.data(), static_cast<std::size_t>(chunk), MSG_NOSIGNAL));
+#endif
+}
+
+inline bool sendAll(SocketHandle s, std::string_view data) {
+    while (!data.empty()) {
+        const int sent = sendSome(s, data);
+        if (sent <= 0) {
+            return false;
+        }
+        data.remove_prefix(static_cast<std::size_t>(sent));
+    }
+    return true;
+}
+
+inline int receiveSome(SocketHandle s, char* buffer, std::size_t capacity) {
+    return static_cast<int>(::recv(s, buffer, static_cast<int>(capacity), 0));
+}
@@ -0,0 +1,362 @@
+/**
+ * @file SocketIngest.h
+ * @brief Receiving log lines over local UDP and Unix domain sockets.
+ *
+ * @details Services that do not write log files can send the usual
+ * pipe-delimited lines to the daemon directly. A datagram may carry one line or
+ * several separated by '\n'; a stream connection carries lines back to back.
+ * Every complete line goes through the same callback as lines read from files,
+ * so the parse and aggregate path is shared.
+ *
+ * All receive buffers are allocated once, up front. On Linux, datagram
+ * sockets are drained with recvmmsg(), which fetches a whole batch of
+ * datagrams per system call; other platforms fall back to one recv() per
+ * datagram. Losses are counted rather than hidden:
+ *  - kernelDrops: datagrams the kernel discarded because the receive queue was
+ *    full (Linux, from SO_RXQ_OVFL),
+ *  - truncatedDatagrams: datagrams larger than one receive buffer,
+ *  - oversizedLines: stream lines longer than the per-connection limit.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "FileChunks.h"
+#include "SocketCompat.h"
+
+#if defined(__linux__)
+#include <sys/socket.h>
+#define LOG_ANALYZER_HAVE_RECVMMSG 1
+#endif
+
+// --- Counters Exposed in the Daemon's Metrics ---
+struct IngestStats {
+    std::uint64_t datagrams = 0;
+    std::uint64_t bytes = 0;
+    std::uint64_t lines = 0;
+    std::uint64_t truncatedDatagrams = 0;
+    std::uint64_t kernelDrops = 0;
+    std::uint64_t streamConnections = 0;
+    std::uint64_t oversizedLines = 0;
+};
+
+class SocketIngest {
+public:
+    static constexpr std::size_t kBatch = 256;              // Datagrams per recvmmsg() call.
+    static constexpr std::size_t kDatagramBytes = 8192;     // One receive buffer.
+    static constexpr std::size_t kMaxStreamLineBytes = 1u << 20;
+
+    SocketIngest() : pool_(kBatch * kDatagramBytes) {
+#ifdef LOG_ANALYZER_HAVE_RECVMMSG
+        // Each iovec points at its own slice of the pool for good. The message
+        // headers are reset before every call, because the kernel writes back
+        // into their length and flag fields.
+        controls_.resize(kBatch * kControlBytes);
+        for (std::size_t i = 0; i < kBatch; ++i) {
+            iovecs_[i].iov_base = &pool_[i * kDatagramBytes];
+            iovecs_[i].iov_len = kDatagramBytes;
+        }
+#endif
+    }
+
+    ~SocketIngest() {
+        for (const Endpoint& endpoint : datagramSockets_) {
+            closeSocket(endpoint.socket);
+            removePath(endpoint.path);
+        }
+        for (const Endpoint& endpoint : streamListeners_) {
+            closeSocket(endpoint.socket);
+            removePath(endpoint.path);
+        }
+        for (const StreamClient& client : clients_) {
+            closeSocket(client.socket);
+        }
+    }
+
+    SocketIngest(const SocketIngest&) = delete;
+    SocketIngest& operator=(const SocketIngest&) = delete;
+
+    bool addUdp(std::uint16_t port, std::string& error) {
+        return addDatagram(bindUdpLoopback(port, error), std::string(), error);
+    }
+
+    bool addUnixDatagram(const std::string& path, std::string& error) {
+        return addDatagram(bindUnixDatagram(path, error), path, error);
+    }
+
+    bool addUnixStream(const std::string& path, std::string& error) {
+        SocketHandle s = listenUnixStream(path, error);
+        if (s == kInvalidSocket || !watchable(s, error) || !setNonBlocking(s)) {
+            return false;
+        }
+        streamListeners_.push_back({ s, path });
+        return true;
+    }
+
+    bool empty() const { return datagramSockets_.empty() && streamListeners_.empty(); }
+    const IngestStats& stats() const { return stats_; }
+
+    // Waits up to 'timeoutMs' for traffic, then drains whatever is queued and
+    // passes each complete line to 'onLine(std::string_view)'. Returns the
+    // number of lines delivered.
+    template<typename Fn>
+    std::uint64_t poll(int timeoutMs, Fn&& onLine) {
+        fd_set readable;
+        FD_ZERO(&readable);
+        SocketHandle highest = 0;
+        const auto watch = [&](SocketHandle s) {
+            FD_SET(s, &readable);
+            highest = std::max(highest, s);
+        };
+        for (const Endpoint& endpoint : datagramSockets_) { watch(endpoint.socket); }
+        for (const Endpoint& endpoint : streamListeners_) { watch(endpoint.socket); }
+        for (const StreamClient& client : clients_) { watch(client.socket); }
+
+        timeval timeout;
+        timeout.tv_sec = timeoutMs / 1000;
+        timeout.tv_usec = (timeoutMs % 1000) * 1000;
+        if (::select(static_cast<int>(highest) + 1, &readable, nullptr, nullptr, &timeout) <= 0) {
+            return 0;
+        }
+
+        const std::uint64_t linesBefore = stats_.lines;
+        for (const Endpoint& endpoint : datagramSockets_) {
+            if (FD_ISSET(endpoint.socket, &readable)) {
+                drainDatagrams(endpoint.socket, onLine);
+            }
+        }
+        for (std::size_t i = 0; i < clients_.size();) {
+            if (FD_ISSET(clients_[i].socket, &readable) && !readStream(clients_[i], onLine)) {
+                closeSocket(clients_[i].socket);
+                clients_[i] = std::move(clients_.back());
+                clients_.pop_back();
+                continue;
+            }
+            ++i;
+        }
+        for (const Endpoint& endpoint : streamListeners_) {
+            if (FD_ISSET(endpoint.socket, &readable)) {
+                acceptClients(endpoint.socket);
+            }
+        }
+        return stats_.lines - linesBefore;
+    }
+
+private:
+    struct Endpoint {
+        SocketHandle socket;
+        std::string path; // Unix socket file to remove on shutdown; empty for UDP.
+    };
+
+    struct StreamClient {
+        SocketHandle socket;
+        std::string pending; // Bytes of a line whose '\n' has not arrived yet.
+        bool skipping = false; // Discarding the rest of an oversized line.
+    };
+
+    // Closes 's' and fails if poll()'s select() could not watch it.
+    static bool watchable(SocketHandle s, std::string& error) {
+        if (fitsInFdSet(s)) {
+            return true;
+        }
+        closeSocket(s);
+        error = "too many open files to watch another socket";
+        return false;
+    }
+
+    bool addDatagram(SocketHandle s, const std::string& path, std::string& error) {
+        if (s == kInvalidSocket || !watchable(s, error) || !setNonBlocking(s)) {
+            return false;
+        }
+        requestReceiveBuffer(s, 8 << 20);
+#if defined(SO_RXQ_OVFL)
+        int enabled = 1;
+        ::setsockopt(s, SOL_SOCKET, SO_RXQ_OVFL, &enabled, sizeof(enabled));
+#endif
+        datagramSockets_.push_back({ s, path });
+        dropCounters_.push_back(0);
+        return true;
+    }
+
+    static void removePath(const std::string& path) {
+#ifndef _WIN32
+        if (!path.empty()) {
+            ::unlink(path.c_str());
+        }
+#else
+        (void)path;
+#endif
+    }
+
+    // Splits one datagram into lines. A final line without '\n' still counts.
+    template<typename Fn>
+    void deliverDatagram(const char* data, std::size_t size, Fn& onLine) {
+        stats_.datagrams++;
+        stats_.bytes += size;
+        forEachLine(std::string_view(data, size), [&](std::string_view line) {
+            if (!line.empty()) {
+                stats_.lines++;
+                onLine(line);
+            }
+        });
+    }
+
+    template<typename Fn>
+    void drainDatagrams(SocketHandle s, Fn& onLine) {
+        // Bounded so a flood on one socket cannot starve the others or the files.
+        for (int round = 0; round < 64; ++round) {
+#ifdef LOG_ANALYZER_HAVE_RECVMMSG
+            for (std::size_t i = 0; i < kBatch; ++i) {
+                iovecs_[i].iov_len = kDatagramBytes;
+                messages_[i].msg_hdr = msghdr();
+                messages_[i].msg_hdr.msg_iov = &iovecs_[i];
+                messages_[i].msg_hdr.msg_iovlen = 1;
+                messages_[i].msg_hdr.msg_control = &controls_[i * kControlBytes];
+                messages_[i].msg_hdr.msg_controllen = kControlBytes;
+            }
+            const int received = ::recvmmsg(s, messages_, static_cast<unsigned>(kBatch), MSG_DONTWAIT, nullptr);
+            if (received <= 0) {
+                return;
+            }
+            for (int i = 0; i < received; ++i) {
+                const msghdr& header = messages_[i].msg_hdr;
+                if (header.msg_flags & MSG_TRUNC) {
+                    stats_.truncatedDatagrams++;
+                }
+                noteKernelDrops(s, header);
+                deliverDatagram(&pool_[static_cast<std::size_t>(i) * kDatagramBytes], messages_[i].msg_len, onLine);
+            }
+            if (received < static_cast<int>(kBatch)) {
+                return;
+            }
+#else
+            for (std::size_t i = 0; i < kBatch; ++i) {
+                const int received = static_cast<int>(::recv(s, &pool_[0], static_cast<int>(kDatagramBytes), 0));
+                if (received < 0) {
+#ifdef _WIN32
+                    if (WSAGetLastError() == WSAEMSGSIZE) {
+                        stats_.truncatedDatagrams++;
+                        deliverDatagram(&pool_[0], kDatagramBytes, onLine);
+                        continue;
+                    }
+#endif
+                    return;
+                }
+                deliverDatagram(&pool_[0], static_cast<std::size_t>(received), onLine);
+            }
+#endif
+        }
+    }
+
+#ifdef LOG_ANALYZER_HAVE_RECVMMSG
+    // SO_RXQ_OVFL attaches the socket's running drop count to each datagram;
+    // the increase since the last one seen is what was lost in between.
+    void noteKernelDrops(SocketHandle s, const msghdr& header) {
+#if defined(SO_RXQ_OVFL)
+        for (cmsghdr* c = CMSG_FIRSTHDR(const_cast<msghdr*>(&header)); c != nullptr;
+             c = CMSG_NXTHDR(const_cast<msghdr*>(&header), c)) {
+            if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SO_RXQ_OVFL) {
+                std::uint32_t dropped = 0;
+                std::memcpy(&dropped, CMSG_DATA(c), sizeof(dropped));
+                for (std::size_t i = 0; i < datagramSockets_.size(); ++i) {
+                    if (datagramSockets_[i].socket == s && dropped > dropCounters_[i]) {
+                        stats_.kernelDrops += dropped - dropCounters_[i];
+                        dropCounters_[i] = dropped;
+                    }
+                }
+            }
+        }
+#else
+        (void)s;
+        (void)header;
+#endif
+    }
+#endif
+
+    void acceptClients(SocketHandle listener) {
+        for (;;) {
+            SocketHandle client = ::accept(listener, nullptr, nullptr);
+            if (client == kInvalidSocket) {
+                return;
+            }
+            if (clients_.size() >= FD_SETSIZE / 2 || !fitsInFdSet(client) || !setNonBlocking(client)) {
+                closeSocket(client); // select() cannot watch it (see fitsInFdSet()).
+                continue;
+            }
+            stats_.streamConnections++;
+            clients_.push_back({ client, std::string() });
+        }
+    }
+
+    // Reads what a stream client has sent. Returns false once the peer closed
+    // the connection (or it failed), after delivering any final unterminated line.
+    template<typename Fn>
+    bool readStream(StreamClient& client, Fn& onLine) {
+        for (;;) {
+            const int received = receiveSome(client.socket, &pool_[0], pool_.size());
+            if (received == 0 || (received < 0 && !lastCallWouldBlock())) {
+                if (!client.pending.empty() && !client.skipping) {
+                    stats_.lines++;
+                    onLine(std::string_view(client.pending));
+                }
+                return false;
+            }
+            if (received < 0) {
+                return true; // Drained for now.
+            }
+            stats_.bytes += static_cast<std::uint64_t>(received);
+
+            std::string_view data(&pool_[0], static_cast<std::size_t>(received));
+            while (!data.empty()) {
+                const std::size_t newline = data.find('\n');
+                const std::string_view piece = data.substr(0, newline);
+                if (newline != std::string_view::npos && client.pending.empty() && !client.skipping) {
+                    // The common case: a whole line inside this read, delivered without copying.
+                    if (!piece.empty()) {
+                        stats_.lines++;
+                        onLine(piece);
+                    }
+                    data.remove_prefix(newline + 1);
+                    continue;
+                }
+                if (!client.skipping) {
+                    client.pending.append(piece.data(), piece.size());
+                }
+                if (newline == std::string_view::npos) {
+                    if (client.pending.size() > kMaxStreamLineBytes) {
+                        stats_.oversizedLines++;
+                        client.pending.clear();
+                        client.skipping = true;
+                    }
+                    break;
+                }
+                if (!client.skipping && !client.pending.empty()) {
+                    stats_.lines++;
+                    onLine(std::string_view(client.pending));
+                }
+                client.pending.clear();
+                client.skipping = false;
+                data.remove_prefix(newline + 1);
+            }
+        }
+    }
+
+    std::vector<char> pool_; // kBatch receive buffers of kDatagramBytes, allocated once.
+    std::vector<Endpoint> datagramSockets_;
+    std::vector<std::uint32_t> dropCounters_; // Last SO_RXQ_OVFL value per datagram socket.
+    std::vector<Endpoint> streamListeners_;
+    std::vector<StreamClient> clients_;
+    IngestStats stats_;
+#ifdef LOG_ANALYZER_HAVE_RECVMMSG
+    static constexpr std::size_t kControlBytes = 64;
+    std::vector<char> controls_;
+    mmsghdr messages_[kBatch];
+    iovec iovecs_[kBatch];
+#endif
+};
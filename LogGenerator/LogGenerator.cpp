@@ -6,6 +6,11 @@
  * format. This allows us to focus on the analysis logic rather than dealing with
  * inconsistent real-world log data. The format is designed to be relevant for
  * both financial and cybersecurity analysis.
+ *
+ * Usage: LogGenerator [output_file] [--lines <n>] [--seed <n>] [--binary]
+ *
+ * With --binary the same records are written in the analyzer's compact binary
+ * format (see BinaryLog.h in the analyzer for the layout) instead of as text.
  */
 
 #include <iostream>
@@ -15,6 +20,13 @@
 #include <random>    // For modern C++ random number generation.
 #include <ctime>     // For seeding the random number generator.
 #include <iomanip>   // For formatting output (e.g., setting decimal precision).
+#include <sstream>   // For building the Details field before it is written.
+#include <unordered_map> // For the binary writer's per-block string dictionary.
+#include <cstdint>   // For fixed-width integers in the binary format.
+#include <charconv>  // For checking the numbers given on the command line.
+#include <cstring>   // For std::strlen.
+#include <cstdlib>   // For std::strtoll / std::strtoul when reading --lines and --seed.
+#include <memory>    // For std::unique_ptr.
 
  // --- Template Helper Function ---
  // This is a generic function that can get a random element from a vector of any type.
@@ -26,16 +38,132 @@ T getRandomElement(const std::vector<T>& vec, std::mt19937& gen) {
     return vec[distrib(gen)];
 }
 
-int main() {
+// --- Binary Output ---
+// Writes records in blocks of about 64 KiB. Each block starts with an empty
+// string dictionary; a string is written (tag 1) the first time a record in the
+// block uses it, and records (tag 2) refer to strings by their index.
+class BinaryLogWriter {
+public:
+    explicit BinaryLogWriter(std::ofstream& out) : out_(out) {
+        out_.write("LFAB\x01\0\0\0", 8); // Magic, version 1, three reserved bytes.
+    }
+
+    void write(long long timestamp, const std::string& ip, const std::string& user, const std::string& action,
+               const std::string& status, int latency, const std::string& details) {
+        // Strings first, so the record that uses them can follow directly.
+        const std::uint64_t ids[4] = { intern(ip), intern(user), intern(action), intern(status) };
+        payload_.push_back(2);
+        const std::uint64_t bits = static_cast<std::uint64_t>(timestamp);
+        for (int i = 0; i < 8; ++i) {
+            payload_.push_back(static_cast<char>((bits >> (8 * i)) & 0xFF));
+        }
+        for (std::uint64_t id : ids) {
+            varint(id);
+        }
+        varint((static_cast<std::uint64_t>(latency) << 1) ^ static_cast<std::uint64_t>(latency >> 31)); // zigzag
+        varint(details.size());
+        payload_ += details;
+        ++records_;
+        if (payload_.size() >= 64 * 1024) {
+            flush();
+        }
+    }
+
+    void flush() {
+        if (records_ == 0) {
+            return;
+        }
+        char header[8];
+        const std::uint32_t fields[2] = { static_cast<std::uint32_t>(payload_.size()), records_ };
+        for (int f = 0; f < 2; ++f) {
+            for (int i = 0; i < 4; ++i) {
+                header[4 * f + i] = static_cast<char>((fields[f] >> (8 * i)) & 0xFF);
+            }
+        }
+        out_.write(header, sizeof(header));
+        out_.write(payload_.data(), static_cast<std::streamsize>(payload_.size()));
+        payload_.clear();
+        dictionary_.clear();
+        records_ = 0;
+    }
+
+private:
+    void varint(std::uint64_t value) {
+        while (value >= 0x80) {
+            payload_.push_back(static_cast<char>((value & 0x7F) | 0x80));
+            value >>= 7;
+        }
+        payload_.push_back(static_cast<char>(value));
+    }
+
+    std::uint64_t intern(const std::string& value) {
+        auto found = dictionary_.find(value);
+        if (found != dictionary_.end()) {
+            return found->second;
+        }
+        const std::uint64_t id = dictionary_.size();
+        dictionary_.emplace(value, id);
+        payload_.push_back(1);
+        varint(value.size());
+        payload_ += value;
+        return id;
+    }
+
+    std::ofstream& out_;
+    std::string payload_;
+    std::unordered_map<std::string, std::uint64_t> dictionary_;
+    std::uint32_t records_ = 0;
+};
+
+int main(int argc, char* argv[]) {
     // --- High-Quality Random Number Setup ---
     // std::mt19937 is a powerful and widely-used random number generation engine.
     // We "seed" it with the current time to ensure we get a different sequence
     // of random numbers every time we run the generator. This makes our test data less repetitive.
+    // --seed replaces the time, to generate the same records again (for example
+    // once as text and once as binary).
     std::mt19937 random_engine(static_cast<unsigned int>(time(0)));
 
     // --- Configuration ---
-    const long long numberOfLinesToGenerate = 100000; // Generate a significant number of lines.
-    const std::string outputFilename = "sample.log";
+    // Defaults, which the command line can override.
+    long long numberOfLinesToGenerate = 100000; // Generate a significant number of lines.
+    bool binary = false;
+    std::string outputFilename;
+    // True if 'text' is a whole number, with nothing before or after it.
+    const auto parseNumber = [](const char* text, auto& out) {
+        const char* end = text + std::strlen(text);
+        const std::from_chars_result result = std::from_chars(text, end, out);
+        return result.ec == std::errc() && result.ptr == end;
+    };
+    bool badArguments = false;
+    for (int i = 1; i < argc && !badArguments; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--binary") {
+            binary = true;
+        }
+        else if (arg == "--lines" && i + 1 < argc) {
+            badArguments = !parseNumber(argv[++i], numberOfLinesToGenerate) || numberOfLinesToGenerate <= 0;
+        }
+        else if (arg == "--seed" && i + 1 < argc) {
+            unsigned int seed = 0;
+            badArguments = !parseNumber(argv[++i], seed);
+            random_engine.seed(seed);
+        }
+        else if (outputFilename.empty() && arg.rfind("--", 0) != 0) {
+            outputFilename = arg;
+        }
+        else {
+            badArguments = true;
+        }
+    }
+    if (badArguments) {
+        std::cerr << "Usage: " << argv[0] << " [output_file] [--lines <n>] [--seed <n>] [--binary]\n"
+                  << "  --lines takes a positive whole number, --seed a whole number from 0 to " << UINT32_MAX << ".\n";
+        return 1;
+    }
+    if (outputFilename.empty()) {
+        outputFilename = binary ? "sample.lfab" : "sample.log";
+    }
 
     // --- Data Pools for Generating Realistic Log Entries ---
     // Using vectors to hold our sample data makes it easy to add more variety later.
@@ -47,13 +175,18 @@ int main() {
 
     // --- File Generation Logic ---
     // 'ofstream' stands for 'Output File Stream'. We use it for writing to files.
-    std::ofstream outputFile(outputFilename);
+    std::ofstream outputFile(outputFilename, binary ? std::ios::out | std::ios::binary : std::ios::out);
     if (!outputFile.is_open()) {
         std::cerr << "Error: Could not open file for writing: " << outputFilename << std::endl;
         return 1;
     }
 
     long long startTimestamp = 1672531200; // A fixed start time (approx. Jan 1, 2023) for consistency.
+    // The binary writer only exists when asked for; a null pointer means "text".
+    std::unique_ptr<BinaryLogWriter> binaryWriter;
+    if (binary) {
+        binaryWriter = std::make_unique<BinaryLogWriter>(outputFile);
+    }
 
     for (long long i = 0; i < numberOfLinesToGenerate; ++i) {
         // Increment timestamp by a random small amount to simulate time passing.
@@ -70,33 +203,43 @@ int main() {
         std::uniform_int_distribution<> latency_dist(5, 250); // latency in milliseconds
         int latency = latency_dist(random_engine);
 
-        // --- Assembling the Log Line ---
-        // Format: Timestamp|IP|UserID|Action|Status|Latency(ms)|Details
-        outputFile << startTimestamp << "|"
-            << ip << "|"
-            << user << "|"
-            << action << "|"
-            << status << "|"
-            << latency << "ms|";
-
         // Add context-specific details based on the action.
+        std::ostringstream details;
         if (action == "TRADE_EXECUTE") {
             std::uniform_int_distribution<> quantity_dist(10, 500);
             std::uniform_real_distribution<> price_dist(100.0, 5000.0);
-            outputFile << "Symbol:" << getRandomElement(trade_symbols, random_engine)
+            details << "Symbol:" << getRandomElement(trade_symbols, random_engine)
                 << ",Quantity:" << quantity_dist(random_engine)
                 << ",Price:" << std::fixed << std::setprecision(2) << price_dist(random_engine);
         }
         else if (action == "FAILED_LOGIN") {
-            outputFile << "ErrorCode:401_UNAUTHORIZED";
+            details << "ErrorCode:401_UNAUTHORIZED";
         }
         else {
-            outputFile << "Details:N/A";
+            details << "Details:N/A";
+        }
+
+        if (binaryWriter) {
+            binaryWriter->write(startTimestamp, ip, user, action, status, latency, details.str());
+            continue;
         }
-        // End the line with a newline character.
-        outputFile << "\n";
+
+        // --- Assembling the Log Line ---
+        // Format: Timestamp|IP|UserID|Action|Status|Latency(ms)|Details
+        outputFile << startTimestamp << "|"
+            << ip << "|"
+            << user << "|"
+            << action << "|"
+            << status << "|"
+            << latency << "ms|"
+            << details.str()
+            // End the line with a newline character.
+            << "\n";
     }
 
+    if (binaryWriter) {
+        binaryWriter->flush(); // The last, partly filled block.
+    }
     outputFile.close(); // Explicitly close the file.
     std::cout << "Successfully generated " << numberOfLinesToGenerate << " lines in '" << outputFilename << "'" << std::endl;
 